@@ -155,7 +155,7 @@ QStatus AllJoynDebugObj::Get(const char* ifcName, const char* propName, MsgArg&
 
 QStatus AllJoynDebugObj::Set(const char* ifcName, const char* propName, MsgArg& val)
 {
-    PropertyStore::const_iterator it = properties.find(propName);
+    PropertyStore::const_iterator it = properties.find(ifcName);
     if (it == properties.end()) {
         return ER_BUS_NO_SUCH_PROPERTY;
     }
@@ -176,6 +176,19 @@ void AllJoynDebugObj::GetProp(const InterfaceDescription::Member* member, Messag
 }
 
 
+void AllJoynDebugObj::SetProp(const InterfaceDescription::Member* member, Message& msg)
+{
+    assert(bus);
+
+    const qcc::String guid(bus->GetInternal().GetGlobalGUID().ToShortString());
+    qcc::String sender(msg->GetSender());
+    // Only allow local connections to set properties
+    if (sender.substr(1, guid.size()) == guid) {
+        BusObject::SetProp(member, msg);
+    } // else someone off-device is trying to set our debug output, punish them by not responding.
+}
+
+
 AllJoynDebugObj::AllJoynDebugObj(Bus& bus, BusController* busController) : BusObject(bus, org::alljoyn::Daemon::Debug::ObjectPath), busController(busController)
 {
     self = this;
@@ -135,6 +135,8 @@ class AllJoynDebugObj : public BusObject {
 
     void GetProp(const InterfaceDescription::Member* member, Message& msg);
 
+    void SetProp(const InterfaceDescription::Member* member, Message& msg);
+
   private:
 
     /**
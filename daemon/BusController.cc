@@ -43,6 +43,7 @@ BusController::BusController(Bus& alljoynBus, AuthListener* authListener) :
     sessionlessObj(bus, this),
 #ifndef NDEBUG
     alljoynDebugObj(bus, this),
+    statsDebugObj(reinterpret_cast<DaemonRouter&>(bus.GetInternal().GetRouter())),
 #endif
     initComplete(false)
 
@@ -34,6 +34,7 @@
 #include "DBusObj.h"
 #include "AllJoynObj.h"
 #include "AllJoynDebugObj.h"
+#include "StatsDebug.h"
 #include "SessionlessObj.h"
 #include "ProtectedAuthListener.h"
 
@@ -176,6 +177,9 @@ class BusController {
 #ifndef NDEBUG
     /** Bus object responsible for org.alljoyn.Debug */
     debug::AllJoynDebugObj alljoynDebugObj;
+
+    /** Traffic statistics interface added to org.alljoyn.Debug */
+    debug::StatsDebugObj statsDebugObj;
 #endif
 
     /** Event to wait on while initialization completes */
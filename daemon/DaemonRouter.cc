@@ -23,6 +23,8 @@
 #include <qcc/platform.h>
 
 #include <assert.h>
+#include <new>
+#include <vector>
 
 #include <qcc/Debug.h>
 #include <qcc/Logger.h>
@@ -38,6 +40,7 @@
 #include "DaemonRouter.h"
 #include "EndpointHelper.h"
 #include "DaemonConfig.h"
+#include "ThreadShard.h"
 
 #define QCC_MODULE "ALLJOYN"
 
@@ -48,8 +51,14 @@ using namespace qcc;
 namespace ajn {
 
 
-DaemonRouter::DaemonRouter() : ruleTable(), nameTable(), busController(NULL)
+DaemonRouter::DaemonRouter() : ruleTable(), nameTable(), busController(NULL), ruleMatches(0)
 {
+    /* The router is heap allocated with no alignment guarantee so align the shards by hand */
+    uintptr_t mem = reinterpret_cast<uintptr_t>(statsShardMem);
+    statsShards = reinterpret_cast<StatsShard*>((mem + CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(CACHE_LINE_SIZE - 1));
+    for (size_t i = 0; i < NUM_STATS_SHARDS; ++i) {
+        new (&statsShards[i]) StatsShard();
+    }
 }
 
 DaemonRouter::~DaemonRouter()
@@ -71,6 +80,25 @@ static inline QStatus SendThroughEndpoint(Message& msg, BusEndpoint& ep, Session
     return status;
 }
 
+DaemonRouter::StatsShard& DaemonRouter::GetStatsShard()
+{
+    /* The counters are atomic so threads sharing a shard only costs some contention */
+    return statsShards[ThreadShard(NUM_STATS_SHARDS)];
+}
+
+void DaemonRouter::GetRouterStats(RouterStats& stats)
+{
+    stats = RouterStats();
+    for (size_t i = 0; i < NUM_STATS_SHARDS; ++i) {
+        stats.routed += static_cast<uint32_t>(statsShards[i].routed);
+        stats.noRoute += static_cast<uint32_t>(statsShards[i].noRoute);
+        stats.broadcasts += static_cast<uint32_t>(statsShards[i].broadcasts);
+    }
+    ruleTable.Lock();
+    stats.ruleMatches = ruleMatches;
+    ruleTable.Unlock();
+}
+
 QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
 {
     /*
@@ -116,7 +144,7 @@ QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
 
     bool destinationEmpty = destination[0] == '\0';
     if (!destinationEmpty) {
-        nameTable.Lock();
+        /* The lookup does not lock the name table and the reference keeps the destination alive */
         BusEndpoint destEndpoint = nameTable.FindEndpoint(destination);
         if (destEndpoint->IsValid()) {
             /* If this message is coming from a bus-to-bus ep, make sure the receiver is willing to receive it */
@@ -135,9 +163,10 @@ QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
                     BusEndpoint busEndpoint = BusEndpoint::cast(localEndpoint);
                     PushMessage(msg, busEndpoint);
                 } else {
-                    nameTable.Unlock();
                     status = SendThroughEndpoint(msg, destEndpoint, sessionId);
-                    nameTable.Lock();
+                    if (status == ER_OK) {
+                        IncrementAndFetch(&GetStatsShard().routed);
+                    }
                 }
             } else {
                 QCC_DbgPrintf(("Blocking message from %s to %s (serial=%d) because receiver does not allow remote messages",
@@ -157,9 +186,7 @@ QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
             if ((ER_OK != status) && (ER_BUS_ENDPOINT_CLOSING != status) && (status != ER_BUS_STOPPING)) {
                 QCC_LogError(status, ("BusEndpoint::PushMessage failed"));
             }
-            nameTable.Unlock();
         } else {
-            nameTable.Unlock();
             if ((msg->GetFlags() & ALLJOYN_FLAG_AUTO_START) &&
                 (sender->GetEndpointType() != ENDPOINT_TYPE_BUS2BUS) &&
                 (sender->GetEndpointType() != ENDPOINT_TYPE_NULL)) {
@@ -169,6 +196,7 @@ QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
                 status = ER_BUS_NO_ROUTE;
             }
             if (status != ER_OK) {
+                IncrementAndFetch(&GetStatsShard().noRoute);
                 if (replyExpected) {
                     QCC_LogError(status, ("Returning error %s no route to %s", msg->Description().c_str(), destination));
                     /* Need to let the sender know its reply message cannot be passed on. */
@@ -198,32 +226,28 @@ QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
          * The message has an empty destination field and no session is specified so this is a
          * regular broadcast message.
          */
+        std::vector<BusEndpoint> dests;
         nameTable.Lock();
         ruleTable.Lock();
-        RuleIterator it = ruleTable.Begin();
-        while (it != ruleTable.End()) {
-            if (it->second.IsMatch(msg)) {
-                BusEndpoint dest = it->first;
-                QCC_DbgPrintf(("Routing %s (%d) to %s", msg->Description().c_str(), msg->GetCallSerial(), dest->GetUniqueName().c_str()));
-                /*
-                 * If the message originated locally or the destination allows remote messages
-                 * forward the message, otherwise silently ignore it.
-                 */
-                if (!((sender->GetEndpointType() == ENDPOINT_TYPE_BUS2BUS) && !dest->AllowRemoteMessages())) {
-                    ruleTable.Unlock();
-                    nameTable.Unlock();
-                    QStatus tStatus = SendThroughEndpoint(msg, dest, sessionId);
-                    status = (status == ER_OK) ? tStatus : status;
-                    nameTable.Lock();
-                    ruleTable.Lock();
-                }
-                it = ruleTable.AdvanceToNextEndpoint(dest);
-            } else {
-                ++it;
-            }
-        }
+        ruleTable.FindMatchingEndpoints(msg, dests);
+        ruleMatches += dests.size();
         ruleTable.Unlock();
         nameTable.Unlock();
+        IncrementAndFetch(&GetStatsShard().broadcasts);
+
+        /* The endpoint references keep the destinations alive while sending without the locks */
+        for (std::vector<BusEndpoint>::iterator it = dests.begin(); it != dests.end(); ++it) {
+            BusEndpoint& dest = *it;
+            QCC_DbgPrintf(("Routing %s (%d) to %s", msg->Description().c_str(), msg->GetCallSerial(), dest->GetUniqueName().c_str()));
+            /*
+             * If the message originated locally or the destination allows remote messages
+             * forward the message, otherwise silently ignore it.
+             */
+            if (!((sender->GetEndpointType() == ENDPOINT_TYPE_BUS2BUS) && !dest->AllowRemoteMessages())) {
+                QStatus tStatus = SendThroughEndpoint(msg, dest, sessionId);
+                status = (status == ER_OK) ? tStatus : status;
+            }
+        }
 
         if (msg->IsSessionless()) {
             /* Give "locally generated" sessionless message to SessionlessObj */
@@ -321,6 +345,7 @@ QStatus DaemonRouter::PushMessage(Message& msg, BusEndpoint& origSender)
             }
         }
         if (!foundDest) {
+            IncrementAndFetch(&GetStatsShard().noRoute);
             status = ER_BUS_NO_ROUTE;
         }
         sessionCastSetLock.Unlock(MUTEX_CONTEXT);
@@ -334,6 +359,23 @@ void DaemonRouter::GetBusNames(vector<qcc::String>& names) const
     nameTable.GetBusNames(names);
 }
 
+void DaemonRouter::GetRemoteEndpoints(vector<RemoteEndpoint>& endpoints)
+{
+    vector<qcc::String> names;
+    nameTable.GetBusNames(names);
+    for (vector<qcc::String>::const_iterator it = names.begin(); it != names.end(); ++it) {
+        if ((*it)[0] == ':') {
+            BusEndpoint ep = nameTable.FindEndpoint(*it);
+            if (ep->IsValid() && (ep->GetEndpointType() == ENDPOINT_TYPE_REMOTE)) {
+                endpoints.push_back(RemoteEndpoint::cast(ep));
+            }
+        }
+    }
+    m_b2bEndpointsLock.Lock(MUTEX_CONTEXT);
+    endpoints.insert(endpoints.end(), m_b2bEndpoints.begin(), m_b2bEndpoints.end());
+    m_b2bEndpointsLock.Unlock(MUTEX_CONTEXT);
+}
+
 BusEndpoint DaemonRouter::FindEndpoint(const qcc::String& busName)
 {
     BusEndpoint ep = nameTable.FindEndpoint(busName);
@@ -373,6 +415,28 @@ QStatus DaemonRouter::RemoveRule(BusEndpoint& endpoint, Rule& rule)
     return status;
 }
 
+QStatus DaemonRouter::ConfigureTxQueue(RemoteEndpoint& endpoint)
+{
+    DaemonConfig* config = DaemonConfig::Access();
+    uint32_t maxQueueSize = config->Get("limit@max_tx_queue", static_cast<uint32_t>(_RemoteEndpoint::DEFAULT_MAX_TX_QUEUE_SIZE));
+    uint32_t maxWaitMs = config->Get("limit@max_tx_wait", 0);
+    qcc::String overflow = config->Get("limit@tx_overflow", "drop_expired");
+
+    _RemoteEndpoint::TxOverflowPolicy policy = _RemoteEndpoint::TX_OVERFLOW_DROP_EXPIRED;
+    if (overflow == "block") {
+        policy = _RemoteEndpoint::TX_OVERFLOW_BLOCK;
+    } else if (overflow == "fail") {
+        policy = _RemoteEndpoint::TX_OVERFLOW_FAIL;
+    } else if (overflow != "drop_expired") {
+        QCC_LogError(ER_BUS_BAD_VALUE, ("Unknown tx_overflow limit \"%s\", using \"drop_expired\"", overflow.c_str()));
+    }
+    QStatus status = endpoint->SetTxQueuePolicy(maxQueueSize, policy, maxWaitMs);
+    if (status != ER_OK) {
+        QCC_LogError(status, ("Cannot apply tx queue limits to %s", endpoint->GetUniqueName().c_str()));
+    }
+    return status;
+}
+
 QStatus DaemonRouter::RegisterEndpoint(BusEndpoint& endpoint)
 {
     QCC_DbgTrace(("DaemonRouter::RegisterEndpoint(%s, %d)", endpoint->GetUniqueName().c_str(), endpoint->GetEndpointType()));
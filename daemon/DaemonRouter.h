@@ -34,6 +34,7 @@
 #include "Router.h"
 #include "NameTable.h"
 #include "RuleTable.h"
+#include "ThreadShard.h"
 
 namespace ajn {
 
@@ -148,6 +149,13 @@ class DaemonRouter : public Router {
      */
     void GetBusNames(std::vector<qcc::String>& names) const;
 
+    /**
+     * Get the remote endpoints, both bus-to-client and bus-to-bus, connected to this router.
+     *
+     * @param endpoints  OUT Parameter: Vector of remote endpoints.
+     */
+    void GetRemoteEndpoints(std::vector<RemoteEndpoint>& endpoints);
+
     /**
      * Find the endpoint that owns the given unique or well-known name.
      *
@@ -237,6 +245,18 @@ class DaemonRouter : public Router {
      */
     QStatus RegisterEndpoint(BusEndpoint& endpoint);
 
+    /**
+     * Apply the tx queue limits from the daemon configuration to a remote endpoint.
+     * This method must be called by a transport before the endpoint is started.
+     *
+     * The limits are max_tx_queue (messages), max_tx_wait (ms, 0 waits indefinitely) and
+     * tx_overflow ("block", "drop_expired" or "fail").
+     *
+     * @param endpoint   Endpoint being configured.
+     * @return  ER_OK if successful.
+     */
+    QStatus ConfigureTxQueue(RemoteEndpoint& endpoint);
+
     /**
      * Un-register an endpoint.
      * This method must be called by an endpoint before the endpoint is deallocted.
@@ -351,7 +371,48 @@ class DaemonRouter : public Router {
      */
     void RemoveSessionRoutes(const char* uniqueName, SessionId id);
 
+    /**
+     * Routing statistics. The counters are 32 bit and wrap.
+     */
+    struct RouterStats {
+        uint32_t routed;        /**< Messages with a destination that were successfully handed to an endpoint */
+        uint32_t noRoute;       /**< Messages that were discarded because there was no route to the destination */
+        uint32_t broadcasts;    /**< Broadcast signals routed using the rule table */
+        uint64_t ruleMatches;   /**< Endpoints that broadcast signals were delivered to by matching rules */
+
+        RouterStats() : routed(0), noRoute(0), broadcasts(0), ruleMatches(0) { }
+    };
+
+    /**
+     * Get a snapshot of the routing statistics.
+     *
+     * @param stats   Returns the statistics.
+     */
+    void GetRouterStats(RouterStats& stats);
+
   private:
+
+    /** Number of shards the routing counters are split over, must be a power of two */
+    static const size_t NUM_STATS_SHARDS = 8;
+
+    /**
+     * A shard of the routing counters. Each shard fills a cache line and the shards are aligned
+     * to cache lines so that threads routing on different shards do not contend for the same line.
+     */
+    struct StatsShard {
+        volatile int32_t routed;
+        volatile int32_t noRoute;
+        volatile int32_t broadcasts;
+        uint8_t pad[CACHE_LINE_SIZE - 3 * sizeof(int32_t)];
+
+        StatsShard() : routed(0), noRoute(0), broadcasts(0) { }
+    };
+
+    /**
+     * Pick the counter shard for the calling thread.
+     */
+    StatsShard& GetStatsShard();
+
     LocalEndpoint localEndpoint;    /**< The local endpoint */
     RuleTable ruleTable;            /**< Routing rule table */
     NameTable nameTable;            /**< BusName to transport lookupl table */
@@ -388,6 +449,10 @@ class DaemonRouter : public Router {
 
     std::set<SessionCastEntry> sessionCastSet; /**< Session multicast set */
     qcc::Mutex sessionCastSetLock;             /**< Lock that protects sessionCastSet */
+
+    uint8_t statsShardMem[(NUM_STATS_SHARDS + 1) * CACHE_LINE_SIZE];  /**< Storage for statsShards with room to align them */
+    StatsShard* statsShards;                                          /**< Routing counters, cache line aligned in statsShardMem */
+    uint64_t ruleMatches;                      /**< Rule matches for broadcast signals, protected by the rule table lock */
 };
 
 }
@@ -24,11 +24,14 @@
 #include <qcc/platform.h>
 
 #include <assert.h>
+#include <new>
 
 #include <qcc/Debug.h>
 #include <qcc/Logger.h>
 #include <qcc/String.h>
 #include <qcc/StringUtil.h>
+#include <qcc/Thread.h>
+#include <qcc/atomic.h>
 
 #include "NameTable.h"
 #include "VirtualEndpoint.h"
@@ -43,6 +46,32 @@ using namespace qcc;
 
 namespace ajn {
 
+NameTable::NameTable() : uniqueId(0), uniquePrefix(":1.")
+{
+    /* The name table is part of a heap allocated router with no alignment guarantee so align the shards by hand */
+    uintptr_t mem = reinterpret_cast<uintptr_t>(routeShardMem);
+    routeShards = reinterpret_cast<PaddedRouteShard*>((mem + CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(CACHE_LINE_SIZE - 1));
+    for (size_t i = 0; i < NUM_ROUTE_SHARDS; ++i) {
+        RouteShard& shard = *new (&routeShards[i]) PaddedRouteShard();
+        shard.routes = new RouteMap();
+        shard.epoch = 0;
+        shard.readers[0] = 0;
+        shard.readers[1] = 0;
+        shard.version = 0;
+    }
+}
+
+NameTable::~NameTable()
+{
+    for (size_t i = 0; i < NUM_ROUTE_SHARDS; ++i) {
+        delete routeShards[i].routes;
+        for (size_t j = 0; j < routeShards[i].retired.size(); ++j) {
+            delete routeShards[i].retired[j];
+        }
+        routeShards[i].~PaddedRouteShard();
+    }
+}
+
 qcc::String NameTable::GenerateUniqueName(void)
 {
     return uniquePrefix + U32ToString(IncrementAndFetch((int32_t*)&uniqueId));
@@ -64,7 +93,9 @@ void NameTable::AddUniqueName(BusEndpoint& endpoint)
     QCC_DbgPrintf(("Add unique name %s", uniqueName.c_str()));
     lock.Lock(MUTEX_CONTEXT);
     uniqueNames[uniqueName] = endpoint;
+    UpdateRoute(uniqueName);
     lock.Unlock(MUTEX_CONTEXT);
+    ReclaimRoutes();
 
     /* Notify listeners */
     CallListeners(uniqueName, NULL, &uniqueName);
@@ -123,10 +154,18 @@ void NameTable::RemoveUniqueName(const qcc::String& uniqueName)
 
         if (it != uniqueNames.end()) {
             uniqueNames.erase(it);
+            UpdateRoute(uniqueName);
+            /* Aliases that could not be released must no longer route to the endpoint */
+            for (ait = aliasNames.begin(); ait != aliasNames.end(); ++ait) {
+                if (ait->second.front().endpointName == uniqueName) {
+                    UpdateRoute(ait->first);
+                }
+            }
             QCC_DbgPrintf(("Removed ep=%s from name table", uniqueName.c_str()));
         }
 
         lock.Unlock(MUTEX_CONTEXT);
+        ReclaimRoutes();
         /* Notify listeners */
         CallListeners(uniqueName, &uniqueName, NULL);
     } else {
@@ -187,7 +226,11 @@ QStatus NameTable::AddAlias(const qcc::String& aliasName,
                 origOwner = &vit->second->GetUniqueName();
             }
         }
+        if (newOwner) {
+            UpdateRoute(aliasName);
+        }
         lock.Unlock(MUTEX_CONTEXT);
+        ReclaimRoutes();
 
         if (listener) {
             listener->AddAliasComplete(aliasName, disposition, context);
@@ -227,7 +270,7 @@ void NameTable::RemoveAlias(const qcc::String& aliasName,
             /* Remove primary */
             if (queue.size() > 1) {
                 queue.pop_front();
-                BusEndpoint ep = FindEndpoint(queue[0].endpointName);
+                BusEndpoint ep = FindEndpointLocked(queue[0].endpointName);
                 if (ep->IsValid()) {
                     newOwner = queue[0].endpointName;
                 }
@@ -240,6 +283,8 @@ void NameTable::RemoveAlias(const qcc::String& aliasName,
                 }
                 aliasNames.erase(it);
             }
+            /* aliasName may be a reference to the key of the erased entry */
+            UpdateRoute(aliasNameCopy);
             oldOwner = ownerName;
             disposition = DBUS_RELEASE_NAME_REPLY_RELEASED;
         } else {
@@ -251,6 +296,7 @@ void NameTable::RemoveAlias(const qcc::String& aliasName,
     }
 
     lock.Unlock(MUTEX_CONTEXT);
+    ReclaimRoutes();
 
     if (listener) {
         listener->RemoveAliasComplete(aliasNameCopy, disposition, context);
@@ -261,10 +307,29 @@ void NameTable::RemoveAlias(const qcc::String& aliasName,
 }
 
 BusEndpoint NameTable::FindEndpoint(const qcc::String& busName) const
+{
+    BusEndpoint ep;
+    RouteShard& shard = GetRouteShard(busName);
+
+    /*
+     * The increment is a full barrier so the snapshot cannot be read before this reader is
+     * registered. Writers never free a snapshot while it has readers.
+     */
+    volatile int32_t* readers = &shard.readers[shard.epoch & 1];
+    IncrementAndFetch(readers);
+    const RouteMap* routes = shard.routes;
+    RouteMap::const_iterator it = routes->find(busName);
+    if (it != routes->end()) {
+        ep = it->second;
+    }
+    DecrementAndFetch(readers);
+    return ep;
+}
+
+BusEndpoint NameTable::FindEndpointLocked(const qcc::String& busName) const
 {
     BusEndpoint ep;
 
-    lock.Lock(MUTEX_CONTEXT);
     if (busName[0] == ':') {
         unordered_map<qcc::String, BusEndpoint, Hash, Equal>::const_iterator it = uniqueNames.find(busName);
         if (it != uniqueNames.end()) {
@@ -274,7 +339,7 @@ BusEndpoint NameTable::FindEndpoint(const qcc::String& busName) const
         unordered_map<qcc::String, deque<NameQueueEntry>, Hash, Equal>::const_iterator it = aliasNames.find(busName);
         if (it != aliasNames.end()) {
             assert(!it->second.empty());
-            ep = FindEndpoint(it->second[0].endpointName);
+            ep = FindEndpointLocked(it->second[0].endpointName);
         }
         /* Fallback to virtual (remote) aliases if a suitable local one cannot be found */
         if (!ep->IsValid()) {
@@ -285,10 +350,69 @@ BusEndpoint NameTable::FindEndpoint(const qcc::String& busName) const
             }
         }
     }
-    lock.Unlock(MUTEX_CONTEXT);
     return ep;
 }
 
+void NameTable::UpdateRoute(const qcc::String& busName)
+{
+    BusEndpoint ep = FindEndpointLocked(busName);
+    RouteShard& shard = GetRouteShard(busName);
+    RouteMap* oldRoutes = shard.routes;
+
+    RouteMap::const_iterator it = oldRoutes->find(busName);
+    if (it == oldRoutes->end() ? !ep->IsValid() : (it->second == ep)) {
+        return;
+    }
+    RouteMap* newRoutes = new RouteMap(*oldRoutes);
+    if (ep->IsValid()) {
+        (*newRoutes)[busName] = ep;
+    } else {
+        newRoutes->erase(busName);
+    }
+
+    /* The increment is a full barrier so the new snapshot is complete before it is published */
+    IncrementAndFetch(&shard.version);
+    shard.routes = newRoutes;
+
+    /* Readers may still be using the old snapshot, it is freed by ReclaimRoutes */
+    shard.retired.push_back(oldRoutes);
+}
+
+void NameTable::ReclaimRoutes()
+{
+    reclaimLock.Lock(MUTEX_CONTEXT);
+    std::vector<RouteMap*> reclaim[NUM_ROUTE_SHARDS];
+    lock.Lock(MUTEX_CONTEXT);
+    for (size_t i = 0; i < NUM_ROUTE_SHARDS; ++i) {
+        reclaim[i].swap(routeShards[i].retired);
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+
+    for (size_t i = 0; i < NUM_ROUTE_SHARDS; ++i) {
+        if (reclaim[i].empty()) {
+            continue;
+        }
+        RouteShard& shard = routeShards[i];
+        /*
+         * The snapshots being reclaimed were replaced before the epoch is flipped. A reader that
+         * sampled the epoch just before a flip can register in the old epoch after the writer has
+         * stopped waiting for it. Flipping and draining twice guarantees that every reader that
+         * might hold a replaced snapshot has finished with it. The reclaim lock makes sure only
+         * one writer is flipping the epochs.
+         */
+        for (size_t e = 0; e < 2; ++e) {
+            int32_t oldEpoch = IncrementAndFetch(&shard.epoch) - 1;
+            while (shard.readers[oldEpoch & 1] != 0) {
+                qcc::Sleep(0);
+            }
+        }
+        for (size_t j = 0; j < reclaim[i].size(); ++j) {
+            delete reclaim[i][j];
+        }
+    }
+    reclaimLock.Unlock(MUTEX_CONTEXT);
+}
+
 void NameTable::GetBusNames(vector<qcc::String>& names) const
 {
     lock.Lock(MUTEX_CONTEXT);
@@ -320,7 +444,7 @@ void NameTable::GetUniqueNamesAndAliases(vector<pair<qcc::String, vector<qcc::St
     unordered_map<qcc::String, deque<NameQueueEntry>, Hash, Equal>::const_iterator ait = aliasNames.begin();
     while (ait != aliasNames.end()) {
         if (!ait->second.empty()) {
-            BusEndpoint ep = FindEndpoint(ait->second.front().endpointName);
+            BusEndpoint ep = FindEndpointLocked(ait->second.front().endpointName);
             if (ep->IsValid()) {
                 epMap.insert(pair<BusEndpoint, qcc::String>(ep, ait->first));
             }
@@ -380,7 +504,7 @@ void NameTable::GetQueuedNames(const qcc::String& busName, std::vector<qcc::Stri
 void NameTable::RemoveVirtualAliases(const qcc::String& epName)
 {
     lock.Lock(MUTEX_CONTEXT);
-    BusEndpoint tempEp = FindEndpoint(epName);
+    BusEndpoint tempEp = FindEndpointLocked(epName);
     VirtualEndpoint ep = VirtualEndpoint::cast(tempEp);
 
     QCC_DbgTrace(("NameTable::RemoveVirtualAliases(%s)", ep->IsValid() ? ep->GetUniqueName().c_str() : "<none>"));
@@ -391,6 +515,7 @@ void NameTable::RemoveVirtualAliases(const qcc::String& epName)
             if (vit->second == ep) {
                 String alias = vit->first.c_str();
                 virtualAliasNames.erase(vit++);
+                UpdateRoute(alias);
                 if (aliasNames.find(alias) == aliasNames.end()) {
                     lock.Unlock(MUTEX_CONTEXT);
                     CallListeners(alias, &epName, NULL);
@@ -403,6 +528,7 @@ void NameTable::RemoveVirtualAliases(const qcc::String& epName)
         }
     }
     lock.Unlock(MUTEX_CONTEXT);
+    ReclaimRoutes();
 }
 
 bool NameTable::SetVirtualAlias(const qcc::String& alias,
@@ -447,11 +573,13 @@ bool NameTable::SetVirtualAlias(const qcc::String& alias,
         madeChange = true;
         virtualAliasNames.erase(StringMapKey(alias));
     }
+    UpdateRoute(alias);
 
     String oldName = oldOwner->IsValid() ? oldOwner->GetUniqueName() : "";
     String newName = newOwner ? (*newOwner)->GetUniqueName() : "";
 
     lock.Unlock(MUTEX_CONTEXT);
+    ReclaimRoutes();
 
     /* Virtual aliases cannot override locally requested aliases */
     if (madeChange && !maskingLocalName) {
@@ -37,6 +37,7 @@
 
 #include "BusEndpoint.h"
 #include "VirtualEndpoint.h"
+#include "ThreadShard.h"
 
 #include <qcc/STLContainer.h>
 
@@ -50,6 +51,12 @@ class NameListener;
  * bus names and the BusEndpoint that these names exist on.
  * This mapping is many (names) to one (endpoint). Every endpoint has
  * exactly one unique name and zero or more well-known names.
+ *
+ * Lookups with FindEndpoint() are much more frequent than changes to the table
+ * so the name to endpoint routes are also kept in a set of read-only snapshots
+ * that FindEndpoint() reads without taking the table lock. The snapshots are
+ * sharded by name hash and a change to the table copies and republishes only
+ * the shard of the affected name.
  */
 class NameTable {
   public:
@@ -67,7 +74,12 @@ class NameTable {
     /**
      * Constructor
      */
-    NameTable() : uniqueId(0), uniquePrefix(":1.") { }
+    NameTable();
+
+    /**
+     * Destructor
+     */
+    ~NameTable();
 
     /**
      * Set the GUID of the bus.
@@ -171,7 +183,8 @@ class NameTable {
     void RemoveVirtualAliases(const qcc::String& uniqueName);
 
     /**
-     * Find an endpoint for a given unique or alias bus name.
+     * Find an endpoint for a given unique or alias bus name. This does not take the
+     * table lock.
      *
      * @param busName   Name of bus.
      * @return  Returns the endpoint if it was found or an invalid endpoint if not found
@@ -231,7 +244,40 @@ class NameTable {
         }
     };
 
+    /**
+     * Snapshot of the routes for the names that hash to one shard.
+     */
+    typedef std::unordered_map<qcc::String, BusEndpoint, Hash, Equal> RouteMap;
+
+    /**
+     * A shard of the route snapshots. Readers register in the reader count for the current
+     * epoch while they use the snapshot. A writer publishes a new snapshot under the table lock
+     * and retires the old one. After releasing the table lock it flips the epoch and waits for
+     * the readers of the old epoch to drain before freeing the retired snapshots.
+     */
+    struct RouteShard {
+        RouteMap* volatile routes;        /**< Current snapshot */
+        volatile int32_t epoch;           /**< Low bit selects the reader count new readers use */
+        volatile int32_t readers[2];      /**< Number of readers in each epoch */
+        volatile int32_t version;         /**< Number of snapshots published */
+        std::vector<RouteMap*> retired;   /**< Replaced snapshots waiting for readers to drain (table lock) */
+    };
+
+    /**
+     * A route shard padded to a whole number of cache lines so that readers registering in
+     * different shards do not contend for the same line.
+     */
+    struct PaddedRouteShard : public RouteShard {
+        uint8_t pad[CACHE_LINE_SIZE - (sizeof(RouteShard) % CACHE_LINE_SIZE)];
+    };
+
+    static const size_t NUM_ROUTE_SHARDS = 16;  /**< Must be a power of two */
+
+    uint8_t routeShardMem[NUM_ROUTE_SHARDS * sizeof(PaddedRouteShard) + CACHE_LINE_SIZE];  /**< Storage for routeShards with room to align them */
+    PaddedRouteShard* routeShards;                                       /**< Route snapshots, cache line aligned in routeShardMem */
+
     mutable qcc::Mutex lock;                                             /**< Lock protecting name tables */
+    qcc::Mutex reclaimLock;                                              /**< Serializes epoch flips in ReclaimRoutes */
     std::unordered_map<qcc::String, BusEndpoint, Hash, Equal> uniqueNames;   /**< Unique name table */
     std::unordered_map<qcc::String, std::deque<NameQueueEntry>, Hash, Equal> aliasNames;  /**< Alias name table */
     uint32_t uniqueId;
@@ -251,6 +297,36 @@ class NameTable {
     void CallListeners(const qcc::String& aliasName,
                        const qcc::String* origOwner,
                        const qcc::String* newOwner);
+
+    /**
+     * Find an endpoint from the name tables rather than the route snapshots. Must be called
+     * with the table lock held.
+     *
+     * @param busName   Name of bus.
+     * @return  Returns the endpoint if it was found or an invalid endpoint if not found
+     */
+    BusEndpoint FindEndpointLocked(const qcc::String& busName) const;
+
+    /**
+     * Republish the route for a name after the name tables have changed. Must be called with
+     * the table lock held and followed by ReclaimRoutes once the lock has been released.
+     *
+     * @param busName   Name of bus whose route may have changed.
+     */
+    void UpdateRoute(const qcc::String& busName);
+
+    /**
+     * Free the snapshots retired by UpdateRoute once no reader can be using them. Must be
+     * called by writers after releasing the table lock.
+     */
+    void ReclaimRoutes();
+
+    /**
+     * Get the route shard for a name.
+     */
+    RouteShard& GetRouteShard(const qcc::String& busName) const {
+        return routeShards[Hash()(busName) & (NUM_ROUTE_SHARDS - 1)];
+    }
 };
 
 /**
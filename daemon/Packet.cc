@@ -29,6 +29,7 @@
 #include <qcc/time.h>
 
 #include "Packet.h"
+#include "PacketCRC16.h"
 #include "PacketStream.h"
 
 #if defined(QCC_OS_DARWIN)
@@ -77,7 +78,27 @@ Packet::Packet(size_t _mtu) :
     fastRetransmit(false),
     mtu(_mtu),
     crc16(0),
-    version(0)
+    version(0),
+    ownsBuffer(true)
+{
+}
+
+Packet::Packet(size_t _mtu, uint32_t* _buffer) :
+    chanId(0),
+    seqNum(0),
+    gap(0),
+    flags(0),
+    payloadLen(0),
+    payload(NULL),
+    buffer(_buffer),
+    expireTs(0),
+    sendTs(0),
+    sendAttempts(0),
+    fastRetransmit(false),
+    mtu(_mtu),
+    crc16(0),
+    version(0),
+    ownsBuffer(false)
 {
 }
 
@@ -95,7 +116,8 @@ Packet::Packet(const Packet& other) :
     fastRetransmit(other.fastRetransmit),
     mtu(other.mtu),
     crc16(other.crc16),
-    version(other.version)
+    version(other.version),
+    ownsBuffer(true)
 {
 }
 
@@ -108,9 +130,12 @@ Packet& Packet::operator=(const Packet& other)
         flags = other.flags;
         payloadLen = other.payloadLen;
         payload = other.payload;
-        if (mtu != other.mtu) {
-            delete buffer;
+        if ((mtu != other.mtu) || !ownsBuffer) {
+            if (ownsBuffer) {
+                delete[] buffer;
+            }
             buffer = new uint32_t[(other.mtu + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+            ownsBuffer = true;
         }
         expireTs = other.expireTs;
         sendTs = other.sendTs;
@@ -125,7 +150,9 @@ Packet& Packet::operator=(const Packet& other)
 
 Packet::~Packet()
 {
-    delete[] buffer;
+    if (ownsBuffer) {
+        delete[] buffer;
+    }
 }
 
 size_t Packet::SetPayload(const void* _payload, size_t _payloadLen)
@@ -146,9 +173,22 @@ size_t Packet::SetPayload(const void* _payload, size_t _payloadLen)
 QStatus Packet::Unmarshal(PacketSource& source)
 {
     /* Get bytes from source */
-    size_t actBytes;
-    QStatus status = source.PullPacketBytes(buffer, mtu, actBytes, sender, 3000);
+    size_t actBytes = 0;
+    PacketDest pulledFrom = sender;
+    QStatus status = source.PullPacketBytes(buffer, mtu, actBytes, pulledFrom, 3000);
+    if (status == ER_OK) {
+        status = Unmarshal(pulledFrom, actBytes);
+    } else {
+        Unmarshal(pulledFrom, 0);
+    }
+    return status;
+}
+
+QStatus Packet::Unmarshal(const PacketDest& sender, size_t actBytes)
+{
+    QStatus status = ER_OK;
     uint8_t* tBuf = reinterpret_cast<uint8_t*>(buffer);
+    this->sender = sender;
 
     if (actBytes < PAYLOAD_OFFSET) {
         status = ER_PACKET_BAD_FORMAT;
@@ -158,8 +198,8 @@ QStatus Packet::Unmarshal(PacketSource& source)
         /* Crc check */
         uint16_t crc = 0;
         uint16_t packetCrc = letoh16(*reinterpret_cast<uint16_t*>(tBuf + CRC_OFFSET));
-        CRC16_Compute(tBuf, CRC_OFFSET, &crc);
-        CRC16_Compute(tBuf + PAYLOAD_OFFSET, actBytes - PAYLOAD_OFFSET, &crc);
+        PacketCRC16::Compute(tBuf, CRC_OFFSET, &crc);
+        PacketCRC16::Compute(tBuf + PAYLOAD_OFFSET, actBytes - PAYLOAD_OFFSET, &crc);
         status = (crc == packetCrc) ? ER_OK : ER_PACKET_BAD_CRC;
     }
 
@@ -213,9 +253,9 @@ void Packet::Marshal()
         ::memmove(tBuf + PAYLOAD_OFFSET, payload, payloadLen);
     }
     uint16_t crc = 0;
-    CRC16_Compute(tBuf, CRC_OFFSET, &crc);
+    PacketCRC16::Compute(tBuf, CRC_OFFSET, &crc);
     if (payloadLen) {
-        CRC16_Compute(tBuf + PAYLOAD_OFFSET, payloadLen, &crc);
+        PacketCRC16::Compute(tBuf + PAYLOAD_OFFSET, payloadLen, &crc);
     }
     *reinterpret_cast<uint16_t*>(tBuf + CRC_OFFSET) = htole16(crc);
 }
@@ -84,6 +84,14 @@ class Packet {
     /** Constructor */
     Packet(size_t mtu);
 
+    /**
+     * Construct a packet over a buffer owned by the caller.
+     *
+     * @param mtu      Size of buffer in bytes.
+     * @param buffer   4-byte aligned buffer that outlives the packet.
+     */
+    Packet(size_t mtu, uint32_t* buffer);
+
     /** Copy constructor */
     Packet(const Packet& other);
 
@@ -105,6 +113,15 @@ class Packet {
      */
     QStatus Unmarshal(PacketSource& source);
 
+    /**
+     * Unmarshal packet state from bytes that have already been pulled into the buffer member.
+     *
+     * @param sender     Sender of the packet.
+     * @param numBytes   Number of bytes in the buffer.
+     * @return ER_OK if successful.
+     */
+    QStatus Unmarshal(const PacketDest& sender, size_t numBytes);
+
     /**
      * Marshal packet state into serialized form.
      * After calling this method, the packet's object state will be serialized into the buffer member.
@@ -121,6 +138,7 @@ class Packet {
     uint16_t crc16;
     uint8_t version;
     PacketDest sender;
+    bool ownsBuffer;
 
     Packet();
 };
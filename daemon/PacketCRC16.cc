@@ -0,0 +1,109 @@
+/**
+ * @file
+ * Slice-by-8 implementation of the CRC16 used by PacketEngine packets.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#include <qcc/platform.h>
+
+#include <cstring>
+
+#include <qcc/Util.h>
+
+#include "PacketCRC16.h"
+
+#define QCC_MODULE "PACKET"
+
+using namespace qcc;
+
+namespace ajn {
+
+/* Number of bytes consumed per step */
+static const size_t SLICE = 8;
+
+/*
+ * The CRC after a block of SLICE bytes is a function of the running CRC and each of the bytes
+ * that can be split into one table lookup per byte. The tables are filled by running
+ * CRC16_Compute over blocks that are all zeros except for one byte. The CRC with zero input is
+ * left in the first table only so that it cancels out correctly if CRC16_Compute is affine
+ * rather than strictly linear.
+ *
+ * Packets may in principle be checked before the tables are built, in which case the byte at a
+ * time implementation is used.
+ */
+static bool tablesReady = false;
+
+class CRC16Tables {
+  public:
+    CRC16Tables()
+    {
+        uint8_t block[SLICE];
+        ::memset(block, 0, sizeof(block));
+        uint16_t zero = 0;
+        CRC16_Compute(block, SLICE, &zero);
+
+        for (size_t v = 0; v < 256; ++v) {
+            uint16_t crc = static_cast<uint16_t>(v << 8);
+            CRC16_Compute(block, SLICE, &crc);
+            crcHi[v] = crc;
+            crc = static_cast<uint16_t>(v);
+            CRC16_Compute(block, SLICE, &crc);
+            crcLo[v] = crc ^ zero;
+            for (size_t i = 0; i < SLICE; ++i) {
+                block[i] = static_cast<uint8_t>(v);
+                crc = 0;
+                CRC16_Compute(block, SLICE, &crc);
+                data[i][v] = crc ^ zero;
+                block[i] = 0;
+            }
+        }
+        tablesReady = true;
+    }
+
+    ~CRC16Tables() { tablesReady = false; }
+
+    uint16_t crcHi[256];          /**< Contribution of the high byte of the running CRC */
+    uint16_t crcLo[256];          /**< Contribution of the low byte of the running CRC */
+    uint16_t data[SLICE][256];    /**< Contribution of each byte of the block */
+};
+
+static CRC16Tables tables;
+
+void PacketCRC16::Compute(const uint8_t* buf, size_t len, uint16_t* runningCrc)
+{
+    if (!tablesReady) {
+        CRC16_Compute(buf, len, runningCrc);
+        return;
+    }
+    uint16_t crc = *runningCrc;
+    while (len >= SLICE) {
+        crc = tables.crcHi[crc >> 8] ^ tables.crcLo[crc & 0xFF] ^
+              tables.data[0][buf[0]] ^ tables.data[1][buf[1]] ^
+              tables.data[2][buf[2]] ^ tables.data[3][buf[3]] ^
+              tables.data[4][buf[4]] ^ tables.data[5][buf[5]] ^
+              tables.data[6][buf[6]] ^ tables.data[7][buf[7]];
+        buf += SLICE;
+        len -= SLICE;
+    }
+    *runningCrc = crc;
+    if (len) {
+        CRC16_Compute(buf, len, runningCrc);
+    }
+}
+
+}
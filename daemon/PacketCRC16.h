@@ -0,0 +1,47 @@
+/**
+ * @file
+ * Slice-by-8 implementation of the CRC16 used by PacketEngine packets.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#ifndef _ALLJOYN_PACKETCRC16_H
+#define _ALLJOYN_PACKETCRC16_H
+
+#include <qcc/platform.h>
+
+namespace ajn {
+
+/**
+ * Computes the same CRC16 as qcc::CRC16_Compute but eight bytes per step. The lookup tables
+ * are generated from qcc::CRC16_Compute itself so the two can never disagree on the wire.
+ */
+class PacketCRC16 {
+  public:
+
+    /**
+     * Update a running CRC16.
+     *
+     * @param buf         Bytes to add to the CRC.
+     * @param len         Number of bytes.
+     * @param runningCrc  [IN/OUT] The running CRC, zero to start a new CRC.
+     */
+    static void Compute(const uint8_t* buf, size_t len, uint16_t* runningCrc);
+};
+
+}
+
+#endif
@@ -25,6 +25,7 @@
 #include <limits>
 
 #include <qcc/Crypto.h>
+#include <qcc/StringUtil.h>
 #include <qcc/Util.h>
 #include "PacketEngine.h"
 
@@ -47,70 +48,6 @@ using namespace qcc;
 
 namespace ajn {
 
-struct AlarmContext {
-    enum ContextType {
-        CONTEXT_CONNECT_REQ,
-        CONTEXT_CONNECT_RSP,
-        CONTEXT_CONNECT_RSP_ACK,
-        CONTEXT_DISCONNECT_REQ,
-        CONTEXT_DISCONNECT_RSP,
-        CONTEXT_XON,
-        CONTEXT_DELAY_ACK,
-        CONTEXT_CLOSING
-    };
-
-    ContextType contextType;
-    uint32_t chanId;
-
-    AlarmContext(AlarmContext::ContextType t, uint32_t chanId) : contextType(t), chanId(chanId) { }
-
-    virtual ~AlarmContext() { }
-};
-
-struct ConnectReqAlarmContext : public AlarmContext {
-    void* context;
-    PacketDest dest;
-    uint32_t retries;
-    uint32_t connReq[3];
-    ConnectReqAlarmContext(uint32_t chanId, const PacketDest& dest, void* context) :
-        AlarmContext(AlarmContext::CONTEXT_CONNECT_REQ, chanId), context(context), dest(dest), retries(0) { }
-};
-
-struct ConnectRspAlarmContext : public AlarmContext {
-    PacketDest dest;
-    uint32_t retries;
-    uint32_t connRsp[4];
-    ConnectRspAlarmContext(uint32_t chanId, const PacketDest& dest) :
-        AlarmContext(AlarmContext::CONTEXT_CONNECT_RSP, chanId), dest(dest), retries(0) { }
-};
-
-struct DisconnectReqAlarmContext : public AlarmContext {
-    uint32_t retries;
-    uint32_t disconnReq[1];
-    DisconnectReqAlarmContext(uint32_t chanId) :
-        AlarmContext(AlarmContext::CONTEXT_DISCONNECT_REQ, chanId), retries(0) { }
-};
-
-struct DisconnectRspAlarmContext : public AlarmContext {
-    uint32_t disconnRsp[1];
-    DisconnectRspAlarmContext(uint32_t chanId) : AlarmContext(AlarmContext::CONTEXT_DISCONNECT_RSP, chanId) { }
-};
-
-struct XOnAlarmContext : public AlarmContext {
-    uint32_t retries;
-    uint32_t xon[3];
-    uint16_t xoffSeqNum;
-    XOnAlarmContext(uint32_t chanId, uint16_t seqNum) : AlarmContext(AlarmContext::CONTEXT_XON, chanId), retries(0), xoffSeqNum(seqNum) { }
-};
-
-struct DelayAckAlarmContext : public AlarmContext {
-    DelayAckAlarmContext(uint32_t chanId) : AlarmContext(AlarmContext::CONTEXT_DELAY_ACK, chanId) { }
-};
-
-struct ClosingAlarmContext : public AlarmContext {
-    ClosingAlarmContext(uint32_t chanId) : AlarmContext(AlarmContext::CONTEXT_CLOSING, chanId) { }
-};
-
 static uint32_t GetValidWindowSize(uint32_t inWinSize)
 {
     uint32_t allowedSize = 0x400;  /* max allowed window size is 1k packets */
@@ -120,16 +57,21 @@ static uint32_t GetValidWindowSize(uint32_t inWinSize)
     return allowedSize;
 }
 
-PacketEngine::PacketEngine(const qcc::String& name, uint32_t maxWindowSize) :
+PacketEngine::PacketEngine(const qcc::String& name, uint32_t maxWindowSize, uint32_t numWorkers) :
     name(name),
-    rxPacketThread(name),
-    txPacketThread(name),
-    timer("PacketEngineTimer"),
+    timerThread(name),
     maxWindowSize(maxWindowSize),
-    isRunning(false),
-    rxPacketThreadReload(false)
+    isRunning(false)
 {
-    QCC_DbgTrace(("PacketEngine::PacketEngine(%p)", this));
+    QCC_DbgTrace(("PacketEngine::PacketEngine(%p, numWorkers=%u)", this, numWorkers));
+
+    /* Create a channel shard and an rx/tx thread pair per worker */
+    numWorkers = ::max(numWorkers, (uint32_t)1);
+    for (uint32_t i = 0; i < numWorkers; ++i) {
+        channelShards.push_back(new ChannelShard());
+        rxPacketThreads.push_back(new RxPacketThread(name, i));
+        txPacketThreads.push_back(new TxPacketThread(name, i));
+    }
 
     /* Check that window size is a power of 2 */
 #ifndef NDEBUG
@@ -148,20 +90,34 @@ PacketEngine::PacketEngine(const qcc::String& name, uint32_t maxWindowSize) :
 PacketEngine::~PacketEngine()
 {
     QCC_DbgTrace(("~PacketEngine(%p)", this));
-    rxPacketThreadReload = true;
+    for (size_t i = 0; i < rxPacketThreads.size(); ++i) {
+        rxPacketThreads[i]->reloaded = true;
+    }
     Stop();
     Join();
+
+    /* Free any remaining channels then the threads that serviced them */
+    for (size_t i = 0; i < channelShards.size(); ++i) {
+        delete channelShards[i];
+    }
+    for (size_t i = 0; i < rxPacketThreads.size(); ++i) {
+        rxPacketThreads[i]->ReturnHandoff();
+        delete rxPacketThreads[i];
+        delete txPacketThreads[i];
+    }
 }
 
 QStatus PacketEngine::Start(uint32_t mtu) {
     QCC_DbgTrace(("PacketEngine::Start()"));
     isRunning = true;
     QStatus status = pool.Start(mtu);
-    QStatus tStatus = rxPacketThread.Start(this);
-    status = (status == ER_OK) ? tStatus : status;
-    tStatus = txPacketThread.Start(this);
-    status = (status == ER_OK) ? tStatus : status;
-    tStatus = timer.Start();
+    for (size_t i = 0; i < rxPacketThreads.size(); ++i) {
+        QStatus tStatus = rxPacketThreads[i]->Start(this);
+        status = (status == ER_OK) ? tStatus : status;
+        tStatus = txPacketThreads[i]->Start(this);
+        status = (status == ER_OK) ? tStatus : status;
+    }
+    QStatus tStatus = timerThread.Start(this);
     status = (status == ER_OK) ? tStatus : status;
     isRunning = (status == ER_OK);
     return status;
@@ -169,12 +125,14 @@ QStatus PacketEngine::Start(uint32_t mtu) {
 
 QStatus PacketEngine::Stop() {
     QCC_DbgTrace(("PacketEngine::Stop()"));
-    QStatus status = timer.Stop();
-    QStatus tStatus = txPacketThread.Stop();
-    status = (status == ER_OK) ? tStatus : status;
-    tStatus = rxPacketThread.Stop();
-    status = (status == ER_OK) ? tStatus : status;
-    tStatus = pool.Stop();
+    QStatus status = timerThread.Stop();
+    for (size_t i = 0; i < txPacketThreads.size(); ++i) {
+        QStatus tStatus = txPacketThreads[i]->Stop();
+        status = (status == ER_OK) ? tStatus : status;
+        tStatus = rxPacketThreads[i]->Stop();
+        status = (status == ER_OK) ? tStatus : status;
+    }
+    QStatus tStatus = pool.Stop();
     isRunning = false;
     return (status == ER_OK) ? tStatus : status;
 }
@@ -182,10 +140,14 @@ QStatus PacketEngine::Stop() {
 QStatus PacketEngine::Join() {
     QCC_DbgTrace(("PacketEngine::Join()"));
 
-    QStatus status = rxPacketThread.Join();
-    QStatus tStatus = txPacketThread.Join();
-    status = (status == ER_OK) ? tStatus : status;
-    tStatus = timer.Join();
+    QStatus status = ER_OK;
+    for (size_t i = 0; i < rxPacketThreads.size(); ++i) {
+        QStatus tStatus = rxPacketThreads[i]->Join();
+        status = (status == ER_OK) ? tStatus : status;
+        tStatus = txPacketThreads[i]->Join();
+        status = (status == ER_OK) ? tStatus : status;
+    }
+    QStatus tStatus = timerThread.Join();
     return (status == ER_OK) ? tStatus : status;
 }
 
@@ -193,10 +155,27 @@ QStatus PacketEngine::AddPacketStream(PacketStream& stream, PacketEngineListener
 {
     QCC_DbgTrace(("PacketEngine::AddPacketStream(%p)", &stream));
 
-    channelInfoLock.Lock();
-    packetStreams[&stream.GetSourceEvent()] = pair<PacketStream*, PacketEngineListener*>(&stream, &listener);
-    channelInfoLock.Unlock();
-    rxPacketThread.Alert();
+    packetStreamLock.Lock();
+    map<Event*, PacketStreamInfo>::iterator it = packetStreams.find(&stream.GetSourceEvent());
+    if (it != packetStreams.end()) {
+        /* Re-adding a stream keeps its rx thread */
+        it->second.stream = &stream;
+        it->second.listener = &listener;
+    } else {
+        /* Give the stream to the rx thread pulling from the fewest streams */
+        vector<size_t> numStreams(rxPacketThreads.size(), 0);
+        for (it = packetStreams.begin(); it != packetStreams.end(); ++it) {
+            ++numStreams[it->second.puller];
+        }
+        PacketStreamInfo info;
+        info.stream = &stream;
+        info.listener = &listener;
+        info.puller = static_cast<uint32_t>(min_element(numStreams.begin(), numStreams.end()) - numStreams.begin());
+        it = packetStreams.insert(pair<Event*, PacketStreamInfo>(&stream.GetSourceEvent(), info)).first;
+    }
+    RxPacketThread* rxThread = rxPacketThreads[it->second.puller];
+    packetStreamLock.Unlock();
+    rxThread->Alert();
     return ER_OK;
 }
 
@@ -223,18 +202,25 @@ QStatus PacketEngine::RemovePacketStream(PacketStream& pktStream)
     }
 
     /* Remove packetStream itself */
-    channelInfoLock.Lock();
-    map<Event*, pair<PacketStream*, PacketEngineListener*> >::iterator it = packetStreams.find(&pktStream.GetSourceEvent());
+    packetStreamLock.Lock();
+    map<Event*, PacketStreamInfo>::iterator it = packetStreams.find(&pktStream.GetSourceEvent());
     if (it != packetStreams.end()) {
         packetStreams.erase(it);
-        rxPacketThreadReload = false;
-        channelInfoLock.Unlock();
-        rxPacketThread.Alert();
-        while (isRunning && !rxPacketThreadReload && (Thread::GetThread() != &rxPacketThread)) {
-            qcc::Sleep(20);
+        for (size_t i = 0; i < rxPacketThreads.size(); ++i) {
+            rxPacketThreads[i]->reloaded = false;
+        }
+        packetStreamLock.Unlock();
+
+        /* Wait for every rx thread (other than this one) to stop using pktStream */
+        for (size_t i = 0; i < rxPacketThreads.size(); ++i) {
+            RxPacketThread* rxThread = rxPacketThreads[i];
+            rxThread->Alert();
+            while (isRunning && !rxThread->reloaded && (Thread::GetThread() != rxThread)) {
+                qcc::Sleep(20);
+            }
         }
     } else {
-        channelInfoLock.Unlock();
+        packetStreamLock.Unlock();
         status = ER_FAIL;
         QCC_LogError(status, ("Cannot find PacketStream"));
     }
@@ -252,36 +238,28 @@ QStatus PacketEngine::Connect(const PacketDest& dest, PacketStream& packetStream
         return status;
     }
 
-    /* Create the connect request */
-    ConnectReqAlarmContext* cctx = new ConnectReqAlarmContext(chanId, dest, context);
-    cctx->connReq[0] = htole32(PACKET_COMMAND_CONNECT_REQ);
-    cctx->connReq[1] = htole32(PACKET_ENGINE_VERSION);
-    cctx->connReq[2] = htole32(maxWindowSize);
-
     /* Create a channel info */
     ChannelInfo* ci = CreateChannelInfo(chanId, dest, packetStream, listener, maxWindowSize);
     if (ci) {
-        /* Put an entry on the callback timer */
-        uint32_t zero = 0;
-        uint32_t timeout = CONNECT_RETRY_TIMEOUT;
-        qcc::AlarmListener* packetEngineListener = this;
-        ci->connectReqAlarm = Alarm(timeout, packetEngineListener, cctx, zero);
-        status = timer.AddAlarm(ci->connectReqAlarm);
-        if (status == ER_OK) {
-            /* Send connect request */
-            status = DeliverControlMsg(*ci, cctx->connReq, sizeof(cctx->connReq));
-            if (status != ER_OK) {
-                QCC_LogError(status, ("Failed to send CONNECT_REQ"));
-            }
-        } else {
-            /* Immediately abort */
-            ci->state = ChannelInfo::CLOSED;
+        /* Create the connect request */
+        ci->connReq[0] = htole32(PACKET_COMMAND_CONNECT_REQ);
+        ci->connReq[1] = htole32(PACKET_ENGINE_VERSION);
+        ci->connReq[2] = htole32(maxWindowSize);
+        ci->connectContext = context;
+
+        /* Arm the retry timer */
+        ci->connectReqTimer.active = true;
+        ArmTimer(ci->connectReqTimer, CONNECT_RETRY_TIMEOUT);
+
+        /* Send connect request */
+        status = DeliverControlMsg(*ci, ci->connReq, sizeof(ci->connReq));
+        if (status != ER_OK) {
+            QCC_LogError(status, ("Failed to send CONNECT_REQ"));
         }
         ReleaseChannelInfo(*ci);
     } else {
         /* Cant create channel */
         status = ER_PACKET_CHANNEL_FAIL;
-        delete cctx;
     }
     return status;
 }
@@ -292,25 +270,20 @@ void PacketEngine::CloseChannel(ChannelInfo& ci)
 
     /* Return early if disconnect already in progress */
     ci.txLock.Lock();
-    DisconnectReqAlarmContext* ctx = static_cast<DisconnectReqAlarmContext*>(ci.disconnectReqAlarm->GetContext());
-    if (ctx) {
+    if (ci.disconnectReqTimer.active) {
         ci.txLock.Unlock();
         return;
     }
 
-    /* Create disconnect context */
-    ctx = new DisconnectReqAlarmContext(ci.id);
-    ctx->disconnReq[0] = htole32(PACKET_COMMAND_DISCONNECT_REQ);
-    uint32_t timeout = DISCONNECT_RETRY_TIMEOUT;
-    uint32_t zero = 0;
-    qcc::AlarmListener* packetEngineListener = this;
-    ci.disconnectReqAlarm = Alarm(timeout, packetEngineListener, ctx, zero);
+    /* Create disconnect request */
+    ci.disconnectReqTimer.active = true;
+    ci.disconnReq[0] = htole32(PACKET_COMMAND_DISCONNECT_REQ);
 
     /* Update state and send the message */
     ci.state = ChannelInfo::CLOSING;
-    QStatus status = DeliverControlMsg(ci, ctx->disconnReq, sizeof(ctx->disconnReq));
+    QStatus status = DeliverControlMsg(ci, ci.disconnReq, sizeof(ci.disconnReq));
     if (status == ER_OK) {
-        status = timer.AddAlarm(ci.disconnectReqAlarm);
+        ArmTimer(ci.disconnectReqTimer, DISCONNECT_RETRY_TIMEOUT);
     }
 
     if (status != ER_OK) {
@@ -342,6 +315,9 @@ QStatus PacketEngine::DeliverControlMsg(PacketEngine::ChannelInfo& ci, const voi
 
     /* Write packet */
     Packet* p = pool.GetPacket();
+    if (!p) {
+        return ER_OUT_OF_MEMORY;
+    }
     p->SetPayload(reinterpret_cast<const uint8_t*>(buf), len);
     p->chanId = ci.id;
     p->seqNum = seqNum;
@@ -350,205 +326,165 @@ QStatus PacketEngine::DeliverControlMsg(PacketEngine::ChannelInfo& ci, const voi
     ci.txLock.Lock();
     ci.txControlQueue.push_back(p);
     ci.txLock.Unlock();
-    QStatus status = txPacketThread.Alert();
+    QStatus status = AlertTx(ci);
     return status;
 }
 
-void PacketEngine::AlarmTriggered(const Alarm& alarm, QStatus reason)
+void PacketEngine::ArmTimer(ChannelTimer& timer, uint32_t delayMs)
 {
-    AlarmContext* ctx = reinterpret_cast<AlarmContext*>(alarm->GetContext());
-    //printf("rx(%d): AlarmTriggered cctx=%d\n", (GetTimestamp() / 100) % 100000, ctx->contextType);
+    /* The timer thread waits forever when no timers are armed */
+    if (timerWheel.Arm(timer, delayMs)) {
+        timerThread.Alert();
+    }
+}
 
-    // To make klocwork happy
-    if (!ctx) {
+void PacketEngine::TimerExpired(const PacketTimerWheel::Expiry& expiry)
+{
+    ChannelInfo* ci = AcquireChannelInfo(expiry.id);
+    if (!ci) {
         return;
     }
 
-    switch (ctx->contextType) {
-    case AlarmContext::CONTEXT_DISCONNECT_REQ:
+    switch (expiry.type) {
+    case TIMER_DISCONNECT_REQ:
     {
         /* Retry the DISCONNECT_REQ if retries still remain */
-        DisconnectReqAlarmContext* cctx = static_cast<DisconnectReqAlarmContext*>(ctx);
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
+        if (!timerWheel.IsCurrent(ci->disconnectReqTimer, expiry.generation)) {
+            break;
+        }
         QStatus status = ER_FAIL;
-        if (ci) {
-            if ((++cctx->retries < DISCONNECT_RETRIES) && (ci->state == ChannelInfo::CLOSING)) {
-                QCC_DbgPrintf(("PacketEngine: cid=0x%x disconnect timeout. Retrying...", ci->id));
-                /* Rearm the timer and resend the disconnect request */
-                status = DeliverControlMsg(*ci, cctx->disconnReq, sizeof(cctx->disconnReq));
-                if (status == ER_OK) {
-                    uint32_t timeout = DISCONNECT_RETRY_TIMEOUT * cctx->retries;
-                    uint32_t zero = 0;
-                    qcc::AlarmListener* packetEngineListener = this;
-                    ci->disconnectReqAlarm = Alarm(timeout, packetEngineListener, ctx, zero);
-                    status = timer.AddAlarm(ci->disconnectReqAlarm);
-                }
-            }
-            if (status != ER_OK) {
-                QCC_LogError(status, ("PacketEngine: cid=0x%x disconnect failed. Closing channel.", ci->id));
-                ci->state = ChannelInfo::CLOSED;
+        if ((++ci->disconnectReqTimer.retries < DISCONNECT_RETRIES) && (ci->state == ChannelInfo::CLOSING)) {
+            QCC_DbgPrintf(("PacketEngine: cid=0x%x disconnect timeout. Retrying...", ci->id));
+            /* Rearm the timer and resend the disconnect request */
+            status = DeliverControlMsg(*ci, ci->disconnReq, sizeof(ci->disconnReq));
+            if (status == ER_OK) {
+                ArmTimer(ci->disconnectReqTimer, DISCONNECT_RETRY_TIMEOUT * ci->disconnectReqTimer.retries);
             }
-            ReleaseChannelInfo(*ci);
+        }
+        if (status != ER_OK) {
+            QCC_LogError(status, ("PacketEngine: cid=0x%x disconnect failed. Closing channel.", ci->id));
+            ci->state = ChannelInfo::CLOSED;
         }
         break;
     }
 
-    case AlarmContext::CONTEXT_DISCONNECT_RSP:
+    case TIMER_DISCONNECT_RSP:
     {
         /* Done waiting for DISCONNECT_REQ retries from remote. Close channel */
-        DisconnectRspAlarmContext* cctx = static_cast<DisconnectRspAlarmContext*>(ctx);
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
-        if (ci) {
+        if (timerWheel.IsCurrent(ci->disconnectRspTimer, expiry.generation)) {
             QCC_DbgPrintf(("Received DisconnectRsp for id=0x%x", ci->id));
             ci->state = ChannelInfo::CLOSED;
-            ReleaseChannelInfo(*ci);
         }
         break;
     }
 
-    case AlarmContext::CONTEXT_CONNECT_REQ:
+    case TIMER_CONNECT_REQ:
     {
-        ConnectReqAlarmContext* cctx = static_cast<ConnectReqAlarmContext*>(ctx);
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
+        if (!timerWheel.IsCurrent(ci->connectReqTimer, expiry.generation)) {
+            break;
+        }
         QStatus status = ER_FAIL;
-        if (ci) {
-            if (++cctx->retries < CONNECT_RETRIES) {
-                /* Rearm the timer and resend the connect request */
-                status = DeliverControlMsg(*ci, cctx->connReq, sizeof(cctx->connReq));
-                if (status == ER_OK) {
-                    uint32_t timeout = CONNECT_RETRY_TIMEOUT * cctx->retries;
-                    uint32_t zero = 0;
-                    qcc::AlarmListener* packetEngineListener = this;
-                    ci->connectReqAlarm = Alarm(timeout, packetEngineListener, ctx, zero);
-                    status = timer.AddAlarm(ci->connectReqAlarm);
-                }
+        if (++ci->connectReqTimer.retries < CONNECT_RETRIES) {
+            /* Rearm the timer and resend the connect request */
+            status = DeliverControlMsg(*ci, ci->connReq, sizeof(ci->connReq));
+            if (status == ER_OK) {
+                ArmTimer(ci->connectReqTimer, CONNECT_RETRY_TIMEOUT * ci->connectReqTimer.retries);
             }
-            if (status != ER_OK) {
-                /* Retries exhauseted. Notify the connect cb and remove the context and channel */
-                QCC_DbgPrintf(("PacketEngine: cid=0x%x connnect response timeout", ci->id));
-                ci->listener.PacketEngineConnectCB(*this, ER_PACKET_CONNECT_TIMEOUT, NULL, cctx->dest, cctx->context);
-                ci->state = ChannelInfo::CLOSED;
-            }
-            ReleaseChannelInfo(*ci);
+        }
+        if (status != ER_OK) {
+            /* Retries exhauseted. Notify the connect cb and close the channel */
+            QCC_DbgPrintf(("PacketEngine: cid=0x%x connnect response timeout", ci->id));
+            ci->listener.PacketEngineConnectCB(*this, ER_PACKET_CONNECT_TIMEOUT, NULL, ci->dest, ci->connectContext);
+            ci->state = ChannelInfo::CLOSED;
         }
         break;
     }
 
-    case AlarmContext::CONTEXT_CONNECT_RSP:
+    case TIMER_CONNECT_RSP:
     {
-        ConnectRspAlarmContext* cctx = static_cast<ConnectRspAlarmContext*>(ctx);
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
+        if (!timerWheel.IsCurrent(ci->connectRspTimer, expiry.generation)) {
+            break;
+        }
         QStatus status = ER_FAIL;
-        if (ci) {
-            if (++cctx->retries < CONNECT_RETRIES) {
-                /* Rearm the timer and resend the connect response */
-                status = DeliverControlMsg(*ci, cctx->connRsp, sizeof(cctx->connRsp));
-                if (status == ER_OK) {
-                    uint32_t zero = 0;
-                    uint32_t timeout = CONNECT_RETRY_TIMEOUT * cctx->retries;
-                    qcc::AlarmListener* packetEngineListener = this;
-                    ci->connectRspAlarm = Alarm(timeout, packetEngineListener, ctx, zero);
-                    status = timer.AddAlarm(ci->connectRspAlarm);
-                }
-            }
-            if (status != ER_OK) {
-                /* Retries exhauseted. */
-                QCC_DbgPrintf(("PacketEngine: cid=0x%x connect response ack timeout", ci->id));
-                ci->state = ChannelInfo::CLOSED;
+        if (++ci->connectRspTimer.retries < CONNECT_RETRIES) {
+            /* Rearm the timer and resend the connect response */
+            status = DeliverControlMsg(*ci, ci->connRsp, sizeof(ci->connRsp));
+            if (status == ER_OK) {
+                ArmTimer(ci->connectRspTimer, CONNECT_RETRY_TIMEOUT * ci->connectRspTimer.retries);
             }
-            ReleaseChannelInfo(*ci);
+        }
+        if (status != ER_OK) {
+            /* Retries exhauseted. */
+            QCC_DbgPrintf(("PacketEngine: cid=0x%x connect response ack timeout", ci->id));
+            ci->state = ChannelInfo::CLOSED;
         }
         break;
     }
 
-    case AlarmContext::CONTEXT_XON:
+    case TIMER_XON:
     {
-        XOnAlarmContext* cctx = static_cast<XOnAlarmContext*>(ctx);
-
-        // To make klocwork happy
-        if (!cctx) {
+        QStatus status = ER_OK;
+        ci->rxLock.Lock();
+        /* Retry the Xon only if the timer has not been re-armed for a later Xon or cancelled */
+        if (!timerWheel.IsCurrent(ci->xOnTimer, expiry.generation)) {
+            ci->rxLock.Unlock();
             break;
         }
-
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
-        QStatus status = ER_FAIL;
-        if (ci) {
-            ci->rxLock.Lock();
-            /* Retry the Xon and reload the alarm only if this alarm is the
-             * latest Xon alarm that has been setup. */
-            if (cctx->xoffSeqNum == ci->rxFlowSeqNum) {
-                if (++cctx->retries < XON_RETRIES) {
-                    /* Rearm the timer and resend the XON */
-                    cctx->xon[1] = htole32(ci->rxAck);
-                    cctx->xon[2] = htole32(ci->rxDrain);
-                    status = DeliverControlMsg(*ci, cctx->xon, sizeof(cctx->xon), ci->rxFlowSeqNum);
-                    if (status != ER_OK) {
-                        QCC_LogError(status, ("Failed to send XON"));
-                    }
-
-                    uint32_t nextTime = GetRetryMs(*ci, cctx->retries);
-                    uint32_t zero = 0;
-                    qcc::AlarmListener* packetEngineListener = this;
-                    ci->xOnAlarm = Alarm(nextTime, packetEngineListener, ctx, zero);
-                    status = timer.AddAlarm(ci->xOnAlarm);
-                    //printf("rx(%d): xon retry=%d rxD=0x%x, next=%d\n", (GetTimestamp() / 100) % 100000, cctx->retries + 1, ci->rxDrain, nextTime);
-                }
-            } else {
-                QCC_DbgPrintf(("PacketEngine: cid=0x%x Not retrying stale XON", ci->id));
-
-                /* Delete the context associated with the stale Xon alarm */
-                if (cctx) {
-                    delete cctx;
-                    cctx = NULL;
+        if (ci->xOnSeqNum == ci->rxFlowSeqNum) {
+            status = ER_FAIL;
+            if (++ci->xOnTimer.retries < XON_RETRIES) {
+                /* Rearm the timer and resend the XON */
+                ci->xOn[1] = htole32(ci->rxAck);
+                ci->xOn[2] = htole32(ci->rxDrain);
+                status = DeliverControlMsg(*ci, ci->xOn, sizeof(ci->xOn), ci->rxFlowSeqNum);
+                if (status != ER_OK) {
+                    QCC_LogError(status, ("Failed to send XON"));
                 }
 
+                uint32_t nextTime = GetRetryMs(*ci, ci->xOnTimer.retries);
+                ArmTimer(ci->xOnTimer, nextTime);
                 status = ER_OK;
+                //printf("rx(%d): xon retry=%d rxD=0x%x, next=%d\n", (GetTimestamp() / 100) % 100000, ci->xOnTimer.retries + 1, ci->rxDrain, nextTime);
             }
-
-            ci->rxLock.Unlock();
-            if (status != ER_OK) {
-                /* Retries exhauseted. */
-                QCC_DbgPrintf(("PacketEngine: cid=0x%x XON retries exhausted. Attempting graceful disconnect", ci->id));
-                CloseChannel(*ci);
-            }
-            ReleaseChannelInfo(*ci);
+        } else {
+            QCC_DbgPrintf(("PacketEngine: cid=0x%x Not retrying stale XON", ci->id));
+        }
+        ci->rxLock.Unlock();
+        if (status != ER_OK) {
+            /* Retries exhauseted. */
+            QCC_DbgPrintf(("PacketEngine: cid=0x%x XON retries exhausted. Attempting graceful disconnect", ci->id));
+            CloseChannel(*ci);
         }
         break;
     }
 
-    case AlarmContext::CONTEXT_DELAY_ACK:
+    case TIMER_DELAY_ACK:
     {
-        DelayAckAlarmContext* cctx = static_cast<DelayAckAlarmContext*>(ctx);
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
-        if (ci) {
-            ci->rxLock.Lock();
-            ci->isAckAlarmArmed = false;
+        ci->rxLock.Lock();
+        if (timerWheel.IsCurrent(ci->ackTimer, expiry.generation)) {
+            ci->ackTimer.active = false;
             SendAckNow(*ci, ci->rxAdvancedSeqNum);
-            ci->rxLock.Unlock();
-            ReleaseChannelInfo(*ci);
         }
+        ci->rxLock.Unlock();
         break;
     }
 
-    case AlarmContext::CONTEXT_CLOSING:
+    case TIMER_CLOSING:
     {
-        ClosingAlarmContext* cctx = static_cast<ClosingAlarmContext*>(ctx);
-        ChannelInfo* ci = AcquireChannelInfo(cctx->chanId);
-        if (ci) {
-            QCC_DbgPrintf(("PacketEngine::AlarmTriggered(CLOSING_CONTEXT): Closing id=0x%x", ci->id));
+        if (timerWheel.IsCurrent(ci->closingTimer, expiry.generation)) {
+            QCC_DbgPrintf(("PacketEngine::TimerExpired(TIMER_CLOSING): Closing id=0x%x", ci->id));
             ci->state = ChannelInfo::CLOSED;
-            ReleaseChannelInfo(*ci);
         }
         break;
     }
 
     default:
     {
-        uint32_t t = static_cast<uint32_t>(ctx->contextType);
-        QCC_LogError(ER_FAIL, ("Received AlarmContext with unknown type (%u)", t));
+        QCC_LogError(ER_FAIL, ("Received timer expiry with unknown type (%u)", expiry.type));
         break;
     }
     }
+    ReleaseChannelInfo(*ci);
 }
 
 PacketEngine::ChannelInfo::ChannelInfo(PacketEngine& engine, uint32_t id, const PacketDest& dest, PacketStream& packetStream,
@@ -563,13 +499,15 @@ PacketEngine::ChannelInfo::ChannelInfo(PacketEngine& engine, uint32_t id, const
     packetStream(packetStream),
     listener(listener),
     useCount(0),
-    connectReqAlarm(),
-    connectRspAlarm(),
-    disconnectReqAlarm(),
-    disconnectRspAlarm(),
-    xOnAlarm(),
-    ackAlarmContext(new DelayAckAlarmContext(id)),
-    isAckAlarmArmed(false),
+    connectReqTimer(id, TIMER_CONNECT_REQ),
+    connectContext(NULL),
+    connectRspTimer(id, TIMER_CONNECT_RSP),
+    disconnectReqTimer(id, TIMER_DISCONNECT_REQ),
+    disconnectRspTimer(id, TIMER_DISCONNECT_RSP),
+    xOnTimer(id, TIMER_XON),
+    xOnSeqNum(0),
+    ackTimer(id, TIMER_DELAY_ACK),
+    closingTimer(id, TIMER_CLOSING),
     rxFill(0),
     rxDrain(0),
     rxAck(0),
@@ -625,13 +563,15 @@ PacketEngine::ChannelInfo::ChannelInfo(const ChannelInfo& other) :
     packetStream(other.packetStream),
     listener(other.listener),
     useCount(other.useCount),
-    connectReqAlarm(other.connectReqAlarm),
-    connectRspAlarm(other.connectRspAlarm),
-    disconnectReqAlarm(other.disconnectReqAlarm),
-    disconnectRspAlarm(other.disconnectRspAlarm),
-    xOnAlarm(other.xOnAlarm),
-    ackAlarmContext(new DelayAckAlarmContext(other.id)),
-    isAckAlarmArmed(false),
+    connectReqTimer(other.connectReqTimer),
+    connectContext(other.connectContext),
+    connectRspTimer(other.connectRspTimer),
+    disconnectReqTimer(other.disconnectReqTimer),
+    disconnectRspTimer(other.disconnectRspTimer),
+    xOnTimer(other.xOnTimer),
+    xOnSeqNum(other.xOnSeqNum),
+    ackTimer(other.ackTimer),
+    closingTimer(other.closingTimer),
     rxFill(other.rxFill),
     rxDrain(other.rxDrain),
     rxAck(other.rxAck),
@@ -693,31 +633,13 @@ PacketEngine::ChannelInfo::~ChannelInfo()
         qcc::Sleep(5);
     }
 
-    AlarmContext* ac = static_cast<AlarmContext*>(connectReqAlarm->GetContext());
-    if (ac) {
-        engine.timer.RemoveAlarm(connectReqAlarm);
-        delete ac;
-    }
-    ac = static_cast<AlarmContext*>(connectRspAlarm->GetContext());
-    if (ac) {
-        engine.timer.RemoveAlarm(connectRspAlarm);
-        delete ac;
-    }
-    ac = static_cast<AlarmContext*>(disconnectReqAlarm->GetContext());
-    if (ac) {
-        engine.timer.RemoveAlarm(disconnectReqAlarm);
-        delete ac;
-    }
-    ac = static_cast<AlarmContext*>(disconnectRspAlarm->GetContext());
-    if (ac) {
-        engine.timer.RemoveAlarm(disconnectRspAlarm);
-        delete ac;
-    }
-    ac = static_cast<AlarmContext*>(xOnAlarm->GetContext());
-    if (ac) {
-        engine.timer.RemoveAlarm(xOnAlarm);
-        delete ac;
-    }
+    engine.timerWheel.Cancel(connectReqTimer);
+    engine.timerWheel.Cancel(connectRspTimer);
+    engine.timerWheel.Cancel(disconnectReqTimer);
+    engine.timerWheel.Cancel(disconnectRspTimer);
+    engine.timerWheel.Cancel(xOnTimer);
+    engine.timerWheel.Cancel(ackTimer);
+    engine.timerWheel.Cancel(closingTimer);
 
     txLock.Lock();
     while (!txControlQueue.empty()) {
@@ -726,7 +648,6 @@ PacketEngine::ChannelInfo::~ChannelInfo()
     }
     txLock.Unlock();
 
-    delete ackAlarmContext;
     delete[] rxPackets;
     delete[] txPackets;
     delete[] rxMask;
@@ -737,13 +658,15 @@ PacketEngine::ChannelInfo* PacketEngine::CreateChannelInfo(uint32_t chanId, cons
                                                            PacketEngineListener& listener, uint16_t windowSize)
 {
     ChannelInfo* ret = NULL;
-    channelInfoLock.Lock();
-    if (channelInfos.find(chanId) == channelInfos.end()) {
-        /* Make sure packetStream is still on the list while holding channelInfos lock */
+    ChannelShard& shard = GetChannelShard(chanId);
+    packetStreamLock.Lock();
+    shard.lock.Lock();
+    if (shard.channelInfos.find(chanId) == shard.channelInfos.end()) {
+        /* Make sure packetStream is still on the list while holding packetStreams lock */
         bool found = false;
-        map<Event*, pair<PacketStream*, PacketEngineListener*> >::iterator it = packetStreams.begin();
+        map<Event*, PacketStreamInfo>::iterator it = packetStreams.begin();
         while (it != packetStreams.end()) {
-            if (it->second.first == &packetStream) {
+            if (it->second.stream == &packetStream) {
                 found = true;
                 break;
             }
@@ -752,43 +675,57 @@ PacketEngine::ChannelInfo* PacketEngine::CreateChannelInfo(uint32_t chanId, cons
 
         /* Add ChannelInfo if packetStream was valid */
         if (found) {
-            ret = &(channelInfos.insert(pair<uint32_t, ChannelInfo>(chanId, ChannelInfo(*this, chanId, dest, packetStream, listener, windowSize))).first->second);
+            ret = &(shard.channelInfos.insert(pair<uint32_t, ChannelInfo>(chanId, ChannelInfo(*this, chanId, dest, packetStream, listener, windowSize))).first->second);
             ret->useCount = 1;
         }
     }
-    channelInfoLock.Unlock();
+    shard.lock.Unlock();
+    packetStreamLock.Unlock();
     return ret;
 }
 
 PacketEngine::ChannelInfo* PacketEngine::AcquireChannelInfo(uint32_t chanId)
 {
     ChannelInfo* ret = NULL;
-    channelInfoLock.Lock();
-    map<uint32_t, ChannelInfo>::iterator it = channelInfos.find(chanId);
-    if (it != channelInfos.end()) {
+    ChannelShard& shard = GetChannelShard(chanId);
+    shard.lock.Lock();
+    map<uint32_t, ChannelInfo>::iterator it = shard.channelInfos.find(chanId);
+    if (it != shard.channelInfos.end()) {
         ret = &(it->second);
         ret->useCount++;
     }
-    channelInfoLock.Unlock();
+    shard.lock.Unlock();
     return ret;
 }
 
 PacketEngine::ChannelInfo* PacketEngine::AcquireNextChannelInfo(PacketEngine::ChannelInfo* inCi)
+{
+    /* Walk the shards in order */
+    uint32_t shard = inCi ? (inCi->id % channelShards.size()) : 0;
+    ChannelInfo* ret = AcquireNextChannelInfo(shard, inCi);
+    while (!ret && (++shard < channelShards.size())) {
+        ret = AcquireNextChannelInfo(shard, NULL);
+    }
+    return ret;
+}
+
+PacketEngine::ChannelInfo* PacketEngine::AcquireNextChannelInfo(uint32_t shard, PacketEngine::ChannelInfo* inCi)
 {
     ChannelInfo* ret = NULL;
-    channelInfoLock.Lock();
-    map<uint32_t, ChannelInfo>::iterator it = channelInfos.begin();
+    ChannelShard& cs = *channelShards[shard];
+    cs.lock.Lock();
+    map<uint32_t, ChannelInfo>::iterator it = cs.channelInfos.begin();
     if (inCi) {
-        it = channelInfos.find(inCi->id);
-        if (it != channelInfos.end()) {
+        it = cs.channelInfos.find(inCi->id);
+        if (it != cs.channelInfos.end()) {
             ++it;
         }
     }
-    if (it != channelInfos.end()) {
+    if (it != cs.channelInfos.end()) {
         ret = &(it->second);
         ret->useCount++;
     }
-    channelInfoLock.Unlock();
+    cs.lock.Unlock();
     if (inCi) {
         ReleaseChannelInfo(*inCi);
     }
@@ -797,20 +734,21 @@ PacketEngine::ChannelInfo* PacketEngine::AcquireNextChannelInfo(PacketEngine::Ch
 
 void PacketEngine::ReleaseChannelInfo(ChannelInfo& ci)
 {
-    channelInfoLock.Lock();
+    ChannelShard& shard = GetChannelShard(ci.id);
+    shard.lock.Lock();
     if ((--ci.useCount == 0) && (ci.state == ChannelInfo::CLOSED)) {
         PacketEngineStream stream = ci.stream;
         PacketEngineListener& listener = ci.listener;
         PacketDest dest = ci.dest;
 
         /* Erase entry in channelInfos */
-        channelInfos.erase(ci.id);
+        shard.channelInfos.erase(ci.id);
 
-        /* Notify disconnect cb (Must be done without holding channelInfoLock) */
-        channelInfoLock.Unlock();
+        /* Notify disconnect cb (Must be done without holding the shard lock) */
+        shard.lock.Unlock();
         listener.PacketEngineDisconnectCB(*this, stream, dest);
     } else {
-        channelInfoLock.Unlock();
+        shard.lock.Unlock();
     }
 }
 
@@ -822,16 +760,9 @@ void PacketEngine::SendAck(ChannelInfo& ci, uint16_t seqNum, bool allowDelay)
     /* Decide between delayed and immediate ack */
     if ((ACK_DELAY_MS > 0) && allowDelay) {
         ci.rxLock.Lock();
-        if (!ci.isAckAlarmArmed) {
-            uint32_t zero = 0;
-            uint32_t timeout = ACK_DELAY_MS;
-            qcc::AlarmListener* packetEngineListener = this;
-            Alarm a(timeout, packetEngineListener, ci.ackAlarmContext, zero);
-            QStatus status = timer.AddAlarm(a);
-            ci.isAckAlarmArmed = (status == ER_OK);
-            if (status != ER_OK) {
-                QCC_LogError(status, ("SendAck failed to add alarm"));
-            }
+        if (!ci.ackTimer.active) {
+            ci.ackTimer.active = true;
+            ArmTimer(ci.ackTimer, ACK_DELAY_MS);
         }
         ci.rxLock.Unlock();
     } else {
@@ -869,32 +800,53 @@ uint32_t PacketEngine::GetRetryMs(const ChannelInfo& ci, uint32_t sendAttempt) c
 void PacketEngine::SendXOn(ChannelInfo& ci)
 {
     QCC_DbgTrace(("PacketEngine::SendXOn(chan=0x%x, rxFill=0x%x, rxDrain=0x%x, rxAck=0x%x, rxFlowSeqNum=0x%x)", ci.id, ci.rxFill, ci.rxDrain, ci.rxAck, ci.rxFlowSeqNum));
-    /* Create the XON context and message */
+    /* Create the XON message */
     //printf("rx(%d): xon rF=0x%x, rD=0x%x, rA=0x%x, flowSeq=0x%x\n", (GetTimestamp() / 100) % 100000, ci.rxFill, ci.rxDrain, ci.rxAck, ci.rxFlowSeqNum);
     ci.rxLock.Lock();
 
-    XOnAlarmContext* cctx = new XOnAlarmContext(ci.id, ci.rxFlowSeqNum);
-    cctx->xon[0] = htole32(PACKET_COMMAND_XON);
-    cctx->xon[1] = htole32(ci.rxAck);
-    cctx->xon[2] = htole32(ci.rxDrain);
-    uint32_t zero = 0;
-    uint32_t timeout = GetRetryMs(ci, ++cctx->retries);
-    qcc::AlarmListener* packetEngineListener = this;
-    ci.xOnAlarm = Alarm(timeout, packetEngineListener, cctx, zero);
-    QStatus status = timer.AddAlarm(ci.xOnAlarm);
-    if (status == ER_OK) {
-        status = DeliverControlMsg(ci, cctx->xon, sizeof(cctx->xon), ci.rxFlowSeqNum);
-    } else {
+    ci.xOn[0] = htole32(PACKET_COMMAND_XON);
+    ci.xOn[1] = htole32(ci.rxAck);
+    ci.xOn[2] = htole32(ci.rxDrain);
+    ci.xOnSeqNum = ci.rxFlowSeqNum;
+    ci.xOnTimer.retries = 1;
+    ArmTimer(ci.xOnTimer, GetRetryMs(ci, ci.xOnTimer.retries));
+    QStatus status = DeliverControlMsg(ci, ci.xOn, sizeof(ci.xOn), ci.rxFlowSeqNum);
+    if (status != ER_OK) {
         QCC_LogError(status, ("PacketEngine::SendXON failed"));
-        delete cctx;
-        ci.xOnAlarm = Alarm();
     }
 
     ci.rxLock.Unlock();
 }
 
-PacketEngine::RxPacketThread::RxPacketThread(const qcc::String& engineName) : Thread(engineName + "-rx"), engine(NULL)
+PacketEngine::RxPacketThread::RxPacketThread(const qcc::String& engineName, uint32_t index) :
+    Thread(engineName + "-rx" + U32ToString(index)), reloaded(false), engine(NULL), index(index)
+{
+    for (size_t i = 0; i < PACKET_BATCH_SIZE; ++i) {
+        rxPackets[i] = NULL;
+    }
+}
+
+void PacketEngine::RxPacketThread::Handoff(Packet** packets, size_t numPackets, Event* streamEvent)
+{
+    handoffLock.Lock();
+    for (size_t i = 0; i < numPackets; ++i) {
+        HandoffEntry entry;
+        entry.p = packets[i];
+        entry.streamEvent = streamEvent;
+        handoff.push_back(entry);
+    }
+    handoffLock.Unlock();
+    handoffEvent.SetEvent();
+}
+
+void PacketEngine::RxPacketThread::ReturnHandoff()
 {
+    handoffLock.Lock();
+    for (size_t i = 0; i < handoff.size(); ++i) {
+        engine->pool.ReturnPacket(handoff[i].p);
+    }
+    handoff.clear();
+    handoffLock.Unlock();
 }
 
 qcc::ThreadReturn STDCALL PacketEngine::RxPacketThread::Run(void* arg)
@@ -907,54 +859,156 @@ qcc::ThreadReturn STDCALL PacketEngine::RxPacketThread::Run(void* arg)
         checkEvents.clear();
         sigEvents.clear();
         checkEvents.push_back(&stopEvent);
-        engine->rxPacketThreadReload = true;
-        engine->channelInfoLock.Lock();
-        map<Event*, pair<PacketStream*, PacketEngineListener*> >::iterator sit = engine->packetStreams.begin();
+        checkEvents.push_back(&handoffEvent);
+        reloaded = true;
+        engine->packetStreamLock.Lock();
+        map<Event*, PacketStreamInfo>::iterator sit = engine->packetStreams.begin();
         while (sit != engine->packetStreams.end()) {
-            checkEvents.push_back(sit->first);
+            if (sit->second.puller == index) {
+                checkEvents.push_back(sit->first);
+            }
             sit++;
         }
-        engine->channelInfoLock.Unlock();
+        engine->packetStreamLock.Unlock();
         status = Event::Wait(checkEvents, sigEvents, Event::WAIT_FOREVER);
         if (status == ER_OK) {
             while (!sigEvents.empty()) {
-                engine->channelInfoLock.Lock();
-                map<Event*, pair<PacketStream*, PacketEngineListener*> >::const_iterator it = engine->packetStreams.find(sigEvents.back());
-                if (it != engine->packetStreams.end()) {
-                    PacketStream& stream = *(it->second.first);
-                    PacketEngineListener& listener = *(it->second.second);
-                    Packet* p = engine->pool.GetPacket();
-                    status = p->Unmarshal(stream);
-                    engine->channelInfoLock.Unlock();
-                    if (status == ER_OK) {
-                        /* Handle control or data packet */
-                        if (p->flags & PACKET_FLAG_CONTROL) {
-                            HandleControlPacket(p, stream, listener);
-                        } else {
-                            HandleDataPacket(p);
-                        }
-                    } else {
-                        /* Failed to unmarshal a single packet. This is not fatal */
-                        QCC_DbgPrintf(("Packet::Unmarshal failed with %s", QCC_StatusText(status)));
-                        engine->pool.ReturnPacket(p);
-                        status = ER_OK;
-                    }
+                Event* sigEvent = sigEvents.back();
+                sigEvents.pop_back();
+                if (sigEvent == &stopEvent) {
+                    stopEvent.ResetEvent();
+                } else if (sigEvent == &handoffEvent) {
+                    HandleHandoff();
                 } else {
-                    engine->channelInfoLock.Unlock();
-                    if (sigEvents.back() == &stopEvent) {
-                        GetStopEvent().ResetEvent();
-                    }
+                    PullPackets(sigEvent);
                 }
-                sigEvents.pop_back();
             }
         }
     }
+    for (size_t i = 0; i < PACKET_BATCH_SIZE; ++i) {
+        if (rxPackets[i]) {
+            engine->pool.ReturnPacket(rxPackets[i]);
+            rxPackets[i] = NULL;
+        }
+    }
+    ReturnHandoff();
     if (status != ER_STOPPING_THREAD) {
         QCC_DbgPrintf(("RxPacketThread::Run() exiting with %s", QCC_StatusText(status)));
     }
     return (qcc::ThreadReturn) status;
 }
 
+void PacketEngine::RxPacketThread::PullPackets(Event* streamEvent)
+{
+    engine->packetStreamLock.Lock();
+    map<Event*, PacketStreamInfo>::const_iterator it = engine->packetStreams.find(streamEvent);
+    if (it == engine->packetStreams.end()) {
+        engine->packetStreamLock.Unlock();
+        return;
+    }
+    PacketStreamInfo info = it->second;
+    engine->packetStreamLock.Unlock();
+
+    /* Pull as many queued packets as there are reserved packets */
+    PacketBatchEntry batch[PACKET_BATCH_SIZE];
+    size_t numReserved = 0;
+    while (numReserved < PACKET_BATCH_SIZE) {
+        if (!rxPackets[numReserved]) {
+            rxPackets[numReserved] = engine->pool.GetPacket();
+            if (!rxPackets[numReserved]) {
+                /* Pull a smaller batch when packets run out */
+                break;
+            }
+        }
+        batch[numReserved].buf = rxPackets[numReserved]->buffer;
+        batch[numReserved].bufSize = engine->pool.GetMTU();
+        ++numReserved;
+    }
+    if (numReserved == 0) {
+        QCC_LogError(ER_OUT_OF_MEMORY, ("No packets available to pull into"));
+        return;
+    }
+
+    size_t numPulled = 0;
+    QStatus status = info.stream->PullPacketBatch(batch, numReserved, numPulled, 3000);
+    if ((status != ER_OK) && (status != ER_WOULDBLOCK)) {
+        /* Failing to pull is not fatal */
+        QCC_DbgPrintf(("PacketStream::PullPacketBatch failed with %s", QCC_StatusText(status)));
+    }
+
+    /* Handle the packets for this thread's shard and hand off the rest */
+    Packet* others[PACKET_BATCH_SIZE];
+    size_t numOthers = 0;
+    for (size_t i = 0; i < numPulled; ++i) {
+        Packet* p = rxPackets[i];
+        rxPackets[i] = NULL;
+        QStatus unmarshalStatus = p->Unmarshal(batch[i].dest, batch[i].numBytes);
+        if (unmarshalStatus != ER_OK) {
+            /* Failed to unmarshal a single packet. This is not fatal */
+            QCC_DbgPrintf(("Packet::Unmarshal failed with %s", QCC_StatusText(unmarshalStatus)));
+            engine->pool.ReturnPacket(p);
+        } else if (&engine->GetRxPacketThread(p->chanId) == this) {
+            HandlePacket(p, *info.stream, *info.listener);
+        } else {
+            others[numOthers++] = p;
+        }
+    }
+    while (numOthers > 0) {
+        /* Hand off the packets for one rx thread at a time keeping them in order */
+        RxPacketThread& rxThread = engine->GetRxPacketThread(others[0]->chanId);
+        Packet* mine[PACKET_BATCH_SIZE];
+        size_t numMine = 0;
+        size_t numLeft = 0;
+        for (size_t i = 0; i < numOthers; ++i) {
+            if (&engine->GetRxPacketThread(others[i]->chanId) == &rxThread) {
+                mine[numMine++] = others[i];
+            } else {
+                others[numLeft++] = others[i];
+            }
+        }
+        rxThread.Handoff(mine, numMine, streamEvent);
+        numOthers = numLeft;
+    }
+}
+
+void PacketEngine::RxPacketThread::HandleHandoff()
+{
+    vector<HandoffEntry> entries;
+    handoffLock.Lock();
+    entries.swap(handoff);
+    handoffEvent.ResetEvent();
+    handoffLock.Unlock();
+
+    /*
+     * The stream may have been removed after the packets were pulled. Holding packetStreamLock
+     * while looking it up is enough because RemovePacketStream waits for this thread to reload
+     * before the stream goes away.
+     */
+    for (size_t i = 0; i < entries.size(); ++i) {
+        engine->packetStreamLock.Lock();
+        map<Event*, PacketStreamInfo>::const_iterator it = engine->packetStreams.find(entries[i].streamEvent);
+        bool found = (it != engine->packetStreams.end());
+        PacketStreamInfo info;
+        if (found) {
+            info = it->second;
+        }
+        engine->packetStreamLock.Unlock();
+        if (found) {
+            HandlePacket(entries[i].p, *info.stream, *info.listener);
+        } else {
+            engine->pool.ReturnPacket(entries[i].p);
+        }
+    }
+}
+
+void PacketEngine::RxPacketThread::HandlePacket(Packet* p, PacketStream& packetStream, PacketEngineListener& listener)
+{
+    if (p->flags & PACKET_FLAG_CONTROL) {
+        HandleControlPacket(p, packetStream, listener);
+    } else {
+        HandleDataPacket(p);
+    }
+}
 void PacketEngine::RxPacketThread::HandleControlPacket(Packet* p, PacketStream& packetStream, PacketEngineListener& listener)
 {
     uint32_t cmd = letoh32(p->payload[0]);
@@ -1170,31 +1224,22 @@ void PacketEngine::RxPacketThread::HandleConnectReq(Packet* p, PacketStream& pac
         ci->protocolVersion = ::min(reqProtoVersion, (uint32_t)PACKET_ENGINE_VERSION);
 
         /* Create the connect response */
-        ConnectRspAlarmContext* cctx = new ConnectRspAlarmContext(ci->id, ci->dest);
-        cctx->connRsp[0] = htole32(PACKET_COMMAND_CONNECT_RSP);
-        cctx->connRsp[1] = htole32(ci->protocolVersion);
-        cctx->connRsp[2] = htole32(accepted ? ER_OK : ER_BUS_CONNECTION_REJECTED);
-        cctx->connRsp[3] = htole32(ci->windowSize);
-
-        /* Put an entry on the callback timer */
-        uint32_t timeout = CONNECT_RETRY_TIMEOUT;
-        uint32_t zero = 0;
-        ci->connectRspAlarm = Alarm(timeout, engine, cctx, zero);
-        QStatus status = engine->timer.AddAlarm(ci->connectRspAlarm);
+        ci->connRsp[0] = htole32(PACKET_COMMAND_CONNECT_RSP);
+        ci->connRsp[1] = htole32(ci->protocolVersion);
+        ci->connRsp[2] = htole32(accepted ? ER_OK : ER_BUS_CONNECTION_REJECTED);
+        ci->connRsp[3] = htole32(ci->windowSize);
 
-        if (status == ER_OK) {
-            ci->state = ChannelInfo::OPENING;
-            status = engine->DeliverControlMsg(*ci, cctx->connRsp, sizeof(cctx->connRsp));
-            if (status != ER_OK) {
-                QCC_LogError(status, ("Failed to send ConnectRsp to %s", engine->ToString(ci->packetStream, p->GetSender()).c_str()));
-            }
-            if (!accepted) {
-                ci->state = ChannelInfo::CLOSING;
-            }
-        } else {
-            /* Failed to add alarm */
-            QCC_LogError(status, ("AddAlarm failed"));
-            ci->state = ChannelInfo::CLOSED;
+        /* Arm the retry timer */
+        ci->connectRspTimer.active = true;
+        engine->ArmTimer(ci->connectRspTimer, CONNECT_RETRY_TIMEOUT);
+
+        ci->state = ChannelInfo::OPENING;
+        QStatus status = engine->DeliverControlMsg(*ci, ci->connRsp, sizeof(ci->connRsp));
+        if (status != ER_OK) {
+            QCC_LogError(status, ("Failed to send ConnectRsp to %s", engine->ToString(ci->packetStream, p->GetSender()).c_str()));
+        }
+        if (!accepted) {
+            ci->state = ChannelInfo::CLOSING;
         }
         engine->ReleaseChannelInfo(*ci);
     }
@@ -1212,10 +1257,9 @@ void PacketEngine::RxPacketThread::HandleConnectRsp(Packet* p)
     ChannelInfo* ci = engine->AcquireChannelInfo(p->chanId);
     QCC_DbgTrace(("PacketEngine::HandleConnectRsp(%s)", ci ? engine->ToString(ci->packetStream, p->GetSender()).c_str() : ""));
     if (ci) {
-        ConnectReqAlarmContext* ctx = static_cast<ConnectReqAlarmContext*>(ci->connectReqAlarm->GetContext());
-        if (ctx) {
-            /* Disable any connectReqAlarm retry timer */
-            engine->timer.RemoveAlarm(ci->connectReqAlarm);
+        if (ci->connectReqTimer.active) {
+            /* Disable any connectReqTimer retries */
+            engine->timerWheel.Cancel(ci->connectReqTimer);
 
             /* Call user callback (once) */
             if (ci->state == ChannelInfo::OPENING) {
@@ -1234,14 +1278,12 @@ void PacketEngine::RxPacketThread::HandleConnectRsp(Packet* p)
                 ci->state = (rspStatus == ER_OK) ? ChannelInfo::OPEN : ChannelInfo::CLOSING;
                 ci->windowSize = reqWindowSize;
                 ci->wasOpen = (ci->state == ChannelInfo::OPEN);
-                ci->listener.PacketEngineConnectCB(*engine, rspStatus, &ci->stream, ci->dest, ctx->context);
+                ci->listener.PacketEngineConnectCB(*engine, rspStatus, &ci->stream, ci->dest, ci->connectContext);
 
                 /* Arm the close timer if needed */
-                if (ci->state == ChannelInfo::CLOSING && !ci->closingAlarmContext) {
-                    ci->closingAlarmContext = new ClosingAlarmContext(ci->id);
-                    uint32_t timeout = CLOSING_TIMEOUT;
-                    uint32_t zero = 0;
-                    engine->timer.AddAlarm(Alarm(timeout, engine, ci->closingAlarmContext, zero));
+                if (ci->state == ChannelInfo::CLOSING && !ci->closingTimer.active) {
+                    ci->closingTimer.active = true;
+                    engine->ArmTimer(ci->closingTimer, CLOSING_TIMEOUT);
                 }
             } else if ((ci->state != ChannelInfo::OPEN) && (ci->state != ChannelInfo::CLOSING)) {
                 /* Only allow retry of ack if state OPEN or CLOSING */
@@ -1268,13 +1310,11 @@ void PacketEngine::RxPacketThread::HandleConnectRspAck(Packet* p)
 
     /* Channel for this connectRsp should already exist and should be in OPENING state */
     ChannelInfo* ci = engine->AcquireChannelInfo(p->chanId);
-    ConnectRspAlarmContext* ctx = static_cast<ConnectRspAlarmContext*>(ci ? ci->connectRspAlarm->GetContext() : NULL);
     QCC_DbgTrace(("PacketEngine::HandleConnectRspAck(%s)", ci ? engine->ToString(ci->packetStream, p->GetSender()).c_str() : ""));
-    if (ci && ctx) {
-        /* Disable any connect(Rsp)Alarm retry timer */
-        engine->timer.RemoveAlarm(ci->connectRspAlarm);
-        ci->connectRspAlarm = Alarm();
-        delete ctx;
+    if (ci && ci->connectRspTimer.active) {
+        /* Disable any connectRspTimer retries */
+        engine->timerWheel.Cancel(ci->connectRspTimer);
+        ci->connectRspTimer.active = false;
         if (ci->state == ChannelInfo::OPENING) {
             ci->state = ChannelInfo::OPEN;
         }
@@ -1288,19 +1328,15 @@ void PacketEngine::RxPacketThread::HandleDisconnectReq(Packet* p)
 {
     ChannelInfo* ci = engine->AcquireChannelInfo(p->chanId);
     if (ci) {
-        /* Create disconnect response context if necessary */
-        DisconnectRspAlarmContext* ctx = static_cast<DisconnectRspAlarmContext*>(ci->disconnectRspAlarm->GetContext());
-        if (!ctx) {
-            ctx = new DisconnectRspAlarmContext(ci->id);
-            ctx->disconnRsp[0] = htole32(PACKET_COMMAND_DISCONNECT_RSP);
-            uint32_t timeout = DISCONNECT_TIMEOUT;
-            uint32_t zero = 0;
-            ci->disconnectRspAlarm = Alarm(timeout, engine, ctx, zero);
-            engine->timer.AddAlarm(ci->disconnectRspAlarm);
+        /* Create disconnect response if necessary */
+        if (!ci->disconnectRspTimer.active) {
+            ci->disconnectRspTimer.active = true;
+            ci->disconnRsp[0] = htole32(PACKET_COMMAND_DISCONNECT_RSP);
+            engine->ArmTimer(ci->disconnectRspTimer, DISCONNECT_TIMEOUT);
             ci->state = ChannelInfo::CLOSING;
         }
         /* Send disconnect response */
-        QStatus status = engine->DeliverControlMsg(*ci, ctx->disconnRsp, sizeof(ctx->disconnRsp));
+        QStatus status = engine->DeliverControlMsg(*ci, ci->disconnRsp, sizeof(ci->disconnRsp));
         if (status != ER_OK) {
             QCC_LogError(status, ("Failed to send DisconnectReq to %s", engine->ToString(ci->packetStream, p->GetSender()).c_str()));
         }
@@ -1311,12 +1347,10 @@ void PacketEngine::RxPacketThread::HandleDisconnectReq(Packet* p)
 void PacketEngine::RxPacketThread::HandleDisconnectRsp(Packet* p)
 {
     ChannelInfo* ci = engine->AcquireChannelInfo(p->chanId);
-    DisconnectReqAlarmContext* ctx = static_cast<DisconnectReqAlarmContext*>(ci ? ci->disconnectReqAlarm->GetContext() : NULL);
-    if (ci && ctx) {
+    if (ci && ci->disconnectReqTimer.active) {
         /* Ignore disconnect rsp that has already timed out */
-        engine->timer.RemoveAlarm(ci->disconnectReqAlarm);
-        ci->disconnectReqAlarm = Alarm();
-        delete ctx;
+        engine->timerWheel.Cancel(ci->disconnectReqTimer);
+        ci->disconnectReqTimer.active = false;
         QCC_DbgPrintf(("PacketEngine::HandleDisconnectRsp: Closing id=0x%x", ci->id));
         ci->state = ChannelInfo::CLOSED;
     }
@@ -1426,7 +1460,7 @@ void PacketEngine::RxPacketThread::HandleAck(Packet* controlPacket)
                 }
                 ackedPackets--;
             }
-            engine->txPacketThread.Alert();
+            engine->AlertTx(*ci);
         } else {
             QCC_DbgPrintf(("Invalid ack window: seqNum=0x%x, drain=0x%x, ack=0x%x", controlPacket->seqNum, ci->remoteRxDrain, remoteRxAck));
         }
@@ -1482,7 +1516,7 @@ void PacketEngine::RxPacketThread::HandleXOn(Packet* controlPacket)
             }
 
             ci->txLock.Unlock();
-            engine->txPacketThread.Alert();
+            engine->AlertTx(*ci);
         } else {
             ci->txLock.Unlock();
         }
@@ -1506,25 +1540,42 @@ void PacketEngine::RxPacketThread::HandleXOnAck(Packet* controlPacket)
     if (ci) {
         ci->rxLock.Lock();
         QCC_DbgTrace(("PacketEngine::HandleXOnAck(ci->rxFlowSeqNum=0x%x) (controlPacket->seqNum=0x%x)", ci->rxFlowSeqNum, controlPacket->seqNum));
-        /* Remove the Xon alarm only if the received XonAck is in response to the latest
-         * Xon packet for which the alarm was initialized. We also need to account for back
+        /* Cancel the Xon timer only if the received XonAck is in response to the latest
+         * Xon packet for which the timer was armed. We also need to account for back
          * compatibility with previous versions of PacketEngine. So we should still handle
          * the case when controlPacket->seqNum==0 the same way as before */
         if ((ci->rxFlowSeqNum == controlPacket->seqNum) || (controlPacket->seqNum == 0)) {
-            XOnAlarmContext* cctx = static_cast<XOnAlarmContext*>(ci->xOnAlarm->GetContext());
-            if (cctx) {
-                engine->timer.RemoveAlarm(ci->xOnAlarm);
-                ci->xOnAlarm = Alarm();
-                delete cctx;
-            }
+            engine->timerWheel.Cancel(ci->xOnTimer);
         }
         ci->rxLock.Unlock();
         engine->ReleaseChannelInfo(*ci);
     }
 }
 
-PacketEngine::TxPacketThread::TxPacketThread(const qcc::String& engineName) : Thread(engineName + "-tx"), engine(NULL)
+PacketEngine::TxPacketThread::TxPacketThread(const qcc::String& engineName, uint32_t shard) :
+    Thread(engineName + "-tx" + U32ToString(shard)), engine(NULL), shard(shard), batchCount(0)
+{
+}
+
+QStatus PacketEngine::TxPacketThread::FlushTxBatch(ChannelInfo& ci, uint32_t& waitMs)
 {
+    size_t numPushed = 0;
+    QStatus status = (batchCount > 0) ? ci.packetStream.PushPacketBatch(batchEntries, batchCount, numPushed) : ER_OK;
+    uint64_t now = GetTimestamp64();
+    for (size_t i = 0; i < numPushed; ++i) {
+        Packet* p = batchPackets[i];
+        QCC_DbgPrintf(("TxPacketThread sent seqNum=0x%x to %s (try=%d, gap=%d)", p->seqNum, engine->ToString(ci.packetStream, ci.dest).c_str(), p->sendAttempts, p->gap));
+        /* Update sendTs and update (next) wait time */
+        p->sendTs = now;
+        waitMs = ::min(waitMs, engine->GetRetryMs(ci, p->sendAttempts));
+    }
+    batchCount = 0;
+    if (status != ER_OK) {
+        /* Close this channel */
+        QCC_LogError(status, ("TxPacketThread: PushPacketBatch(%s) failed. Closing channel", engine->ToString(ci.packetStream, ci.dest).c_str()));
+        ci.state = ChannelInfo::CLOSED;
+    }
+    return status;
 }
 
 qcc::ThreadReturn STDCALL PacketEngine::TxPacketThread::Run(void* arg)
@@ -1546,24 +1597,35 @@ qcc::ThreadReturn STDCALL PacketEngine::TxPacketThread::Run(void* arg)
         }
         waitMs = Event::WAIT_FOREVER;
         if (!IsStopping() && (status == ER_OK)) {
-            /* Iterate over tx queue and send, resend or expire */
+            /* Iterate over the tx queues of this thread's channels and send, resend or expire */
             ChannelInfo* ci = NULL;
-            while ((ci = engine->AcquireNextChannelInfo(ci)) != NULL) {
+            while ((ci = engine->AcquireNextChannelInfo(shard, ci)) != NULL) {
                 ci->txLock.Lock();
-                /* Send all control messages */
-                while (!ci->txControlQueue.empty()) {
-                    Packet* p = ci->txControlQueue.front();
-                    ci->txControlQueue.pop_front();
-                    p->Marshal();
-                    status = ci->packetStream.PushPacketBytes(p->buffer, p->payloadLen + Packet::payloadOffset, ci->dest);
-                    /* Closedown if control message was a disconnectRsp */
-                    if (letoh32(p->payload[0]) == PACKET_COMMAND_DISCONNECT_RSP) {
-                        QCC_DbgPrintf(("PacketEngine::TxThread: Send DisconnectRsp. Closing id=0x%x", ci->id));
-                        ci->state = ChannelInfo::CLOSED;
-                        engine->pool.ReturnPacket(p);
-                        break;
+                /* Send all control messages a batch at a time */
+                bool disconnectRspSent = false;
+                while (!ci->txControlQueue.empty() && !disconnectRspSent) {
+                    while (!ci->txControlQueue.empty() && (batchCount < PACKET_BATCH_SIZE) && !disconnectRspSent) {
+                        Packet* p = ci->txControlQueue.front();
+                        ci->txControlQueue.pop_front();
+                        p->Marshal();
+                        batchPackets[batchCount] = p;
+                        batchEntries[batchCount].buf = p->buffer;
+                        batchEntries[batchCount].numBytes = p->payloadLen + Packet::payloadOffset;
+                        batchEntries[batchCount].dest = ci->dest;
+                        ++batchCount;
+                        disconnectRspSent = (letoh32(p->payload[0]) == PACKET_COMMAND_DISCONNECT_RSP);
                     }
-                    engine->pool.ReturnPacket(p);
+                    size_t numPushed = 0;
+                    status = ci->packetStream.PushPacketBatch(batchEntries, batchCount, numPushed);
+                    for (size_t i = 0; i < batchCount; ++i) {
+                        engine->pool.ReturnPacket(batchPackets[i]);
+                    }
+                    batchCount = 0;
+                }
+                /* Closedown if control message was a disconnectRsp */
+                if (disconnectRspSent) {
+                    QCC_DbgPrintf(("PacketEngine::TxThread: Send DisconnectRsp. Closing id=0x%x", ci->id));
+                    ci->state = ChannelInfo::CLOSED;
                 }
                 /* Walk from [txDrain, min(txFill,congestion_window,remoteRxDrain+window)) and (re)send any user packets */
                 if (ci && ci->state == ChannelInfo::OPEN) {
@@ -1616,18 +1678,12 @@ qcc::ThreadReturn STDCALL PacketEngine::TxPacketThread::Run(void* arg)
                                     if (needMarshal) {
                                         p->Marshal();
                                     }
-                                    status = ci->packetStream.PushPacketBytes(p->buffer, p->payloadLen + Packet::payloadOffset, ci->dest);
-                                    //printf("tx(%d): s=0x%x, len=%d, gap=%d, retry=%d txFill=0x%x, txDrain=0x%x, drain=0x%x, retryMs=%d, actMs=%d, xoff=%s\n", (GetTimestamp() / 100) % 100000, p->seqNum, (int) p->payloadLen, p->gap, p->sendAttempts, ci->txFill, ci->txDrain, drain, retryMs, (int) (now - p->sendTs), (p->flags & PACKET_FLAG_FLOW_OFF) ? "off" : "nc");
-                                    QCC_DbgPrintf(("TxPacketThread sent seqNum=0x%x to %s (try=%d, gap=%d, drain=0x%x) %s", p->seqNum, engine->ToString(ci->packetStream, ci->dest).c_str(), p->sendAttempts, p->gap, drain, QCC_StatusText(status)));
-                                    if (status == ER_OK) {
-                                        /* Update sendTs and update (next) wait time */
-                                        p->sendTs = GetTimestamp64();
-                                        waitMs = ::min(waitMs, engine->GetRetryMs(*ci, p->sendAttempts));
-                                    } else {
-                                        /* Return packet and close this channel */
-                                        QCC_LogError(status, ("TxPacketThread: PushPacketBytes(%s) failed. Closing channel", engine->ToString(ci->packetStream, ci->dest).c_str()));
-                                        ci->state = ChannelInfo::CLOSED;
-                                        status = ER_OK;
+                                    /* Queue the packet and push it when the batch is full or the walk is done */
+                                    batchPackets[batchCount] = p;
+                                    batchEntries[batchCount].buf = p->buffer;
+                                    batchEntries[batchCount].numBytes = p->payloadLen + Packet::payloadOffset;
+                                    batchEntries[batchCount].dest = ci->dest;
+                                    if ((++batchCount == PACKET_BATCH_SIZE) && (FlushTxBatch(*ci, waitMs) != ER_OK)) {
                                         break;
                                     }
                                     /* Adjust congestion window down (by factor of 2) if this was a retry */
@@ -1650,6 +1706,7 @@ qcc::ThreadReturn STDCALL PacketEngine::TxPacketThread::Run(void* arg)
                         }
                         ++drain;
                     }
+                    FlushTxBatch(*ci, waitMs);
                     //printf("tx(%d): while exited d=0x%x, tD=0x%x, tF=0x%x, rrD=0x%x, nep=%d, cw=%d\n", (GetTimestamp() / 100) % 100000, drain, ci->txDrain, ci->txFill, ci->remoteRxDrain, nonExpiredPackets, ci->txCongestionWindow);
                 }
                 ci->txLock.Unlock();
@@ -1662,19 +1719,45 @@ qcc::ThreadReturn STDCALL PacketEngine::TxPacketThread::Run(void* arg)
     return (qcc::ThreadReturn) 0;
 }
 
+PacketEngine::TimerThread::TimerThread(const qcc::String& engineName) : Thread(engineName + "-timer"), engine(NULL)
+{
+}
+
+qcc::ThreadReturn STDCALL PacketEngine::TimerThread::Run(void* arg)
+{
+    engine = reinterpret_cast<PacketEngine*>(arg);
+    while (!IsStopping()) {
+        /* Collect everything that has expired then handle it without holding the wheel lock */
+        expired.clear();
+        uint32_t waitMs = engine->timerWheel.Advance(expired);
+        for (size_t i = 0; (i < expired.size()) && !IsStopping(); ++i) {
+            engine->TimerExpired(expired[i]);
+        }
+        if (expired.empty() && (waitMs > 0)) {
+            Event evt(waitMs);
+            QStatus status = Event::Wait(evt);
+            if (status == ER_ALERTED_THREAD) {
+                GetStopEvent().ResetEvent();
+            }
+        }
+    }
+    return (qcc::ThreadReturn) 0;
+}
+
 PacketStream* PacketEngine::GetPacketStream(const PacketEngineStream& stream)
 {
     PacketStream* ret = NULL;
-    channelInfoLock.Lock();
-    map<uint32_t, ChannelInfo>::iterator it = channelInfos.begin();
-    while (it != channelInfos.end()) {
+    ChannelShard& shard = GetChannelShard(stream.GetChannelId());
+    shard.lock.Lock();
+    map<uint32_t, ChannelInfo>::iterator it = shard.channelInfos.begin();
+    while (it != shard.channelInfos.end()) {
         if (&(it->second.stream) == &stream) {
             ret = &(it->second.packetStream);
             break;
         }
         ++it;
     }
-    channelInfoLock.Unlock();
+    shard.lock.Unlock();
     return ret;
 }
 
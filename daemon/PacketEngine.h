@@ -24,16 +24,17 @@
 #include <qcc/platform.h>
 #include <map>
 #include <deque>
+#include <vector>
 
 #include <qcc/Stream.h>
 #include <qcc/SocketStream.h>
 #include <qcc/Mutex.h>
 #include <qcc/Thread.h>
-#include <qcc/Timer.h>
 #include <qcc/Event.h>
 #include "Packet.h"
 #include "PacketStream.h"
 #include "PacketPool.h"
+#include "PacketTimerWheel.h"
 #include "PacketEngineStream.h"
 
 /**
@@ -57,13 +58,12 @@
 #define ACK_DELAY_MS              10         /**<  Ms of delay before sending acks */
 #define XON_THRESHOLD             4          /**<  Min number of empty slots in rx buffer necessary to send XON */
 #define CLOSING_TIMEOUT           4000       /**< Max num of ms to wait for channel to stay in CLOSING state before being forced to CLOSED */
+#define PACKET_BATCH_SIZE         16         /**< Max number of packets moved by one batched pull or push */
 
 namespace ajn {
 
 /* Forward Declaration */
 class PacketEngine;
-struct DelayAckAlarmContext;
-struct ClosingAlarmContext;
 
 /**
  * PacketEngineListener provides connect/accept/disconnect event information to PacketEngine users.
@@ -83,11 +83,34 @@ class PacketEngineListener {
  * PacketEngine converts qcc:Streams to packets suitable for sending over UDP or other
  * packet oriented comm transports.
  */
-class PacketEngine : public qcc::AlarmListener {
+class PacketEngine {
 
     friend class PacketEngineStream;
 
   private:
+    /** Channel timers. Used as the timer type in PacketTimerWheel expiry records */
+    enum TimerType {
+        TIMER_CONNECT_REQ,
+        TIMER_CONNECT_RSP,
+        TIMER_DISCONNECT_REQ,
+        TIMER_DISCONNECT_RSP,
+        TIMER_XON,
+        TIMER_DELAY_ACK,
+        TIMER_CLOSING
+    };
+
+    /**
+     * A channel timer.
+     * active is set while the exchange the timer belongs to is in progress, which may be
+     * longer than the timer is armed.
+     */
+    struct ChannelTimer : public PacketTimerWheel::Timer {
+        bool active;
+        uint32_t retries;
+
+        ChannelTimer(uint32_t chanId, TimerType type) : PacketTimerWheel::Timer(chanId, type), active(false), retries(0) { }
+    };
+
     struct ChannelInfo {
 
         enum State {
@@ -124,14 +147,20 @@ class PacketEngine : public qcc::AlarmListener {
         PacketStream& packetStream;
         PacketEngineListener& listener;
         int useCount;
-        qcc::Alarm connectReqAlarm;
-        qcc::Alarm connectRspAlarm;
-        qcc::Alarm disconnectReqAlarm;
-        qcc::Alarm disconnectRspAlarm;
-        qcc::Alarm xOnAlarm;
-        DelayAckAlarmContext* ackAlarmContext;
-        ClosingAlarmContext* closingAlarmContext;
-        bool isAckAlarmArmed;
+        ChannelTimer connectReqTimer;
+        uint32_t connReq[3];
+        void* connectContext;
+        ChannelTimer connectRspTimer;
+        uint32_t connRsp[4];
+        ChannelTimer disconnectReqTimer;
+        uint32_t disconnReq[1];
+        ChannelTimer disconnectRspTimer;
+        uint32_t disconnRsp[1];
+        ChannelTimer xOnTimer;
+        uint32_t xOn[3];
+        uint16_t xOnSeqNum;
+        ChannelTimer ackTimer;
+        ChannelTimer closingTimer;
 
         Packet**   rxPackets;
         uint16_t rxFill, rxDrain, rxAck;
@@ -168,16 +197,70 @@ class PacketEngine : public qcc::AlarmListener {
         ChannelInfo& operator=(const ChannelInfo& other);
     };
 
+    /**
+     * A shard of the channel table. Channels are assigned to shards by channel id and each
+     * shard is serviced by its own RxPacketThread and TxPacketThread.
+     */
+    struct ChannelShard {
+        qcc::Mutex lock;
+        std::map<uint32_t, ChannelInfo> channelInfos;
+    };
+
+    /**
+     * A registered PacketStream. Each stream is waited on and pulled from by a single rx thread
+     * so a packet arriving on a stream only wakes one thread.
+     */
+    struct PacketStreamInfo {
+        PacketStream* stream;
+        PacketEngineListener* listener;
+        uint32_t puller;    /**< Index of the rx thread that pulls from the stream */
+    };
+
+    /**
+     * The PacketStreams are spread over the rx threads and each is pulled from by one of them.
+     * Packets are handled by the rx thread with the same index as the channel's shard so the
+     * packets of a channel are only ever handled by one thread. Packets for other shards are
+     * handed off to the rx thread of that shard.
+     */
     class RxPacketThread : public qcc::Thread {
       public:
-        RxPacketThread(const qcc::String& engineName);
+        RxPacketThread(const qcc::String& engineName, uint32_t index);
+
+        bool reloaded;    /**< Set each time the thread reloads the list of packetStreams */
+
+        /**
+         * Queue packets pulled by another rx thread for this thread to handle.
+         *
+         * @param packets      The packets.
+         * @param numPackets   Number of packets.
+         * @param streamEvent  Source event of the PacketStream the packets were pulled from.
+         */
+        void Handoff(Packet** packets, size_t numPackets, qcc::Event* streamEvent);
+
+        /**
+         * Return packets that were handed off but never handled to the packet pool.
+         */
+        void ReturnHandoff();
 
       protected:
         qcc::ThreadReturn STDCALL Run(void* arg);
 
       private:
-        PacketEngine* engine;
+        struct HandoffEntry {
+            Packet* p;
+            qcc::Event* streamEvent;
+        };
 
+        PacketEngine* engine;
+        uint32_t index;                         /**< Index of this thread and of its channel shard */
+        Packet* rxPackets[PACKET_BATCH_SIZE];   /**< Packets reserved for the next batched pull */
+        qcc::Mutex handoffLock;
+        std::vector<HandoffEntry> handoff;      /**< Packets handed off by other rx threads */
+        qcc::Event handoffEvent;                /**< Set when packets are handed off */
+
+        void PullPackets(qcc::Event* streamEvent);
+        void HandleHandoff();
+        void HandlePacket(Packet* p, PacketStream& packetStream, PacketEngineListener& listener);
         void HandleControlPacket(Packet* p, PacketStream& packetStream, PacketEngineListener& listener);
         void HandleDataPacket(Packet* p);
 
@@ -196,20 +279,47 @@ class PacketEngine : public qcc::AlarmListener {
 
     class TxPacketThread : public qcc::Thread {
       public:
-        TxPacketThread(const qcc::String& engineName);
+        TxPacketThread(const qcc::String& engineName, uint32_t shard);
+
+      protected:
+        qcc::ThreadReturn STDCALL Run(void* arg);
+
+      private:
+        PacketEngine* engine;
+        uint32_t shard;                                   /**< Index of the channel shard serviced by this thread */
+        Packet* batchPackets[PACKET_BATCH_SIZE];          /**< Data packets waiting to be pushed */
+        PacketBatchEntry batchEntries[PACKET_BATCH_SIZE]; /**< Batch entries for batchPackets */
+        size_t batchCount;                                /**< Number of packets in batchPackets */
+
+        QStatus FlushTxBatch(ChannelInfo& ci, uint32_t& waitMs);
+    };
+
+    class TimerThread : public qcc::Thread {
+      public:
+        TimerThread(const qcc::String& engineName);
 
       protected:
         qcc::ThreadReturn STDCALL Run(void* arg);
 
       private:
         PacketEngine* engine;
+        std::vector<PacketTimerWheel::Expiry> expired;
     };
 
     void CloseChannel(ChannelInfo& ci);
 
   public:
 
-    PacketEngine(const qcc::String& name, uint32_t maxWindowSize = 128);
+    /**
+     * Constructor.
+     *
+     * @param name           Name of the engine. Used to name its threads.
+     * @param maxWindowSize  Max number of packets in flight per channel. Must be a power of 2.
+     * @param numWorkers     Number of rx/tx thread pairs. Channels are sharded across the worker
+     *                       pairs by channel id. Each PacketStream is received from by one rx
+     *                       thread which hands packets off to the rx thread of the channel's shard.
+     */
+    PacketEngine(const qcc::String& name, uint32_t maxWindowSize = 128, uint32_t numWorkers = 1);
 
     virtual ~PacketEngine();
 
@@ -237,7 +347,7 @@ class PacketEngine : public qcc::AlarmListener {
 
     QStatus DeliverControlMsg(ChannelInfo& ci, const void* buf, size_t len, uint16_t seqNum = 0);
 
-    void AlarmTriggered(const qcc::Alarm& alarm, QStatus status);
+    void TimerExpired(const PacketTimerWheel::Expiry& expiry);
 
     qcc::String ToString(const PacketStream& stream, const PacketDest& dest) const { return stream.ToString(dest); }
 
@@ -247,15 +357,19 @@ class PacketEngine : public qcc::AlarmListener {
 
     qcc::String name;
     PacketPool pool;
-    RxPacketThread rxPacketThread;
-    TxPacketThread txPacketThread;
-    std::map<qcc::Event*, std::pair<PacketStream*, PacketEngineListener*> > packetStreams;
-    qcc::Timer timer;
-    qcc::Mutex channelInfoLock;
-    std::map<uint32_t, ChannelInfo> channelInfos;
+    std::vector<RxPacketThread*> rxPacketThreads;
+    std::vector<TxPacketThread*> txPacketThreads;
+    TimerThread timerThread;
+    qcc::Mutex packetStreamLock;
+    std::map<qcc::Event*, PacketStreamInfo> packetStreams;
+    PacketTimerWheel timerWheel;
+    std::vector<ChannelShard*> channelShards;
     uint32_t maxWindowSize;
     bool isRunning;
-    bool rxPacketThreadReload;
+
+    ChannelShard& GetChannelShard(uint32_t chanId) { return *channelShards[chanId % channelShards.size()]; }
+
+    RxPacketThread& GetRxPacketThread(uint32_t chanId) { return *rxPacketThreads[chanId % rxPacketThreads.size()]; }
 
     ChannelInfo* CreateChannelInfo(uint32_t chanId, const PacketDest& dest, PacketStream& packetStream, PacketEngineListener& listener, uint16_t windowSize);
 
@@ -263,6 +377,8 @@ class PacketEngine : public qcc::AlarmListener {
 
     ChannelInfo* AcquireNextChannelInfo(ChannelInfo* inCi);
 
+    ChannelInfo* AcquireNextChannelInfo(uint32_t shard, ChannelInfo* inCi);
+
     void ReleaseChannelInfo(ChannelInfo& ci);
 
     void SendAck(ChannelInfo& ci, uint16_t seqNum, bool allowDelay);
@@ -270,6 +386,10 @@ class PacketEngine : public qcc::AlarmListener {
     void SendAckNow(ChannelInfo& ci, uint16_t seqNum);
 
     uint32_t GetRetryMs(const ChannelInfo& ci, uint32_t sendAttempt) const;
+
+    void ArmTimer(ChannelTimer& timer, uint32_t delayMs);
+
+    QStatus AlertTx(const ChannelInfo& ci) { return txPacketThreads[ci.id % txPacketThreads.size()]->Alert(); }
 };
 
 }
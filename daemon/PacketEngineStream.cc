@@ -149,7 +149,7 @@ QStatus PacketEngineStream::PullBytes(void* buf, size_t reqBytes, size_t& actual
         if (ci->rxFlowOff && ((ci->rxDrain == ci->rxAck) || IN_WINDOW(uint16_t, ci->rxDrain, ci->windowSize - 2 - XON_THRESHOLD, ci->rxFlowSeqNum))) {
             ci->rxFlowOff = false;
             engine->SendXOn(*ci);
-            engine->txPacketThread.Alert();
+            engine->AlertTx(*ci);
         }
     }
 
@@ -192,7 +192,7 @@ QStatus PacketEngineStream::PullBytes(void* buf, size_t reqBytes, size_t& actual
     if (ci->rxFlowOff && ((ci->rxDrain == ci->rxAck) || IN_WINDOW(uint16_t, ci->rxDrain, ci->windowSize - 2 - XON_THRESHOLD, ci->rxFlowSeqNum))) {
         ci->rxFlowOff = false;
         engine->SendXOn(*ci);
-        engine->txPacketThread.Alert();
+        engine->AlertTx(*ci);
     }
     ci->rxLock.Unlock();
     engine->ReleaseChannelInfo(*ci);
@@ -256,10 +256,25 @@ QStatus PacketEngineStream::PushBytes(const void* buf, size_t numBytes, size_t&
         }
     }
 
+    /* Get all the packets before writing any so a message is never partly queued */
+    for (size_t i = 0; (status == ER_OK) && (i < numPackets); ++i) {
+        Packet* p = engine->pool.GetPacket();
+        if (p) {
+            ci->txPackets[(ci->txFill + i) % ci->windowSize] = p;
+        } else {
+            status = ER_OUT_OF_MEMORY;
+            while (i > 0) {
+                --i;
+                engine->pool.ReturnPacket(ci->txPackets[(ci->txFill + i) % ci->windowSize]);
+                ci->txPackets[(ci->txFill + i) % ci->windowSize] = NULL;
+            }
+        }
+    }
+
     /* Write packets */
     bool isFirst = true;
     while ((status == ER_OK) && (numSent < numBytes)) {
-        Packet* p = engine->pool.GetPacket();
+        Packet* p = ci->txPackets[ci->txFill % ci->windowSize];
         size_t pLen = ::min(maxPayload, numBytes - numSent);
         p->SetPayload(reinterpret_cast<const uint8_t*>(buf) + numSent, pLen);
         p->chanId = ci->id;
@@ -267,13 +282,12 @@ QStatus PacketEngineStream::PushBytes(const void* buf, size_t numBytes, size_t&
         p->flags = isFirst ? PACKET_FLAG_BOM : 0;
         p->flags |= (numBytes - numSent) <= maxPayload ? PACKET_FLAG_EOM : 0;
         p->expireTs = (ttl == 0) ? numeric_limits<uint64_t>::max() : now + ttl;
-        ci->txPackets[ci->txFill % ci->windowSize] = p;
         ci->txFill++;
         numSent += pLen;
         isFirst = false;
     }
     if (status == ER_OK) {
-        engine->txPacketThread.Alert();
+        engine->AlertTx(*ci);
     }
     ci->txLock.Unlock();
     engine->ReleaseChannelInfo(*ci);
@@ -19,9 +19,23 @@
  *    limitations under the License.
  ******************************************************************************/
 #include <qcc/platform.h>
+
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#if defined(QCC_OS_GROUP_WINDOWS)
+#include <malloc.h>
+#endif
+#if defined(QCC_OS_LINUX)
+#include <sys/mman.h>
+#endif
+
+#include <qcc/Debug.h>
 #include <qcc/Mutex.h>
+#include <qcc/atomic.h>
 
 #include "PacketPool.h"
+#include "ThreadShard.h"
 
 using namespace std;
 using namespace qcc;
@@ -30,14 +44,88 @@ using namespace qcc;
 
 namespace ajn {
 
-PacketPool::PacketPool() : mtu(0), usedCount(0)
+/* Size and alignment of a slab. Matches the x86 huge page size */
+static const size_t SLAB_SIZE = 2 * 1024 * 1024;
+
+/* Packets and buffers are laid out on cache line boundaries */
+static const size_t PACKET_ALIGN = 64;
+
+/* Number of packets moved between a cache and the depot at a time */
+static const size_t BATCH = 32;
+
+/* A cache holding more than this many packets spills a batch to the depot */
+static const size_t MAX_CACHED = 2 * BATCH;
+
+static inline size_t RoundUp(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+/*
+ * Allocate a slab aligned to SLAB_SIZE. Returns NULL if out of memory.
+ */
+static uint8_t* AllocSlab(bool& hugePage)
+{
+    void* mem = NULL;
+    hugePage = false;
+#if defined(QCC_OS_LINUX) && defined(MAP_HUGETLB)
+    /* Fails unless huge pages have been reserved */
+    mem = ::mmap(NULL, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) {
+        hugePage = true;
+        return static_cast<uint8_t*>(mem);
+    }
+    mem = NULL;
+#endif
+#if defined(QCC_OS_GROUP_WINDOWS)
+    mem = _aligned_malloc(SLAB_SIZE, SLAB_SIZE);
+#else
+    if (posix_memalign(&mem, SLAB_SIZE, SLAB_SIZE) != 0) {
+        mem = NULL;
+    }
+#endif
+#if defined(QCC_OS_LINUX) && defined(MADV_HUGEPAGE)
+    /* Only a hint. Regular pages are used if transparent huge pages are not available */
+    if (mem) {
+        ::madvise(mem, SLAB_SIZE, MADV_HUGEPAGE);
+    }
+#endif
+    return static_cast<uint8_t*>(mem);
+}
+
+bool PacketPool::AddrBeforeSlab(const uint8_t* addr, const Slab& slab)
 {
+    return addr < slab.base;
+}
+
+bool PacketPool::SlabBefore(const Slab& a, const Slab& b)
+{
+    return a.base < b.base;
+}
+
+PacketPool::PacketPool() : mtu(0), packetStride(0), slabCapacity(0), trimDepotSize(0), totalCount(0), inUseCount(0), highWaterCount(0)
+{
+    carving.base = NULL;
+    carving.hugePage = false;
+    carving.numPackets = 0;
 }
 
 QStatus PacketPool::Start(size_t mtu)
 {
-    this->mtu = mtu;
-    return ER_OK;
+    QStatus status = ER_OK;
+    depotLock.Lock(MUTEX_CONTEXT);
+    if (totalCount == 0) {
+        this->mtu = mtu;
+        packetStride = RoundUp(sizeof(Packet), PACKET_ALIGN) + RoundUp(mtu, PACKET_ALIGN);
+        slabCapacity = SLAB_SIZE / packetStride;
+        trimDepotSize = slabCapacity;
+    } else if (mtu != this->mtu) {
+        status = ER_FAIL;
+        QCC_LogError(status, ("PacketPool::Start: cannot change mtu from %u to %u after packets were allocated",
+                              static_cast<uint32_t>(this->mtu), static_cast<uint32_t>(mtu)));
+    }
+    depotLock.Unlock(MUTEX_CONTEXT);
+    return status;
 }
 
 QStatus PacketPool::Stop()
@@ -47,14 +135,131 @@ QStatus PacketPool::Stop()
 
 PacketPool::~PacketPool()
 {
-    lock.Lock();
-    std::vector<Packet*>::iterator it = freeList.begin();
-    for (; it != freeList.end(); ++it) {
-        Packet* p = *it;
-        delete p;
+    for (size_t i = 0; i < slabs.size(); ++i) {
+        FreeSlab(slabs[i]);
+    }
+    slabs.clear();
+    if (carving.base) {
+        FreeSlab(carving);
     }
-    freeList.clear();
-    lock.Unlock();
+}
+
+void PacketPool::FreeSlab(Slab& slab)
+{
+    /* Packets are placement constructed in the slabs. Destroy them then free the slab */
+    for (size_t j = 0; j < slab.numPackets; ++j) {
+        reinterpret_cast<Packet*>(slab.base + (j * packetStride))->~Packet();
+    }
+#if defined(QCC_OS_LINUX) && defined(MAP_HUGETLB)
+    if (slab.hugePage) {
+        ::munmap(slab.base, SLAB_SIZE);
+        slab.base = NULL;
+        return;
+    }
+#endif
+#if defined(QCC_OS_GROUP_WINDOWS)
+    _aligned_free(slab.base);
+#else
+    free(slab.base);
+#endif
+    slab.base = NULL;
+}
+
+PacketPool::Cache& PacketPool::CacheForThisThread()
+{
+    return caches[ThreadShard(NUM_CACHES)];
+}
+
+size_t PacketPool::FindSlab(const Packet* p) const
+{
+    const uint8_t* addr = reinterpret_cast<const uint8_t*>(p);
+    vector<Slab>::const_iterator it = upper_bound(slabs.begin(), slabs.end(), addr, AddrBeforeSlab);
+    if ((it == slabs.begin()) || (addr >= (--it)->base + SLAB_SIZE)) {
+        return slabs.size();
+    }
+    return it - slabs.begin();
+}
+
+void PacketPool::Refill(Cache& cache)
+{
+    depotLock.Lock(MUTEX_CONTEXT);
+    size_t num = min(depot.size(), BATCH);
+    cache.packets.insert(cache.packets.end(), depot.end() - num, depot.end());
+    depot.resize(depot.size() - num);
+    trimDepotSize = max(slabCapacity, min(trimDepotSize, depot.size() + slabCapacity));
+
+    /* Carve new packets out of the slabs if the depot was empty */
+    while (num < BATCH) {
+        if (!carving.base || (carving.numPackets == slabCapacity)) {
+            if (carving.base) {
+                slabs.insert(upper_bound(slabs.begin(), slabs.end(), carving, SlabBefore), carving);
+            }
+            carving.base = AllocSlab(carving.hugePage);
+            carving.numPackets = 0;
+            if (!carving.base) {
+                QCC_LogError(ER_OUT_OF_MEMORY, ("PacketPool::Refill: cannot allocate a slab"));
+                break;
+            }
+        }
+        uint8_t* mem = carving.base + (carving.numPackets * packetStride);
+        uint32_t* buffer = reinterpret_cast<uint32_t*>(mem + RoundUp(sizeof(Packet), PACKET_ALIGN));
+        cache.packets.push_back(new (mem) Packet(mtu, buffer));
+        ++carving.numPackets;
+        ++totalCount;
+        ++num;
+    }
+    depotLock.Unlock(MUTEX_CONTEXT);
+}
+
+void PacketPool::Spill(Cache& cache)
+{
+    depotLock.Lock(MUTEX_CONTEXT);
+    depot.insert(depot.end(), cache.packets.end() - BATCH, cache.packets.end());
+    if ((depot.size() >= trimDepotSize) && (depot.size() > (2 * static_cast<size_t>(GetInUseCount())))) {
+        Trim();
+    }
+    depotLock.Unlock(MUTEX_CONTEXT);
+    cache.packets.resize(cache.packets.size() - BATCH);
+}
+
+void PacketPool::Trim()
+{
+    /* Count the free packets of each full slab. The depot lock is held */
+    vector<size_t> freeCount(slabs.size(), 0);
+    for (size_t i = 0; i < depot.size(); ++i) {
+        size_t idx = FindSlab(depot[i]);
+        if (idx < slabs.size()) {
+            ++freeCount[idx];
+        }
+    }
+    size_t numIdle = 0;
+    for (size_t i = 0; i < slabs.size(); ++i) {
+        numIdle += (freeCount[i] == slabCapacity) ? 1 : 0;
+    }
+    if (numIdle > 0) {
+        /* Take the packets of idle slabs out of the depot then free the slabs */
+        size_t numKept = 0;
+        for (size_t i = 0; i < depot.size(); ++i) {
+            size_t idx = FindSlab(depot[i]);
+            if ((idx == slabs.size()) || (freeCount[idx] != slabCapacity)) {
+                depot[numKept++] = depot[i];
+            }
+        }
+        depot.resize(numKept);
+        size_t numSlabs = 0;
+        for (size_t i = 0; i < slabs.size(); ++i) {
+            if (freeCount[i] == slabCapacity) {
+                FreeSlab(slabs[i]);
+            } else {
+                slabs[numSlabs++] = slabs[i];
+            }
+        }
+        slabs.resize(numSlabs);
+        totalCount -= numIdle * slabCapacity;
+        QCC_DbgPrintf(("PacketPool::Trim: returned %u slabs", static_cast<uint32_t>(numIdle)));
+    }
+    /* Free packets scattered over busy slabs are not looked at again until the depot grows */
+    trimDepotSize = depot.size() + slabCapacity;
 }
 
 Packet* PacketPool::GetPacket() {
@@ -62,15 +267,23 @@ Packet* PacketPool::GetPacket() {
 #ifdef PACKET_LEAK_DEBUG
     p = new Packet(mtu);
 #else
-    lock.Lock();
-    usedCount++;
-    if (freeList.size() > 0) {
-        p = freeList.back();
-        freeList.pop_back();
-        lock.Unlock();
-    } else {
-        lock.Unlock();
-        p = new Packet(mtu);
+    Cache& cache = CacheForThisThread();
+    cache.lock.Lock(MUTEX_CONTEXT);
+    if (cache.packets.empty()) {
+        Refill(cache);
+    }
+    if (cache.packets.empty()) {
+        cache.lock.Unlock(MUTEX_CONTEXT);
+        return NULL;
+    }
+    p = cache.packets.back();
+    cache.packets.pop_back();
+    cache.lock.Unlock(MUTEX_CONTEXT);
+
+    /* The high water mark may be missed by a packet or two when threads race here */
+    int32_t inUse = IncrementAndFetch(&inUseCount);
+    if (inUse > highWaterCount) {
+        highWaterCount = inUse;
     }
 #endif
     return p;
@@ -80,17 +293,24 @@ void PacketPool::ReturnPacket(Packet* p) {
 #ifdef PACKET_LEAK_DEBUG
     delete p;
 #else
-    lock.Lock();
-    --usedCount;
-    if ((freeList.size() * 2) > usedCount) {
-        lock.Unlock();
-        delete p;
-    } else {
-        p->Clean();
-        freeList.push_back(p);
-        lock.Unlock();
+    p->Clean();
+    Cache& cache = CacheForThisThread();
+    cache.lock.Lock(MUTEX_CONTEXT);
+    cache.packets.push_back(p);
+    if (cache.packets.size() > MAX_CACHED) {
+        Spill(cache);
     }
+    cache.lock.Unlock(MUTEX_CONTEXT);
+    DecrementAndFetch(&inUseCount);
 #endif
 }
 
+uint32_t PacketPool::GetFreeCount() const
+{
+    depotLock.Lock(MUTEX_CONTEXT);
+    uint32_t total = static_cast<uint32_t>(totalCount);
+    depotLock.Unlock(MUTEX_CONTEXT);
+    return total - GetInUseCount();
+}
+
 }
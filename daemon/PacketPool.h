@@ -25,31 +25,97 @@
 
 #include <vector>
 
+#include <qcc/Mutex.h>
+
 #include "Packet.h"
 
 namespace ajn {
 
+/**
+ * Pool of Packets.
+ *
+ * Packets and their buffers are carved out of 2MB slabs. On Linux a slab is an explicit huge
+ * page when huge pages are reserved, otherwise slabs are aligned to the huge page size and
+ * marked for transparent huge pages.
+ *
+ * Free packets are kept in a small set of caches, each with its own lock. Threads are dealt out
+ * over the caches round-robin so threads mostly use different caches, but a cache may be shared.
+ * Caches are refilled from and spill to a shared depot a batch of packets at a time so the depot
+ * lock is taken once per batch rather than once per packet. When the depot holds more than a
+ * slab of packets and more than twice as many packets as are in use, full slabs whose packets
+ * are all in the depot are returned to the system.
+ */
 class PacketPool {
   public:
     PacketPool();
 
+    /**
+     * Start the pool.
+     *
+     * @param mtu  Size of packet buffers. Can only be changed before the first packet is allocated.
+     * @return ER_OK if successful.
+     */
     QStatus Start(size_t mtu);
 
     QStatus Stop();
 
     ~PacketPool();
 
+    /** Get a free packet or NULL if no memory could be found for more packets */
     Packet* GetPacket();
 
     void ReturnPacket(Packet* p);
 
     uint32_t GetMTU() const { return mtu; }
 
+    /** Number of packets currently handed out by GetPacket() */
+    uint32_t GetInUseCount() const { return static_cast<uint32_t>(inUseCount); }
+
+    /** Number of allocated packets that are not in use */
+    uint32_t GetFreeCount() const;
+
+    /** Highest number of packets that have been in use at the same time */
+    uint32_t GetHighWaterCount() const { return static_cast<uint32_t>(highWaterCount); }
+
   private:
+
+    static const size_t NUM_CACHES = 8;
+
+    struct Cache {
+        qcc::Mutex lock;
+        std::vector<Packet*> packets;
+    };
+
+    struct Slab {
+        uint8_t* base;         /**< Start of the slab */
+        bool hugePage;         /**< The slab is an explicit huge page */
+        size_t numPackets;     /**< Number of packets carved out of the slab so far */
+    };
+
+    PacketPool(const PacketPool& other);
+    PacketPool& operator=(const PacketPool& other);
+
+    Cache& CacheForThisThread();
+    void Refill(Cache& cache);
+    void Spill(Cache& cache);
+    void Trim();
+    size_t FindSlab(const Packet* p) const;
+    static bool AddrBeforeSlab(const uint8_t* addr, const Slab& slab);
+    static bool SlabBefore(const Slab& a, const Slab& b);
+    void FreeSlab(Slab& slab);
+
     size_t mtu;
-    qcc::Mutex lock;
-    std::vector<Packet*> freeList;
-    size_t usedCount;
+    size_t packetStride;                 /**< Bytes per packet (object and buffer) in a slab */
+    size_t slabCapacity;                 /**< Number of packets in a full slab */
+    Cache caches[NUM_CACHES];
+    mutable qcc::Mutex depotLock;
+    std::vector<Packet*> depot;          /**< Free packets shared by all caches */
+    size_t trimDepotSize;                /**< Depot size at which idle slabs are looked for */
+    Slab carving;                        /**< Slab packets are being carved out of */
+    std::vector<Slab> slabs;             /**< Full slabs sorted by address */
+    size_t totalCount;                   /**< Number of packets carved out of the slabs */
+    volatile int32_t inUseCount;
+    volatile int32_t highWaterCount;
 };
 
 }
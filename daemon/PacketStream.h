@@ -28,6 +28,16 @@
 
 namespace ajn {
 
+/**
+ * One datagram in a batched pull or push.
+ */
+struct PacketBatchEntry {
+    void* buf;          /**< Buffer holding the packet bytes */
+    size_t bufSize;     /**< Size of buf (pull only) */
+    size_t numBytes;    /**< Number of bytes pulled into or to be pushed from buf */
+    PacketDest dest;    /**< Sender of a pulled packet or destination of a pushed packet */
+};
+
 /**
  * PacketSource defines a standard interface for packet providers.
  */
@@ -64,6 +74,30 @@ class PacketSource {
      */
     virtual QStatus PullPacketBytes(void* buf, size_t reqBytes, size_t& actualBytes, PacketDest& sender, uint32_t timeout = qcc::Event::WAIT_FOREVER) = 0;
 
+    /**
+     * Pull a batch of packets from the source.
+     * Sources that can receive several datagrams with one system call should override this.
+     * The default implementation pulls a single packet with PullPacketBytes.
+     *
+     * @param entries      Packet buffers to fill. numBytes and dest are set for each pulled packet.
+     * @param numEntries   Number of entries.
+     * @param numPulled    Number of packets pulled. Valid even if an error is returned.
+     * @param timeout      Time to wait for the first packet.
+     * @return   ER_OK if at least one packet was pulled. Otherwise an error.
+     */
+    virtual QStatus PullPacketBatch(PacketBatchEntry* entries, size_t numEntries, size_t& numPulled, uint32_t timeout = qcc::Event::WAIT_FOREVER)
+    {
+        numPulled = 0;
+        if (numEntries == 0) {
+            return ER_OK;
+        }
+        QStatus status = PullPacketBytes(entries[0].buf, entries[0].bufSize, entries[0].numBytes, entries[0].dest, timeout);
+        if (status == ER_OK) {
+            numPulled = 1;
+        }
+        return status;
+    }
+
     /**
      * Get the Event indicating that data is available when signaled.
      *
@@ -98,6 +132,28 @@ class PacketSink {
      */
     virtual QStatus PushPacketBytes(const void* buf, size_t numBytes, PacketDest& dest) = 0;
 
+    /**
+     * Push a batch of packets into the sink.
+     * Sinks that can send several datagrams with one system call should override this.
+     * The default implementation pushes the packets one at a time with PushPacketBytes.
+     *
+     * @param entries      Packets to push. (numBytes of each must be less than or equal to MTU of PacketSink.)
+     * @param numEntries   Number of entries.
+     * @param numPushed    Number of packets pushed. Valid even if an error is returned.
+     * @return   ER_OK if all the packets were pushed.
+     */
+    virtual QStatus PushPacketBatch(PacketBatchEntry* entries, size_t numEntries, size_t& numPushed)
+    {
+        QStatus status = ER_OK;
+        for (numPushed = 0; numPushed < numEntries; ++numPushed) {
+            status = PushPacketBytes(entries[numPushed].buf, entries[numPushed].numBytes, entries[numPushed].dest);
+            if (status != ER_OK) {
+                break;
+            }
+        }
+        return status;
+    }
+
     /**
      * Get the Event that indicates when data can be pushed to sink.
      *
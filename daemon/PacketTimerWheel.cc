@@ -0,0 +1,202 @@
+/**
+ * @file
+ * Hierarchical timing wheel for PacketEngine channel timers.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#include <qcc/platform.h>
+
+#include <qcc/Event.h>
+#include <qcc/Mutex.h>
+#include <qcc/time.h>
+
+#include "PacketTimerWheel.h"
+
+#define QCC_MODULE "PACKET"
+
+using namespace std;
+using namespace qcc;
+
+namespace ajn {
+
+PacketTimerWheel::PacketTimerWheel() : baseMs(GetTimestamp64()), curTick(0), wakeTick(NO_TICK), count(0)
+{
+    for (size_t i = 0; i < L0_SIZE; ++i) {
+        level0[i].prev = level0[i].next = &level0[i];
+    }
+    for (size_t i = 0; i < L1_SIZE; ++i) {
+        level1[i].prev = level1[i].next = &level1[i];
+    }
+}
+
+uint64_t PacketTimerWheel::NowTick() const
+{
+    return (GetTimestamp64() - baseMs) / TICK_MS;
+}
+
+bool PacketTimerWheel::IsEmpty(const Timer& head)
+{
+    return head.next == &head;
+}
+
+void PacketTimerWheel::Unlink(Timer& timer)
+{
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = NULL;
+}
+
+void PacketTimerWheel::Insert(Timer& timer)
+{
+    Timer* head;
+    if (timer.expireTick <= curTick) {
+        /* Only happens while cascading, the timer expires on the tick being processed */
+        head = &level0[curTick & (L0_SIZE - 1)];
+    } else if ((timer.expireTick - curTick) < L0_SIZE) {
+        head = &level0[timer.expireTick & (L0_SIZE - 1)];
+    } else {
+        if ((timer.expireTick - curTick) >= (L0_SIZE * L1_SIZE)) {
+            timer.expireTick = curTick + (L0_SIZE * L1_SIZE) - 1;
+        }
+        head = &level1[(timer.expireTick >> L0_BITS) & (L1_SIZE - 1)];
+    }
+    timer.prev = head->prev;
+    timer.next = head;
+    head->prev->next = &timer;
+    head->prev = &timer;
+}
+
+bool PacketTimerWheel::Arm(Timer& timer, uint32_t delayMs)
+{
+    uint64_t ticks = (delayMs + TICK_MS - 1) / TICK_MS;
+    lock.Lock(MUTEX_CONTEXT);
+    if (timer.next) {
+        Unlink(timer);
+        --count;
+    }
+    bool wasEmpty = (count == 0);
+    uint64_t now = NowTick();
+    if (wasEmpty && (now > curTick)) {
+        /* Nothing is armed so the wheel can jump straight to the current time */
+        curTick = now;
+    }
+    timer.expireTick = now + (ticks ? ticks : 1);
+    if (timer.expireTick <= curTick) {
+        timer.expireTick = curTick + 1;
+    }
+    ++timer.generation;
+    Insert(timer);
+    ++count;
+    /* Cascading a second level bucket wakes the thread calling Advance() no later than this */
+    uint64_t tick = timer.expireTick;
+    if ((tick - curTick) >= L0_SIZE) {
+        tick &= ~static_cast<uint64_t>(L0_SIZE - 1);
+    }
+    bool wake = (tick < wakeTick);
+    if (wake) {
+        wakeTick = tick;
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+    return wake;
+}
+
+void PacketTimerWheel::Cancel(Timer& timer)
+{
+    lock.Lock(MUTEX_CONTEXT);
+    if (timer.next) {
+        Unlink(timer);
+        --count;
+    }
+    ++timer.generation;
+    lock.Unlock(MUTEX_CONTEXT);
+}
+
+bool PacketTimerWheel::IsCurrent(const Timer& timer, uint32_t generation)
+{
+    lock.Lock(MUTEX_CONTEXT);
+    bool current = !timer.next && (timer.generation == generation);
+    lock.Unlock(MUTEX_CONTEXT);
+    return current;
+}
+
+uint32_t PacketTimerWheel::Advance(std::vector<Expiry>& expired)
+{
+    lock.Lock(MUTEX_CONTEXT);
+    uint64_t now = NowTick();
+    while (count && (curTick < now)) {
+        ++curTick;
+        size_t idx = curTick & (L0_SIZE - 1);
+        if (idx == 0) {
+            /* Move the timers expiring in the next L0_SIZE ticks down to the first level */
+            Timer* head = &level1[(curTick >> L0_BITS) & (L1_SIZE - 1)];
+            while (head->next != head) {
+                Timer* timer = head->next;
+                Unlink(*timer);
+                Insert(*timer);
+            }
+        }
+        Timer* head = &level0[idx];
+        while (head->next != head) {
+            Timer* timer = head->next;
+            Unlink(*timer);
+            --count;
+            Expiry expiry;
+            expiry.id = timer->id;
+            expiry.type = timer->type;
+            expiry.generation = timer->generation;
+            expired.push_back(expiry);
+        }
+    }
+    if (count == 0) {
+        if (now > curTick) {
+            curTick = now;
+        }
+        wakeTick = NO_TICK;
+        lock.Unlock(MUTEX_CONTEXT);
+        return Event::WAIT_FOREVER;
+    }
+    wakeTick = NextTick();
+    uint64_t nextMs = baseMs + (wakeTick * TICK_MS);
+    uint64_t nowMs = GetTimestamp64();
+    lock.Unlock(MUTEX_CONTEXT);
+    return (nextMs > nowMs) ? static_cast<uint32_t>(nextMs - nowMs) : 0;
+}
+
+uint64_t PacketTimerWheel::NextTick() const
+{
+    /*
+     * Timers in the first level expire on the tick of their bucket. Timers in the second level
+     * expire no earlier than the tick their bucket is cascaded on, so wake up for that.
+     */
+    uint64_t tick = curTick + 1;
+    for (; tick < curTick + L0_SIZE; ++tick) {
+        size_t idx = tick & (L0_SIZE - 1);
+        if (!IsEmpty(level0[idx]) || ((idx == 0) && !IsEmpty(level1[(tick >> L0_BITS) & (L1_SIZE - 1)]))) {
+            return tick;
+        }
+    }
+    tick = (tick + L0_SIZE - 1) & ~static_cast<uint64_t>(L0_SIZE - 1);
+    for (size_t i = 0; i < L1_SIZE; ++i, tick += L0_SIZE) {
+        if (!IsEmpty(level1[(tick >> L0_BITS) & (L1_SIZE - 1)])) {
+            return tick;
+        }
+    }
+    return curTick + 1;
+}
+
+}
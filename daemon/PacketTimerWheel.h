@@ -0,0 +1,151 @@
+/**
+ * @file
+ * Hierarchical timing wheel for PacketEngine channel timers.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#ifndef _ALLJOYN_PACKETTIMERWHEEL_H
+#define _ALLJOYN_PACKETTIMERWHEEL_H
+
+#include <qcc/platform.h>
+
+#include <vector>
+
+#include <qcc/Mutex.h>
+
+namespace ajn {
+
+/**
+ * A two level timing wheel with a 10ms tick. Timers are embedded in the objects they time out
+ * so arming and cancelling a timer is O(1) and never allocates. The first level covers the
+ * next 2.56 seconds one tick per bucket, the second level covers the next 163 seconds and is
+ * cascaded into the first level as time advances. Longer timeouts are clamped.
+ *
+ * Expired timers are handed back in batches by Advance() as (id, type, generation) records
+ * rather than as pointers, so that the object owning a timer may be destroyed before the
+ * expiry is processed. The generation lets the owner detect that a timer was re-armed or
+ * cancelled after it expired.
+ */
+class PacketTimerWheel {
+  public:
+
+    /** Length of a tick in milliseconds */
+    static const uint32_t TICK_MS = 10;
+
+    /**
+     * A timer. Embed one of these in the object being timed out.
+     */
+    struct Timer {
+        uint32_t id;           /**< Identifies the owner of the timer in expiry records */
+        uint32_t type;         /**< Identifies the timer within its owner in expiry records */
+
+        Timer(uint32_t id = 0, uint32_t type = 0) : id(id), type(type), prev(NULL), next(NULL), expireTick(0), generation(0) { }
+
+        /** Copies are never armed */
+        Timer(const Timer& other) : id(other.id), type(other.type), prev(NULL), next(NULL), expireTick(0), generation(0) { }
+
+      private:
+        friend class PacketTimerWheel;
+
+        Timer& operator=(const Timer& other);
+
+        Timer* prev;
+        Timer* next;
+        uint64_t expireTick;
+        uint32_t generation;   /**< Incremented each time the timer is armed or cancelled */
+    };
+
+    /**
+     * Record of an expired timer.
+     */
+    struct Expiry {
+        uint32_t id;
+        uint32_t type;
+        uint32_t generation;
+    };
+
+    /** Constructor */
+    PacketTimerWheel();
+
+    /**
+     * Arm a timer, re-arming it if it is already armed.
+     *
+     * @param timer    The timer.
+     * @param delayMs  Milliseconds until the timer expires.
+     *
+     * @return  true if the timer expires before the time the thread calling Advance() is
+     *          waiting for. That thread needs to be woken up.
+     */
+    bool Arm(Timer& timer, uint32_t delayMs);
+
+    /**
+     * Cancel a timer. Does nothing if the timer is not armed.
+     *
+     * @param timer    The timer.
+     */
+    void Cancel(Timer& timer);
+
+    /**
+     * Check that a timer has not been re-armed or cancelled since it expired.
+     *
+     * @param timer       The timer.
+     * @param generation  The generation from the timer's expiry record.
+     *
+     * @return  true if the expiry record is still current.
+     */
+    bool IsCurrent(const Timer& timer, uint32_t generation);
+
+    /**
+     * Advance the wheel to the current time collecting the timers that have expired.
+     *
+     * @param expired  [OUT] Expired timers are appended to this vector.
+     *
+     * @return  Milliseconds until the next tick that has timers to expire or cascade, or
+     *          qcc::Event::WAIT_FOREVER if no timers are armed.
+     */
+    uint32_t Advance(std::vector<Expiry>& expired);
+
+  private:
+
+    static const size_t L0_BITS = 8;
+    static const size_t L0_SIZE = 1 << L0_BITS;
+    static const size_t L1_BITS = 6;
+    static const size_t L1_SIZE = 1 << L1_BITS;
+
+    PacketTimerWheel(const PacketTimerWheel& other);
+    PacketTimerWheel& operator=(const PacketTimerWheel& other);
+
+    static const uint64_t NO_TICK = static_cast<uint64_t>(-1);
+
+    uint64_t NowTick() const;
+    uint64_t NextTick() const;
+    void Insert(Timer& timer);
+    static bool IsEmpty(const Timer& head);
+    static void Unlink(Timer& timer);
+
+    qcc::Mutex lock;
+    uint64_t baseMs;           /**< Timestamp of tick 0 */
+    uint64_t curTick;          /**< Last tick that has been processed */
+    uint64_t wakeTick;         /**< Tick the thread calling Advance() is waiting for */
+    size_t count;              /**< Number of armed timers */
+    Timer level0[L0_SIZE];     /**< List heads for the timers expiring in the next L0_SIZE ticks */
+    Timer level1[L1_SIZE];     /**< List heads for the timers expiring later */
+};
+
+}
+
+#endif
@@ -21,13 +21,17 @@
  ******************************************************************************/
 #include <qcc/platform.h>
 
+#include <algorithm>
 #include <cstring>
+#include <ctype.h>
 
 #include "RuleTable.h"
 
 #include <qcc/Debug.h>
 #include <qcc/String.h>
+#include <qcc/StringUtil.h>
 #include <alljoyn/Message.h>
+#include <alljoyn/MsgArg.h>
 
 #define QCC_MODULE "ALLJOYN"
 
@@ -36,6 +40,9 @@ using namespace qcc;
 
 namespace ajn {
 
+/* Highest argument index allowed in argN and argNpath keys */
+static const uint32_t MAX_ARG_INDEX = 63;
+
 Rule::Rule(const char* ruleSpec, QStatus* outStatus) : type(MESSAGE_INVALID), sessionless(SESSIONLESS_NOT_SPECIFIED)
 {
     QStatus status = ER_OK;
@@ -64,6 +71,11 @@ Rule::Rule(const char* ruleSpec, QStatus* outStatus) : type(MESSAGE_INVALID), se
             QCC_LogError(status, ("Quote mismatch in ruleSpec \"%s\"", ruleSpec));
             break;
         }
+        /* Quoted values (especially arg values) may contain commas */
+        endPos = strchr(endQuotePos, ',');
+        if (NULL == endPos) {
+            endPos = finalPos;
+        }
         if (0 == strncmp("type", pos, 4)) {
             if (0 == strncmp("signal", begQuotePos, endQuotePos - begQuotePos)) {
                 type = MESSAGE_SIGNAL;
@@ -84,16 +96,38 @@ Rule::Rule(const char* ruleSpec, QStatus* outStatus) : type(MESSAGE_INVALID), se
             iface = qcc::String(begQuotePos, endQuotePos - begQuotePos);
         } else if (0 == strncmp("member", pos, 6)) {
             member = qcc::String(begQuotePos, endQuotePos - begQuotePos);
+        } else if (0 == strncmp("path_namespace", pos, 14)) {
+            pathNamespace = qcc::String(begQuotePos, endQuotePos - begQuotePos);
         } else if (0 == strncmp("path", pos, 4)) {
             path = qcc::String(begQuotePos, endQuotePos - begQuotePos);
         } else if (0 == strncmp("destination", pos, 11)) {
             destination = qcc::String(begQuotePos, endQuotePos - begQuotePos);
         } else if (0 == strncmp("sessionless", pos, 11)) {
             sessionless = ((begQuotePos[0] == 't') || (begQuotePos[0] == 'T')) ? SESSIONLESS_TRUE : SESSIONLESS_FALSE;
+        } else if (0 == strncmp("arg0namespace", pos, 13)) {
+            arg0Namespace = qcc::String(begQuotePos, endQuotePos - begQuotePos);
         } else if (0 == strncmp("arg", pos, 3)) {
-            status = ER_NOT_IMPLEMENTED;
-            QCC_LogError(status, ("arg keys are not supported in ruleSpec \"%s\"", ruleSpec));
-            break;
+            /* argN or argNpath where N is 0 to 63 */
+            const char* numPos = pos + 3;
+            uint32_t argIdx = 0;
+            while ((numPos < (eqPos - 1)) && isdigit(*numPos) && (argIdx <= MAX_ARG_INDEX)) {
+                argIdx = argIdx * 10 + (*numPos++ - '0');
+            }
+            size_t suffixLen = (eqPos - 1) - numPos;
+            if ((numPos == (pos + 3)) || (argIdx > MAX_ARG_INDEX)) {
+                status = ER_FAIL;
+                QCC_LogError(status, ("Invalid arg index in ruleSpec \"%s\"", ruleSpec));
+                break;
+            }
+            if (suffixLen == 0) {
+                args[argIdx] = qcc::String(begQuotePos, endQuotePos - begQuotePos);
+            } else if ((suffixLen == 4) && (0 == strncmp("path", numPos, 4))) {
+                pathArgs[argIdx] = qcc::String(begQuotePos, endQuotePos - begQuotePos);
+            } else {
+                status = ER_FAIL;
+                QCC_LogError(status, ("Invalid arg key in ruleSpec \"%s\"", ruleSpec));
+                break;
+            }
         } else {
             status = ER_FAIL;
             QCC_LogError(status, ("Invalid key in ruleSpec \"%s\"", ruleSpec));
@@ -101,12 +135,74 @@ Rule::Rule(const char* ruleSpec, QStatus* outStatus) : type(MESSAGE_INVALID), se
         }
         pos = endPos + 1;
     }
+    if ((status == ER_OK) && !path.empty() && !pathNamespace.empty()) {
+        status = ER_FAIL;
+        QCC_LogError(status, ("path and path_namespace cannot both be specified in ruleSpec \"%s\"", ruleSpec));
+    }
     if (outStatus) {
         *outStatus = status;
     }
 }
 
+QStatus MatchArgs::Get(size_t& outNumArgs, const MsgArg*& outArgs)
+{
+    if (!clone && (status == ER_OK)) {
+        if (msg->IsEncrypted()) {
+            /* The daemon doesn't have the keys needed to look inside encrypted messages */
+            status = ER_BUS_MESSAGE_DECRYPTION_FAILED;
+        } else {
+            /*
+             * Unmarshal a copy of the message since unmarshalling is not thread-safe and the
+             * message may be unmarshalled by the local endpoint too.
+             */
+            clone = new Message(msg, true);
+            status = (*clone)->UnmarshalArgs("*");
+            if (status == ER_OK) {
+                (*clone)->GetArgs(numArgs, args);
+            } else {
+                QCC_DbgPrintf(("Unable to unmarshal %s for arg matching: %s", msg->Description().c_str(), QCC_StatusText(status)));
+            }
+        }
+    }
+    outNumArgs = numArgs;
+    outArgs = args;
+    return status;
+}
+
+/*
+ * True if str is equal to ns or is in namespace ns, that is, it starts with ns followed by sep.
+ */
+static bool InNamespace(const char* str, const qcc::String& ns, char sep)
+{
+    size_t len = ns.size();
+    if (0 != strncmp(str, ns.c_str(), len)) {
+        return false;
+    }
+    return (str[len] == '\0') || (str[len] == sep) || ((len > 0) && (ns[len - 1] == sep));
+}
+
+/*
+ * The argNpath match from the D-Bus specification: the arg and the rule value are equal or
+ * one of them ends with '/' and is a prefix of the other.
+ */
+static bool IsPathArgMatch(const char* arg, size_t argLen, const qcc::String& value)
+{
+    if (argLen == value.size()) {
+        return 0 == strcmp(arg, value.c_str());
+    } else if (argLen < value.size()) {
+        return (argLen > 0) && (arg[argLen - 1] == '/') && (0 == strncmp(arg, value.c_str(), argLen));
+    } else {
+        return !value.empty() && (value[value.size() - 1] == '/') && (0 == strncmp(arg, value.c_str(), value.size()));
+    }
+}
+
 bool Rule::IsMatch(const Message& msg)
+{
+    MatchArgs msgArgs(msg);
+    return IsMatch(msg, msgArgs);
+}
+
+bool Rule::IsMatch(const Message& msg, MatchArgs& msgArgs)
 {
     /* The fields of a rule (if specified) are logically anded together */
     if ((type != MESSAGE_INVALID) && (type != msg->GetType())) {
@@ -131,21 +227,197 @@ bool Rule::IsMatch(const Message& msg)
         ((sessionless == SESSIONLESS_FALSE) && msg->IsSessionless())) {
         return false;
     }
+    if (!pathNamespace.empty() && !InNamespace(msg->GetObjectPath(), pathNamespace, '/')) {
+        return false;
+    }
+    if (!HasArgMatches()) {
+        return true;
+    }
 
-    // @@ TODO Arg matches are not handled
+    /* The header fields all match so now it is worth looking at the message body */
+    size_t numArgs;
+    const MsgArg* margs;
+    QStatus status = msgArgs.Get(numArgs, margs);
+    if (status == ER_BUS_MESSAGE_DECRYPTION_FAILED) {
+        /* Arg keys cannot be checked on an encrypted body so let the receiver decide */
+        return true;
+    } else if (status != ER_OK) {
+        return false;
+    }
+    if (!arg0Namespace.empty()) {
+        if ((numArgs == 0) || (margs[0].typeId != ALLJOYN_STRING) || !InNamespace(margs[0].v_string.str, arg0Namespace, '.')) {
+            return false;
+        }
+    }
+    for (std::map<uint32_t, qcc::String>::const_iterator it = args.begin(); it != args.end(); ++it) {
+        if ((it->first >= numArgs) || (margs[it->first].typeId != ALLJOYN_STRING) ||
+            (it->second != margs[it->first].v_string.str)) {
+            return false;
+        }
+    }
+    for (std::map<uint32_t, qcc::String>::const_iterator it = pathArgs.begin(); it != pathArgs.end(); ++it) {
+        if (it->first >= numArgs) {
+            return false;
+        }
+        const MsgArg& arg = margs[it->first];
+        if (arg.typeId == ALLJOYN_STRING) {
+            if (!IsPathArgMatch(arg.v_string.str, arg.v_string.len, it->second)) {
+                return false;
+            }
+        } else if (arg.typeId == ALLJOYN_OBJECT_PATH) {
+            if (!IsPathArgMatch(arg.v_objPath.str, arg.v_objPath.len, it->second)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
     return true;
 }
 
 qcc::String Rule::ToString() const
 {
-    return "s:" + sender + " i:" + iface + " m:" + member + " p:" + path + " d:" + destination;
+    qcc::String str = "s:" + sender + " i:" + iface + " m:" + member + " p:" + path + " d:" + destination;
+    if (!pathNamespace.empty()) {
+        str += " pn:" + pathNamespace;
+    }
+    if (!arg0Namespace.empty()) {
+        str += " a0n:" + arg0Namespace;
+    }
+    for (std::map<uint32_t, qcc::String>::const_iterator it = args.begin(); it != args.end(); ++it) {
+        str += " a" + U32ToString(it->first) + ":" + it->second;
+    }
+    for (std::map<uint32_t, qcc::String>::const_iterator it = pathArgs.begin(); it != pathArgs.end(); ++it) {
+        str += " a" + U32ToString(it->first) + "p:" + it->second;
+    }
+    return str;
+}
+
+RuleTable::~RuleTable()
+{
+    std::unordered_map<const char*, InternEntry*, Hash, Equal>::iterator it = internTable.begin();
+    while (it != internTable.end()) {
+        delete it->second;
+        ++it;
+    }
+}
+
+RuleTable::InternId RuleTable::Intern(const qcc::String& str)
+{
+    if (str.empty()) {
+        return ANY_ID;
+    }
+    InternEntry* entry;
+    std::unordered_map<const char*, InternEntry*, Hash, Equal>::iterator it = internTable.find(str.c_str());
+    if (it == internTable.end()) {
+        entry = new InternEntry(str, nextInternId++);
+        internTable[entry->str.c_str()] = entry;
+    } else {
+        entry = it->second;
+    }
+    ++entry->refs;
+    return entry->id;
+}
+
+void RuleTable::Release(const qcc::String& str)
+{
+    if (!str.empty()) {
+        std::unordered_map<const char*, InternEntry*, Hash, Equal>::iterator it = internTable.find(str.c_str());
+        if ((it != internTable.end()) && (--it->second->refs == 0)) {
+            InternEntry* entry = it->second;
+            internTable.erase(it);
+            delete entry;
+        }
+    }
+}
+
+RuleTable::InternId RuleTable::LookupId(const char* str) const
+{
+    std::unordered_map<const char*, InternEntry*, Hash, Equal>::const_iterator it = internTable.find(str);
+    return (it == internTable.end()) ? NO_ID : it->second->id;
+}
+
+void RuleTable::IndexRule(RuleIterator it)
+{
+    const Rule& rule = it->second;
+    InternId ifaceId = Intern(rule.iface);
+    InternId memberId = Intern(rule.member);
+    InternId pathId = Intern(rule.path);
+    buckets[BucketKey(ifaceId, memberId)].push_back(IndexEntry(it, pathId));
+}
+
+void RuleTable::UnindexRule(RuleIterator it)
+{
+    const Rule& rule = it->second;
+    InternId ifaceId = rule.iface.empty() ? ANY_ID : LookupId(rule.iface.c_str());
+    InternId memberId = rule.member.empty() ? ANY_ID : LookupId(rule.member.c_str());
+    std::unordered_map<uint64_t, RuleBucket>::iterator bit = buckets.find(BucketKey(ifaceId, memberId));
+    if (bit != buckets.end()) {
+        RuleBucket& bucket = bit->second;
+        for (size_t i = 0; i < bucket.size(); ++i) {
+            if (bucket[i].it == it) {
+                /* Order within a bucket does not matter so swap with the last entry */
+                bucket[i] = bucket.back();
+                bucket.pop_back();
+                break;
+            }
+        }
+        if (bucket.empty()) {
+            buckets.erase(bit);
+        }
+    }
+    Release(rule.iface);
+    Release(rule.member);
+    Release(rule.path);
+}
+
+void RuleTable::MatchBucket(uint64_t key, InternId pathId, const Message& msg, MatchArgs& msgArgs, std::vector<BusEndpoint>& matches)
+{
+    std::unordered_map<uint64_t, RuleBucket>::iterator bit = buckets.find(key);
+    if (bit != buckets.end()) {
+        RuleBucket& bucket = bit->second;
+        for (size_t i = 0; i < bucket.size(); ++i) {
+            /* Interned paths let us reject most non-matching rules without a string compare */
+            if ((bucket[i].pathId != ANY_ID) && (bucket[i].pathId != pathId)) {
+                continue;
+            }
+            if (bucket[i].it->second.IsMatch(msg, msgArgs)) {
+                matches.push_back(bucket[i].it->first);
+            }
+        }
+    }
+}
+
+void RuleTable::FindMatchingEndpoints(const Message& msg, std::vector<BusEndpoint>& matches)
+{
+    size_t first = matches.size();
+    InternId ifaceId = LookupId(msg->GetInterface());
+    InternId memberId = LookupId(msg->GetMemberName());
+    InternId pathId = LookupId(msg->GetObjectPath());
+    MatchArgs msgArgs(msg);
+
+    if (ifaceId != NO_ID) {
+        if (memberId != NO_ID) {
+            MatchBucket(BucketKey(ifaceId, memberId), pathId, msg, msgArgs, matches);
+        }
+        MatchBucket(BucketKey(ifaceId, ANY_ID), pathId, msg, msgArgs, matches);
+    }
+    if (memberId != NO_ID) {
+        MatchBucket(BucketKey(ANY_ID, memberId), pathId, msg, msgArgs, matches);
+    }
+    MatchBucket(BucketKey(ANY_ID, ANY_ID), pathId, msg, msgArgs, matches);
+
+    /* An endpoint with several matching rules only receives the message once */
+    std::sort(matches.begin() + first, matches.end());
+    matches.erase(std::unique(matches.begin() + first, matches.end()), matches.end());
 }
 
 QStatus RuleTable::AddRule(BusEndpoint& endpoint, const Rule& rule)
 {
     QCC_DbgPrintf(("AddRule for endpoint %s\n  %s", endpoint->GetUniqueName().c_str(), rule.ToString().c_str()));
     Lock();
-    rules.insert(std::pair<BusEndpoint, Rule>(endpoint, rule));
+    RuleIterator it = rules.insert(std::pair<BusEndpoint, Rule>(endpoint, rule));
+    IndexRule(it);
     Unlock();
     return ER_OK;
 }
@@ -158,6 +430,7 @@ QStatus RuleTable::RemoveRule(BusEndpoint& endpoint, Rule& rule)
     std::pair<RuleIterator, RuleIterator> range = rules.equal_range(endpoint);
     while (range.first != range.second) {
         if (range.first->second == rule) {
+            UnindexRule(range.first);
             rules.erase(range.first);
             break;
         }
@@ -172,6 +445,9 @@ QStatus RuleTable::RemoveAllRules(BusEndpoint& endpoint)
     Lock();
     std::pair<RuleIterator, RuleIterator> range = rules.equal_range(endpoint);
     if (range.first != rules.end()) {
+        for (RuleIterator it = range.first; it != range.second; ++it) {
+            UnindexRule(it);
+        }
         rules.erase(range.first, range.second);
     }
     Unlock();
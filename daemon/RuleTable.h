@@ -26,10 +26,14 @@
 
 #include <qcc/platform.h>
 
+#include <cstring>
 #include <map>
+#include <vector>
 
 #include <qcc/String.h>
 #include <qcc/Mutex.h>
+#include <qcc/StringMapKey.h>
+#include <qcc/Util.h>
 
 #include <alljoyn/Message.h>
 
@@ -37,8 +41,55 @@
 
 #include <alljoyn/Status.h>
 
+#include <qcc/STLContainer.h>
+
 namespace ajn {
 
+/**
+ * The body of a message being matched against rules that have arg keys. The body is only
+ * unmarshalled the first time a rule whose header fields matched needs to look at it and
+ * is then shared by all the other rules evaluated for the same message.
+ */
+class MatchArgs {
+  public:
+
+    /**
+     * Constructor
+     *
+     * @param msg   Message whose arguments will be matched.
+     */
+    MatchArgs(const Message& msg) : msg(msg), clone(NULL), status(ER_OK), numArgs(0), args(NULL) { }
+
+    /**
+     * Destructor
+     */
+    ~MatchArgs() { delete clone; }
+
+    /**
+     * Get the unmarshalled message arguments.
+     *
+     * @param[out] numArgs  Number of arguments.
+     * @param[out] args     The arguments.
+     *
+     * @return  - ER_OK if the arguments are available
+     *          - ER_BUS_MESSAGE_DECRYPTION_FAILED if the body is encrypted
+     *          - Other error status codes if the body could not be unmarshalled
+     */
+    QStatus Get(size_t& numArgs, const MsgArg*& args);
+
+  private:
+
+    /* Copy constructor and assignment operator are private */
+    MatchArgs(const MatchArgs& other);
+    MatchArgs& operator=(const MatchArgs& other);
+
+    const Message& msg;    /**< Message being matched */
+    Message* clone;        /**< Copy of msg that has been unmarshalled */
+    QStatus status;        /**< Status of unmarshalling the clone */
+    size_t numArgs;        /**< Number of unmarshalled arguments */
+    const MsgArg* args;    /**< Unmarshalled arguments */
+};
+
 /**
  * Rule defines a message bus routing rule.
  */
@@ -65,23 +116,35 @@ struct Rule {
     /** true iff Rule specifies a filter for sessionless signals */
     enum {SESSIONLESS_NOT_SPECIFIED, SESSIONLESS_FALSE, SESSIONLESS_TRUE} sessionless;
 
-    /** Map of argument matches */
-    // @@ TODO
+    /** Object path namespace or empty for all object paths */
+    qcc::String pathNamespace;
+
+    /** Namespace that a string arg 0 must be in or empty for no arg 0 namespace match */
+    qcc::String arg0Namespace;
+
+    /** Map of argument matches (argN) from argument index to the required string value */
+    std::map<uint32_t, qcc::String> args;
+
+    /** Map of argument path matches (argNpath) from argument index to the required path */
+    std::map<uint32_t, qcc::String> pathArgs;
 
     /** Equality comparison */
     bool operator==(const Rule& o) const {
         return (type == o.type) && (sender == o.sender) && (iface == o.iface) &&
-               (member == o.member) && (path == o.path) && (destination == o.destination);
+               (member == o.member) && (path == o.path) && (destination == o.destination) &&
+               (pathNamespace == o.pathNamespace) && (arg0Namespace == o.arg0Namespace) &&
+               (args == o.args) && (pathArgs == o.pathArgs);
     }
 
     /** Constructor */
-    Rule() : type(MESSAGE_INVALID) { }
+    Rule() : type(MESSAGE_INVALID), sessionless(SESSIONLESS_NOT_SPECIFIED) { }
 
     /**
      * Construct a rule from a rule string.
      *
      * @param ruleStr   String describing the rule.
      *                  This format of this string is specified in the DBUS spec.
+     *                  The argN, argNpath, arg0namespace and path_namespace keys are supported.
      *                  AllJoyn has added the following additional parameters:
      *                     sessionless  - Valid values are "true" and "false"
      *
@@ -97,6 +160,21 @@ struct Rule {
      */
     bool IsMatch(const Message& msg);
 
+    /**
+     * Return true if messages matches rule. The message body is only unmarshalled if all the
+     * header fields match and the rule has arg keys.
+     *
+     * @param msg      Message to compare with rule.
+     * @param msgArgs  Lazily unmarshalled arguments of msg.
+     * @return  true if this rule matches the message.
+     */
+    bool IsMatch(const Message& msg, MatchArgs& msgArgs);
+
+    /**
+     * Return true if the rule has keys that are matched against the message body.
+     */
+    bool HasArgMatches() const { return !args.empty() || !pathArgs.empty() || !arg0Namespace.empty(); }
+
     /**
      * String representation of a rule
      */
@@ -111,10 +189,24 @@ typedef std::multimap<BusEndpoint, Rule>::iterator RuleIterator;
 /**
  * RuleTable is a thread-safe store used for storing
  * and retrieving message bus routing rules.
+ *
+ * In addition to the endpoint ordered rule map, rules are indexed by their interned
+ * (interface, member) pair so that broadcast routing only has to look at the rules that
+ * could possibly match a message rather than walking every rule in the table.
  */
 class RuleTable {
   public:
 
+    /**
+     * Constructor
+     */
+    RuleTable() : nextInternId(1) { }
+
+    /**
+     * Destructor
+     */
+    ~RuleTable();
+
     /**
      * Add a rule for an endpoint.
      *
@@ -202,9 +294,76 @@ class RuleTable {
         return ret;
     }
 
+    /**
+     * Find the endpoints that have at least one rule matching a message.
+     * Only the rules in the index buckets for the message's (interface, member) pair and the
+     * corresponding wildcard buckets are evaluated. Each endpoint is reported at most once.
+     * Caller should obtain lock before calling this method.
+     *
+     * @param msg      Message to match against the rules.
+     * @param matches  [OUT] Endpoints with a matching rule (appended to).
+     */
+    void FindMatchingEndpoints(const Message& msg, std::vector<BusEndpoint>& matches);
+
   private:
+
+    /** Interned string identifier. ANY_ID is used for unspecified (empty) rule fields. */
+    typedef uint32_t InternId;
+
+    static const InternId ANY_ID = 0;            /**< Wildcard id for an empty rule field */
+    static const InternId NO_ID = 0xFFFFFFFF;    /**< Id of a string that no rule refers to */
+
+    /** An interned string along with its reference count */
+    struct InternEntry {
+        qcc::String str;
+        InternId id;
+        uint32_t refs;
+        InternEntry(const qcc::String& str, InternId id) : str(str), id(id), refs(0) { }
+    };
+
+    /** A rule in an index bucket */
+    struct IndexEntry {
+        RuleIterator it;      /**< Rule (and endpoint) in the rule map */
+        InternId pathId;      /**< Interned path of the rule or ANY_ID */
+        IndexEntry(RuleIterator it, InternId pathId) : it(it), pathId(pathId) { }
+    };
+
+    typedef std::vector<IndexEntry> RuleBucket;
+
+    struct Hash {
+        inline size_t operator()(const char* s) const {
+            return qcc::hash_string(s);
+        }
+    };
+
+    struct Equal {
+        inline bool operator()(const char* s1, const char* s2) const {
+            return strcmp(s1, s2) == 0;
+        }
+    };
+
+    static uint64_t BucketKey(InternId ifaceId, InternId memberId) {
+        return (static_cast<uint64_t>(ifaceId) << 32) | memberId;
+    }
+
+    InternId Intern(const qcc::String& str);
+
+    void Release(const qcc::String& str);
+
+    InternId LookupId(const char* str) const;
+
+    void IndexRule(RuleIterator it);
+
+    void UnindexRule(RuleIterator it);
+
+    void MatchBucket(uint64_t key, InternId pathId, const Message& msg, MatchArgs& msgArgs, std::vector<BusEndpoint>& matches);
+
     qcc::Mutex lock;                            /**< Lock protecting rule table */
     std::multimap<BusEndpoint, Rule> rules;    /**< Rule table */
+
+    std::unordered_map<const char*, InternEntry*, Hash, Equal> internTable;   /**< Interned interface/member/path strings */
+    InternId nextInternId;                                                  /**< Next intern id to hand out */
+    std::unordered_map<uint64_t, RuleBucket> buckets;                       /**< Rules indexed by (interface, member) */
 };
 
 }
@@ -21,6 +21,13 @@
 
 #include <qcc/platform.h>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include <qcc/time.h>
+
 #include <alljoyn/AllJoynStd.h>
 #include <alljoyn/Session.h>
 
@@ -320,13 +327,7 @@ QStatus SessionlessObj::PushMessage(Message& msg)
     /* Put the message in the map and kick the worker */
     MessageMapKey key(msg->GetSender(), msg->GetInterface(), msg->GetMemberName(), msg->GetObjectPath());
     lock.Lock();
-    pair<uint32_t, Message> val(nextChangeId++, msg);
-    map<MessageMapKey, pair<uint32_t, Message> >::iterator it = messageMap.find(key);
-    if (it == messageMap.end()) {
-        messageMap.insert(pair<MessageMapKey, pair<uint32_t, Message> >(key, val));
-    } else {
-        it->second = val;
-    }
+    InsertMessage(key, nextChangeId++, msg);
     lock.Unlock();
     uint32_t zero = 0;
     SessionlessObj* slObj = this;
@@ -348,23 +349,27 @@ bool SessionlessObj::RouteSessionlessMessage(uint32_t sessionId, Message& msg)
     lock.Lock();
     map<uint32_t, CatchupState>::const_iterator it = catchupMap.find(sessionId);
     if (it != catchupMap.end()) {
-        String epName = it->second.sender;
+        vector<String> epNames(1, it->second.sender);
+        epNames.insert(epNames.end(), it->second.moreSenders.begin(), it->second.moreSenders.end());
         lock.Unlock();
-        router.LockNameTable();
-        BusEndpoint ep = router.FindEndpoint(epName);
-        if (ep->IsValid()) {
-            QStatus status;
-            router.UnlockNameTable();
-            if (ep->GetEndpointType() == ENDPOINT_TYPE_VIRTUAL) {
-                status = VirtualEndpoint::cast(ep)->PushMessage(msg, sessionId);
+        for (vector<String>::const_iterator nit = epNames.begin(); nit != epNames.end(); ++nit) {
+            const String& epName = *nit;
+            router.LockNameTable();
+            BusEndpoint ep = router.FindEndpoint(epName);
+            if (ep->IsValid()) {
+                QStatus status;
+                router.UnlockNameTable();
+                if (ep->GetEndpointType() == ENDPOINT_TYPE_VIRTUAL) {
+                    status = VirtualEndpoint::cast(ep)->PushMessage(msg, sessionId);
+                } else {
+                    status = ep->PushMessage(msg);
+                }
+                if (status != ER_OK) {
+                    QCC_LogError(status, ("PushMessage to %s failed", epName.c_str()));
+                }
             } else {
-                status = ep->PushMessage(msg);
-            }
-            if (status != ER_OK) {
-                QCC_LogError(status, ("PushMessage to %s failed", epName.c_str()));
+                router.UnlockNameTable();
             }
-        } else {
-            router.UnlockNameTable();
         }
         ret = true;
     } else {
@@ -382,13 +387,13 @@ QStatus SessionlessObj::CancelMessage(const qcc::String& sender, uint32_t serial
 
     lock.Lock();
     MessageMapKey key(sender.c_str(), "", "", "");
-    map<MessageMapKey, pair<uint32_t, Message> >::iterator it = messageMap.lower_bound(key);
+    MessageMap::iterator it = messageMap.lower_bound(key);
     while ((it != messageMap.end()) && (sender == it->second.second->GetSender())) {
         if (it->second.second->GetCallSerial() == serialNum) {
             if (!it->second.second->IsExpired()) {
                 status = ER_OK;
             }
-            messageMap.erase(it);
+            EraseMessage(it);
             messageErased = true;
             break;
         }
@@ -488,9 +493,9 @@ void SessionlessObj::NameOwnerChanged(const String& name,
 
         /* Remove stored sessionless messages sent by toldOwner */
         MessageMapKey key(oldOwner->c_str(), "", "", "");
-        map<MessageMapKey, pair<uint32_t, Message> >::iterator mit = messageMap.lower_bound(key);
+        MessageMap::iterator mit = messageMap.lower_bound(key);
         while ((mit != messageMap.end()) && (::strcmp(oldOwner->c_str(), mit->second.second->GetSender()) == 0)) {
-            messageMap.erase(mit++);
+            EraseMessage(mit++);
         }
         /* Alert the advertiser worker if messageMap is empty */
         if (messageMap.empty()) {
@@ -681,43 +686,55 @@ void SessionlessObj::HandleRangeRequest(const char* sender, SessionId sessionId,
     /* Enable concurrency since PushMessage could block */
     bus.EnableConcurrentCallbacks();
 
-    /* Send all messages in messageMap in range [fromChangeId, toChangeId) */
+    /*
+     * Collect the messages in range [fromChangeId, toChangeId) from the change id index. A range
+     * that wraps around continues from the lowest change id.
+     */
+    vector<Message> msgs;
     lock.Lock();
-    map<MessageMapKey, pair<uint32_t, Message> >::iterator it = messageMap.begin();
     uint32_t rangeLen = toChangeId - fromChangeId;
-    while (it != messageMap.end()) {
-        if (IN_WINDOW(uint32_t, fromChangeId, rangeLen, it->second.first)) {
-            MessageMapKey key = it->first;
-            if (it->second.second->IsExpired()) {
-                /* Remove expired message without sending */
-                messageMap.erase(++it);
-                messageErased = true;
+    bool wraps = static_cast<uint32_t>(fromChangeId + rangeLen) < fromChangeId;
+    bool wrapped = false;
+    map<uint32_t, MessageMap::iterator>::iterator cit = changeIdIndex.lower_bound(fromChangeId);
+    while (true) {
+        if (cit == changeIdIndex.end()) {
+            if (!wraps || wrapped) {
+                break;
+            }
+            wrapped = true;
+            cit = changeIdIndex.begin();
+            continue;
+        }
+        if ((wrapped && (cit->first >= fromChangeId)) || !IN_WINDOW(uint32_t, fromChangeId, rangeLen, cit->first)) {
+            break;
+        }
+        MessageMap::iterator it = (cit++)->second;
+        if (it->second.second->IsExpired()) {
+            /* Remove expired message without sending */
+            EraseMessage(it);
+            messageErased = true;
+        } else {
+            msgs.push_back(it->second.second);
+        }
+    }
+    lock.Unlock();
+
+    /* Send the messages */
+    if (!msgs.empty()) {
+        router.LockNameTable();
+        BusEndpoint ep = router.FindEndpoint(sender);
+        router.UnlockNameTable();
+        for (vector<Message>::iterator mit = msgs.begin(); ep->IsValid() && (mit != msgs.end()); ++mit) {
+            if (ep->GetEndpointType() == ENDPOINT_TYPE_VIRTUAL) {
+                status = VirtualEndpoint::cast(ep)->PushMessage(*mit, sessionId);
             } else {
-                /* Send message */
-                lock.Unlock();
-                router.LockNameTable();
-                BusEndpoint ep = router.FindEndpoint(sender);
-                if (ep->IsValid()) {
-                    router.UnlockNameTable();
-                    if (ep->GetEndpointType() == ENDPOINT_TYPE_VIRTUAL) {
-                        status = VirtualEndpoint::cast(ep)->PushMessage(it->second.second, sessionId);
-                    } else {
-                        status = ep->PushMessage(it->second.second);
-                    }
-                } else {
-                    router.UnlockNameTable();
-                }
-                lock.Lock();
-                it = messageMap.upper_bound(key);
+                status = ep->PushMessage(*mit);
             }
             if (status != ER_OK) {
                 QCC_LogError(status, ("Failed to push sessionless signal to %s", sender));
             }
-        } else {
-            ++it;
         }
     }
-    lock.Unlock();
 
     /* Alert the advertiser worker */
     if (messageErased) {
@@ -743,24 +760,11 @@ void SessionlessObj::AlarmTriggered(const Alarm& alarm, QStatus reason)
     QStatus status;
 
     if (reason == ER_OK) {
-        uint32_t tilExpire = ::numeric_limits<uint32_t>::max();
-        uint32_t expire;
-        uint32_t maxChangeId = 0;
-        bool mapIsEmpty = true;
-
         /* Purge the messageMap of expired messages */
         lock.Lock();
-        map<MessageMapKey, pair<uint32_t, Message> >::iterator it = messageMap.begin();
-        while (it != messageMap.end()) {
-            if (it->second.second->IsExpired(&expire)) {
-                messageMap.erase(it++);
-            } else {
-                maxChangeId = max(maxChangeId, it->second.first);
-                tilExpire = min(tilExpire, expire);
-                mapIsEmpty = false;
-                ++it;
-            }
-        }
+        uint32_t tilExpire = PurgeExpiredMessages();
+        bool mapIsEmpty = messageMap.empty();
+        uint32_t maxChangeId = mapIsEmpty ? 0 : changeIdIndex.rbegin()->first;
         lock.Unlock();
 
         /* Change advertisment if map is empty or if maxChangeId > lastAdvChangeId */
@@ -808,6 +812,76 @@ void SessionlessObj::AlarmTriggered(const Alarm& alarm, QStatus reason)
     }
 }
 
+void SessionlessObj::InsertMessage(const MessageMapKey& key, uint32_t changeId, Message& msg)
+{
+    MessageMap::iterator it = messageMap.find(key);
+    if (it == messageMap.end()) {
+        it = messageMap.insert(pair<MessageMapKey, pair<uint32_t, Message> >(key, pair<uint32_t, Message>(changeId, msg))).first;
+    } else {
+        changeIdIndex.erase(it->second.first);
+        it->second = pair<uint32_t, Message>(changeId, msg);
+    }
+    changeIdIndex[changeId] = it;
+
+    greater<pair<uint64_t, uint32_t> > cmp;
+    uint32_t tilExpire;
+    if (expireHeap.size() >= (2 * messageMap.size() + 64)) {
+        /* Rebuild the heap when it is mostly entries for messages that have been replaced or removed */
+        uint64_t now = GetTimestamp64();
+        expireHeap.clear();
+        for (MessageMap::iterator mit = messageMap.begin(); mit != messageMap.end(); ++mit) {
+            mit->second.second->IsExpired(&tilExpire);
+            if (tilExpire != numeric_limits<uint32_t>::max()) {
+                expireHeap.push_back(pair<uint64_t, uint32_t>(now + tilExpire, mit->second.first));
+            }
+        }
+        make_heap(expireHeap.begin(), expireHeap.end(), cmp);
+    } else {
+        msg->IsExpired(&tilExpire);
+        if (tilExpire != numeric_limits<uint32_t>::max()) {
+            expireHeap.push_back(pair<uint64_t, uint32_t>(GetTimestamp64() + tilExpire, changeId));
+            push_heap(expireHeap.begin(), expireHeap.end(), cmp);
+        }
+    }
+}
+
+void SessionlessObj::EraseMessage(MessageMap::iterator it)
+{
+    map<uint32_t, MessageMap::iterator>::iterator cit = changeIdIndex.find(it->second.first);
+    if ((cit != changeIdIndex.end()) && (cit->second == it)) {
+        changeIdIndex.erase(cit);
+    }
+    messageMap.erase(it);
+}
+
+uint32_t SessionlessObj::PurgeExpiredMessages()
+{
+    greater<pair<uint64_t, uint32_t> > cmp;
+    uint64_t now = GetTimestamp64();
+    while (!expireHeap.empty() && (expireHeap.front().first <= now)) {
+        uint32_t changeId = expireHeap.front().second;
+        pop_heap(expireHeap.begin(), expireHeap.end(), cmp);
+        expireHeap.pop_back();
+        /* The message may have been replaced or removed since the entry was added */
+        map<uint32_t, MessageMap::iterator>::iterator cit = changeIdIndex.find(changeId);
+        if (cit != changeIdIndex.end()) {
+            uint32_t tilExpire;
+            if (cit->second->second.second->IsExpired(&tilExpire)) {
+                EraseMessage(cit->second);
+            } else {
+                /* Message timestamps have millisecond resolution so check again later */
+                expireHeap.push_back(pair<uint64_t, uint32_t>(now + tilExpire, changeId));
+                push_heap(expireHeap.begin(), expireHeap.end(), cmp);
+            }
+        }
+    }
+    if (expireHeap.empty()) {
+        return numeric_limits<uint32_t>::max();
+    } else {
+        return static_cast<uint32_t>(expireHeap.front().first - now);
+    }
+}
+
 void SessionlessObj::JoinSessionCB(QStatus status, SessionId id, const SessionOpts& opts, void* context)
 {
     pair<uint32_t, String>* ctx1 = reinterpret_cast<pair<uint32_t, String>*>(context);
@@ -856,10 +930,21 @@ void SessionlessObj::JoinSessionCB(QStatus status, SessionId id, const SessionOp
                 }
                 router.UnlockNameTable();
                 if (rangeCapable) {
-                    /* Handle head of catchup list */
+                    /*
+                     * Handle head of catchup list. Catchups queued behind it for the same range
+                     * share this session rather than each joining a session of their own.
+                     */
                     isCatchup = true;
                     catchup = cit->second.catchupList.front();
                     cit->second.catchupList.pop();
+                    while (!cit->second.catchupList.empty() && (cit->second.catchupList.front().changeId == catchup.changeId)) {
+                        const String& sender = cit->second.catchupList.front().sender;
+                        if ((sender != catchup.sender) &&
+                            (find(catchup.moreSenders.begin(), catchup.moreSenders.end(), sender) == catchup.moreSenders.end())) {
+                            catchup.moreSenders.push_back(sender);
+                        }
+                        cit->second.catchupList.pop();
+                    }
                 } else {
                     /* This session cant be used for catchup because remote side doesn't support it */
                     /* Just clear the catchupList and move on as if it was the non-catchup case */
@@ -26,6 +26,7 @@
 #include <map>
 #include <set>
 #include <queue>
+#include <vector>
 
 #include <qcc/String.h>
 #include <qcc/Timer.h>
@@ -276,8 +277,44 @@ class SessionlessObj : public BusObject, public NameListener, public SessionList
         }
     };
 
+    typedef std::map<MessageMapKey, std::pair<uint32_t, Message> > MessageMap;
+
     /** Storage for sessionless messages waiting to be delivered */
-    std::map<MessageMapKey, std::pair<uint32_t, Message> > messageMap;
+    MessageMap messageMap;
+
+    /** Index of messageMap by change id */
+    std::map<uint32_t, MessageMap::iterator> changeIdIndex;
+
+    /**
+     * Min-heap of (expiration time, change id) for the messages in messageMap that have a TTL.
+     * Entries for messages that have since been replaced or removed are discarded when they reach
+     * the top of the heap.
+     */
+    std::vector<std::pair<uint64_t, uint32_t> > expireHeap;
+
+    /**
+     * Add a message to messageMap replacing any message with the same key. Must be called with
+     * lock held.
+     *
+     * @param key       Key for the message.
+     * @param changeId  Change id of the message.
+     * @param msg       The message.
+     */
+    void InsertMessage(const MessageMapKey& key, uint32_t changeId, Message& msg);
+
+    /**
+     * Remove a message from messageMap. Must be called with lock held.
+     *
+     * @param it   Iterator for the message to remove.
+     */
+    void EraseMessage(MessageMap::iterator it);
+
+    /**
+     * Remove expired messages from messageMap. Must be called with lock held.
+     *
+     * @return  Milliseconds until the next message expires or max uint32_t if no message expires.
+     */
+    uint32_t PurgeExpiredMessages();
 
     /** Count the number of rules (per endpoint) that specify sesionless=TRUE */
     std::map<qcc::String, uint32_t> ruleCountMap;
@@ -290,6 +327,7 @@ class SessionlessObj : public BusObject, public NameListener, public SessionList
         qcc::String guid;
         uint32_t changeId;
         uint32_t sessionId;
+        std::vector<qcc::String> moreSenders;   /**< Other local clients catching up on the same range over the same session */
     };
     /** Map sessionIds to catupStates */
     std::map<uint32_t, CatchupState> catchupMap;
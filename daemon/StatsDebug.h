@@ -0,0 +1,286 @@
+/**
+ * @file
+ * Debug interface (org.alljoyn.Bus.Debug.Stats) for getting traffic statistics
+ * for the daemon's endpoints and router.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#ifndef _ALLJOYN_STATSDEBUGOBJ_H
+#define _ALLJOYN_STATSDEBUGOBJ_H
+
+// Include contents in debug builds only.
+#ifndef NDEBUG
+
+#include <qcc/platform.h>
+
+#include <vector>
+
+#include <qcc/Debug.h>
+#include <qcc/Mutex.h>
+#include <qcc/String.h>
+#include <qcc/StringUtil.h>
+#include <qcc/Timer.h>
+
+#include "AllJoynDebugObj.h"
+#include "DaemonRouter.h"
+#include "MsgBufferPool.h"
+#include "RemoteEndpoint.h"
+
+
+namespace ajn {
+
+namespace debug {
+
+
+/**
+ * Debug interface for org.alljoyn.Bus.Debug.Stats. Exposes the traffic statistics kept by
+ * the remote endpoints and the router and the message buffer pool statistics as properties and can periodically dump them to the
+ * debug log.
+ *
+ * @cond ALLJOYN_DEV
+ *
+ * This is implemented entirely in the header file for the following reasons:
+ *
+ * - It is only instantiated in one place in debug builds only.
+ * - It is easily excluded from release builds by conditionally including it.
+ *
+ * @endcond
+ */
+class StatsDebugObj : public AllJoynDebugObjAddon, public qcc::AlarmListener {
+  public:
+    class StatsDebugProperties;
+    friend class StatsDebugProperties;
+
+    class StatsDebugProperties : public AllJoynDebugObj::Properties {
+      public:
+        StatsDebugProperties(StatsDebugObj& owner) : owner(owner) { }
+
+        QStatus Get(const char* propName, MsgArg& val) const
+        {
+            if (::strcmp(propName, "Endpoints") == 0) {
+                return owner.GetEndpointStats(val);
+            } else if (::strcmp(propName, "Router") == 0) {
+                return owner.GetRouterStats(val);
+            } else if (::strcmp(propName, "MsgBuffers") == 0) {
+                return owner.GetMsgBufferStats(val);
+            } else if (::strcmp(propName, "DumpPeriod") == 0) {
+                return val.Set("u", owner.GetDumpPeriod());
+            }
+            return ER_BUS_NO_SUCH_PROPERTY;
+        }
+
+        QStatus Set(const char* propName, MsgArg& val)
+        {
+            if (::strcmp(propName, "DumpPeriod") == 0) {
+                uint32_t period;
+                QStatus status = val.Get("u", &period);
+                if (status == ER_OK) {
+                    status = owner.SetDumpPeriod(period);
+                }
+                return status;
+            } else if ((::strcmp(propName, "Endpoints") == 0) || (::strcmp(propName, "Router") == 0) ||
+                       (::strcmp(propName, "MsgBuffers") == 0)) {
+                return ER_BUS_PROPERTY_ACCESS_DENIED;
+            }
+            return ER_BUS_NO_SUCH_PROPERTY;
+        }
+
+        void GetProperyInfo(const AllJoynDebugObj::Properties::Info*& info, size_t& infoSize)
+        {
+            static const AllJoynDebugObj::Properties::Info ourInfo[] = {
+                { "Endpoints",  "a(sttttuuuau)", PROP_ACCESS_READ },
+                { "Router",     "a{st}",         PROP_ACCESS_READ },
+                { "MsgBuffers", "a{st}",         PROP_ACCESS_READ },
+                { "DumpPeriod", "u",             PROP_ACCESS_RW },
+            };
+            info = ourInfo;
+            infoSize = ArraySize(ourInfo);
+        }
+
+      private:
+        StatsDebugObj& owner;
+    };
+
+    StatsDebugObj(DaemonRouter& router) :
+        router(router),
+        properties(*this),
+        timer("StatsDump"),
+        timerStarted(false),
+        dumpPeriod(0)
+    {
+        AllJoynDebugObj* dbg = AllJoynDebugObj::GetAllJoynDebugObj();
+
+#define _MethodHandler(_a) static_cast<AllJoynDebugObjAddon::MethodHandler>(_a)
+        AllJoynDebugObj::MethodInfo methodInfo[] = {
+            { "DumpStats",   NULL,   NULL, NULL,
+              _MethodHandler(&StatsDebugObj::DumpStatsHandler) },
+        };
+#undef _MethodHandler
+
+        dbg->AddDebugInterface(this,
+                               "org.alljoyn.Bus.Debug.Stats",
+                               methodInfo, ArraySize(methodInfo),
+                               properties);
+    }
+
+    ~StatsDebugObj()
+    {
+        timer.Stop();
+        timer.Join();
+    }
+
+  private:
+
+    /** Property value for each endpoint: name, rx msgs, rx bytes, tx msgs, tx bytes, tx queue high-water, rx/tx TTL drops, latency histogram */
+    QStatus GetEndpointStats(MsgArg& val) const
+    {
+        std::vector<RemoteEndpoint> endpoints;
+        router.GetRemoteEndpoints(endpoints);
+
+        std::vector<MsgArg> elements;
+        elements.reserve(endpoints.size());
+        for (std::vector<RemoteEndpoint>::iterator it = endpoints.begin(); it != endpoints.end(); ++it) {
+            _RemoteEndpoint::TrafficStats stats;
+            (*it)->GetTrafficStats(stats);
+            elements.push_back(MsgArg("(sttttuuuau)", (*it)->GetUniqueName().c_str(),
+                                      stats.rxMsgs, stats.rxBytes, stats.txMsgs, stats.txBytes,
+                                      stats.txQueueHighWater, stats.rxTtlDrops, stats.txTtlDrops,
+                                      _RemoteEndpoint::TrafficStats::LATENCY_BUCKETS, stats.txLatency));
+            elements.back().Stabilize();
+        }
+        QStatus status = val.Set("a(sttttuuuau)", elements.size(), elements.empty() ? NULL : &elements.front());
+        val.Stabilize();
+        return status;
+    }
+
+    QStatus GetRouterStats(MsgArg& val) const
+    {
+        DaemonRouter::RouterStats stats;
+        router.GetRouterStats(stats);
+
+        MsgArg entries[4];
+        entries[0].Set("{st}", "Routed", static_cast<uint64_t>(stats.routed));
+        entries[1].Set("{st}", "NoRoute", static_cast<uint64_t>(stats.noRoute));
+        entries[2].Set("{st}", "Broadcasts", static_cast<uint64_t>(stats.broadcasts));
+        entries[3].Set("{st}", "RuleMatches", stats.ruleMatches);
+        QStatus status = val.Set("a{st}", ArraySize(entries), entries);
+        val.Stabilize();
+        return status;
+    }
+
+    QStatus GetMsgBufferStats(MsgArg& val) const
+    {
+        MsgBufferPool::Stats stats;
+        MsgBufferPool::GetStats(stats);
+
+        MsgArg entries[3];
+        entries[0].Set("{st}", "Allocs", stats.allocs);
+        entries[1].Set("{st}", "PoolHits", stats.poolHits);
+        entries[2].Set("{st}", "LargeAllocs", stats.largeAllocs);
+        QStatus status = val.Set("a{st}", ArraySize(entries), entries);
+        val.Stabilize();
+        return status;
+    }
+
+    uint32_t GetDumpPeriod() const { return dumpPeriod; }
+
+    /**
+     * Set the period in seconds at which the statistics are dumped to the debug log, 0 turns
+     * the periodic dump off.
+     */
+    QStatus SetDumpPeriod(uint32_t period)
+    {
+        QStatus status = ER_OK;
+        lock.Lock(MUTEX_CONTEXT);
+        if (dumpPeriod) {
+            timer.RemoveAlarm(dumpAlarm);
+        }
+        dumpPeriod = period;
+        if (dumpPeriod) {
+            if (!timerStarted) {
+                status = timer.Start();
+                timerStarted = (status == ER_OK);
+            }
+            if (status == ER_OK) {
+                dumpAlarm = qcc::Alarm(dumpPeriod * 1000, this, NULL, dumpPeriod * 1000);
+                status = timer.AddAlarm(dumpAlarm);
+            }
+            if (status != ER_OK) {
+                dumpPeriod = 0;
+            }
+        }
+        lock.Unlock(MUTEX_CONTEXT);
+        return status;
+    }
+
+    void AlarmTriggered(const qcc::Alarm& alarm, QStatus reason)
+    {
+        if (reason == ER_OK) {
+            DumpStats();
+        }
+    }
+
+    void DumpStats()
+    {
+        std::vector<RemoteEndpoint> endpoints;
+        router.GetRemoteEndpoints(endpoints);
+        for (std::vector<RemoteEndpoint>::iterator it = endpoints.begin(); it != endpoints.end(); ++it) {
+            _RemoteEndpoint::TrafficStats stats;
+            (*it)->GetTrafficStats(stats);
+            qcc::String latency;
+            for (size_t i = 0; i < _RemoteEndpoint::TrafficStats::LATENCY_BUCKETS; ++i) {
+                latency += (i ? " " : "") + qcc::U32ToString(stats.txLatency[i]);
+            }
+            QCC_DbgHLPrintf(("Stats %s: rx %llu msgs %llu bytes, tx %llu msgs %llu bytes, txq high-water %u, TTL drops rx %u tx %u, latency [%s]",
+                             (*it)->GetUniqueName().c_str(),
+                             static_cast<unsigned long long>(stats.rxMsgs), static_cast<unsigned long long>(stats.rxBytes),
+                             static_cast<unsigned long long>(stats.txMsgs), static_cast<unsigned long long>(stats.txBytes),
+                             stats.txQueueHighWater, stats.rxTtlDrops, stats.txTtlDrops, latency.c_str()));
+        }
+        DaemonRouter::RouterStats stats;
+        router.GetRouterStats(stats);
+        QCC_DbgHLPrintf(("Stats router: routed %u, no route %u, broadcasts %u, rule matches %llu",
+                         stats.routed, stats.noRoute, stats.broadcasts, static_cast<unsigned long long>(stats.ruleMatches)));
+        MsgBufferPool::Stats bufStats;
+        MsgBufferPool::GetStats(bufStats);
+        QCC_DbgHLPrintf(("Stats message buffers: allocs %llu, pool hits %llu, large allocs %llu",
+                         static_cast<unsigned long long>(bufStats.allocs), static_cast<unsigned long long>(bufStats.poolHits),
+                         static_cast<unsigned long long>(bufStats.largeAllocs)));
+    }
+
+    QStatus DumpStatsHandler(Message& msg, std::vector<MsgArg>& replyArgs)
+    {
+        DumpStats();
+        return ER_OK;
+    }
+
+    DaemonRouter& router;
+    StatsDebugProperties properties;
+    qcc::Timer timer;          /**< Timer for the periodic dump */
+    bool timerStarted;
+    qcc::Alarm dumpAlarm;
+    uint32_t dumpPeriod;       /**< Dump period in seconds or 0 if the periodic dump is off */
+    qcc::Mutex lock;           /**< Protects the periodic dump state */
+};
+
+
+
+} // namespace debug
+} // namespace ajn
+
+#endif
+#endif
@@ -849,6 +849,10 @@ void TCPTransport::Authenticated(TCPEndpoint& conn)
 
     conn->SetListener(this);
 
+    DaemonRouter& router = reinterpret_cast<DaemonRouter&>(m_bus.GetInternal().GetRouter());
+    RemoteEndpoint rep = RemoteEndpoint::cast(conn);
+    router.ConfigureTxQueue(rep);
+
     conn->SetEpStarting();
 
     QStatus status = conn->Start();
@@ -2827,6 +2831,8 @@ QStatus TCPTransport::Connect(const char* connectSpec, const SessionOpts& opts,
         status = tcpEp->Establish("ANONYMOUS", authName, redirection, authListener);
         if (status == ER_OK) {
             tcpEp->SetListener(this);
+            RemoteEndpoint rep = RemoteEndpoint::cast(tcpEp);
+            router.ConfigureTxQueue(rep);
             tcpEp->SetEpStarting();
             status = tcpEp->Start();
             if (status == ER_OK) {
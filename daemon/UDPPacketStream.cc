@@ -23,6 +23,13 @@
 #include <qcc/Util.h>
 #include <errno.h>
 #include <assert.h>
+#include <algorithm>
+
+#if defined(QCC_OS_LINUX)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#endif
 
 #include <qcc/Event.h>
 #include <qcc/Debug.h>
@@ -37,6 +44,44 @@ using namespace qcc;
 
 namespace ajn {
 
+#if defined(QCC_OS_LINUX)
+/* Max number of datagrams moved by a single recvmmsg or sendmmsg call */
+static const size_t MAX_MMSG_BATCH = 32;
+
+static socklen_t RenderSockAddr(const PacketDest& dest, struct sockaddr_storage& addr)
+{
+    ::memset(&addr, 0, sizeof(addr));
+    if (dest.addrSize == IPAddress::IPv4_SIZE) {
+        struct sockaddr_in* sa = reinterpret_cast<struct sockaddr_in*>(&addr);
+        sa->sin_family = AF_INET;
+        sa->sin_port = htons(dest.port);
+        ::memcpy(&sa->sin_addr, dest.ip, IPAddress::IPv4_SIZE);
+        return sizeof(struct sockaddr_in);
+    } else {
+        struct sockaddr_in6* sa = reinterpret_cast<struct sockaddr_in6*>(&addr);
+        sa->sin6_family = AF_INET6;
+        sa->sin6_port = htons(dest.port);
+        ::memcpy(&sa->sin6_addr, dest.ip, IPAddress::IPv6_SIZE);
+        return sizeof(struct sockaddr_in6);
+    }
+}
+
+static void ParseSockAddr(const struct sockaddr_storage& addr, PacketDest& sender)
+{
+    if (addr.ss_family == AF_INET) {
+        const struct sockaddr_in* sa = reinterpret_cast<const struct sockaddr_in*>(&addr);
+        ::memcpy(sender.ip, &sa->sin_addr, IPAddress::IPv4_SIZE);
+        sender.addrSize = IPAddress::IPv4_SIZE;
+        sender.port = ntohs(sa->sin_port);
+    } else {
+        const struct sockaddr_in6* sa = reinterpret_cast<const struct sockaddr_in6*>(&addr);
+        ::memcpy(sender.ip, &sa->sin6_addr, IPAddress::IPv6_SIZE);
+        sender.addrSize = IPAddress::IPv6_SIZE;
+        sender.port = ntohs(sa->sin6_port);
+    }
+}
+#endif
+
 UDPPacketStream::UDPPacketStream(const char* ifaceName, uint16_t port) :
     ipAddr(),
     port(port),
@@ -190,7 +235,9 @@ QStatus UDPPacketStream::PullPacketBytes(void* buf, size_t reqBytes, size_t& act
     IPAddress tmpIpAddr;
     uint16_t tmpPort = 0;
     status =  qcc::RecvFrom(sock, tmpIpAddr, tmpPort, buf, recvBytes, actualBytes);
-    if (ER_OK != status) {
+    if (ER_WOULDBLOCK == status) {
+        /* Another PacketEngine rx thread emptied the socket first */
+    } else if (ER_OK != status) {
         QCC_LogError(status, ("recvfrom failed: %s", ::strerror(errno)));
     } else {
         tmpIpAddr.RenderIPBinary(sender.ip, IPAddress::IPv6_SIZE);
@@ -200,6 +247,83 @@ QStatus UDPPacketStream::PullPacketBytes(void* buf, size_t reqBytes, size_t& act
     return status;
 }
 
+#if defined(QCC_OS_LINUX)
+QStatus UDPPacketStream::PushPacketBatch(PacketBatchEntry* entries, size_t numEntries, size_t& numPushed)
+{
+    struct mmsghdr msgs[MAX_MMSG_BATCH];
+    struct iovec iovs[MAX_MMSG_BATCH];
+    struct sockaddr_storage addrs[MAX_MMSG_BATCH];
+
+    numPushed = 0;
+    while (numPushed < numEntries) {
+        size_t num = min(numEntries - numPushed, MAX_MMSG_BATCH);
+        ::memset(msgs, 0, num * sizeof(msgs[0]));
+        for (size_t i = 0; i < num; ++i) {
+            PacketBatchEntry& entry = entries[numPushed + i];
+            assert(entry.numBytes <= mtu);
+            iovs[i].iov_base = entry.buf;
+            iovs[i].iov_len = entry.numBytes;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = RenderSockAddr(entry.dest, addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int ret = ::sendmmsg(sock, msgs, num, 0);
+        if (ret <= 0) {
+            QStatus status = ER_OS_ERROR;
+            QCC_LogError(status, ("sendmmsg failed: %s (%d)", ::strerror(errno), errno));
+            return status;
+        }
+        for (int i = 0; i < ret; ++i) {
+            if (msgs[i].msg_len != entries[numPushed].numBytes) {
+                QStatus status = ER_OS_ERROR;
+                QCC_LogError(status, ("Short udp send: exp=%d, act=%d", entries[numPushed].numBytes, msgs[i].msg_len));
+                return status;
+            }
+            ++numPushed;
+        }
+    }
+    return ER_OK;
+}
+
+QStatus UDPPacketStream::PullPacketBatch(PacketBatchEntry* entries, size_t numEntries, size_t& numPulled, uint32_t timeout)
+{
+    struct mmsghdr msgs[MAX_MMSG_BATCH];
+    struct iovec iovs[MAX_MMSG_BATCH];
+    struct sockaddr_storage addrs[MAX_MMSG_BATCH];
+
+    numPulled = 0;
+    size_t num = min(numEntries, MAX_MMSG_BATCH);
+    if (num == 0) {
+        return ER_OK;
+    }
+    ::memset(msgs, 0, num * sizeof(msgs[0]));
+    for (size_t i = 0; i < num; ++i) {
+        assert(entries[i].bufSize >= mtu);
+        iovs[i].iov_base = entries[i].buf;
+        iovs[i].iov_len = entries[i].bufSize;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int ret = ::recvmmsg(sock, msgs, num, MSG_DONTWAIT, NULL);
+    if (ret < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return ER_WOULDBLOCK;
+        }
+        QStatus status = ER_OS_ERROR;
+        QCC_LogError(status, ("recvmmsg failed: %s", ::strerror(errno)));
+        return status;
+    }
+    for (numPulled = 0; numPulled < static_cast<size_t>(ret); ++numPulled) {
+        entries[numPulled].numBytes = msgs[numPulled].msg_len;
+        ParseSockAddr(addrs[numPulled], entries[numPulled].dest);
+    }
+    return ER_OK;
+}
+#endif
+
 String UDPPacketStream::ToString(const PacketDest& dest) const
 {
     IPAddress ipAddr(dest.ip, dest.addrSize);
@@ -86,6 +86,19 @@ class UDPPacketStream : public PacketStream {
      */
     QStatus PullPacketBytes(void* buf, size_t reqBytes, size_t& actualBytes, PacketDest& sender, uint32_t timeout = qcc::Event::WAIT_FOREVER);
 
+#if defined(QCC_OS_LINUX)
+    /**
+     * Pull a batch of packets from the source with a single recvmmsg call.
+     *
+     * @param entries      Packet buffers to fill. numBytes and dest are set for each pulled packet.
+     * @param numEntries   Number of entries.
+     * @param numPulled    Number of packets pulled. Valid even if an error is returned.
+     * @param timeout      Ignored. Only packets already queued on the socket are pulled.
+     * @return   ER_OK if at least one packet was pulled. ER_WOULDBLOCK if none were queued. Otherwise an error.
+     */
+    QStatus PullPacketBatch(PacketBatchEntry* entries, size_t numEntries, size_t& numPulled, uint32_t timeout = qcc::Event::WAIT_FOREVER);
+#endif
+
     /**
      * Get the Event indicating that data is available when signaled.
      *
@@ -109,6 +122,18 @@ class UDPPacketStream : public PacketStream {
      */
     QStatus PushPacketBytes(const void* buf, size_t numBytes, PacketDest& dest);
 
+#if defined(QCC_OS_LINUX)
+    /**
+     * Push a batch of packets into the sink with a single sendmmsg call.
+     *
+     * @param entries      Packets to push. (numBytes of each must be less than or equal to MTU of PacketSink.)
+     * @param numEntries   Number of entries.
+     * @param numPushed    Number of packets pushed. Valid even if an error is returned.
+     * @return   ER_OK if all the packets were pushed.
+     */
+    QStatus PushPacketBatch(PacketBatchEntry* entries, size_t numEntries, size_t& numPushed);
+#endif
+
     /**
      * Get the Event that indicates when data can be pushed to sink.
      *
@@ -21,6 +21,9 @@
 
 #include <qcc/platform.h>
 
+#include <algorithm>
+#include <functional>
+
 #include <qcc/Debug.h>
 #include <qcc/Logger.h>
 #include <qcc/Util.h>
@@ -31,6 +34,12 @@ using namespace ajn;
 using namespace qcc;
 using namespace std;
 
+/*
+ * Upper bound on the number of cached verdicts.  The cache is simply emptied
+ * when it gets this big.
+ */
+static const size_t MAX_VERDICTS = 4096;
+
 uint32_t _PolicyDB::GetStringIDMapUpdate(const qcc::String& key)
 {
     uint32_t id;
@@ -122,7 +131,139 @@ bool _PolicyDB::TrueFalseStrToBool(const qcc::String& str, bool& b)
 }
 
 
-_PolicyDB::_PolicyDB() : eavesdrop(false)
+void _PolicyDB::PolicyRuleList::push_back(const PolicyRule& rule)
+{
+    uint32_t index = rules.size();
+    rules.push_back(rule);
+
+    if (rule.member != WILDCARD) {
+        byMember[rule.member].push_back(index);
+    } else if (rule.path != WILDCARD) {
+        byPath[rule.path].push_back(index);
+    } else if (rule.error != WILDCARD) {
+        byError[rule.error].push_back(index);
+    } else if (rule.busName != WILDCARD) {
+        byBusName[rule.busName].push_back(index);
+    } else {
+        unindexed.push_back(index);
+    }
+}
+
+
+void _PolicyDB::PolicyRuleList::GetCandidates(const NormalizedMsgHdr& nmh,
+                                              const BusNameIDSet& bnIDSet,
+                                              std::vector<uint32_t>& candidates) const
+{
+    RuleIndex::const_iterator it;
+
+    candidates.insert(candidates.end(), unindexed.begin(), unindexed.end());
+
+    it = byMember.find(nmh.memberID);
+    if (it != byMember.end()) {
+        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    }
+
+    it = byPath.find(nmh.pathID);
+    if (it != byPath.end()) {
+        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    }
+
+    it = byError.find(nmh.errorID);
+    if (it != byError.end()) {
+        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    }
+
+    if (!byBusName.empty()) {
+        for (BusNameIDSet::const_iterator bnit = bnIDSet.begin(); bnit != bnIDSet.end(); ++bnit) {
+            it = byBusName.find(*bnit);
+            if (it != byBusName.end()) {
+                candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+            }
+        }
+    }
+
+    /* Each rule is only indexed once so there are no duplicates to remove. */
+    sort(candidates.begin(), candidates.end(), greater<uint32_t>());
+}
+
+
+_PolicyDB::VerdictKey::VerdictKey(bool send, const NormalizedMsgHdr& nmh, uint32_t uid, uint32_t gid) :
+    send(send),
+    type(nmh.type),
+    ifcID(nmh.ifcID),
+    memberID(nmh.memberID),
+    errorID(nmh.errorID),
+    pathID(nmh.pathID),
+    uid(uid),
+    gid(gid),
+    busName(send ? nmh.destination : nmh.sender)
+{
+}
+
+
+bool _PolicyDB::VerdictKey::operator<(const VerdictKey& other) const
+{
+    if (send != other.send) {
+        return send < other.send;
+    }
+    if (type != other.type) {
+        return type < other.type;
+    }
+    if (ifcID != other.ifcID) {
+        return ifcID < other.ifcID;
+    }
+    if (memberID != other.memberID) {
+        return memberID < other.memberID;
+    }
+    if (errorID != other.errorID) {
+        return errorID < other.errorID;
+    }
+    if (pathID != other.pathID) {
+        return pathID < other.pathID;
+    }
+    if (uid != other.uid) {
+        return uid < other.uid;
+    }
+    if (gid != other.gid) {
+        return gid < other.gid;
+    }
+    return busName < other.busName;
+}
+
+
+bool _PolicyDB::GetCachedVerdict(const VerdictKey& key, bool& allow) const
+{
+    bool found(false);
+
+    bnLock.Lock(MUTEX_CONTEXT);
+    VerdictCache::const_iterator it(verdicts.find(key));
+    if (it != verdicts.end()) {
+        allow = it->second;
+        found = true;
+    }
+    bnLock.Unlock(MUTEX_CONTEXT);
+    return found;
+}
+
+
+void _PolicyDB::CacheVerdict(const VerdictKey& key, uint32_t generation, bool allow) const
+{
+    bnLock.Lock(MUTEX_CONTEXT);
+    if (generation == bnGeneration) {
+        if (verdicts.size() >= MAX_VERDICTS) {
+            verdicts.clear();
+        }
+
+        /* The key refers to the bus name in the message, the cache needs its own copy. */
+        VerdictKey stored(key);
+        stored.busName = qcc::StringMapKey(qcc::String(key.busName.c_str()));
+        verdicts[stored] = allow;
+    }
+    bnLock.Unlock(MUTEX_CONTEXT);
+}
+
+
+_PolicyDB::_PolicyDB() : eavesdrop(false), bnGeneration(0)
 {
     stringIDs[""] = WILDCARD;
     stringIDs["*"] = WILDCARD;
@@ -326,24 +467,24 @@ void _PolicyDB::NameOwnerChanged(const qcc::String& alias,
     StringIDMap::const_iterator bnit(busNameMap.find(alias));
 
     if (bnit != busNameMap.end()) {
+        bnLock.Lock(MUTEX_CONTEXT);
         if (oldOwner) {
             UniqueNameIDMap::iterator unit = uniqueNameMap.find(*oldOwner);
             if (unit != uniqueNameMap.end()) {
-                bnLock.Lock(MUTEX_CONTEXT);
                 unit->second.erase(bnit->second);
                 if (unit->second.empty()) {
                     uniqueNameMap.erase(unit);
                 }
-                bnLock.Unlock(MUTEX_CONTEXT);
             }
         }
         if (newOwner) {
-            if (bnit != busNameMap.end()) {
-                bnLock.Lock(MUTEX_CONTEXT);
-                uniqueNameMap[*newOwner].insert(bnit->second);
-                bnLock.Unlock(MUTEX_CONTEXT);
-            }
+            uniqueNameMap[*newOwner].insert(bnit->second);
         }
+
+        /* Verdicts involving either owner may no longer hold. */
+        ++bnGeneration;
+        verdicts.clear();
+        bnLock.Unlock(MUTEX_CONTEXT);
     }
 }
 
@@ -351,14 +492,16 @@ void _PolicyDB::NameOwnerChanged(const qcc::String& alias,
 bool _PolicyDB::CheckConnect(bool& allow, const PolicyRuleList& ruleList,
                              uint32_t uid, uint32_t gid) const
 {
-    PolicyRuleList::const_reverse_iterator it;
+    std::vector<PolicyRule>::const_reverse_iterator it;
     bool ruleMatch(false);
+    policydb::PolicyPermission permission;
 
-    for (it = ruleList.rbegin(); !ruleMatch && (it != ruleList.rend()); ++it) {
+    for (it = ruleList.rules.rbegin(); !ruleMatch && (it != ruleList.rules.rend()); ++it) {
         ruleMatch = (it->CheckUser(uid) && it->CheckGroup(gid));
+        permission = it->permission;
     }
     if (ruleMatch) {
-        allow = (it->permission == policydb::POLICY_ALLOW);
+        allow = (permission == policydb::POLICY_ALLOW);
     }
     return ruleMatch;;
 }
@@ -366,11 +509,11 @@ bool _PolicyDB::CheckConnect(bool& allow, const PolicyRuleList& ruleList,
 bool _PolicyDB::CheckOwn(bool& allow, const PolicyRuleList& ruleList,
                          uint32_t bnid) const
 {
-    PolicyRuleList::const_reverse_iterator it;
+    std::vector<PolicyRule>::const_reverse_iterator it;
     bool ruleMatch(false);
     policydb::PolicyPermission permission;
 
-    for (it = ruleList.rbegin(); !ruleMatch && (it != ruleList.rend()); ++it) {
+    for (it = ruleList.rules.rbegin(); !ruleMatch && (it != ruleList.rules.rend()); ++it) {
         ruleMatch = it->CheckOwn(bnid);
         permission = it->permission;
 
@@ -389,23 +532,27 @@ bool _PolicyDB::CheckMessage(bool& allow, const PolicyRuleList& ruleList,
                              const BusNameIDSet& bnIDSet,
                              bool eavesdrop) const
 {
-    PolicyRuleList::const_reverse_iterator it;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t>::const_iterator it;
     bool ruleMatch(false);
     policydb::PolicyPermission permission;
 
-    for (it = ruleList.rbegin(); !ruleMatch && (it != ruleList.rend()); ++it) {
-        ruleMatch = (it->CheckType(nmh.type) &&
-                     it->CheckInterface(nmh.ifcID) &&
-                     it->CheckMember(nmh.memberID) &&
-                     it->CheckPath(nmh.pathID) &&
-                     it->CheckError(nmh.errorID) &&
-                     it->CheckEavesdrop(eavesdrop) &&
-                     it->CheckBusName(bnIDSet));
-        permission = it->permission;
+    ruleList.GetCandidates(nmh, bnIDSet, candidates);
+
+    for (it = candidates.begin(); !ruleMatch && (it != candidates.end()); ++it) {
+        const PolicyRule& rule = ruleList.rules[*it];
+        ruleMatch = (rule.CheckType(nmh.type) &&
+                     rule.CheckInterface(nmh.ifcID) &&
+                     rule.CheckMember(nmh.memberID) &&
+                     rule.CheckPath(nmh.pathID) &&
+                     rule.CheckError(nmh.errorID) &&
+                     rule.CheckEavesdrop(eavesdrop) &&
+                     rule.CheckBusName(bnIDSet));
+        permission = rule.permission;
 
         ALLJOYN_POLICY_DEBUG(Log(LOG_DEBUG, "        checking rule: %s - %s - %s\n",
-                                 it->permission == policydb::POLICY_ALLOW ? "ALLOW" : "DENY",
-                                 it->ruleString.c_str(), ruleMatch ? "MATCH" : "no match"));
+                                 rule.permission == policydb::POLICY_ALLOW ? "ALLOW" : "DENY",
+                                 rule.ruleString.c_str(), ruleMatch ? "MATCH" : "no match"));
     }
 
     if (ruleMatch) {
@@ -514,6 +661,21 @@ bool _PolicyDB::OKToOwn(uint32_t busNameID,
 bool _PolicyDB::OKToReceive(const NormalizedMsgHdr& nmh,
                             uint32_t uid,
                             uint32_t gid) const
+{
+    VerdictKey key(false, nmh, uid, gid);
+    bool allow;
+
+    if (!GetCachedVerdict(key, allow)) {
+        allow = CheckReceive(nmh, uid, gid);
+        CacheVerdict(key, nmh.generation, allow);
+    }
+    return allow;
+}
+
+
+bool _PolicyDB::CheckReceive(const NormalizedMsgHdr& nmh,
+                             uint32_t uid,
+                             uint32_t gid) const
 {
     bool allow(false);
     bool ruleMatch(false);
@@ -566,6 +728,21 @@ bool _PolicyDB::OKToReceive(const NormalizedMsgHdr& nmh,
 bool _PolicyDB::OKToSend(const NormalizedMsgHdr& nmh,
                          uint32_t uid,
                          uint32_t gid) const
+{
+    VerdictKey key(true, nmh, uid, gid);
+    bool allow;
+
+    if (!GetCachedVerdict(key, allow)) {
+        allow = CheckSend(nmh, uid, gid);
+        CacheVerdict(key, nmh.generation, allow);
+    }
+    return allow;
+}
+
+
+bool _PolicyDB::CheckSend(const NormalizedMsgHdr& nmh,
+                          uint32_t uid,
+                          uint32_t gid) const
 {
     bool allow(((nmh.type != ajn::MESSAGE_INVALID) &&
                 (nmh.type != ajn::MESSAGE_METHOD_CALL)));
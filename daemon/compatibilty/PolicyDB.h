@@ -22,7 +22,12 @@
 #define _POLICYDB_H
 
 #include <qcc/platform.h>
+
+#include <map>
+#include <vector>
+
 #include <qcc/ManagedObj.h>
+#include <qcc/Mutex.h>
 #include <qcc/String.h>
 #include <qcc/StringMapKey.h>
 
@@ -397,7 +402,48 @@ class _PolicyDB {
         }
     };
 
-    typedef std::list<PolicyRule> PolicyRuleList;   /**< Policy rule list typedef */
+    /**
+     * A list of policy rules in the order they were added, later rules take
+     * precedence over earlier ones.  Each rule is also indexed by the first
+     * of its member, path, error or bus name that is not a wildcard, since a
+     * rule can only match a message that has that value.  This means only the
+     * rules that can possibly match a message need to be checked.
+     */
+    struct PolicyRuleList {
+        typedef std::unordered_map<uint32_t, std::vector<uint32_t> > RuleIndex;
+
+        std::vector<PolicyRule> rules;  /**< all of the rules */
+        RuleIndex byMember;             /**< rules indexed by member name */
+        RuleIndex byPath;               /**< rules indexed by object path */
+        RuleIndex byError;              /**< rules indexed by error name */
+        RuleIndex byBusName;            /**< rules indexed by bus name */
+        std::vector<uint32_t> unindexed; /**< rules with none of the above */
+
+        /**
+         * Add a rule to the end of the list and index it.
+         *
+         * @param rule  The rule to add
+         */
+        void push_back(const PolicyRule& rule);
+
+        /**
+         * Check if there are any rules in the list.
+         *
+         * @return true = no rules, false = some rules
+         */
+        bool empty() const { return rules.empty(); }
+
+        /**
+         * Get the rules that could match a message.
+         *
+         * @param nmh           normalized message header
+         * @param bnIDSet       set of normalized bus names
+         * @param candidates    [OUT] indices of the rules in order of precedence
+         */
+        void GetCandidates(const ajn::NormalizedMsgHdr& nmh,
+                           const BusNameIDSet& bnIDSet,
+                           std::vector<uint32_t>& candidates) const;
+    };
 
     /**
      * Collection of policy rules for each category.
@@ -508,6 +554,61 @@ class _PolicyDB {
                       const BusNameIDSet& bnIDSet,
                       bool eavesdrop) const;
 
+    /**
+     * Key for caching the verdict of OKToSend or OKToReceive for messages
+     * with the same header fields exchanged with the same bus name.
+     */
+    struct VerdictKey {
+        bool send;                      /**< true for OKToSend, false for OKToReceive */
+        ajn::AllJoynMessageType type;   /**< message type */
+        uint32_t ifcID;                 /**< normalized interface name */
+        uint32_t memberID;              /**< normalized member name */
+        uint32_t errorID;               /**< normalized error name */
+        uint32_t pathID;                /**< normalized object path */
+        uint32_t uid;                   /**< numeric user id */
+        uint32_t gid;                   /**< numeric group id */
+        qcc::StringMapKey busName;      /**< destination for send, sender for receive */
+
+        VerdictKey(bool send, const ajn::NormalizedMsgHdr& nmh, uint32_t uid, uint32_t gid);
+
+        bool operator<(const VerdictKey& other) const;
+    };
+
+    /** typedef for cached verdicts */
+    typedef std::map<VerdictKey, bool> VerdictCache;
+
+    /**
+     * Look up a cached verdict.
+     *
+     * @param key       the verdict key
+     * @param allow     [OUT] the cached verdict
+     *
+     * @return  true if a verdict was found
+     */
+    bool GetCachedVerdict(const VerdictKey& key, bool& allow) const;
+
+    /**
+     * Cache a verdict unless bus name ownership has changed since the
+     * message header was normalized.
+     *
+     * @param key           the verdict key
+     * @param generation    bus name generation the message header was normalized with
+     * @param allow         the verdict
+     */
+    void CacheVerdict(const VerdictKey& key, uint32_t generation, bool allow) const;
+
+    /**
+     * Determine if the sender is allowed to send the specified message
+     * without consulting the verdict cache.
+     */
+    bool CheckSend(const ajn::NormalizedMsgHdr& nmh, uint32_t uid, uint32_t gid) const;
+
+    /**
+     * Determine if the destination is allowed to receive the specified
+     * message without consulting the verdict cache.
+     */
+    bool CheckReceive(const ajn::NormalizedMsgHdr& nmh, uint32_t uid, uint32_t gid) const;
+
     bool eavesdrop;     /**< indicated if there is a rule specifying eavesdropping */
 
     PolicyRuleListSet ownRS;        /**< bus name ownership policy rule sets */
@@ -518,7 +619,9 @@ class _PolicyDB {
     StringIDMap stringIDs;          /**< mapping of strings to normalization IDs */
     UniqueNameIDMap uniqueNameMap;  /**< mapping of unique bus names to normalized well known bus names */
     StringIDMap busNameMap;         /**< mapping of well known bus names to normalization IDs */
-    mutable qcc::Mutex bnLock;      /**< mutex protecting access to uniqueNameMap and busNameMap when normalizing unique names to list of normalized well known bus names. */
+    mutable qcc::Mutex bnLock;      /**< mutex protecting access to uniqueNameMap and busNameMap when normalizing unique names to list of normalized well known bus names. Also protects verdicts and bnGeneration. */
+    uint32_t bnGeneration;          /**< incremented whenever uniqueNameMap changes */
+    mutable VerdictCache verdicts;  /**< cached OKToSend and OKToReceive verdicts */
 
     friend class ajn::NormalizedMsgHdr;
 };
@@ -543,16 +646,21 @@ class NormalizedMsgHdr {
         memberID(policy->LookupStringID(msg->GetMemberName())),
         errorID(policy->LookupStringID(msg->GetErrorName())),
         pathID(policy->LookupStringID(msg->GetObjectPath())),
-        type(msg->GetType())
+        type(msg->GetType()),
+        sender(msg->GetSender() ? msg->GetSender() : ""),
+        destination(msg->GetDestination() ? msg->GetDestination() : "")
     {
         policy->bnLock.Lock(MUTEX_CONTEXT);
-        InitBusNameID(policy, msg->GetSender(), senderIDList);
-        InitBusNameID(policy, msg->GetDestination(), destIDList);
+        InitBusNameID(policy, sender, senderIDList);
+        InitBusNameID(policy, destination, destIDList);
+        generation = policy->bnGeneration;
         policy->bnLock.Unlock(MUTEX_CONTEXT);
     }
 
   private:
     friend class _PolicyDB;  /**< Give PolicyDB access to the internals */
+    friend struct _PolicyDB::PolicyRuleList;  /**< Give PolicyDB rule lists access to the internals */
+    friend struct _PolicyDB::VerdictKey;      /**< Give PolicyDB verdict keys access to the internals */
 
     /**
      * Helper function generate a set of normalized well known bus names
@@ -584,6 +692,9 @@ class NormalizedMsgHdr {
     uint32_t errorID;           /**< normalized error name */
     uint32_t pathID;            /**< normalized object path */
     ajn::AllJoynMessageType type; /**< message type */
+    const char* sender;         /**< sender bus name, valid as long as the message */
+    const char* destination;    /**< destination bus name, valid as long as the message */
+    uint32_t generation;        /**< PolicyDB bus name generation used for destIDList and senderIDList */
     _PolicyDB::BusNameIDSet destIDList;    /**< set of normalized well known bus name destinations */
     _PolicyDB::BusNameIDSet senderIDList;  /**< set of normalized well known bus name senders */
 };
@@ -533,7 +533,8 @@ DaemonICETransport::DaemonICETransport(BusAttachment& bus) :
     m_iceManager(),
     m_stopping(false),
     m_listener(0),
-    m_packetEngine("ice_packet_engine"),
+    m_packetEngine("ice_packet_engine", 128,
+                   DaemonConfig::Access()->Get("ice/limit@packet_workers", ALLJOYN_PACKET_WORKERS_ICE_DEFAULT)),
     m_iceCallback(m_listener, this),
     daemonICETransportTimer("ICETransTimer", true)
 {
@@ -677,6 +677,16 @@ class DaemonICETransport : public Transport, public _RemoteEndpoint::EndpointLis
      */
     static const uint32_t ALLJOYN_MAX_COMPLETED_CONNECTIONS_ICE_DEFAULT = 50;
 
+    /**
+     * @brief The default number of rx/tx worker thread pairs of the ICE packet
+     * engine.
+     *
+     * To override this value, change the limit, "packet_workers" in the "ice"
+     * section of the configuration. Channels are spread over the workers so
+     * more workers let more ICE connections be serviced in parallel.
+     */
+    static const uint32_t ALLJOYN_PACKET_WORKERS_ICE_DEFAULT = 2;
+
     /**
      * @brief The scheduling interval for the DaemonICETransport::Run thread.
      */
@@ -167,12 +167,45 @@ const uint32_t StunAttributeFingerprint::CRC_TABLE[256] = {
 };
 #endif
 
+/*
+ * CRC_SLICE_TABLE[k][i] is the CRC of byte i followed by k zero bytes. The table is built during
+ * static initialization, any fingerprint computed before then is done a byte at a time.
+ */
+uint32_t StunAttributeFingerprint::CRC_SLICE_TABLE[8][256];
+bool StunAttributeFingerprint::sliceTableReady = StunAttributeFingerprint::BuildSliceTable();
+
+bool StunAttributeFingerprint::BuildSliceTable()
+{
+    for (size_t i = 0; i < 256; ++i) {
+        CRC_SLICE_TABLE[0][i] = CRC_TABLE[i];
+    }
+    for (size_t k = 1; k < 8; ++k) {
+        for (size_t i = 0; i < 256; ++i) {
+            uint32_t prev = CRC_SLICE_TABLE[k - 1][i];
+            CRC_SLICE_TABLE[k][i] = (prev >> 8) ^ CRC_TABLE[prev & 0xff];
+        }
+    }
+    return true;
+}
+
 
 uint32_t StunAttributeFingerprint::ComputeCRC(const uint8_t* buf,
                                               size_t len,
                                               uint32_t crc)
 {
     crc = ~crc;
+    // Eight bytes at a time, this must match the byte at a time calculation below.
+    if (sliceTableReady) {
+        const uint32_t (*t)[256] = CRC_SLICE_TABLE;
+        while (len >= 8) {
+            uint32_t lo = crc ^ (buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24));
+            uint32_t hi = buf[4] | (buf[5] << 8) | (buf[6] << 16) | (static_cast<uint32_t>(buf[7]) << 24);
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                  t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            buf += 8;
+            len -= 8;
+        }
+    }
     while (len > 0) {
 // TODO Which calculation is correct??
 #if 0
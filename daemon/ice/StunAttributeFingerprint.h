@@ -44,10 +44,21 @@ class StunMessage;
 class StunAttributeFingerprint : public StunAttribute {
   private:
     static const uint32_t CRC_TABLE[256];   ///< CRC look up table.
+    static uint32_t CRC_SLICE_TABLE[8][256];   ///< CRC look up tables for 8 bytes at a time.
+    static bool sliceTableReady;   ///< True once CRC_SLICE_TABLE has been built.
     const StunMessage& message;   ///< Reference to containing message.
     uint32_t fingerprint;         ///< CRC-32 value (XOR'd w/ 0x5354554e) for containing message.
     static const uint32_t MAGIC_XOR = 0x5354554e;    ///< Magic XOR value (see RFC 5389 sec. 15.5).
 
+    /**
+     * Build CRC_SLICE_TABLE from CRC_TABLE.
+     *
+     * @return  true
+     */
+    static bool BuildSliceTable();
+
+
+  public:
     /**
      * Compute the CRC-32 value.
      *
@@ -59,8 +70,6 @@ class StunAttributeFingerprint : public StunAttribute {
      */
     static uint32_t ComputeCRC(const uint8_t* buf, size_t len, uint32_t crc = 0);
 
-
-  public:
     /**
      * StunAttributeFingerprint constructor.  Fingerprint only works for the
      * message this instance is contained in.  Therefore, the message this
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <ctype.h>
 #include <algorithm>
@@ -37,6 +38,7 @@
 #include <qcc/Socket.h>
 #include <qcc/SocketTypes.h>
 #include <qcc/IfConfig.h>
+#include <qcc/StringUtil.h>
 #include <qcc/time.h>
 
 #include <DaemonConfig.h>
@@ -1739,6 +1741,7 @@ QStatus IpNameServiceImpl::AdvertiseName(TransportMask transportMask, vector<qcc
             list<qcc::String>::iterator j = find(m_advertised_quietly[transportIndex].begin(), m_advertised_quietly[transportIndex].end(), wkn[i]);
             if (j == m_advertised_quietly[transportIndex].end()) {
                 m_advertised_quietly[transportIndex].push_back(wkn[i]);
+                IndexAdvertisement(wkn[i], transportIndex, true, true);
             } else {
                 //
                 // Nothing has changed, so don't bother.
@@ -1770,6 +1773,7 @@ QStatus IpNameServiceImpl::AdvertiseName(TransportMask transportMask, vector<qcc
             list<qcc::String>::iterator j = find(m_advertised[transportIndex].begin(), m_advertised[transportIndex].end(), wkn[i]);
             if (j == m_advertised[transportIndex].end()) {
                 m_advertised[transportIndex].push_back(wkn[i]);
+                IndexAdvertisement(wkn[i], transportIndex, false, true);
             } else {
                 //
                 // Nothing has changed, so don't bother.
@@ -2063,12 +2067,14 @@ QStatus IpNameServiceImpl::CancelAdvertiseName(TransportMask transportMask, vect
         list<qcc::String>::iterator j = find(m_advertised[transportIndex].begin(), m_advertised[transportIndex].end(), wkn[i]);
         if (j != m_advertised[transportIndex].end()) {
             m_advertised[transportIndex].erase(j);
+            IndexAdvertisement(wkn[i], transportIndex, false, false);
             changed = true;
         }
 
         list<qcc::String>::iterator k = find(m_advertised_quietly[transportIndex].begin(), m_advertised_quietly[transportIndex].end(), wkn[i]);
         if (k != m_advertised_quietly[transportIndex].end()) {
             m_advertised_quietly[transportIndex].erase(k);
+            IndexAdvertisement(wkn[i], transportIndex, true, false);
         }
     }
 
@@ -2310,6 +2316,10 @@ void IpNameServiceImpl::QueueProtocolMessage(Header& header)
 
     // printf("%s: m_mutex.Lock()\n", __FUNCTION__);
     m_mutex.Lock();
+    if (CoalesceProtocolMessage(header)) {
+        m_mutex.Unlock();
+        return;
+    }
     if (m_outbound.size() > MAX_IPNS_MESSAGES) {
         m_mutex.Unlock();
         return;
@@ -2320,6 +2330,164 @@ void IpNameServiceImpl::QueueProtocolMessage(Header& header)
     m_mutex.Unlock();
 }
 
+bool IpNameServiceImpl::SameInterfacesRequested(uint32_t transportIndexA, uint32_t transportIndexB)
+{
+    if (transportIndexA == transportIndexB) {
+        return true;
+    }
+
+    if (m_any[transportIndexA] != m_any[transportIndexB]) {
+        return false;
+    }
+
+    if (m_any[transportIndexA]) {
+        return true;
+    }
+
+    std::vector<InterfaceSpecifier>& a = m_requestedInterfaces[transportIndexA];
+    std::vector<InterfaceSpecifier>& b = m_requestedInterfaces[transportIndexB];
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < a.size(); ++i) {
+        if (a[i].m_interfaceName != b[i].m_interfaceName) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IpNameServiceImpl::CoalesceProtocolMessage(Header& header)
+{
+    uint32_t nsVersion, msgVersion;
+    header.GetVersion(nsVersion, msgVersion);
+
+    size_t size = header.GetSerializedSize();
+    uint8_t* buffer = new uint8_t[size];
+    header.Serialize(buffer);
+
+    //
+    // Answers have addresses rewritten into them on the way out, so allow
+    // for the worst case of an IPv4 and an IPv6 address per answer (see
+    // Retransmit()).
+    //
+    size_t answerSize = size + 20 * header.GetNumberAnswers();
+    bool answersOnly = header.GetNumberQuestions() == 0 && header.GetNumberAnswers() != 0;
+
+    bool absorbed = false;
+    for (list<Header>::iterator i = m_outbound.begin(); i != m_outbound.end() && !absorbed; ++i) {
+        uint32_t queuedNsVersion, queuedMsgVersion;
+        i->GetVersion(queuedNsVersion, queuedMsgVersion);
+        if (queuedNsVersion != nsVersion || queuedMsgVersion != msgVersion || i->GetTimer() != header.GetTimer()) {
+            continue;
+        }
+
+        if (i->DestinationSet() != header.DestinationSet()) {
+            continue;
+        }
+
+        if (header.DestinationSet()) {
+            qcc::IPEndpoint a = i->GetDestination();
+            qcc::IPEndpoint b = header.GetDestination();
+            if (!(a.addr == b.addr) || a.port != b.port) {
+                continue;
+            }
+        }
+
+        //
+        // The same message may already be waiting to go out, typically the
+        // answer to a question that several hosts asked at around the same
+        // time.  There is no need to send it twice.
+        //
+        size_t queuedSize = i->GetSerializedSize();
+        if (queuedSize == size) {
+            uint8_t* queuedBuffer = new uint8_t[queuedSize];
+            i->Serialize(queuedBuffer);
+            absorbed = memcmp(buffer, queuedBuffer, size) == 0;
+            delete [] queuedBuffer;
+            if (absorbed) {
+                QCC_DbgPrintf(("IpNameServiceImpl::CoalesceProtocolMessage(): Duplicate message dropped"));
+                break;
+            }
+        }
+
+        //
+        // Version zero daemons do not expect answers from more than one
+        // advertisement in a message, so only version one answers are merged.
+        //
+        if (!answersOnly || msgVersion == 0 || i->GetNumberQuestions() != 0) {
+            continue;
+        }
+
+        if (queuedSize + 20 * i->GetNumberAnswers() + answerSize > NS_MESSAGE_MAX) {
+            continue;
+        }
+
+        //
+        // A multicast message goes out every interface requested by any of
+        // the transports it carries answers for, so answers for a transport
+        // may only join a message for transports using the same interfaces.
+        // A unicast message only goes out the interface of its destination.
+        //
+        if (!header.DestinationSet()) {
+            bool compatible = true;
+            for (uint32_t j = 0; j < header.GetNumberAnswers() && compatible; ++j) {
+                uint32_t indexA = IndexFromBit(header.GetAnswer(j).GetTransportMask());
+                for (uint32_t k = 0; k < i->GetNumberAnswers() && compatible; ++k) {
+                    compatible = SameInterfacesRequested(indexA, IndexFromBit(i->GetAnswer(k).GetTransportMask()));
+                }
+            }
+            if (!compatible) {
+                continue;
+            }
+        }
+
+        QCC_DbgPrintf(("IpNameServiceImpl::CoalesceProtocolMessage(): Answers merged into queued message"));
+        for (uint32_t j = 0; j < header.GetNumberAnswers(); ++j) {
+            i->AddAnswer(header.GetAnswer(j));
+        }
+        absorbed = true;
+    }
+
+    delete [] buffer;
+    return absorbed;
+}
+
+bool IpNameServiceImpl::AnsweredRecently(uint32_t transportIndex, bool quietly, const WhoHas& whoHas, const qcc::IPEndpoint& endpoint)
+{
+    uint64_t now = qcc::GetTimestamp64();
+
+    //
+    // Forget about questions answered long enough ago that they no longer
+    // matter, but don't bother until there are enough of them to care.
+    //
+    if (m_recentAnswers.size() > 256) {
+        map<qcc::String, uint64_t>::iterator i = m_recentAnswers.begin();
+        while (i != m_recentAnswers.end()) {
+            if (now - i->second >= ANSWER_HOLDOFF_MS) {
+                m_recentAnswers.erase(i++);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    qcc::String key = U32ToString(transportIndex) + (quietly ? "q" : "a") + endpoint.ToString();
+    for (uint32_t i = 0; i < whoHas.GetNumberNames(); ++i) {
+        key += " " + whoHas.GetName(i);
+    }
+
+    map<qcc::String, uint64_t>::iterator i = m_recentAnswers.find(key);
+    if (i != m_recentAnswers.end() && now - i->second < ANSWER_HOLDOFF_MS) {
+        return true;
+    }
+
+    m_recentAnswers[key] = now;
+    return false;
+}
+
 //
 // If you set HAPPY_WANDERER to 1, it will enable a test behavior that
 // simulates the daemon happily wandering in and out of range of an
@@ -4105,51 +4273,129 @@ void IpNameServiceImpl::DoPeriodicMaintenance(void)
     m_mutex.Unlock();
 }
 
-void IpNameServiceImpl::HandleProtocolQuestion(WhoHas whoHas, const qcc::IPEndpoint& endpoint)
+void IpNameServiceImpl::IndexAdvertisement(const qcc::String& name, uint32_t index, bool quietly, bool add)
 {
-    QCC_DbgPrintf(("IpNameServiceImpl::HandleProtocolQuestion(%s)", endpoint.ToString().c_str()));
+    uint32_t bit = 1 << index;
+    if (add) {
+        AdvertisedBy& by = m_advertisedIndex[name];
+        if (quietly) {
+            by.quiet |= bit;
+        } else {
+            by.active |= bit;
+        }
+    } else {
+        map<qcc::String, AdvertisedBy>::iterator i = m_advertisedIndex.find(name);
+        if (i == m_advertisedIndex.end()) {
+            return;
+        }
+        if (quietly) {
+            i->second.quiet &= ~bit;
+        } else {
+            i->second.active &= ~bit;
+        }
+        if (i->second.active == 0 && i->second.quiet == 0) {
+            m_advertisedIndex.erase(i);
+        }
+    }
+}
 
+void IpNameServiceImpl::MatchAdvertisements(const qcc::String& pattern, uint32_t& active, uint32_t& quiet)
+{
     //
-    // There are at least two threads wandering through the advertised list.
+    // IpNameServiceImplWildcardMatch compares the characters before the first
+    // wildcard literally, so a name can only match if it starts with them.
+    // Those names are adjacent in the sorted index.
     //
-    // printf("%s: m_mutex.Lock()\n", __FUNCTION__);
-    m_mutex.Lock();
+    const char* p = pattern.c_str();
+    size_t prefixLen = strcspn(p, "*?");
+    qcc::String prefix(p, prefixLen);
 
     //
-    // The who-has message doesn't specify which transport is doing the asking.
-    // This is an oversight and should be fixed in a subsequent version.  The
-    // only reasonable thing to do is to return name matches found in all of
-    // the advertising transports.
+    // Once every transport that advertises anything is known to match there
+    // is no point in looking any further.
     //
+    uint32_t allActive = 0;
+    uint32_t allQuiet = 0;
     for (uint32_t index = 0; index < N_TRANSPORTS; ++index) {
+        if (!m_advertised[index].empty()) {
+            allActive |= 1 << index;
+        }
+        if (!m_advertised_quietly[index].empty()) {
+            allQuiet |= 1 << index;
+        }
+    }
+
+    for (map<qcc::String, AdvertisedBy>::iterator i = m_advertisedIndex.lower_bound(prefix); i != m_advertisedIndex.end(); ++i) {
+        if (strncmp(i->first.c_str(), p, prefixLen) != 0) {
+            break;
+        }
 
         //
-        // If there are no names being advertised by the transport identified by
-        // its index (actively or quietly), there is nothing to do.
+        // Skip names that could not add a transport we haven't already found.
         //
-        if (m_advertised[index].empty() && m_advertised_quietly[index].empty()) {
+        if ((i->second.active & ~active) == 0 && (i->second.quiet & ~quiet) == 0) {
             continue;
         }
 
         //
-        // Loop through the names we are being asked about, and if we have
-        // advertised any of them, we are going to need to respond to this
-        // question.  Keep track of whether or not any of our corresponding
-        // advertisements are quiet, since we want to respond quietly to a
-        // question about a quiet advertisements.  That is, if any of the names
-        // the client is asking about corresponds to a quiet advertisement we
-        // respond directly to the client and do not multicast the response.
-        // The only way we multicast a response is if the client does not ask
-        // about any of our quietly advertised names.
+        // The requested name comes in from the WhoHas message and we allow
+        // wildcards there.
         //
-        // Becuse of this requirement, we loop through all of the names in the
-        // who-has message to see if any of them correspond to quiet
-        // advertisements.  We don't just break out and respond if we find any
-        // old match since it may be the case that the last name is the quiet
-        // one.
+        if (prefixLen < pattern.size() && IpNameServiceImplWildcardMatch(i->first, pattern)) {
+            QCC_DbgPrintf(("IpNameServiceImpl::MatchAdvertisements(): request for %s does not match my %s",
+                           pattern.c_str(), i->first.c_str()));
+            continue;
+        }
+
         //
-        bool respond = false;
-        bool respondQuietly = false;
+        // Without wildcards, only an exact match will do.
+        //
+        if (prefixLen == pattern.size() && i->first.size() != prefixLen) {
+            break;
+        }
+
+        active |= i->second.active;
+        quiet |= i->second.quiet;
+
+        if ((active & allActive) == allActive && (quiet & allQuiet) == allQuiet) {
+            break;
+        }
+    }
+}
+
+void IpNameServiceImpl::HandleProtocolQuestion(WhoHas whoHas, const qcc::IPEndpoint& endpoint)
+{
+    QCC_DbgPrintf(("IpNameServiceImpl::HandleProtocolQuestion(%s)", endpoint.ToString().c_str()));
+
+    //
+    // There are at least two threads wandering through the advertised list.
+    //
+    // printf("%s: m_mutex.Lock()\n", __FUNCTION__);
+    m_mutex.Lock();
+
+    //
+    // Loop through the names we are being asked about, and if we have
+    // advertised any of them, we are going to need to respond to this
+    // question.  Keep track of whether or not any of our corresponding
+    // advertisements are quiet, since we want to respond quietly to a
+    // question about a quiet advertisements.  That is, if any of the names
+    // the client is asking about corresponds to a quiet advertisement we
+    // respond directly to the client and do not multicast the response.
+    // The only way we multicast a response is if the client does not ask
+    // about any of our quietly advertised names.
+    //
+    // Becuse of this requirement, we look at all of the names in the
+    // who-has message to see if any of them correspond to quiet
+    // advertisements.  We don't just stop and respond if we find any old
+    // match since it may be the case that the last name is the quiet one.
+    //
+    // The advertised names of all of the transports are kept in one sorted
+    // index, so each name in the question is looked up once and tells us
+    // which transports need to respond.
+    //
+    uint32_t matchedActive = 0;
+    uint32_t matchedQuiet = 0;
+    if (!m_advertisedIndex.empty()) {
         for (uint32_t i = 0; i < whoHas.GetNumberNames(); ++i) {
             qcc::String wkn = whoHas.GetName(i);
 
@@ -4161,44 +4407,27 @@ void IpNameServiceImpl::HandleProtocolQuestion(WhoHas whoHas, const qcc::IPEndpo
                 continue;
             }
 
-            //
-            // check to see if this name on the list of names we actively advertise.
-            //
-            for (list<qcc::String>::iterator j = m_advertised[index].begin(); j != m_advertised[index].end(); ++j) {
-
-                //
-                // The requested name comes in from the WhoHas message and we
-                // allow wildcards there.
-                //
-                if (IpNameServiceImplWildcardMatch((*j), wkn)) {
-                    QCC_DbgPrintf(("IpNameServiceImpl::HandleProtocolQuestion(): request for %s does not match my %s",
-                                   wkn.c_str(), (*j).c_str()));
-                    continue;
-                } else {
-                    respond = true;
-                    break;
-                }
-            }
+            MatchAdvertisements(wkn, matchedActive, matchedQuiet);
+        }
+    }
 
-            //
-            // Check to see if this name on the list of names we quietly advertise.
-            //
-            for (list<qcc::String>::iterator j = m_advertised_quietly[index].begin(); j != m_advertised_quietly[index].end(); ++j) {
+    //
+    // The who-has message doesn't specify which transport is doing the asking.
+    // This is an oversight and should be fixed in a subsequent version.  The
+    // only reasonable thing to do is to return name matches found in all of
+    // the advertising transports.
+    //
+    for (uint32_t index = 0; index < N_TRANSPORTS; ++index) {
+        bool respond = ((matchedActive | matchedQuiet) & (1 << index)) != 0;
+        bool respondQuietly = (matchedQuiet & (1 << index)) != 0;
 
-                //
-                // The requested name comes in from the WhoHas message and we
-                // allow wildcards there.
-                //
-                if (IpNameServiceImplWildcardMatch((*j), wkn)) {
-                    QCC_DbgPrintf(("IpNameServiceImpl::HandleProtocolQuestion(): request for %s does not match my %s",
-                                   wkn.c_str(), (*j).c_str()));
-                    continue;
-                } else {
-                    respond = true;
-                    respondQuietly = true;
-                    break;
-                }
-            }
+        //
+        // Some clients repeat a question many times in quick succession.
+        // The answer to the first one is all they need.
+        //
+        if (respond && AnsweredRecently(index, respondQuietly, whoHas, endpoint)) {
+            QCC_DbgPrintf(("IpNameServiceImpl::HandleProtocolQuestion(): Repeated question from %s ignored", endpoint.ToString().c_str()));
+            respond = false;
         }
 
         //
@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <list>
+#include <map>
 
 #include <qcc/String.h>
 #include <qcc/Thread.h>
@@ -905,6 +906,54 @@ class IpNameServiceImpl : public qcc::Thread {
      */
     void QueueProtocolMessage(Header& header);
 
+    /**
+     * @internal
+     * @brief Try to fold a protocol message into one already queued for
+     * transmission.  A message identical to one already queued is dropped,
+     * and the answers of an answer-only message are appended to a queued
+     * answer-only message going to the same place if the result still fits
+     * in NS_MESSAGE_MAX.  Must be called with m_mutex held.
+     *
+     * @param header The message to be queued.
+     *
+     * @return true if the message was absorbed by the queue and must not be
+     *     queued itself.
+     */
+    bool CoalesceProtocolMessage(Header& header);
+
+    /**
+     * @internal
+     * @brief Check whether two transports send over the same interfaces, in
+     * which case their answers can share a multicast message.
+     */
+    bool SameInterfacesRequested(uint32_t transportIndexA, uint32_t transportIndexB);
+
+    /**
+     * @internal
+     * @brief Check whether an identical question from the same endpoint has
+     * been answered recently for a transport, and if not note that it is
+     * being answered now.  Must be called with m_mutex held.
+     *
+     * @return true if the question has been answered in the last
+     *     ANSWER_HOLDOFF_MS milliseconds and should be ignored.
+     */
+    bool AnsweredRecently(uint32_t transportIndex, bool quietly, const WhoHas& whoHas, const qcc::IPEndpoint& endpoint);
+
+    /**
+     * @internal
+     * @brief Minimum time between answers to identical questions from the
+     * same endpoint.  Questions are retried by their askers on the order of
+     * seconds, so this only absorbs bursts of duplicates.
+     */
+    static const uint32_t ANSWER_HOLDOFF_MS = 250;
+
+    /**
+     * @internal
+     * @brief When each recently answered question was answered, keyed by the
+     * transport, the asker and the question.
+     */
+    std::map<qcc::String, uint64_t> m_recentAnswers;
+
     /**
      * @internal
      * @brief Send a protocol message out on the multicast group.
@@ -1026,6 +1075,49 @@ class IpNameServiceImpl : public qcc::Thread {
      */
     std::list<qcc::String> m_advertised_quietly[N_TRANSPORTS];
 
+    /**
+     * @internal @brief Which transports advertise a given name.  Bit n of
+     * each mask is set if the transport with index n advertises the name.
+     */
+    struct AdvertisedBy {
+        uint32_t active;   /**< Transports actively advertising the name */
+        uint32_t quiet;    /**< Transports quietly advertising the name */
+        AdvertisedBy() : active(0), quiet(0) { }
+    };
+
+    /**
+     * @internal @brief A sorted index of all of the names in m_advertised and
+     * m_advertised_quietly shared by all of the transports.  Used to answer
+     * who-has questions without walking every advertised name for every
+     * question.
+     */
+    std::map<qcc::String, AdvertisedBy> m_advertisedIndex;
+
+    /**
+     * @internal
+     * @brief Record that a transport has started or stopped advertising a
+     * name in m_advertisedIndex.  Must be called with m_mutex held.
+     *
+     * @param name The well-known name.
+     * @param index The index of the transport.
+     * @param quietly true if the name is quietly advertised.
+     * @param add true if the transport started advertising the name.
+     */
+    void IndexAdvertisement(const qcc::String& name, uint32_t index, bool quietly, bool add);
+
+    /**
+     * @internal
+     * @brief Find which transports advertise a name matching a who-has
+     * pattern.  Only the advertised names that start with the literal prefix
+     * of the pattern (the characters before the first wildcard) can match, so
+     * only those are checked.  Must be called with m_mutex held.
+     *
+     * @param pattern The name from the who-has message, may contain wildcards.
+     * @param active Transports with a matching active advertisement are or'ed in.
+     * @param quiet Transports with a matching quiet advertisement are or'ed in.
+     */
+    void MatchAdvertisements(const qcc::String& pattern, uint32_t& active, uint32_t& quiet);
+
     /**
      * @internal
      * @brief The daemon GUID string of the daemon assoicated with this instance
@@ -34,6 +34,7 @@
 #include "BusInternal.h"
 #include "RemoteEndpoint.h"
 #include "Router.h"
+#include "DaemonRouter.h"
 #include "DaemonTransport.h"
 
 #define QCC_MODULE "ALLJOYN"
@@ -246,6 +247,8 @@ void* DaemonTransport::Run(void* arg)
             status = conn->Establish("EXTERNAL", authName, redirection);
             if (status == ER_OK) {
                 conn->SetListener(this);
+                RemoteEndpoint rep = RemoteEndpoint::cast(conn);
+                reinterpret_cast<DaemonRouter&>(bus.GetInternal().GetRouter()).ConfigureTxQueue(rep);
                 status = conn->Start();
             }
             if (status != ER_OK) {
@@ -0,0 +1,214 @@
+/**
+ * @file
+ * Micro-benchmark for the checksums computed over PacketEngine and STUN datagrams.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#include <qcc/platform.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <qcc/Crypto.h>
+#include <qcc/StringUtil.h>
+#include <qcc/Util.h>
+#include <qcc/time.h>
+
+#include <alljoyn/version.h>
+
+#include <StunAttributeFingerprint.h>
+
+#include "Fletcher32.h"
+#include "PacketCRC16.h"
+
+using namespace qcc;
+using namespace std;
+using namespace ajn;
+
+/* Buffer sizes: UDP payload for a 1500 byte MTU and for a 9000 byte jumbo frame */
+static const size_t BUF_SIZES[] = { 1472, 8972 };
+
+/*
+ * The byte (or word) at a time implementations that the fast versions replaced. These are the
+ * reference both for the results and the timings.
+ */
+static uint32_t RefCRC32Table[256];
+
+static void BuildRefCRC32Table()
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+        }
+        RefCRC32Table[i] = c;
+    }
+}
+
+static uint32_t RefCRC32(const uint8_t* buf, size_t len, uint32_t crc)
+{
+    crc = ~crc;
+    while (len--) {
+        crc = (crc >> 8) ^ RefCRC32Table[(crc ^ *buf++) & 0xff];
+    }
+    return ~crc;
+}
+
+static uint32_t RefFletcher32(const uint16_t* data, size_t len)
+{
+    uint32_t fletch1 = 0xFFFF;
+    uint32_t fletch2 = 0xFFFF;
+    while (len) {
+        size_t l = (len <= 360) ? len : 360;
+        len -= l;
+        while (l--) {
+            fletch1 += *data++;
+            fletch2 += fletch1;
+        }
+        fletch1 = (fletch1 & 0xFFFF) + (fletch1 >> 16);
+        fletch2 = (fletch2 & 0xFFFF) + (fletch2 >> 16);
+    }
+    return (fletch2 << 16) | (fletch1 & 0xFFFF);
+}
+
+enum Variant {
+    CRC16_BYTE,
+    CRC16_SLICE8,
+    FLETCHER32_REF,
+    FLETCHER32,
+    CRC32_BYTE,
+    CRC32_SLICE8
+};
+
+static const char* VariantName(Variant v)
+{
+    switch (v) {
+    case CRC16_BYTE:     return "crc16 (byte)";
+    case CRC16_SLICE8:   return "crc16 (slice-8)";
+    case FLETCHER32_REF: return "fletcher32 (word)";
+    case FLETCHER32:     return "fletcher32 (4 words)";
+    case CRC32_BYTE:     return "crc32 (byte)";
+    case CRC32_SLICE8:   return "crc32 (slice-8)";
+    }
+    return "";
+}
+
+static uint32_t Checksum(Variant v, const uint8_t* buf, size_t len)
+{
+    switch (v) {
+    case CRC16_BYTE: {
+            uint16_t crc = 0;
+            CRC16_Compute(buf, len, &crc);
+            return crc;
+        }
+
+    case CRC16_SLICE8: {
+            uint16_t crc = 0;
+            PacketCRC16::Compute(buf, len, &crc);
+            return crc;
+        }
+
+    case FLETCHER32_REF:
+        return RefFletcher32(reinterpret_cast<const uint16_t*>(buf), len / 2);
+
+    case FLETCHER32: {
+            Fletcher32 fletcher;
+            return fletcher.Update(reinterpret_cast<const uint16_t*>(buf), len / 2);
+        }
+
+    case CRC32_BYTE:
+        return RefCRC32(buf, len, 0);
+
+    case CRC32_SLICE8:
+        return StunAttributeFingerprint::ComputeCRC(buf, len, 0);
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    printf("Usage: checksumbench [-h] [-n <iterations>]\n\n");
+    printf("Options:\n");
+    printf("   -h                = Print this help message\n");
+    printf("   -n <iterations>   = Number of buffers to checksum per variant and size (default 100000)\n");
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t iterations = 100000;
+
+    printf("AllJoyn Library version: %s\n", ajn::GetVersion());
+    printf("AllJoyn Library build info: %s\n", ajn::GetBuildInfo());
+
+    for (int i = 1; i < argc; ++i) {
+        if (::strcmp("-h", argv[i]) == 0) {
+            usage();
+            exit(0);
+        } else if ((::strcmp("-n", argv[i]) == 0) && (++i < argc)) {
+            iterations = StringToU32(argv[i], 10, iterations);
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+            usage();
+            exit(1);
+        }
+    }
+
+    BuildRefCRC32Table();
+
+    for (size_t s = 0; s < ArraySize(BUF_SIZES); ++s) {
+        size_t bufSize = BUF_SIZES[s];
+        /* uint16_t storage so the buffer is aligned for Fletcher32 */
+        vector<uint16_t> storage((bufSize + 1) / 2);
+        uint8_t* buf = reinterpret_cast<uint8_t*>(&storage[0]);
+        Crypto_GetRandomBytes(buf, bufSize);
+
+        /*
+         * Each fast variant must agree with its reference for every length up to the buffer
+         * size, this covers all the tail lengths, before we bother timing them.
+         */
+        for (size_t len = 0; len <= bufSize; ++len) {
+            if ((Checksum(CRC16_BYTE, buf, len) != Checksum(CRC16_SLICE8, buf, len)) ||
+                (Checksum(FLETCHER32_REF, buf, len) != Checksum(FLETCHER32, buf, len)) ||
+                (Checksum(CRC32_BYTE, buf, len) != Checksum(CRC32_SLICE8, buf, len))) {
+                printf("FAILED: checksums disagree for length %u\n", static_cast<uint32_t>(len));
+                return 1;
+            }
+        }
+
+        printf("%u byte buffers:\n", static_cast<uint32_t>(bufSize));
+        for (int v = CRC16_BYTE; v <= CRC32_SLICE8; ++v) {
+            uint32_t sum = 0;
+            uint64_t start = GetTimestamp64();
+            for (uint32_t i = 0; i < iterations; ++i) {
+                /* Vary the first byte so the work cannot be hoisted out of the loop */
+                buf[0] = static_cast<uint8_t>(i);
+                sum += Checksum(static_cast<Variant>(v), buf, bufSize);
+            }
+            uint64_t elapsedMs = GetTimestamp64() - start;
+            if (elapsedMs == 0) {
+                elapsedMs = 1;
+            }
+            printf("  %-22s: %u ms = %u MB/sec (sum 0x%08x)\n", VariantName(static_cast<Variant>(v)),
+                   static_cast<uint32_t>(elapsedMs),
+                   static_cast<uint32_t>((static_cast<uint64_t>(iterations) * bufSize) / (elapsedMs * 1000)),
+                   sum);
+        }
+    }
+    return 0;
+}
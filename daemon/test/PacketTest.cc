@@ -26,12 +26,15 @@
 #include <sys/socket.h>
 
 #include <map>
+#include <vector>
 
 #include <qcc/Debug.h>
 #include <qcc/Log.h>
 #include <qcc/String.h>
 #include <qcc/StringUtil.h>
 #include <qcc/Mutex.h>
+#include <qcc/Thread.h>
+#include <qcc/Util.h>
 #include <alljoyn/version.h>
 
 #include "PacketEngine.h"
@@ -48,11 +51,12 @@ static const char* g_ifaceName = "eth0";
 static uint16_t g_port = 9911;
 static uint32_t g_sendTtl = 0;
 static uint32_t g_recvTimeout = 1;
+static bool g_quiet = false;
 
 
 class PacketEngineController : public PacketEngineListener {
   public:
-    PacketEngineController(const char* ifaceName, uint16_t port);
+    PacketEngineController(const char* ifaceName, uint16_t port, uint32_t numWorkers = 1);
 
     ~PacketEngineController();
 
@@ -79,10 +83,14 @@ class PacketEngineController : public PacketEngineListener {
 
     QStatus Send(uint32_t chanIdx, const String& data, uint32_t ttl = 0);
 
-    QStatus Recv(uint32_t chanIdx, String& data);
+    QStatus Recv(uint32_t chanIdx, String& data, uint32_t timeout);
+
+    QStatus Recv(uint32_t chanIdx, String& data) { return Recv(chanIdx, data, g_recvTimeout); }
 
     void ListStreams() const;
 
+    size_t GetNumStreams() const;
+
     QStatus SetSendTimeout(uint32_t chanIdx, uint32_t timeout);
 
   private:
@@ -93,9 +101,9 @@ class PacketEngineController : public PacketEngineListener {
     int nextStreamId;
 };
 
-PacketEngineController::PacketEngineController(const char* ifaceName, uint16_t port) :
+PacketEngineController::PacketEngineController(const char* ifaceName, uint16_t port, uint32_t numWorkers) :
     udpStream(ifaceName, port),
-    engine("pe"),
+    engine("pe", 128, numWorkers),
     nextStreamId(0)
 {
 }
@@ -151,7 +159,9 @@ void PacketEngineController::PacketEngineConnectCB(PacketEngine& engine,
                                                    void* context)
 {
     if (status == ER_OK) {
-        printf("Connect to %s succeeded.\n", udpStream.ToString(dest).c_str());
+        if (!g_quiet) {
+            printf("Connect to %s succeeded.\n", udpStream.ToString(dest).c_str());
+        }
         streamsLock.Lock();
         streams.insert(pair<int, PacketEngineStream>(++nextStreamId, *stream));
         streamsLock.Unlock();
@@ -162,7 +172,9 @@ void PacketEngineController::PacketEngineConnectCB(PacketEngine& engine,
 
 bool PacketEngineController::PacketEngineAcceptCB(PacketEngine& engine, const PacketEngineStream& stream, const PacketDest& dest)
 {
-    printf("Accepting connect attempt from %s\n", udpStream.ToString(dest).c_str());
+    if (!g_quiet) {
+        printf("Accepting connect attempt from %s\n", udpStream.ToString(dest).c_str());
+    }
     streamsLock.Lock();
     streams.insert(pair<int, PacketEngineStream>(++nextStreamId, stream));
     streamsLock.Unlock();
@@ -172,7 +184,9 @@ bool PacketEngineController::PacketEngineAcceptCB(PacketEngine& engine, const Pa
 void PacketEngineController::PacketEngineDisconnectCB(PacketEngine& engine, const PacketEngineStream& stream, const PacketDest& dest)
 {
     bool found = false;
-    printf("Disconnect indication from %s\n", udpStream.ToString(dest).c_str());
+    if (!g_quiet) {
+        printf("Disconnect indication from %s\n", udpStream.ToString(dest).c_str());
+    }
     streamsLock.Lock();
     map<int, PacketEngineStream>::iterator it = streams.begin();
     while (it != streams.end()) {
@@ -201,6 +215,14 @@ void PacketEngineController::ListStreams() const
     streamsLock.Unlock();
 }
 
+size_t PacketEngineController::GetNumStreams() const
+{
+    streamsLock.Lock();
+    size_t num = streams.size();
+    streamsLock.Unlock();
+    return num;
+}
+
 QStatus PacketEngineController::SetSendTimeout(uint32_t chanIdx, uint32_t timeout)
 {
     QStatus status = ER_FAIL;
@@ -234,7 +256,7 @@ QStatus PacketEngineController::Send(uint32_t chanIdx, const String& data, uint3
     return status;
 }
 
-QStatus PacketEngineController::Recv(uint32_t chanIdx, String& data)
+QStatus PacketEngineController::Recv(uint32_t chanIdx, String& data, uint32_t timeout)
 {
     QStatus status = ER_FAIL;
     streamsLock.Lock();
@@ -243,7 +265,7 @@ QStatus PacketEngineController::Recv(uint32_t chanIdx, String& data)
         size_t actualBytes;
         PacketEngineStream& stream = it->second;
         streamsLock.Unlock();
-        status = stream.PullBytes(data.begin(), data.capacity(), actualBytes, g_recvTimeout);
+        status = stream.PullBytes(data.begin(), data.capacity(), actualBytes, timeout);
         if (status == ER_OK) {
             data.assign(data.begin(), actualBytes);
         }
@@ -300,11 +322,15 @@ static void SigIntHandler(int sig)
 
 static void usage(void)
 {
-    printf("Usage: packettest [-h] [-i <iface>]\n\n");
+    printf("Usage: packettest [-h] [-i <iface>] [-p <port>] [-b [-c <channels>] [-m <msg_size>] [-n <kbytes>]]\n\n");
     printf("Options:\n");
     printf("   -h            - Print this help message\n");
     printf("   -i <iface>    - Set the network interface\n");
     printf("   -p <port>     - Set the network port\n");
+    printf("   -b            - Run the throughput benchmark with 1, 2, 4 and 8 workers (use -i lo for loopback)\n");
+    printf("   -c <channels> - Number of benchmark channels (default 16)\n");
+    printf("   -m <msg_size> - Benchmark message size in bytes (default 4096)\n");
+    printf("   -n <kbytes>   - KB sent over each benchmark channel (default 4096)\n");
     printf("\n");
 }
 
@@ -410,9 +436,128 @@ static QStatus DoRecvAtRate(PacketEngineController& controller, uint32_t chanIdx
     return status;
 }
 
+/*
+ * Benchmark thread. Either pushes or pulls bytesPerChannel bytes over one stream of a controller.
+ */
+class BenchThread : public Thread {
+  public:
+    BenchThread(PacketEngineController& controller, uint32_t chanIdx, bool isSender, size_t msgSize, uint64_t numBytes) :
+        Thread("bench"), controller(controller), chanIdx(chanIdx), isSender(isSender), msgSize(msgSize), numBytes(numBytes), status(ER_OK) { }
+
+    QStatus GetStatus() const { return status; }
+
+  protected:
+    qcc::ThreadReturn STDCALL Run(void* arg)
+    {
+        String data;
+        if (isSender) {
+            vector<char> msg(msgSize, 'B');
+            data = String(&msg[0], msgSize, msgSize);
+        } else {
+            data.reserve(msgSize);
+        }
+        uint64_t done = 0;
+        while ((status == ER_OK) && (done < numBytes)) {
+            if (isSender) {
+                status = controller.Send(chanIdx, data);
+                done += msgSize;
+            } else {
+                status = controller.Recv(chanIdx, data, 5000);
+                done += data.size();
+            }
+        }
+        return (qcc::ThreadReturn) 0;
+    }
+
+  private:
+    PacketEngineController& controller;
+    uint32_t chanIdx;
+    bool isSender;
+    size_t msgSize;
+    uint64_t numBytes;
+    QStatus status;
+};
+
+/*
+ * Measure the aggregate throughput of numChannels channels between two PacketEngines on the same
+ * interface for an increasing number of rx/tx worker pairs. Each channel has a sending thread
+ * and a receiving thread.
+ */
+static QStatus RunBenchmark(uint32_t numChannels, size_t msgSize, uint64_t bytesPerChannel)
+{
+    static const uint32_t WORKERS[] = { 1, 2, 4, 8 };
+    QStatus status = ER_OK;
+
+    g_quiet = true;
+    printf("%u channels, %u byte messages, %u KB per channel on %s\n", numChannels, static_cast<uint32_t>(msgSize),
+           static_cast<uint32_t>(bytesPerChannel / 1024), g_ifaceName);
+    for (size_t w = 0; (status == ER_OK) && (w < ArraySize(WORKERS)); ++w) {
+        PacketEngineController sender(g_ifaceName, g_port, WORKERS[w]);
+        PacketEngineController receiver(g_ifaceName, g_port + 1, WORKERS[w]);
+        status = sender.Start();
+        if (status == ER_OK) {
+            status = receiver.Start();
+        }
+        for (uint32_t i = 0; (status == ER_OK) && (i < numChannels); ++i) {
+            status = sender.Connect(receiver.GetIPAddr(), g_port + 1);
+        }
+        if (status != ER_OK) {
+            printf("Benchmark setup failed with %s\n", QCC_StatusText(status));
+            break;
+        }
+
+        /* Wait for all channels to open */
+        uint64_t deadline = GetTimestamp64() + 10000;
+        while (((sender.GetNumStreams() < numChannels) || (receiver.GetNumStreams() < numChannels)) && (GetTimestamp64() < deadline)) {
+            qcc::Sleep(10);
+        }
+        if ((sender.GetNumStreams() < numChannels) || (receiver.GetNumStreams() < numChannels)) {
+            status = ER_TIMEOUT;
+            printf("Timed out waiting for %u channels to open\n", numChannels);
+            break;
+        }
+
+        /* Stream indices are 1 based */
+        vector<BenchThread*> threads;
+        for (uint32_t i = 1; i <= numChannels; ++i) {
+            threads.push_back(new BenchThread(receiver, i, false, msgSize, bytesPerChannel));
+            threads.push_back(new BenchThread(sender, i, true, msgSize, bytesPerChannel));
+        }
+        uint64_t start = GetTimestamp64();
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->Start();
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->Join();
+            if ((status == ER_OK) && (threads[i]->GetStatus() != ER_OK)) {
+                status = threads[i]->GetStatus();
+            }
+            delete threads[i];
+        }
+        uint64_t elapsedMs = ::max(GetTimestamp64() - start, (uint64_t)1);
+
+        if (status == ER_OK) {
+            uint64_t totalBytes = bytesPerChannel * numChannels;
+            printf("  %u worker(s): %u ms = %u KB/sec\n", WORKERS[w], static_cast<uint32_t>(elapsedMs),
+                   static_cast<uint32_t>((totalBytes * 1000) / (elapsedMs * 1024)));
+        } else {
+            printf("  %u worker(s): failed with %s\n", WORKERS[w], QCC_StatusText(status));
+        }
+        sender.Stop();
+        receiver.Stop();
+        sender.Join();
+        receiver.Join();
+    }
+    return status;
+}
+
 int main(int argc, char** argv)
 {
     QStatus status = ER_OK;
+    bool benchmark = false;
+    uint32_t benchChannels = 16;
+    uint32_t benchMsgSize = 4096;
+    uint32_t benchKBytes = 4096;
     printf("AllJoyn Library version: %s\n", ajn::GetVersion());
     printf("AllJoyn Library build info: %s\n", ajn::GetBuildInfo());
 
@@ -428,6 +573,14 @@ int main(int argc, char** argv)
             g_ifaceName = argv[++i];
         } else if (::strcmp("-p", argv[i]) == 0) {
             g_port = static_cast<uint16_t>(StringToU32(argv[++i], 10, 0));
+        } else if (::strcmp("-b", argv[i]) == 0) {
+            benchmark = true;
+        } else if (::strcmp("-c", argv[i]) == 0) {
+            benchChannels = StringToU32(argv[++i], 10, benchChannels);
+        } else if (::strcmp("-m", argv[i]) == 0) {
+            benchMsgSize = StringToU32(argv[++i], 10, benchMsgSize);
+        } else if (::strcmp("-n", argv[i]) == 0) {
+            benchKBytes = StringToU32(argv[++i], 10, benchKBytes);
         } else {
             status = ER_FAIL;
             printf("Unknown option %s\n", argv[i]);
@@ -436,6 +589,11 @@ int main(int argc, char** argv)
         }
     }
 
+    if (benchmark) {
+        status = RunBenchmark(benchChannels, benchMsgSize, static_cast<uint64_t>(benchKBytes) * 1024);
+        return (int) status;
+    }
+
     /* Create PacketEngine controller */
     PacketEngineController controller(g_ifaceName, g_port);
     status = controller.Start();
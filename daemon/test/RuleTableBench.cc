@@ -0,0 +1,234 @@
+/**
+ * @file
+ * Micro-benchmark for broadcast signal matching in the daemon's RuleTable.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#include <qcc/platform.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <qcc/Debug.h>
+#include <qcc/String.h>
+#include <qcc/StringUtil.h>
+#include <qcc/time.h>
+
+#include <alljoyn/BusAttachment.h>
+#include <alljoyn/Message.h>
+#include <alljoyn/version.h>
+
+#include <alljoyn/Status.h>
+
+#include "BusEndpoint.h"
+#include "RuleTable.h"
+
+#define QCC_MODULE "ALLJOYN"
+
+using namespace qcc;
+using namespace std;
+using namespace ajn;
+
+/* Number of distinct interfaces and members the rules are spread over */
+static const uint32_t NUM_IFACES = 500;
+static const uint32_t NUM_MEMBERS = 20;
+
+/* Rules added for each endpoint */
+static const uint32_t RULES_PER_ENDPOINT = 5;
+
+/* Number of distinct signals sent during the benchmark */
+static const uint32_t NUM_SIGNALS = 64;
+
+class _BenchEndpoint : public _BusEndpoint {
+  public:
+    _BenchEndpoint(const String& name) : _BusEndpoint(ENDPOINT_TYPE_REMOTE), name(name) { }
+    const String& GetUniqueName() const { return name; }
+  private:
+    String name;
+};
+
+typedef ManagedObj<_BenchEndpoint> BenchEndpoint;
+
+class _BenchMessage : public _Message {
+  public:
+    _BenchMessage(BusAttachment& bus) : _Message(bus) { }
+
+    QStatus Signal(const char* objPath, const char* iface, const char* signalName)
+    {
+        return SignalMsg("", NULL, 0, objPath, iface, signalName, NULL, 0, 0, 0);
+    }
+};
+
+typedef ManagedObj<_BenchMessage> BenchMessage;
+
+static String IfaceName(uint32_t i)
+{
+    return "org.alljoyn.bench.Iface" + U32ToString(i);
+}
+
+static String MemberName(uint32_t m)
+{
+    return "Signal" + U32ToString(m);
+}
+
+/*
+ * The pre-index matching algorithm: walk every rule and skip to the next endpoint on a match.
+ */
+static size_t LinearMatch(RuleTable& ruleTable, const Message& msg)
+{
+    size_t count = 0;
+    RuleIterator it = ruleTable.Begin();
+    while (it != ruleTable.End()) {
+        if (it->second.IsMatch(msg)) {
+            ++count;
+            it = ruleTable.AdvanceToNextEndpoint(it->first);
+        } else {
+            ++it;
+        }
+    }
+    return count;
+}
+
+static size_t IndexedMatch(RuleTable& ruleTable, const Message& msg)
+{
+    vector<BusEndpoint> dests;
+    ruleTable.FindMatchingEndpoints(msg, dests);
+    return dests.size();
+}
+
+static void Report(const char* name, uint32_t iterations, size_t delivered, uint64_t elapsedMs)
+{
+    if (elapsedMs == 0) {
+        elapsedMs = 1;
+    }
+    printf("%-8s: %u signals in %u ms = %u signals/sec (%u deliveries)\n", name, iterations,
+           static_cast<uint32_t>(elapsedMs),
+           static_cast<uint32_t>((static_cast<uint64_t>(iterations) * 1000) / elapsedMs),
+           static_cast<uint32_t>(delivered));
+}
+
+static void usage(void)
+{
+    printf("Usage: ruletablebench [-h] [-r <rules>] [-n <signals>]\n\n");
+    printf("Options:\n");
+    printf("   -h            = Print this help message\n");
+    printf("   -r <rules>    = Total number of match rules (default 10000)\n");
+    printf("   -n <signals>  = Number of signals to route (default 20000)\n");
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numRules = 10000;
+    uint32_t iterations = 20000;
+
+    printf("AllJoyn Library version: %s\n", ajn::GetVersion());
+    printf("AllJoyn Library build info: %s\n", ajn::GetBuildInfo());
+
+    for (int i = 1; i < argc; ++i) {
+        if (::strcmp("-h", argv[i]) == 0) {
+            usage();
+            exit(0);
+        } else if ((::strcmp("-r", argv[i]) == 0) && (++i < argc)) {
+            numRules = StringToU32(argv[i], 10, numRules);
+        } else if ((::strcmp("-n", argv[i]) == 0) && (++i < argc)) {
+            iterations = StringToU32(argv[i], 10, iterations);
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+            usage();
+            exit(1);
+        }
+    }
+
+    BusAttachment bus("ruletablebench");
+    QStatus status = bus.Start();
+    if (status != ER_OK) {
+        QCC_LogError(status, ("BusAttachment::Start failed"));
+        return 1;
+    }
+
+    /*
+     * Each endpoint subscribes to a few interface/member pairs, one whole interface and one
+     * object path. A handful of endpoints also have a catch-all sessionless rule.
+     */
+    RuleTable ruleTable;
+    uint32_t numEndpoints = (numRules + RULES_PER_ENDPOINT - 1) / RULES_PER_ENDPOINT;
+    uint32_t added = 0;
+    for (uint32_t e = 0; (e < numEndpoints) && (added < numRules); ++e) {
+        String name = ":bench." + U32ToString(e);
+        BenchEndpoint bep(name);
+        BusEndpoint ep = BusEndpoint::cast(bep);
+        for (uint32_t r = 0; (r < RULES_PER_ENDPOINT) && (added < numRules); ++r, ++added) {
+            uint32_t iface = (e * 7 + r) % NUM_IFACES;
+            String spec = "type='signal',interface='" + IfaceName(iface) + "'";
+            if (r < 3) {
+                spec += ",member='" + MemberName((e + r) % NUM_MEMBERS) + "'";
+            } else if (r == 4) {
+                spec += ",path='/bench/" + U32ToString(e % 100) + "'";
+            }
+            if ((r == 0) && ((e % 500) == 0)) {
+                spec = "type='signal',sessionless='t'";
+            }
+            Rule rule(spec.c_str(), &status);
+            if (status != ER_OK) {
+                QCC_LogError(status, ("Invalid rule %s", spec.c_str()));
+                return 1;
+            }
+            ruleTable.AddRule(ep, rule);
+        }
+    }
+    printf("%u rules for %u endpoints\n", added, numEndpoints);
+
+    vector<Message> msgs;
+    for (uint32_t s = 0; s < NUM_SIGNALS; ++s) {
+        BenchMessage bmsg(bus);
+        String path = "/bench/" + U32ToString(s % 100);
+        status = bmsg->Signal(path.c_str(), IfaceName((s * 13) % NUM_IFACES).c_str(), MemberName(s % NUM_MEMBERS).c_str());
+        if (status != ER_OK) {
+            QCC_LogError(status, ("Failed to create signal"));
+            return 1;
+        }
+        msgs.push_back(Message::cast(bmsg));
+    }
+
+    /* Both algorithms must agree on every signal before we bother timing them */
+    for (uint32_t s = 0; s < NUM_SIGNALS; ++s) {
+        if (LinearMatch(ruleTable, msgs[s]) != IndexedMatch(ruleTable, msgs[s])) {
+            printf("FAILED: indexed and linear match disagree for %s\n", msgs[s]->Description().c_str());
+            return 1;
+        }
+    }
+
+    size_t delivered = 0;
+    uint64_t start = GetTimestamp64();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        delivered += LinearMatch(ruleTable, msgs[i % NUM_SIGNALS]);
+    }
+    Report("linear", iterations, delivered, GetTimestamp64() - start);
+
+    delivered = 0;
+    start = GetTimestamp64();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        delivered += IndexedMatch(ruleTable, msgs[i % NUM_SIGNALS]);
+    }
+    Report("indexed", iterations, delivered, GetTimestamp64() - start);
+
+    bus.Stop();
+    bus.Join();
+    return 0;
+}
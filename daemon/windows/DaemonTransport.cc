@@ -32,6 +32,7 @@
 #include "BusInternal.h"
 #include "RemoteEndpoint.h"
 #include "Router.h"
+#include "DaemonRouter.h"
 #include "DaemonTransport.h"
 
 #define QCC_MODULE "DAEMON_TRANSPORT"
@@ -122,6 +123,8 @@ void* DaemonTransport::Run(void* arg)
             }
             if (status == ER_OK) {
                 conn->SetListener(this);
+                RemoteEndpoint rep = RemoteEndpoint::cast(conn);
+                reinterpret_cast<DaemonRouter&>(bus.GetInternal().GetRouter()).ConfigureTxQueue(rep);
                 status = conn->Start();
             }
             if (status != ER_OK) {
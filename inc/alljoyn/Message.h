@@ -189,6 +189,7 @@ class _Message {
     friend class AllJoynObj;
     friend class DeferredMsg;
     friend class AllJoynPeerObj;
+    friend class MatchArgs;
 
   public:
     /**
@@ -837,6 +838,13 @@ class _Message {
      */
     QStatus ReMarshal(const char* senderName = NULL);
 
+    /**
+     * @internal
+     * Rewrite the header fields in place. Only valid if the padded length of the header fields
+     * has not changed so the body does not need to move.
+     */
+    void RewriteHeaderFields();
+
     /**
      * @internal
      * Sets the serial number to the next available value for the bus attachment for this message.
@@ -926,7 +934,7 @@ class _Message {
 
     MessageHeader msgHeader;     ///< Current message header.
     uint8_t* _msgBuf;            ///< Pointer to the current msg buffer.
-    uint64_t* msgBuf;            ///< Pointer to the current msg buffer (8 byte aligned pointer into _msgBuf).
+    uint64_t* msgBuf;            ///< Pointer to the current msg buffer (8 byte aligned, same as _msgBuf).
     MsgArg* msgArgs;             ///< Pointer to the unmarshaled arguments.
     uint8_t numMsgArgs;          ///< Number of message args (signature cannot be longer than 255 chars).
 
@@ -1009,7 +1017,7 @@ class _Message {
 
     /* Internal methods for read */
     inline QStatus InterpretHeader();
-    QStatus PullBytes(RemoteEndpoint& endpoint, bool checkSender, bool pedantic = true, uint32_t timeout = 0);
+    QStatus PullBytes(RemoteEndpoint& endpoint, bool checkSender, bool pedantic = true, uint32_t timeout = 0, bool buffered = false);
 };
 
 }
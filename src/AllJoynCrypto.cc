@@ -26,6 +26,7 @@
 #include <qcc/Debug.h>
 #include <qcc/Crypto.h>
 #include <qcc/KeyBlob.h>
+#include <qcc/Mutex.h>
 #include <qcc/Util.h>
 
 #include <alljoyn/Status.h>
@@ -41,54 +42,146 @@ namespace ajn {
 
 const size_t Crypto::MACLength = 8;
 
-static qcc::String ConcatenateCompressedFields(uint8_t* hdr, size_t hdrLen, const HeaderFields& hdrFields)
+/*
+ * Maximum number of expanded AES ciphers kept per session key. More than this many threads using
+ * the same key at once is rare, the extra ciphers are freed when they are released.
+ */
+static const size_t MAX_IDLE_CIPHERS = 4;
+
+_CCMCipher::~_CCMCipher()
+{
+    for (size_t i = 0; i < idle.size(); ++i) {
+        delete idle[i];
+    }
+}
+
+Crypto_AES* _CCMCipher::Acquire() const
+{
+    if (!isAES) {
+        return NULL;
+    }
+    Crypto_AES* aes = NULL;
+    lock.Lock(MUTEX_CONTEXT);
+    if (!idle.empty()) {
+        aes = idle.back();
+        idle.pop_back();
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+    /* Expand the key schedule outside of the lock */
+    return aes ? aes : new Crypto_AES(key, Crypto_AES::CCM);
+}
+
+void _CCMCipher::Release(Crypto_AES* aes) const
 {
-    qcc::String result((char*)hdr, hdrLen, 256);
+    lock.Lock(MUTEX_CONTEXT);
+    if (idle.size() < MAX_IDLE_CIPHERS) {
+        idle.push_back(aes);
+        aes = NULL;
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+    delete aes;
+}
+
+/*
+ * The additional authenticated data for a compressed message is built on the stack unless it is
+ * larger than this.
+ */
+static const size_t EXT_HDR_STACK_SIZE = 512;
 
+/*
+ * Concatenates the header with the compressible header fields. Returns the length of the result
+ * and only writes the result if dest is not NULL so it can be called first to size the buffer.
+ */
+static size_t ConcatenateCompressedFields(uint8_t* dest, const uint8_t* hdr, size_t hdrLen, const HeaderFields& hdrFields)
+{
+    size_t len = hdrLen;
+    if (dest) {
+        memcpy(dest, hdr, hdrLen);
+    }
     for (uint32_t fieldId = ALLJOYN_HDR_FIELD_PATH; fieldId < ArraySize(hdrFields.field); fieldId++) {
         if (!HeaderFields::Compressible[fieldId]) {
             continue;
         }
         const MsgArg* field = &hdrFields.field[fieldId];
-        char buf[8];
+        uint8_t buf[8];
         size_t pos = 0;
-        buf[pos++] = (char)fieldId;
-        buf[pos++] = (char)field->typeId;
+        const void* data = NULL;
+        size_t dataLen = 0;
+        buf[pos++] = (uint8_t)fieldId;
+        buf[pos++] = (uint8_t)field->typeId;
         switch (field->typeId) {
         case ALLJOYN_SIGNATURE:
-            result.append(buf, pos);
-            result.append(field->v_signature.sig, field->v_signature.len);
+            data = field->v_signature.sig;
+            dataLen = field->v_signature.len;
             break;
 
         case ALLJOYN_OBJECT_PATH:
         case ALLJOYN_STRING:
-            result.append(buf, pos);
-            result.append(field->v_string.str, field->v_string.len);
+            data = field->v_string.str;
+            dataLen = field->v_string.len;
             break;
 
         case ALLJOYN_UINT32:
             /* Write integer as little endian */
-            buf[pos++] = (char)(field->v_uint32 >> 0);
-            buf[pos++] = (char)(field->v_uint32 >> 8);
-            buf[pos++] = (char)(field->v_uint32 >> 16);
-            buf[pos++] = (char)(field->v_uint32 >> 24);
-            result.append(buf, pos);
+            buf[pos++] = (uint8_t)(field->v_uint32 >> 0);
+            buf[pos++] = (uint8_t)(field->v_uint32 >> 8);
+            buf[pos++] = (uint8_t)(field->v_uint32 >> 16);
+            buf[pos++] = (uint8_t)(field->v_uint32 >> 24);
             break;
 
         default:
-            break;
+            continue;
+        }
+        if (dest) {
+            memcpy(dest + len, buf, pos);
+            if (dataLen) {
+                memcpy(dest + len + pos, data, dataLen);
+            }
+        }
+        len += pos + dataLen;
+    }
+    return len;
+}
+
+/*
+ * Encrypts or decrypts the message body in place.
+ */
+static QStatus TransformBody(bool encrypt, Crypto_AES& aes, const _Message& message, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen, const KeyBlob& nonce)
+{
+    uint8_t* body = msgBuf + hdrLen;
+    if (!(message.GetFlags() & ALLJOYN_FLAG_COMPRESSED)) {
+        if (encrypt) {
+            return aes.Encrypt_CCM(body, body, bodyLen, nonce, msgBuf, hdrLen, Crypto::MACLength);
+        } else {
+            return aes.Decrypt_CCM(body, body, bodyLen, nonce, msgBuf, hdrLen, Crypto::MACLength);
         }
     }
-    return result;
+    /*
+     * To prevent an attack where the attacker sends a bogus expansion rule we
+     * authenticate the compressed headers even though we won't be sending them.
+     */
+    uint8_t stackBuf[EXT_HDR_STACK_SIZE];
+    size_t extHdrLen = ConcatenateCompressedFields(NULL, msgBuf, hdrLen, message.GetHeaderFields());
+    uint8_t* extHdr = (extHdrLen <= sizeof(stackBuf)) ? stackBuf : new uint8_t[extHdrLen];
+    ConcatenateCompressedFields(extHdr, msgBuf, hdrLen, message.GetHeaderFields());
+    QStatus status;
+    if (encrypt) {
+        status = aes.Encrypt_CCM(body, body, bodyLen, nonce, extHdr, extHdrLen, Crypto::MACLength);
+    } else {
+        status = aes.Decrypt_CCM(body, body, bodyLen, nonce, extHdr, extHdrLen, Crypto::MACLength);
+    }
+    if (extHdr != stackBuf) {
+        delete [] extHdr;
+    }
+    return status;
 }
 
-QStatus Crypto::Encrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen)
+QStatus Crypto::Encrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen, const CCMCipher* cipher)
 {
     QStatus status;
     switch (keyBlob.GetType()) {
     case KeyBlob::AES:
     {
-        uint8_t* body = msgBuf + hdrLen;
         uint8_t nd[5];
         uint32_t serial = message.GetCallSerial();
 
@@ -102,16 +195,13 @@ QStatus Crypto::Encrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t
         QCC_DbgHLPrintf(("Encrypt key:   %s", BytesToHexString(keyBlob.GetData(), keyBlob.GetSize()).c_str()));
         QCC_DbgHLPrintf(("        nonce: %s", BytesToHexString(nonce.GetData(), nonce.GetSize()).c_str()));
 
-        Crypto_AES aes(keyBlob, Crypto_AES::CCM);
-        if (message.GetFlags() & ALLJOYN_FLAG_COMPRESSED) {
-            /*
-             * To prevent an attack where the attacker sends a bogus expansion rule we
-             * authenticate the compressed headers even though we won't be sending them.
-             */
-            qcc::String extHdr = ConcatenateCompressedFields(msgBuf, hdrLen, message.GetHeaderFields());
-            status = aes.Encrypt_CCM(body, body, bodyLen, nonce, extHdr.data(), extHdr.size(), MACLength);
+        if (cipher && (*cipher)->IsValid()) {
+            Crypto_AES* aes = (*cipher)->Acquire();
+            status = TransformBody(true, *aes, message, msgBuf, hdrLen, bodyLen, nonce);
+            (*cipher)->Release(aes);
         } else {
-            status = aes.Encrypt_CCM(body, body, bodyLen, nonce, msgBuf, hdrLen, MACLength);
+            Crypto_AES aes(keyBlob, Crypto_AES::CCM);
+            status = TransformBody(true, aes, message, msgBuf, hdrLen, bodyLen, nonce);
         }
     }
     break;
@@ -124,13 +214,12 @@ QStatus Crypto::Encrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t
     return status;
 }
 
-QStatus Crypto::Decrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen)
+QStatus Crypto::Decrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen, const CCMCipher* cipher)
 {
     QStatus status;
     switch (keyBlob.GetType()) {
     case KeyBlob::AES:
     {
-        uint8_t* body = msgBuf + hdrLen;
         uint8_t nd[5];
         uint32_t serial = message.GetCallSerial();
 
@@ -144,16 +233,13 @@ QStatus Crypto::Decrypt(const _Message& message, const KeyBlob& keyBlob, uint8_t
         QCC_DbgHLPrintf(("Decrypt key:   %s", BytesToHexString(keyBlob.GetData(), keyBlob.GetSize()).c_str()));
         QCC_DbgHLPrintf(("        nonce: %s", BytesToHexString(nonce.GetData(), nonce.GetSize()).c_str()));
 
-        Crypto_AES aes(keyBlob, Crypto_AES::CCM);
-        if (message.GetFlags() & ALLJOYN_FLAG_COMPRESSED) {
-            /*
-             * To prevent an attack where the attacker sends a bogus expansion rule we
-             * authenticate the compressed headers even though we won't be sending them.
-             */
-            qcc::String extHdr = ConcatenateCompressedFields(msgBuf, hdrLen, message.GetHeaderFields());
-            status = aes.Decrypt_CCM(body, body, bodyLen, nonce, extHdr.data(), extHdr.size(), MACLength);
+        if (cipher && (*cipher)->IsValid()) {
+            Crypto_AES* aes = (*cipher)->Acquire();
+            status = TransformBody(false, *aes, message, msgBuf, hdrLen, bodyLen, nonce);
+            (*cipher)->Release(aes);
         } else {
-            status = aes.Decrypt_CCM(body, body, bodyLen, nonce, msgBuf, hdrLen, MACLength);
+            Crypto_AES aes(keyBlob, Crypto_AES::CCM);
+            status = TransformBody(false, aes, message, msgBuf, hdrLen, bodyLen, nonce);
         }
     }
     break;
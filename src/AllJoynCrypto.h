@@ -26,7 +26,13 @@
 #endif
 
 #include <qcc/platform.h>
+
+#include <vector>
+
+#include <qcc/Crypto.h>
 #include <qcc/KeyBlob.h>
+#include <qcc/ManagedObj.h>
+#include <qcc/Mutex.h>
 
 #include <alljoyn/Message.h>
 
@@ -35,6 +41,73 @@
 
 namespace ajn {
 
+/**
+ * An AES-CCM cipher keyed with a session key. Creating an AES cipher expands the key schedule so
+ * peers keep one of these with each of their session keys rather than creating a cipher for every
+ * message. An AES cipher is not shared between threads: each encrypt or decrypt operation takes
+ * an expanded key schedule for its own use and returns it when it is done. A new one is only
+ * created when all of the cached ones are in use.
+ */
+class _CCMCipher {
+  public:
+
+    /**
+     * Construct an empty cipher.
+     */
+    _CCMCipher() : isAES(false) { }
+
+    /**
+     * Construct a cipher for a key.
+     *
+     * @param keyBlob  The key blob, a cipher is only created for AES keys.
+     */
+    _CCMCipher(const qcc::KeyBlob& keyBlob) : key(keyBlob), isAES(keyBlob.GetType() == qcc::KeyBlob::AES) { }
+
+    /**
+     * Destructor
+     */
+    ~_CCMCipher();
+
+    /**
+     * Check if this cipher can be used.
+     *
+     * @return  false if this is an empty cipher.
+     */
+    bool IsValid() const { return isAES; }
+
+    /**
+     * Take an AES cipher for the exclusive use of the calling thread. The cipher must be given
+     * back with Release().
+     *
+     * @return  The cipher or NULL if this is an empty cipher.
+     */
+    qcc::Crypto_AES* Acquire() const;
+
+    /**
+     * Give back an AES cipher taken with Acquire().
+     *
+     * @param aes  The cipher.
+     */
+    void Release(qcc::Crypto_AES* aes) const;
+
+  private:
+
+    /* Copying would free the ciphers twice */
+    _CCMCipher(const _CCMCipher& other);
+    _CCMCipher& operator=(const _CCMCipher& other);
+
+    qcc::KeyBlob key;                            /**< The session key */
+    bool isAES;                                  /**< True if the key is an AES key */
+    mutable qcc::Mutex lock;                     /**< Protects the idle ciphers */
+    mutable std::vector<qcc::Crypto_AES*> idle;  /**< Expanded ciphers not in use by any thread */
+};
+
+/**
+ * CCMCipher is a reference counted (managed) _CCMCipher so a message can keep using a cipher while
+ * the peer is rekeyed.
+ */
+typedef qcc::ManagedObj<_CCMCipher> CCMCipher;
+
 /**
  * Class for encapsulating AllJoyn message encryption and decryption operations.
  */
@@ -53,12 +126,14 @@ class Crypto {
      * @param hdrLen          The length of the header part of the message that will not be encrypted.
      * @param bodyLen[in/out] On input the size of the plaintext body, on output the size of the
      *                        encrypted body.
+     * @param cipher          Optional cipher for the key blob. If not provided a cipher is created
+     *                        for this message.
      *
      * @return - ER_OK if the data was succesfully encrypted.
      *         - ER_BUS_KEYBLOB_OP_INVALID if the key blob cannot be used for encryption.
      *         - Other errors if the arguments are invalid.
      */
-    static QStatus Encrypt(const _Message& message, const qcc::KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen);
+    static QStatus Encrypt(const _Message& message, const qcc::KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen, const CCMCipher* cipher = NULL);
 
     /**
      * Decrypt and authenticate marshaled message inplace using the key blob provided and the
@@ -70,12 +145,14 @@ class Crypto {
      * @param hdrLen          The length of the non-encrypted header part of the message.
      * @param bodyLen[in/out] On input the size of the crypttext body, on output the size of the
      *                        decrypted body.
+     * @param cipher          Optional cipher for the key blob. If not provided a cipher is created
+     *                        for this message.
      *
      * @return - ER_OK if the data was succesfully decrypted.
      *         - ER_BUS_KEYBLOB_OP_INVALID if the key blob cannot be used for decryption.
      *         - Other errors if the arguments are invalid.
      */
-    static QStatus Decrypt(const _Message& message, const qcc::KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen);
+    static QStatus Decrypt(const _Message& message, const qcc::KeyBlob& keyBlob, uint8_t* msgBuf, size_t hdrLen, size_t& bodyLen, const CCMCipher* cipher = NULL);
 
     /**
      * Compute a SHA1 hash over the header fields and return the result in a key blob.
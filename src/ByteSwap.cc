@@ -0,0 +1,109 @@
+/**
+ * @file
+ *
+ * This file implements functions for endian swapping arrays of scalar values.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#include <qcc/platform.h>
+#include <qcc/Util.h>
+
+#include "ByteSwap.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BYTESWAP_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace qcc;
+
+namespace ajn {
+
+#ifdef BYTESWAP_SSE2
+
+/*
+ * Swap the bytes in each 16 bit lane
+ */
+static inline __m128i Swap16x8(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+/*
+ * Swap the 16 bit halves of each 32 bit lane then the bytes in each half
+ */
+static inline __m128i Swap32x4(__m128i v)
+{
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return Swap16x8(v);
+}
+
+/*
+ * Swap the 32 bit halves of each 64 bit lane then the bytes in each half
+ */
+static inline __m128i Swap64x2(__m128i v)
+{
+    return Swap32x4(_mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+#endif
+
+void ByteSwap::Swap16(uint16_t* dest, const uint16_t* src, size_t num)
+{
+    size_t i = 0;
+#ifdef BYTESWAP_SSE2
+    for (; (i + 8) <= num; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), Swap16x8(v));
+    }
+#endif
+    for (; i < num; ++i) {
+        dest[i] = EndianSwap16(src[i]);
+    }
+}
+
+void ByteSwap::Swap32(uint32_t* dest, const uint32_t* src, size_t num)
+{
+    size_t i = 0;
+#ifdef BYTESWAP_SSE2
+    for (; (i + 4) <= num; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), Swap32x4(v));
+    }
+#endif
+    for (; i < num; ++i) {
+        dest[i] = EndianSwap32(src[i]);
+    }
+}
+
+void ByteSwap::Swap64(uint64_t* dest, const uint64_t* src, size_t num)
+{
+    size_t i = 0;
+#ifdef BYTESWAP_SSE2
+    for (; (i + 2) <= num; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), Swap64x2(v));
+    }
+#endif
+    for (; i < num; ++i) {
+        dest[i] = EndianSwap64(src[i]);
+    }
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef _ALLJOYN_BYTESWAP_H
+#define _ALLJOYN_BYTESWAP_H
+/**
+ * @file
+ *
+ * This file defines functions for endian swapping arrays of scalar values.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#ifndef __cplusplus
+#error Only include ByteSwap.h in C++ code.
+#endif
+
+#include <qcc/platform.h>
+
+namespace ajn {
+
+/**
+ * Endian swap arrays of scalars. On x86 processors the arrays are swapped 16 bytes at a time
+ * using SSE2, elsewhere one element at a time. The source and destination do not need to be
+ * aligned beyond the natural alignment of the element type and may be the same array.
+ */
+class ByteSwap {
+
+  public:
+
+    /**
+     * Endian swap an array of 16 bit values.
+     *
+     * @param dest   Array to receive the swapped values.
+     * @param src    Array of values to swap.
+     * @param num    Number of values in the array.
+     */
+    static void Swap16(uint16_t* dest, const uint16_t* src, size_t num);
+
+    /**
+     * Endian swap an array of 32 bit values.
+     *
+     * @param dest   Array to receive the swapped values.
+     * @param src    Array of values to swap.
+     * @param num    Number of values in the array.
+     */
+    static void Swap32(uint32_t* dest, const uint32_t* src, size_t num);
+
+    /**
+     * Endian swap an array of 64 bit values.
+     *
+     * @param dest   Array to receive the swapped values.
+     * @param src    Array of values to swap.
+     * @param num    Number of values in the array.
+     */
+    static void Swap64(uint64_t* dest, const uint64_t* src, size_t num);
+};
+
+}
+
+#endif
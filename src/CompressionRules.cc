@@ -39,49 +39,75 @@ using namespace std;
 
 namespace ajn {
 
-void _CompressionRules::Add(const HeaderFields& hdrFields, uint32_t token)
+/*
+ * Initial size of the rule table, must be a power of two. The table is kept at most half full.
+ */
+static const size_t INITIAL_TABLE_SIZE = 64;
+
+struct _CompressionRules::RuleTraits {
+    static size_t Hash(const Rule& rule) { return rule.hash; }
+    static bool Matches(const Rule& rule, const HeaderFields& hdrFields) { return Equal(rule.fields, hdrFields); }
+};
+
+_CompressionRules::_CompressionRules() : rules(INITIAL_TABLE_SIZE)
+{
+}
+
+void _CompressionRules::Add(const HeaderFields& hdrFields, size_t hash, uint32_t token)
 {
-    HeaderFields* expFields = new HeaderFields;
+    Rule* rule = new Rule;
     /*
      * Copy compressible fields.
      */
-    for (size_t i = 0; i < ArraySize(expFields->field); i++) {
+    for (size_t i = 0; i < ArraySize(rule->fields.field); i++) {
         if (HeaderFields::Compressible[i]) {
-            expFields->field[i] = hdrFields.field[i];
+            rule->fields.field[i] = hdrFields.field[i];
         }
     }
+    rule->hash = hash;
+    rule->token = token;
+
+    rules.Add(rule);
     /*
-     * Add forward and reverse mapping.
+     * Add reverse mapping.
      */
-    tokenMap[token] = expFields;
-    fieldMap[expFields] = token;
-    QCC_DbgHLPrintf(("Added compression/expansion rule %u <-->\n%s", token, expFields->ToString().c_str()));
+    tokenMap[token] = rule;
+    QCC_DbgHLPrintf(("Added compression/expansion rule %u <-->\n%s", token, rule->fields.ToString().c_str()));
 }
 
 void _CompressionRules::AddExpansion(const HeaderFields& hdrFields, uint32_t token)
 {
     if (token) {
-        lock.Lock(MUTEX_CONTEXT);
-        if (fieldMap.count(&hdrFields) == 0) {
-            Add(hdrFields, token);
+        size_t hash = Hash(hdrFields);
+        if (!rules.Find(hdrFields, hash)) {
+            lock.Lock(MUTEX_CONTEXT);
+            /* Check again in case the rule was added while we were waiting for the lock */
+            if (!rules.Find(hdrFields, hash)) {
+                Add(hdrFields, hash, token);
+            }
+            lock.Unlock(MUTEX_CONTEXT);
         }
-        lock.Unlock(MUTEX_CONTEXT);
     }
 }
 
 uint32_t _CompressionRules::GetToken(const HeaderFields& hdrFields)
 {
+    size_t hash = Hash(hdrFields);
+    const Rule* rule = rules.Find(hdrFields, hash);
+    if (rule) {
+        return rule->token;
+    }
     uint32_t token;
     lock.Lock(MUTEX_CONTEXT);
-    unordered_map<const HeaderFields*, uint32_t, HdrFieldHash, HdrFieldsEq>::iterator iter = fieldMap.find(&hdrFields);
-    if (iter != fieldMap.end()) {
-        token = iter->second;
+    rule = rules.Find(hdrFields, hash);
+    if (rule) {
+        token = rule->token;
     } else {
         /*
          * Allocate a random token (check it isn't zero and not in use)
          */
-        do { token = Rand32(); } while (token && GetExpansion(token));
-        Add(hdrFields, token);
+        do { token = Rand32(); } while (!token || tokenMap.count(token));
+        Add(hdrFields, hash, token);
     }
     lock.Unlock(MUTEX_CONTEXT);
     return token;
@@ -92,8 +118,8 @@ const HeaderFields* _CompressionRules::GetExpansion(uint32_t token)
     const HeaderFields* expansion = NULL;
     if (token) {
         lock.Lock(MUTEX_CONTEXT);
-        map<uint32_t, const HeaderFields*>::iterator iter = tokenMap.find(token);
-        expansion = (iter != tokenMap.end()) ? iter->second : NULL;
+        map<uint32_t, const Rule*>::iterator iter = tokenMap.find(token);
+        expansion = (iter != tokenMap.end()) ? &iter->second->fields : NULL;
         lock.Unlock(MUTEX_CONTEXT);
     }
     return expansion;
@@ -101,17 +127,12 @@ const HeaderFields* _CompressionRules::GetExpansion(uint32_t token)
 
 _CompressionRules::~_CompressionRules()
 {
-    map<uint32_t, const ajn::HeaderFields*>::iterator iter = tokenMap.begin();
-    while (iter != tokenMap.end()) {
-        delete iter->second;
-        iter++;
-    }
 }
 
-bool _CompressionRules::HdrFieldsEq::operator()(const HeaderFields* k1, const HeaderFields* k2) const
+bool _CompressionRules::Equal(const HeaderFields& k1, const HeaderFields& k2)
 {
-    const MsgArg* f1 = k1->field;
-    const MsgArg* f2 = k2->field;
+    const MsgArg* f1 = k1.field;
+    const MsgArg* f2 = k2.field;
     for (int i = 0; i < ALLJOYN_HDR_FIELD_UNKNOWN; i++, f1++, f2++) {
         if (HeaderFields::Compressible[i]) {
             if (f1->typeId != f2->typeId) {
@@ -154,15 +175,15 @@ bool _CompressionRules::HdrFieldsEq::operator()(const HeaderFields* k1, const He
     return true;
 }
 
-size_t _CompressionRules::HdrFieldHash::operator()(const HeaderFields* k) const
+size_t _CompressionRules::Hash(const HeaderFields& k)
 {
     Adler32 adler;
     size_t hash = 0;
-    if (k->field[ALLJOYN_HDR_FIELD_MEMBER].typeId == ALLJOYN_STRING) {
-        hash = adler.Update((uint8_t*)k->field[ALLJOYN_HDR_FIELD_MEMBER].v_string.str, k->field[ALLJOYN_HDR_FIELD_MEMBER].v_string.len);
+    if (k.field[ALLJOYN_HDR_FIELD_MEMBER].typeId == ALLJOYN_STRING) {
+        hash = adler.Update((uint8_t*)k.field[ALLJOYN_HDR_FIELD_MEMBER].v_string.str, k.field[ALLJOYN_HDR_FIELD_MEMBER].v_string.len);
     }
-    if (k->field[ALLJOYN_HDR_FIELD_INTERFACE].typeId == ALLJOYN_STRING) {
-        hash = adler.Update((uint8_t*)k->field[ALLJOYN_HDR_FIELD_INTERFACE].v_string.str, k->field[ALLJOYN_HDR_FIELD_INTERFACE].v_string.len);
+    if (k.field[ALLJOYN_HDR_FIELD_INTERFACE].typeId == ALLJOYN_STRING) {
+        hash = adler.Update((uint8_t*)k.field[ALLJOYN_HDR_FIELD_INTERFACE].v_string.str, k.field[ALLJOYN_HDR_FIELD_INTERFACE].v_string.len);
     }
     return hash;
 
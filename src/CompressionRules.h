@@ -37,6 +37,8 @@
 #include <qcc/STLContainer.h>
 #include <map>
 
+#include "GrowOnlyTable.h"
+
 namespace ajn {
 
 /**
@@ -54,11 +56,19 @@ typedef qcc::ManagedObj<_CompressionRules> CompressionRules;
  * This class maintains a list of header compression rules for header field compression and provides
  * methods that map from a expanded header to a compression token and back. This class is used by
  * the marshaling code to compress a header before sending it.
+ *
+ * Rules are never removed so the lookup from header fields to a compression token, which is done
+ * for every compressed message that is sent, does not take a lock. Only adding a rule is serialized.
  */
 class _CompressionRules {
 
   public:
 
+    /**
+     * Constructor
+     */
+    _CompressionRules();
+
     /**
      * Add a new expansion rule to the expansion table. This is an expansion that was received from
      * a remote peer. Note that 0 is an invalid token value.
@@ -97,12 +107,27 @@ class _CompressionRules {
   private:
 
     /**
-     * Add a compression/expansion rule.
+     * A compression rule. Rules are immutable once they have been added.
+     */
+    struct Rule {
+        HeaderFields fields;   /**< The compressible header fields */
+        size_t hash;           /**< Hash of the header fields computed when the rule was added */
+        uint32_t token;        /**< The compression token */
+    };
+
+    /**
+     * Traits for looking up rules by their header fields.
      */
-    void Add(const HeaderFields& hdrFields, uint32_t token);
+    struct RuleTraits;
+    friend struct RuleTraits;
 
     /**
-     * Mutex to protect compression rules maps
+     * Add a compression/expansion rule. Must be called with the lock held.
+     */
+    void Add(const HeaderFields& hdrFields, size_t hash, uint32_t token);
+
+    /**
+     * Mutex to serialize adding rules and to protect the expansion map
      */
     qcc::Mutex lock;
 
@@ -110,26 +135,22 @@ class _CompressionRules {
      * Hash funcion for header compression. Hash value is computed over member and interface only.
      * on the reasonable assumption that there will only be one compression for a specific message.
      */
-    struct HdrFieldHash {
-        size_t operator()(const HeaderFields* k) const;
-    };
+    static size_t Hash(const HeaderFields& k);
 
     /**
      * Function for testing compressible message header fields for equality.
      */
-    struct HdrFieldsEq {
-        bool operator()(const HeaderFields* k1, const HeaderFields* k2) const;
-    };
+    static bool Equal(const HeaderFields& k1, const HeaderFields& k2);
 
     /**
-     * The header compression mapping from header fields to compression token
+     * The header compression mapping from header fields to compression token. Owns the rules.
      */
-    std::unordered_map<const ajn::HeaderFields*, uint32_t, HdrFieldHash, HdrFieldsEq> fieldMap;
+    GrowOnlyTable<Rule, RuleTraits> rules;
 
     /*
      * The header expansion mapping from compression token to header fields
      */
-    std::map<uint32_t, const ajn::HeaderFields*> tokenMap;
+    std::map<uint32_t, const Rule*> tokenMap;
 
 };
 
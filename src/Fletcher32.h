@@ -57,6 +57,16 @@ class Fletcher32 {
         while (data && len) {
             size_t l = (len <= 360) ? len : 360;
             len -= l;
+            /*
+             * Four words per step. The sums after each step are the same as adding the words one
+             * at a time but fletch2 only waits on fletch1 once per step instead of once per word.
+             */
+            while (l >= 4) {
+                fletch2 += 4 * fletch1 + 4 * data[0] + 3 * data[1] + 2 * data[2] + data[3];
+                fletch1 += data[0] + data[1] + data[2] + data[3];
+                data += 4;
+                l -= 4;
+            }
             while (l--) {
                 fletch1 += *data++;
                 fletch2 += fletch1;
@@ -0,0 +1,169 @@
+#ifndef _ALLJOYN_GROWONLYTABLE_H
+#define _ALLJOYN_GROWONLYTABLE_H
+/**
+ * @file
+ * This file defines a hash table that can be searched without a lock because entries are never
+ * removed.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#ifndef __cplusplus
+#error Only include GrowOnlyTable.h in C++ code.
+#endif
+
+#include <qcc/platform.h>
+#include <qcc/atomic.h>
+
+namespace ajn {
+
+/**
+ * Open addressed hash table of immutable entries for data that is looked up far more often than it
+ * is added to. Entries are never removed so Find() does not take a lock, adding entries must be
+ * serialized by the caller. The table is kept at most half full. A full table is replaced by one
+ * twice the size and the old table is kept until the table is destroyed because a reader may still
+ * be probing it. The table owns the entries and deletes them when it is destroyed.
+ *
+ * Traits must provide these static functions:
+ *
+ *   size_t Hash(const T& entry)                    The hash of an entry, it must not change.
+ *   bool Matches(const T& entry, const Key& key)   True if the entry is the one for a key.
+ */
+template <typename T, typename Traits>
+class GrowOnlyTable {
+  public:
+
+    /**
+     * Constructor
+     *
+     * @param initialSize  Initial number of slots, must be a power of two.
+     */
+    GrowOnlyTable(size_t initialSize) : published(0), table(new Table(initialSize, NULL)) { }
+
+    /**
+     * Destructor. Deletes the entries so no other thread can be using the table.
+     */
+    ~GrowOnlyTable()
+    {
+        /* Every entry is in the current table, the retired tables are deleted along with it */
+        for (size_t i = 0; i <= table->mask; ++i) {
+            delete table->slots[i];
+        }
+        delete table;
+    }
+
+    /**
+     * Find the entry for a key without taking a lock.
+     *
+     * @param key   The key to look up.
+     * @param hash  The hash of the key.
+     *
+     * @return  The entry or NULL if there is no entry for the key.
+     */
+    template <typename Key>
+    const T* Find(const Key& key, size_t hash) const
+    {
+        /*
+         * Slots are only ever changed from NULL to a fully initialized entry and tables are never
+         * freed while the table is alive so probing without a lock is safe.
+         */
+        const Table* t = table;
+        for (size_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+            const T* entry = t->slots[i];
+            if (!entry) {
+                return NULL;
+            }
+            if ((Traits::Hash(*entry) == hash) && Traits::Matches(*entry, key)) {
+                return entry;
+            }
+        }
+    }
+
+    /**
+     * Add an entry. Calls must be serialized by the caller and the entry must not already be in
+     * the table.
+     *
+     * @param entry  The entry, the table takes ownership of it.
+     */
+    void Add(const T* entry)
+    {
+        Table* t = table;
+        if ((2 * (t->count + 1)) > (t->mask + 1)) {
+            /*
+             * Move the entries to a table twice the size. The increment is a full barrier so the
+             * new table is completely filled in before readers can see it.
+             */
+            Table* bigger = new Table(2 * (t->mask + 1), t);
+            for (size_t i = 0; i <= t->mask; ++i) {
+                if (t->slots[i]) {
+                    Insert(*bigger, t->slots[i]);
+                }
+            }
+            qcc::IncrementAndFetch(&published);
+            table = t = bigger;
+        }
+        /* The entry must be completely filled in before it is visible to readers */
+        qcc::IncrementAndFetch(&published);
+        Insert(*t, entry);
+    }
+
+  private:
+
+    struct Table {
+        Table(size_t size, Table* retired) : mask(size - 1), count(0), slots(new const T*[size]), retired(retired)
+        {
+            for (size_t i = 0; i < size; ++i) {
+                slots[i] = NULL;
+            }
+        }
+
+        ~Table()
+        {
+            delete [] slots;
+            delete retired;
+        }
+
+        size_t mask;                /**< Table size - 1, the size is a power of two */
+        size_t count;               /**< Number of entries in the table */
+        const T* volatile* slots;   /**< The slots, an empty slot is NULL */
+        Table* retired;             /**< The table this one replaced */
+    };
+
+    /* Copying would delete the entries twice */
+    GrowOnlyTable(const GrowOnlyTable& other);
+    GrowOnlyTable& operator=(const GrowOnlyTable& other);
+
+    /**
+     * Publish an entry in a table, the caller must make sure the table has room for it.
+     */
+    static void Insert(Table& t, const T* entry)
+    {
+        size_t i = Traits::Hash(*entry) & t.mask;
+        while (t.slots[i]) {
+            i = (i + 1) & t.mask;
+        }
+        t.slots[i] = entry;
+        ++t.count;
+    }
+
+    volatile int32_t published;   /**< Counter whose atomic increments are used as memory barriers */
+    Table* volatile table;        /**< The current table */
+};
+
+}
+
+#endif
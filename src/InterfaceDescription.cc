@@ -28,6 +28,7 @@
 #include <alljoyn/Status.h>
 
 #include "SignatureUtils.h"
+#include "MarshalPlan.h"
 
 #define QCC_MODULE "ALLJOYN"
 
@@ -369,6 +370,11 @@ QStatus InterfaceDescription::AddMember(AllJoynMessageType type,
     Member member(this, type, name, inSig, outSig, argNames, annotation, accessPerms);
     pair<StringMapKey, Member> item(key, member);
     pair<Definitions::MemberMap::iterator, bool> ret = defs->members.insert(item);
+    if (ret.second) {
+        /* Compile marshaling plans up front for the signatures of the new member */
+        MarshalPlan::Get(member.signature);
+        MarshalPlan::Get(member.returnSignature);
+    }
     return ret.second ? ER_OK : ER_BUS_MEMBER_ALREADY_EXISTS;
 }
 
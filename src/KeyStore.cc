@@ -59,6 +59,41 @@ static const uint16_t LowStoreVersion = 0x0102;
  */
 static const uint16_t KeyStoreVersion = 0x0103;
 
+/*
+ * Current journal format version, journals in any other format are ignored
+ */
+static const uint16_t JournalVersion = 0x0104;
+
+/*
+ * Changes are journaled until the journal has more than this many records or more records than
+ * a quarter of the number of keys, after which the key store is compacted by pushing all the keys.
+ */
+static const size_t MinJournalRecords = 64;
+
+/*
+ * Journal record operations
+ */
+static const uint8_t JournalAddKey = 1;
+static const uint8_t JournalDelKey = 2;
+
+/*
+ * Sanity check on the length of a journal record
+ */
+static const uint32_t MaxJournalRecordLen = 64000;
+
+/*
+ * Journal records are encrypted with a nonce made from the random salt of the journal and the
+ * record sequence number. The revision cannot be used because it is reset when the key store is
+ * cleared.
+ */
+static KeyBlob JournalNonce(uint64_t salt, uint32_t seq)
+{
+    uint8_t nd[sizeof(uint64_t) + sizeof(uint32_t)];
+    memcpy(nd, &salt, sizeof(salt));
+    memcpy(nd + sizeof(salt), &seq, sizeof(seq));
+    return KeyBlob(nd, sizeof(nd), KeyBlob::GENERIC);
+}
+
 
 QStatus KeyStoreListener::PutKeys(KeyStore& keyStore, const qcc::String& source, const qcc::String& password)
 {
@@ -86,6 +121,7 @@ class DefaultKeyStoreListener : public KeyStoreListener {
         } else {
             fileName = GetHomeDir() + "/.alljoyn_keystore/" + application;
         }
+        journalFileName = fileName + ".journal";
     }
 
     QStatus LoadRequest(KeyStore& keyStore) {
@@ -98,6 +134,7 @@ class DefaultKeyStoreListener : public KeyStoreListener {
                 status = keyStore.Pull(source, fileName);
                 if (status == ER_OK) {
                     QCC_DbgHLPrintf(("Read key store from %s", fileName.c_str()));
+                    status = LoadJournal(keyStore);
                 }
                 source.Unlock();
                 return status;
@@ -133,12 +170,24 @@ class DefaultKeyStoreListener : public KeyStoreListener {
 
     QStatus StoreRequest(KeyStore& keyStore) {
         QStatus status;
+        /* Only write the changes unless the key store needs compacting */
+        if (!keyStore.IsJournalFull()) {
+            status = StoreJournal(keyStore);
+            if (status == ER_OK) {
+                return status;
+            }
+        }
         FileSink sink(fileName, FileSink::PRIVATE);
         if (sink.IsValid()) {
             sink.Lock(true);
             status = keyStore.Push(sink);
             if (status == ER_OK) {
                 QCC_DbgHLPrintf(("Wrote key store to %s", fileName.c_str()));
+                /*
+                 * Start a new journal. If this fails the old journal is ignored on the next load
+                 * because it was written for an earlier revision of the key store.
+                 */
+                StoreJournal(keyStore);
             }
             sink.Unlock();
         } else {
@@ -150,7 +199,40 @@ class DefaultKeyStoreListener : public KeyStoreListener {
 
   private:
 
+    QStatus LoadJournal(KeyStore& keyStore) {
+        FileSource source(journalFileName);
+        if (!source.IsValid()) {
+            /* No changes have been journaled */
+            return ER_OK;
+        }
+        source.Lock(true);
+        QStatus status = keyStore.PullJournal(source);
+        if (status == ER_OK) {
+            QCC_DbgHLPrintf(("Read key store journal from %s", journalFileName.c_str()));
+        }
+        source.Unlock();
+        return status;
+    }
+
+    QStatus StoreJournal(KeyStore& keyStore) {
+        QStatus status;
+        FileSink sink(journalFileName, FileSink::PRIVATE);
+        if (sink.IsValid()) {
+            sink.Lock(true);
+            status = keyStore.PushJournal(sink);
+            if (status == ER_OK) {
+                QCC_DbgHLPrintf(("Wrote key store journal to %s", journalFileName.c_str()));
+            }
+            sink.Unlock();
+        } else {
+            status = ER_BUS_WRITE_ERROR;
+            QCC_LogError(status, ("Cannot write key store journal to %s", journalFileName.c_str()));
+        }
+        return status;
+    }
+
     qcc::String fileName;
+    qcc::String journalFileName;
 
 };
 
@@ -164,7 +246,10 @@ KeyStore::KeyStore(const qcc::String& application) :
     keyStoreKey(NULL),
     shared(false),
     stored(NULL),
-    loaded(NULL)
+    loaded(NULL),
+    journalSalt(0),
+    journalRecords(0),
+    compactJournal(true)
 {
 }
 
@@ -307,6 +392,7 @@ size_t KeyStore::EraseExpiredKeys()
         KeyMap::iterator current = it++;
         if (current->second.key.HasExpired()) {
             QCC_DbgPrintf(("Deleting expired key for GUID %s", current->first.ToString().c_str()));
+            dirty.insert(current->first);
             keys->erase(current);
             ++count;
         }
@@ -330,6 +416,11 @@ QStatus KeyStore::Pull(Source& source, const qcc::String& password)
     size_t len = 0;
     uint16_t version;
 
+    /* Any journal is for the keys being pulled */
+    dirty.clear();
+    RestartJournal();
+    compactJournal = false;
+
     /* Pull and check the key store version */
     QStatus status = source.PullBytes(&version, sizeof(version), pulled);
     if ((status == ER_OK) && ((version > KeyStoreVersion) || (version < LowStoreVersion))) {
@@ -357,6 +448,8 @@ QStatus KeyStore::Pull(Source& source, const qcc::String& password)
         keys->clear();
         storeState = MODIFIED;
         revision = 0;
+        /* The GUID is not saved until the keys are pushed and the journal cannot be read without it */
+        compactJournal = true;
         status = ER_OK;
         goto ExitPull;
     }
@@ -442,6 +535,7 @@ ExitPull:
     if (status != ER_OK) {
         keys->clear();
         storeState = MODIFIED;
+        compactJournal = true;
     }
     if (loaded) {
         loaded->SetEvent();
@@ -450,6 +544,13 @@ ExitPull:
     return status;
 }
 
+void KeyStore::RestartJournal()
+{
+    journal.clear();
+    journalRecords = 0;
+    Crypto_GetRandomBytes(reinterpret_cast<uint8_t*>(&journalSalt), sizeof(journalSalt));
+}
+
 QStatus KeyStore::Clear()
 {
     if (storeState == UNAVAILABLE) {
@@ -460,6 +561,9 @@ QStatus KeyStore::Clear()
     storeState = MODIFIED;
     revision = 0;
     deletions.clear();
+    dirty.clear();
+    RestartJournal();
+    compactJournal = true;
     lock.Unlock(MUTEX_CONTEXT);
     listener->StoreRequest(*this);
     return ER_OK;
@@ -615,6 +719,10 @@ QStatus KeyStore::Push(Sink& sink)
         goto ExitPush;
     }
     storeState = LOADED;
+    /* The journal starts over from this revision */
+    dirty.clear();
+    RestartJournal();
+    compactJournal = false;
 
 ExitPush:
 
@@ -625,6 +733,218 @@ ExitPush:
     return status;
 }
 
+QStatus KeyStore::PullJournal(Source& source)
+{
+    if (storeState == UNAVAILABLE) {
+        return ER_BUS_KEYSTORE_NOT_LOADED;
+    }
+
+    lock.Lock(MUTEX_CONTEXT);
+
+    size_t pulled;
+    uint16_t version = 0;
+    uint32_t rev = 0;
+    uint64_t salt = 0;
+    uint32_t numRecords = 0;
+
+    QStatus status = source.PullBytes(&version, sizeof(version), pulled);
+    if ((status == ER_OK) && (pulled == sizeof(version))) {
+        status = source.PullBytes(&rev, sizeof(rev), pulled);
+    }
+    if ((status == ER_OK) && (pulled == sizeof(rev))) {
+        status = source.PullBytes(&salt, sizeof(salt), pulled);
+    }
+    if ((status == ER_OK) && (pulled == sizeof(salt))) {
+        status = source.PullBytes(&numRecords, sizeof(numRecords), pulled);
+    }
+    /*
+     * An empty journal or a journal for a different revision of the key store has nothing to
+     * apply. The next push of the journal will replace it.
+     */
+    if ((status != ER_OK) || (pulled != sizeof(numRecords)) || (version != JournalVersion) || (rev != revision)) {
+        QCC_DbgPrintf(("KeyStore::PullJournal ignoring journal for revision %d", rev));
+        lock.Unlock(MUTEX_CONTEXT);
+        return ER_OK;
+    }
+    QCC_DbgPrintf(("KeyStore::PullJournal (revision %d, %d records)", revision, numRecords));
+
+    /* New records are appended to this journal */
+    journalSalt = salt;
+
+    Crypto_AES aes(*keyStoreKey, Crypto_AES::CCM);
+    while (journalRecords < numRecords) {
+        uint32_t seq;
+        uint32_t recLen = 0;
+        /*
+         * A journal cut short at a record boundary is truncated too. The missing records were
+         * encrypted with this salt so their sequence numbers must not be used again.
+         */
+        status = source.PullBytes(&seq, sizeof(seq), pulled);
+        if ((status == ER_OK) && (pulled == sizeof(seq))) {
+            status = source.PullBytes(&recLen, sizeof(recLen), pulled);
+        }
+        if ((status == ER_OK) && ((pulled != sizeof(recLen)) || (seq != journalRecords) || (recLen > MaxJournalRecordLen))) {
+            status = ER_BUS_CORRUPT_KEYSTORE;
+        }
+        if (status != ER_OK) {
+            break;
+        }
+        uint8_t* data = new uint8_t[recLen];
+        status = source.PullBytes(data, recLen, pulled);
+        if ((status == ER_OK) && (pulled != recLen)) {
+            status = ER_BUS_CORRUPT_KEYSTORE;
+        }
+        /*
+         * Keep a copy of the encrypted record so it can be pushed again without re-encrypting it.
+         */
+        qcc::String record;
+        if (status == ER_OK) {
+            record.append((const char*)&seq, sizeof(seq));
+            record.append((const char*)&recLen, sizeof(recLen));
+            record.append((const char*)data, recLen);
+            size_t len = recLen;
+            status = aes.Decrypt_CCM(data, data, len, JournalNonce(journalSalt, seq), NULL, 0, 16);
+            if (status == ER_OK) {
+                StringSource strSource(data, len);
+                uint8_t op = 0;
+                uint8_t guidBuf[qcc::GUID128::SIZE];
+                qcc::GUID128 guid;
+                status = strSource.PullBytes(&op, sizeof(op), pulled);
+                if (status == ER_OK) {
+                    status = strSource.PullBytes(guidBuf, qcc::GUID128::SIZE, pulled);
+                    guid.SetBytes(guidBuf);
+                }
+                if ((status == ER_OK) && (op == JournalAddKey)) {
+                    KeyRecord keyRec;
+                    status = strSource.PullBytes(&keyRec.revision, sizeof(keyRec.revision), pulled);
+                    if (status == ER_OK) {
+                        status = keyRec.key.Load(strSource);
+                    }
+                    if (status == ER_OK) {
+                        status = strSource.PullBytes(&keyRec.accessRights, sizeof(keyRec.accessRights), pulled);
+                    }
+                    if (status == ER_OK) {
+                        (*keys)[guid] = keyRec;
+                    }
+                } else if ((status == ER_OK) && (op == JournalDelKey)) {
+                    keys->erase(guid);
+                } else if (status == ER_OK) {
+                    status = ER_BUS_CORRUPT_KEYSTORE;
+                }
+                QCC_DbgPrintf(("KeyStore::PullJournal seq:%d op:%d GUID %s %s", seq, op, guid.ToString().c_str(), QCC_StatusText(status)));
+            }
+        }
+        delete [] data;
+        if (status != ER_OK) {
+            break;
+        }
+        journal.append(record);
+        ++journalRecords;
+    }
+    if (status == ER_NONE) {
+        status = ER_BUS_CORRUPT_KEYSTORE;
+    }
+    if (status != ER_OK) {
+        /*
+         * The tail of the journal is lost if a push was interrupted. Keep the changes from the
+         * good records and rewrite the whole key store on the next store. The journal is
+         * restarted with a new salt so nothing is appended under the salt of the lost records.
+         */
+        QCC_LogError(status, ("Discarding key store journal after %d records", journalRecords));
+        RestartJournal();
+        compactJournal = true;
+        storeState = MODIFIED;
+        status = ER_OK;
+    }
+    if (EraseExpiredKeys()) {
+        storeState = MODIFIED;
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+    return status;
+}
+
+QStatus KeyStore::PushJournal(Sink& sink)
+{
+    size_t pushed;
+    QStatus status = ER_OK;
+
+    lock.Lock(MUTEX_CONTEXT);
+    QCC_DbgHLPrintf(("KeyStore::PushJournal (revision %d, %d changes)", revision, static_cast<uint32_t>(dirty.size())));
+
+    /*
+     * Encrypt a record for each change and add it to the journal.
+     */
+    Crypto_AES aes(*keyStoreKey, Crypto_AES::CCM);
+    std::set<qcc::GUID128>::iterator it;
+    for (it = dirty.begin(); (status == ER_OK) && (it != dirty.end()); ++it) {
+        StringSink strSink;
+        KeyMap::iterator kit = keys->find(*it);
+        uint8_t op = (kit == keys->end()) ? JournalDelKey : JournalAddKey;
+        strSink.PushBytes(&op, sizeof(op), pushed);
+        strSink.PushBytes(it->GetBytes(), qcc::GUID128::SIZE, pushed);
+        if (op == JournalAddKey) {
+            strSink.PushBytes(&kit->second.revision, sizeof(kit->second.revision), pushed);
+            kit->second.key.Store(strSink);
+            strSink.PushBytes(&kit->second.accessRights, sizeof(kit->second.accessRights), pushed);
+        }
+        uint32_t seq = journalRecords;
+        size_t len = strSink.GetString().size();
+        uint8_t* data = new uint8_t[len + 16];
+        status = aes.Encrypt_CCM(strSink.GetString().data(), data, len, JournalNonce(journalSalt, seq), NULL, 0, 16);
+        if (status == ER_OK) {
+            uint32_t recLen = static_cast<uint32_t>(len);
+            journal.append((const char*)&seq, sizeof(seq));
+            journal.append((const char*)&recLen, sizeof(recLen));
+            journal.append((const char*)data, len);
+            ++journalRecords;
+        }
+        delete [] data;
+    }
+    if (status == ER_OK) {
+        dirty.clear();
+        /*
+         * The journal header is the journal version, the revision of the key store the journal
+         * applies to, the salt for the record nonces and the number of records.
+         */
+        status = sink.PushBytes(&JournalVersion, sizeof(JournalVersion), pushed);
+        if (status == ER_OK) {
+            status = sink.PushBytes(&revision, sizeof(revision), pushed);
+        }
+        if (status == ER_OK) {
+            status = sink.PushBytes(&journalSalt, sizeof(journalSalt), pushed);
+        }
+        if (status == ER_OK) {
+            status = sink.PushBytes(&journalRecords, sizeof(journalRecords), pushed);
+        }
+        if ((status == ER_OK) && !journal.empty()) {
+            status = sink.PushBytes(journal.data(), journal.size(), pushed);
+        }
+    }
+    if (status == ER_OK) {
+        storeState = LOADED;
+    } else {
+        /* Records may be missing from the journal so compact on the next store */
+        compactJournal = true;
+    }
+    if (stored) {
+        stored->SetEvent();
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+    return status;
+}
+
+bool KeyStore::IsJournalFull()
+{
+    lock.Lock(MUTEX_CONTEXT);
+    size_t maxRecords = keys->size() / 4;
+    if (maxRecords < MinJournalRecords) {
+        maxRecords = MinJournalRecords;
+    }
+    bool full = shared || compactJournal || ((journalRecords + dirty.size()) > maxRecords);
+    lock.Unlock(MUTEX_CONTEXT);
+    return full;
+}
+
 QStatus KeyStore::GetKey(const qcc::GUID128& guid, KeyBlob& key, uint8_t accessRights[4])
 {
     if (storeState == UNAVAILABLE) {
@@ -672,6 +992,7 @@ QStatus KeyStore::AddKey(const qcc::GUID128& guid, const KeyBlob& key, const uin
     memcpy(&keyRec.accessRights, accessRights, sizeof(uint8_t) * 4);
     storeState = MODIFIED;
     deletions.erase(guid);
+    dirty.insert(guid);
     lock.Unlock(MUTEX_CONTEXT);
     return ER_OK;
 }
@@ -686,6 +1007,7 @@ QStatus KeyStore::DelKey(const qcc::GUID128& guid)
     keys->erase(guid);
     storeState = MODIFIED;
     deletions.insert(guid);
+    dirty.insert(guid);
     lock.Unlock(MUTEX_CONTEXT);
     listener->StoreRequest(*this);
     return ER_OK;
@@ -702,6 +1024,7 @@ QStatus KeyStore::SetKeyExpiration(const qcc::GUID128& guid, const Timespec& exp
     if (keys->count(guid) != 0) {
         (*keys)[guid].key.SetExpiration(expiration);
         storeState = MODIFIED;
+        dirty.insert(guid);
     } else {
         status = ER_BUS_KEY_UNAVAILABLE;
     }
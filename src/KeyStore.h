@@ -256,6 +256,41 @@ class KeyStore {
      */
     QStatus Push(qcc::Sink& sink);
 
+    /**
+     * Pull journaled changes into the key store from a source. This is called after Pull() to
+     * apply the changes that were journaled since the keys were last pushed. A journal written for
+     * a different revision of the key store is ignored. If the journal has fewer records than its
+     * header says or is corrupt the records before the bad record are applied, the journal is
+     * restarted and the key store is marked for compaction.
+     *
+     * @param source The source to read the journal from.
+     * @return
+     *      - ER_OK if successful
+     *      - An error status otherwise
+     */
+    QStatus PullJournal(qcc::Source& source);
+
+    /**
+     * Push the key store journal into a sink. Records for the keys that have been added, changed,
+     * deleted or have expired since the last push are encrypted and added to the journal and the
+     * entire journal is written to the sink. Records that were already in the journal are not
+     * encrypted again.
+     *
+     * @param sink The sink to write the journal to.
+     * @return
+     *      - ER_OK if successful
+     *      - An error status otherwise
+     */
+    QStatus PushJournal(qcc::Sink& sink);
+
+    /**
+     * Check if the key store should be compacted by pushing all the keys with Push() rather than
+     * by pushing the journal with PushJournal(). Shared key stores are always pushed in full.
+     *
+     * @return  Returns true if the key store should be compacted.
+     */
+    bool IsJournalFull();
+
     /**
      * Indicates if this is a shared key store.
      *
@@ -285,6 +320,11 @@ class KeyStore {
      */
     size_t EraseExpiredKeys();
 
+    /**
+     * Internal function to empty the journal and choose a new salt for its record nonces
+     */
+    void RestartJournal();
+
     /**
      * Internal Load function
      */
@@ -375,6 +415,33 @@ class KeyStore {
      * Event for synchronizing load requests
      */
     qcc::Event* loaded;
+
+    /**
+     * GUID for keys that have been added, changed or deleted since the keys or journal were last
+     * pushed
+     */
+    std::set<qcc::GUID128> dirty;
+
+    /**
+     * Random salt for the nonces of the records in the journal, a new salt is chosen each time
+     * the journal is restarted
+     */
+    uint64_t journalSalt;
+
+    /**
+     * The encrypted records in the journal
+     */
+    qcc::String journal;
+
+    /**
+     * Number of records in the journal
+     */
+    uint32_t journalRecords;
+
+    /**
+     * Indicates the journal cannot be appended to and all the keys must be pushed
+     */
+    bool compactJournal;
 };
 
 }
@@ -22,13 +22,17 @@
  ******************************************************************************/
 #include <qcc/platform.h>
 
+#include <deque>
 #include <list>
+#include <vector>
 
 #include <qcc/Debug.h>
 #include <qcc/GUID.h>
 #include <qcc/String.h>
 #include <qcc/StringUtil.h>
 #include <qcc/Thread.h>
+#include <qcc/Event.h>
+#include <qcc/Mutex.h>
 #include <qcc/atomic.h>
 
 #include <alljoyn/DBusStd.h>
@@ -55,23 +59,91 @@ namespace ajn {
 
 static const uint32_t LOCAL_ENDPOINT_CONCURRENCY = 4;
 
+/*
+ * Maximum number of messages queued on the dispatcher before senders are blocked
+ */
+static const size_t LOCAL_ENDPOINT_MAX_PENDING = 10;
 
-class _LocalEndpoint::Dispatcher : public qcc::Timer, public qcc::AlarmListener {
+/*
+ * The dispatcher hands messages received by the local endpoint to a pool of worker threads.
+ * Messages are dispatched in the order they were received and only one message is dispatched
+ * at a time unless the callback for that message enables reentrancy by calling
+ * BusAttachment::EnableConcurrentCallbacks, at which point the next message can be dispatched on
+ * another worker.
+ */
+class _LocalEndpoint::Dispatcher {
   public:
-    Dispatcher(_LocalEndpoint* endpoint, uint32_t concurrency = LOCAL_ENDPOINT_CONCURRENCY) : Timer("lepDisp", true, concurrency, true, 10), AlarmListener(), endpoint(endpoint) { }
+    Dispatcher(_LocalEndpoint* endpoint, uint32_t concurrency = LOCAL_ENDPOINT_CONCURRENCY);
+
+    ~Dispatcher();
+
+    QStatus Start();
+
+    QStatus Stop();
+
+    QStatus Join();
+
     QStatus DispatchMessage(Message& msg);
 
-    void AlarmTriggered(const qcc::Alarm& alarm, QStatus reason);
+    QStatus DispatchDeferredCallbacks();
+
+    void EnableReentrancy();
+
+    bool ThreadHoldsLock();
 
   private:
+
+    class Worker : public qcc::Thread, public qcc::ThreadListener {
+      public:
+        Worker(Dispatcher* dispatcher) : Thread("lepDisp"), reapOnExit(false), dispatcher(dispatcher) { }
+
+        void ThreadExit(qcc::Thread* thread)
+        {
+            /* A worker that joined itself has been detached from the dispatcher and cleans up after itself */
+            if (reapOnExit) {
+                Join();
+                delete this;
+            }
+        }
+
+        bool reapOnExit;   /* Set (on this thread) when the worker joined itself */
+
+      protected:
+        qcc::ThreadReturn STDCALL Run(void* arg) { dispatcher->WorkerRun(this); return 0; }
+
+      private:
+        Dispatcher* dispatcher;
+    };
+
+    struct WorkItem {
+        WorkItem(const Message& msg, bool deferredCallbacks = false) : msg(msg), deferredCallbacks(deferredCallbacks) { }
+        Message msg;
+        bool deferredCallbacks;
+    };
+
+    QStatus Enqueue(const WorkItem& item);
+
+    void WorkerRun(Worker* worker);
+
     _LocalEndpoint* endpoint;
+    uint32_t concurrency;
+    std::vector<Worker*> workers;
+
+    qcc::Mutex lock;                   /* Protects the state below */
+    std::deque<WorkItem> queue;        /* Messages waiting to be dispatched */
+    bool running;
+    qcc::Event workAvailable;          /* Set when a waiting worker may be able to dispatch a message */
+    qcc::Event spaceAvailable;         /* Set when there is room in the queue and a sender is waiting */
+    uint32_t idleWorkers;              /* Number of workers waiting for work */
+    uint32_t blockedSenders;           /* Number of senders waiting for room in the queue */
+    qcc::Thread* callbackThread;       /* The worker dispatching a message, NULL if reentrancy was enabled */
 };
 
-class _LocalEndpoint::DeferredCallbacks : public qcc::AlarmListener {
+class _LocalEndpoint::DeferredCallbacks {
   public:
     DeferredCallbacks(_LocalEndpoint* ep) : endpoint(ep) { }
 
-    void AlarmTriggered(const qcc::Alarm& alarm, QStatus reason);
+    void Run();
 
   private:
     _LocalEndpoint* endpoint;
@@ -390,51 +462,215 @@ QStatus _LocalEndpoint::PeerInterface(Message& message)
 }
 
 
-QStatus _LocalEndpoint::Dispatcher::DispatchMessage(Message& msg)
+_LocalEndpoint::Dispatcher::Dispatcher(_LocalEndpoint* endpoint, uint32_t concurrency) :
+    endpoint(endpoint),
+    concurrency(concurrency ? concurrency : 1),
+    running(false),
+    idleWorkers(0),
+    blockedSenders(0),
+    callbackThread(NULL)
 {
-    uint32_t zero = 0;
-    void* context = new Message(msg);
-    qcc::AlarmListener* localEndpointListener = this;
-    Alarm alarm(zero, localEndpointListener, context, zero);
-    QStatus status = AddAlarm(alarm);
-    if (status != ER_OK) {
-        Message* temp = static_cast<Message*>(context);
-        if (temp) {
-            delete temp;
+}
+
+_LocalEndpoint::Dispatcher::~Dispatcher()
+{
+    Stop();
+    Join();
+}
+
+QStatus _LocalEndpoint::Dispatcher::Start()
+{
+    QStatus status = ER_OK;
+    lock.Lock(MUTEX_CONTEXT);
+    bool mustJoin = !running && !workers.empty();
+    lock.Unlock(MUTEX_CONTEXT);
+    /* Workers left over from a Stop() that was not followed by a Join() must exit first */
+    if (mustJoin) {
+        Join();
+    }
+    lock.Lock(MUTEX_CONTEXT);
+    if (!running) {
+        running = true;
+        for (uint32_t i = 0; i < concurrency; ++i) {
+            Worker* worker = new Worker(this);
+            workers.push_back(worker);
+            status = worker->Start(NULL, worker);
+            if (status != ER_OK) {
+                QCC_LogError(status, ("Failed to start dispatcher thread"));
+                break;
+            }
         }
     }
+    lock.Unlock(MUTEX_CONTEXT);
     return status;
 }
 
-void _LocalEndpoint::EnableReentrancy()
+QStatus _LocalEndpoint::Dispatcher::Stop()
 {
-    if (dispatcher) {
-        dispatcher->EnableReentrancy();
+    lock.Lock(MUTEX_CONTEXT);
+    running = false;
+    /* Messages that have not been dispatched are discarded */
+    queue.clear();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->Stop();
     }
+    /* Unblock any senders */
+    spaceAvailable.SetEvent();
+    lock.Unlock(MUTEX_CONTEXT);
+    return ER_OK;
 }
 
-bool _LocalEndpoint::IsReentrantCall()
+QStatus _LocalEndpoint::Dispatcher::Join()
 {
-    if (!dispatcher) {
-        return false;
+    lock.Lock(MUTEX_CONTEXT);
+    std::vector<Worker*> joining;
+    joining.swap(workers);
+    lock.Unlock(MUTEX_CONTEXT);
+    Thread* thisThread = Thread::GetThread();
+    for (size_t i = 0; i < joining.size(); ++i) {
+        if (joining[i] == thisThread) {
+            /* A worker cannot join itself so it is detached and deletes itself when it exits */
+            joining[i]->reapOnExit = true;
+            continue;
+        }
+        joining[i]->Join();
+        delete joining[i];
     }
-    return dispatcher->ThreadHoldsLock();
+    return ER_OK;
+}
+
+QStatus _LocalEndpoint::Dispatcher::Enqueue(const WorkItem& item)
+{
+    QStatus status = ER_OK;
+    lock.Lock(MUTEX_CONTEXT);
+    /*
+     * Block the sender while the queue is full. Workers are never blocked because they are the
+     * ones that drain the queue.
+     */
+    if (running && (queue.size() >= LOCAL_ENDPOINT_MAX_PENDING)) {
+        Thread* thisThread = Thread::GetThread();
+        bool isWorker = false;
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (workers[i] == thisThread) {
+                isWorker = true;
+                break;
+            }
+        }
+        if (!isWorker) {
+            ++blockedSenders;
+            while (running && (queue.size() >= LOCAL_ENDPOINT_MAX_PENDING)) {
+                spaceAvailable.ResetEvent();
+                status = Event::Wait(spaceAvailable, lock);
+                if ((status != ER_OK) && (status != ER_ALERTED_THREAD)) {
+                    break;
+                }
+                status = ER_OK;
+            }
+            --blockedSenders;
+        }
+    }
+    if (!running) {
+        status = ER_BUS_STOPPING;
+    }
+    if (status == ER_OK) {
+        queue.push_back(item);
+        if (!callbackThread && idleWorkers) {
+            workAvailable.SetEvent();
+        }
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+    return status;
+}
+
+QStatus _LocalEndpoint::Dispatcher::DispatchMessage(Message& msg)
+{
+    return Enqueue(WorkItem(msg));
+}
 
+QStatus _LocalEndpoint::Dispatcher::DispatchDeferredCallbacks()
+{
+    return Enqueue(WorkItem(Message(*endpoint->bus), true));
 }
 
-void _LocalEndpoint::Dispatcher::AlarmTriggered(const Alarm& alarm, QStatus reason)
+void _LocalEndpoint::Dispatcher::WorkerRun(Worker* worker)
 {
-    Message* msg = static_cast<Message*>(alarm->GetContext());
-    if (msg) {
-        if (reason == ER_OK) {
-            QStatus status = endpoint->DoPushMessage(*msg);
+    lock.Lock(MUTEX_CONTEXT);
+    while (running && !worker->IsStopping()) {
+        /*
+         * Messages are taken off the queue in order and a message can only be dispatched once
+         * the callback for the previous message has returned or enabled reentrancy.
+         */
+        if (callbackThread || queue.empty()) {
+            ++idleWorkers;
+            workAvailable.ResetEvent();
+            Event::Wait(workAvailable, lock);
+            --idleWorkers;
+            continue;
+        }
+        WorkItem item = queue.front();
+        queue.pop_front();
+        if (blockedSenders) {
+            spaceAvailable.SetEvent();
+        }
+        callbackThread = worker;
+        lock.Unlock(MUTEX_CONTEXT);
+
+        if (item.deferredCallbacks) {
+            endpoint->deferredCallbacks->Run();
+        } else {
+            QStatus status = endpoint->DoPushMessage(item.msg);
             // ER_BUS_STOPPING is a common shutdown error
             if (status != ER_OK && status != ER_BUS_STOPPING) {
                 QCC_LogError(status, ("LocalEndpoint::DoPushMessage failed"));
             }
         }
-        delete msg;
+
+        lock.Lock(MUTEX_CONTEXT);
+        if (callbackThread == worker) {
+            callbackThread = NULL;
+            if (!queue.empty() && idleWorkers) {
+                workAvailable.SetEvent();
+            }
+        }
     }
+    lock.Unlock(MUTEX_CONTEXT);
+}
+
+void _LocalEndpoint::Dispatcher::EnableReentrancy()
+{
+    lock.Lock(MUTEX_CONTEXT);
+    if (callbackThread && (callbackThread == Thread::GetThread())) {
+        /* Let another worker dispatch the next message while this callback is still running */
+        callbackThread = NULL;
+        if (!queue.empty() && idleWorkers) {
+            workAvailable.SetEvent();
+        }
+    }
+    lock.Unlock(MUTEX_CONTEXT);
+}
+
+bool _LocalEndpoint::Dispatcher::ThreadHoldsLock()
+{
+    lock.Lock(MUTEX_CONTEXT);
+    bool held = callbackThread && (callbackThread == Thread::GetThread());
+    lock.Unlock(MUTEX_CONTEXT);
+    return held;
+}
+
+void _LocalEndpoint::EnableReentrancy()
+{
+    if (dispatcher) {
+        dispatcher->EnableReentrancy();
+    }
+}
+
+bool _LocalEndpoint::IsReentrantCall()
+{
+    if (!dispatcher) {
+        return false;
+    }
+    return dispatcher->ThreadHoldsLock();
+
 }
 
 QStatus _LocalEndpoint::PushMessage(Message& message)
@@ -1048,34 +1284,32 @@ QStatus _LocalEndpoint::HandleMethodReply(Message& message)
     return status;
 }
 
-void _LocalEndpoint::DeferredCallbacks::AlarmTriggered(const qcc::Alarm& alarm, QStatus reason)
+void _LocalEndpoint::DeferredCallbacks::Run()
 {
-    if (reason == ER_OK) {
-        /*
-         * Allow synchronous method calls from within the object registration callbacks
-         */
-        endpoint->bus->EnableConcurrentCallbacks();
-        /*
-         * Call ObjectRegistered for any unregistered bus objects
-         */
-        endpoint->objectsLock.Lock(MUTEX_CONTEXT);
-        unordered_map<const char*, BusObject*, Hash, PathEq>::iterator iter = endpoint->localObjects.begin();
-        while (endpoint->running && (iter != endpoint->localObjects.end())) {
-            if (!iter->second->isRegistered) {
-                BusObject* bo = iter->second;
-                bo->isRegistered = true;
-                bo->InUseIncrement();
-                endpoint->objectsLock.Unlock(MUTEX_CONTEXT);
-                bo->ObjectRegistered();
-                endpoint->objectsLock.Lock(MUTEX_CONTEXT);
-                bo->InUseDecrement();
-                iter = endpoint->localObjects.begin();
-            } else {
-                ++iter;
-            }
+    /*
+     * Allow synchronous method calls from within the object registration callbacks
+     */
+    endpoint->bus->EnableConcurrentCallbacks();
+    /*
+     * Call ObjectRegistered for any unregistered bus objects
+     */
+    endpoint->objectsLock.Lock(MUTEX_CONTEXT);
+    unordered_map<const char*, BusObject*, Hash, PathEq>::iterator iter = endpoint->localObjects.begin();
+    while (endpoint->running && (iter != endpoint->localObjects.end())) {
+        if (!iter->second->isRegistered) {
+            BusObject* bo = iter->second;
+            bo->isRegistered = true;
+            bo->InUseIncrement();
+            endpoint->objectsLock.Unlock(MUTEX_CONTEXT);
+            bo->ObjectRegistered();
+            endpoint->objectsLock.Lock(MUTEX_CONTEXT);
+            bo->InUseDecrement();
+            iter = endpoint->localObjects.begin();
+        } else {
+            ++iter;
         }
-        endpoint->objectsLock.Unlock(MUTEX_CONTEXT);
     }
+    endpoint->objectsLock.Unlock(MUTEX_CONTEXT);
 }
 
 void _LocalEndpoint::OnBusConnected()
@@ -1083,9 +1317,8 @@ void _LocalEndpoint::OnBusConnected()
     /*
      * Use the local endpoint's dispatcher to call back to report the object registrations.
      */
-    uint32_t zero = 0;
     if (dispatcher) {
-        dispatcher->AddAlarm(Alarm(zero, deferredCallbacks));
+        dispatcher->DispatchDeferredCallbacks();
     }
 }
 
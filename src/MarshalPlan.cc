@@ -0,0 +1,312 @@
+/**
+ * @file
+ * Cached marshaling plans for frequently used message signatures.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#include <qcc/platform.h>
+
+#include <qcc/Debug.h>
+#include <qcc/Mutex.h>
+#include <qcc/String.h>
+
+#include <alljoyn/MsgArg.h>
+
+#include "GrowOnlyTable.h"
+#include "MarshalPlan.h"
+
+#define QCC_MODULE "ALLJOYN"
+
+using namespace qcc;
+
+namespace ajn {
+
+/*
+ * Initial size of the plan table, must be a power of two.
+ */
+static const size_t INITIAL_TABLE_SIZE = 64;
+
+struct PlanTraits {
+    static size_t Hash(const MarshalPlan& plan) { return plan.hash; }
+    static bool Matches(const MarshalPlan& plan, const qcc::String& signature) { return plan.GetSignature() == signature; }
+};
+
+/*
+ * The plan cache. Plans are never removed so lookups, which are done for every message that is
+ * marshaled, do not take a lock. Only adding a plan is serialized. Messages may be marshaled
+ * before the cache is constructed or after it has been destroyed, in which case no plan is used.
+ */
+static bool cacheAlive = false;
+
+class PlanCache {
+  public:
+    PlanCache() : plans(INITIAL_TABLE_SIZE) { cacheAlive = true; }
+
+    ~PlanCache() { cacheAlive = false; }
+
+    Mutex lock;                                    /* Serializes adding plans */
+    GrowOnlyTable<MarshalPlan, PlanTraits> plans;  /* The plans, owns the plans */
+};
+
+static PlanCache planCache;
+
+static inline size_t PadUp(size_t sz, size_t alignment)
+{
+    return (sz + alignment - 1) & ~(alignment - 1);
+}
+
+static inline size_t Hash(const qcc::String& signature)
+{
+    size_t hash = 0;
+    for (const char* sig = signature.c_str(); *sig; ++sig) {
+        hash = (hash * 31) + static_cast<uint8_t>(*sig);
+    }
+    return hash;
+}
+
+const MarshalPlan* MarshalPlan::Get(const qcc::String& signature)
+{
+    if (!cacheAlive || signature.empty()) {
+        return NULL;
+    }
+    size_t hash = Hash(signature);
+    const MarshalPlan* plan = planCache.plans.Find(signature, hash);
+    /*
+     * Signatures that cannot be planned are not cached. Rejecting them is a scan of the signature
+     * that usually stops at the first container type.
+     */
+    if (!plan && CanPlan(signature)) {
+        planCache.lock.Lock(MUTEX_CONTEXT);
+        /* Check again in case the plan was added while we were waiting for the lock */
+        plan = planCache.plans.Find(signature, hash);
+        if (!plan) {
+            MarshalPlan* compiled = Compile(signature);
+            if (compiled) {
+                compiled->hash = hash;
+                planCache.plans.Add(compiled);
+                plan = compiled;
+            }
+        }
+        planCache.lock.Unlock(MUTEX_CONTEXT);
+    }
+    return plan;
+}
+
+bool MarshalPlan::CanPlan(const qcc::String& signature)
+{
+    size_t numTypes = 0;
+    for (const char* sig = signature.c_str(); *sig; ++sig, ++numTypes) {
+        switch ((AllJoynTypeId)(*sig)) {
+        case ALLJOYN_BYTE:
+        case ALLJOYN_INT16:
+        case ALLJOYN_UINT16:
+        case ALLJOYN_BOOLEAN:
+        case ALLJOYN_INT32:
+        case ALLJOYN_UINT32:
+        case ALLJOYN_DOUBLE:
+        case ALLJOYN_UINT64:
+        case ALLJOYN_INT64:
+        case ALLJOYN_STRING:
+        case ALLJOYN_OBJECT_PATH:
+        case ALLJOYN_SIGNATURE:
+            break;
+
+        case ALLJOYN_ARRAY:
+            switch (sig[1]) {
+            case ALLJOYN_BYTE:
+            case ALLJOYN_INT16:
+            case ALLJOYN_UINT16:
+            case ALLJOYN_BOOLEAN:
+            case ALLJOYN_INT32:
+            case ALLJOYN_UINT32:
+            case ALLJOYN_DOUBLE:
+            case ALLJOYN_UINT64:
+            case ALLJOYN_INT64:
+                ++sig;
+                break;
+
+            default:
+                return false;
+            }
+            break;
+
+        default:
+            return false;
+        }
+    }
+    return numTypes <= 255;
+}
+
+MarshalPlan* MarshalPlan::Compile(const qcc::String& signature)
+{
+    MarshalPlan* plan = new MarshalPlan(signature);
+    size_t sz = 0;
+    const char* sig = signature.c_str();
+    while (*sig) {
+        AllJoynTypeId typeId = (AllJoynTypeId)(*sig++);
+        switch (typeId) {
+        case ALLJOYN_BYTE:
+            sz += 1;
+            break;
+
+        case ALLJOYN_INT16:
+        case ALLJOYN_UINT16:
+            sz = PadUp(sz, 2) + 2;
+            break;
+
+        case ALLJOYN_BOOLEAN:
+        case ALLJOYN_INT32:
+        case ALLJOYN_UINT32:
+            sz = PadUp(sz, 4) + 4;
+            break;
+
+        case ALLJOYN_DOUBLE:
+        case ALLJOYN_UINT64:
+        case ALLJOYN_INT64:
+            sz = PadUp(sz, 8) + 8;
+            break;
+
+        case ALLJOYN_STRING:
+        case ALLJOYN_OBJECT_PATH:
+        case ALLJOYN_SIGNATURE:
+            plan->isFixed = false;
+            break;
+
+        case ALLJOYN_ARRAY:
+            switch (*sig) {
+            case ALLJOYN_BYTE:
+            case ALLJOYN_INT16:
+            case ALLJOYN_UINT16:
+            case ALLJOYN_BOOLEAN:
+            case ALLJOYN_INT32:
+            case ALLJOYN_UINT32:
+            case ALLJOYN_DOUBLE:
+            case ALLJOYN_UINT64:
+            case ALLJOYN_INT64:
+                typeId = (AllJoynTypeId)((*sig++ << 8) | ALLJOYN_ARRAY);
+                plan->isFixed = false;
+                break;
+
+            default:
+                /* Arrays of containers or strings are not planned */
+                delete plan;
+                return NULL;
+            }
+            break;
+
+        default:
+            /*
+             * Structs, dictionaries and variants are not planned, neither are handles because
+             * marshaling a handle has side effects on the message.
+             */
+            delete plan;
+            return NULL;
+        }
+        plan->types.push_back(typeId);
+    }
+    if (plan->types.size() > 255) {
+        delete plan;
+        return NULL;
+    }
+    plan->fixedSize = sz;
+    QCC_DbgPrintf(("MarshalPlan compiled for \"%s\" %s", signature.c_str(), plan->isFixed ? "(fixed size)" : ""));
+    return plan;
+}
+
+bool MarshalPlan::Matches(const MsgArg* args, size_t numArgs) const
+{
+    if (!args || (numArgs != types.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < numArgs; ++i) {
+        if (args[i].typeId != types[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t MarshalPlan::GetSize(const MsgArg* args) const
+{
+    if (isFixed) {
+        return fixedSize;
+    }
+    size_t sz = 0;
+    for (size_t i = 0; i < types.size(); ++i) {
+        const MsgArg& arg = args[i];
+        switch (types[i]) {
+        case ALLJOYN_BYTE:
+            sz += 1;
+            break;
+
+        case ALLJOYN_INT16:
+        case ALLJOYN_UINT16:
+            sz = PadUp(sz, 2) + 2;
+            break;
+
+        case ALLJOYN_BOOLEAN:
+        case ALLJOYN_INT32:
+        case ALLJOYN_UINT32:
+            sz = PadUp(sz, 4) + 4;
+            break;
+
+        case ALLJOYN_DOUBLE:
+        case ALLJOYN_UINT64:
+        case ALLJOYN_INT64:
+            sz = PadUp(sz, 8) + 8;
+            break;
+
+        case ALLJOYN_STRING:
+        case ALLJOYN_OBJECT_PATH:
+            sz = PadUp(sz, 4) + 4 + arg.v_string.len + 1;
+            break;
+
+        case ALLJOYN_SIGNATURE:
+            sz += 1 + arg.v_signature.len + 1;
+            break;
+
+        case ALLJOYN_BYTE_ARRAY:
+            sz = PadUp(sz, 4) + 4 + arg.v_scalarArray.numElements;
+            break;
+
+        case ALLJOYN_INT16_ARRAY:
+        case ALLJOYN_UINT16_ARRAY:
+            sz = PadUp(sz, 4) + 4 + 2 * arg.v_scalarArray.numElements;
+            break;
+
+        case ALLJOYN_BOOLEAN_ARRAY:
+        case ALLJOYN_INT32_ARRAY:
+        case ALLJOYN_UINT32_ARRAY:
+            sz = PadUp(sz, 4) + 4 + 4 * arg.v_scalarArray.numElements;
+            break;
+
+        case ALLJOYN_DOUBLE_ARRAY:
+        case ALLJOYN_UINT64_ARRAY:
+        case ALLJOYN_INT64_ARRAY:
+            sz = PadUp(sz, 4) + 4;
+            sz = PadUp(sz, 8) + 8 * arg.v_scalarArray.numElements;
+            break;
+
+        default:
+            break;
+        }
+    }
+    return sz;
+}
+
+}
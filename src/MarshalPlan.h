@@ -0,0 +1,118 @@
+#ifndef _ALLJOYN_MARSHALPLAN_H
+#define _ALLJOYN_MARSHALPLAN_H
+/**
+ * @file
+ * This file defines cached marshaling plans for frequently used message signatures.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#ifndef __cplusplus
+#error Only include MarshalPlan.h in C++ code.
+#endif
+
+#include <qcc/platform.h>
+#include <qcc/String.h>
+
+#include <vector>
+
+#include <alljoyn/MsgArg.h>
+
+namespace ajn {
+
+/**
+ * A marshaling plan describes the layout of a message body for a signature made up of a flat
+ * list of basic types and arrays of fixed size scalars. These signatures cover most method calls
+ * and signals. With a plan the body size can be computed with a single loop over the args (or
+ * not at all if every type is fixed size) and the signature does not need to be rebuilt from
+ * the args to check it against the expected signature.
+ *
+ * Plans are compiled once per signature and cached for the life of the process. Looking up a
+ * cached plan does not take a lock. Signatures that cannot be described by a plan are not cached.
+ */
+class MarshalPlan {
+    friend struct PlanTraits;
+  public:
+
+    /**
+     * Get the plan for a signature, compiling it the first time the signature is seen.
+     *
+     * @param signature  The signature of the message body.
+     *
+     * @return  The plan or NULL if the signature cannot be described by a plan.
+     */
+    static const MarshalPlan* Get(const qcc::String& signature);
+
+    /**
+     * Check that a list of args has the types described by the plan. Args that describe the
+     * same signature using generic containers do not match and must be marshaled the slow way.
+     *
+     * @param args     The args to check.
+     * @param numArgs  The number of args.
+     *
+     * @return  true if the args match the plan.
+     */
+    bool Matches(const MsgArg* args, size_t numArgs) const;
+
+    /**
+     * Compute the marshaled size of a list of args that match the plan.
+     *
+     * @param args   The args.
+     *
+     * @return  The marshaled size of the args starting from an 8 byte boundary.
+     */
+    size_t GetSize(const MsgArg* args) const;
+
+    /**
+     * Get the signature for this plan.
+     *
+     * @return  The signature.
+     */
+    const qcc::String& GetSignature() const { return signature; }
+
+  private:
+
+    /**
+     * Check if a signature can be described by a plan without compiling it.
+     *
+     * @param signature  The signature.
+     *
+     * @return  true if the signature can be planned.
+     */
+    static bool CanPlan(const qcc::String& signature);
+
+    /**
+     * Compile a signature into a plan.
+     *
+     * @param signature  The signature.
+     *
+     * @return  The plan or NULL if the signature cannot be described by a plan.
+     */
+    static MarshalPlan* Compile(const qcc::String& signature);
+
+    MarshalPlan(const qcc::String& signature) : signature(signature), hash(0), fixedSize(0), isFixed(true) { }
+
+    qcc::String signature;               /**< The signature for this plan */
+    size_t hash;                         /**< Hash of the signature computed when the plan was cached */
+    std::vector<AllJoynTypeId> types;    /**< Type for each of the args */
+    size_t fixedSize;                    /**< Marshaled size of the args if isFixed is true */
+    bool isFixed;                        /**< True if all the args are fixed size */
+};
+
+}
+
+#endif
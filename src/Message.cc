@@ -39,6 +39,7 @@
 
 #include "BusInternal.h"
 #include "BusUtil.h"
+#include "MsgBufferPool.h"
 
 #define QCC_MODULE "ALLJOYN"
 
@@ -308,6 +309,7 @@ _Message::_Message(BusAttachment& bus) :
     msgArgs(NULL),
     numMsgArgs(0),
     ttl(0),
+    timestamp(0),
     handles(NULL),
     numHandles(0),
     encrypt(false),
@@ -322,7 +324,7 @@ _Message::_Message(BusAttachment& bus) :
 
 _Message::~_Message(void)
 {
-    delete [] _msgBuf;
+    MsgBufferPool::Free(_msgBuf);
     delete [] msgArgs;
     while (numHandles) {
         qcc::Close(handles[--numHandles]);
@@ -351,8 +353,8 @@ _Message::_Message(const _Message& other) :
 {
     if (bufSize > 0) {
         assert(other.msgBuf != NULL);
-        _msgBuf = new uint8_t[bufSize + 7];
-        msgBuf = (uint64_t*)((uintptr_t)(_msgBuf + 7) & ~7);
+        _msgBuf = MsgBufferPool::Allocate(bufSize);
+        msgBuf = (uint64_t*)_msgBuf;
         bufEOD = ((uint8_t*)msgBuf) + (other.bufEOD - ((uint8_t*)other.msgBuf));
         bufPos = ((uint8_t*)msgBuf) + (other.bufPos - ((uint8_t*)other.msgBuf));
         bodyPtr = ((uint8_t*)msgBuf) + (other.bodyPtr - ((uint8_t*)other.msgBuf));
@@ -390,6 +392,8 @@ _Message::_Message(const _Message& other) :
 
 QStatus _Message::ReMarshal(const char* senderName)
 {
+    uint32_t oldHeaderLen = msgHeader.headerLen;
+
     if (senderName) {
         hdrFields.field[ALLJOYN_HDR_FIELD_SENDER].Set("s", senderName);
     }
@@ -402,21 +406,31 @@ QStatus _Message::ReMarshal(const char* senderName)
     numMsgArgs = 0;
 
     /*
-     * We delete the current buffer after we have copied the body data
+     * Compute the new header sizes
      */
-    uint8_t* _savBuf = _msgBuf;
+    ComputeHeaderLen();
 
     /*
-     * Compute the new header sizes
+     * If the padded header is the same size as before the body does not move and only the header
+     * fields need to be rewritten. This is the common case when the daemon replaces a sender name
+     * with one of a similar length.
      */
-    ComputeHeaderLen();
+    if (msgBuf && (((msgHeader.headerLen + 7) & ~7) == ((oldHeaderLen + 7) & ~7))) {
+        RewriteHeaderFields();
+        return ER_OK;
+    }
+
+    /*
+     * We delete the current buffer after we have copied the body data
+     */
+    uint8_t* _savBuf = _msgBuf;
     /*
      * Padding the end of the buffer ensures we can unmarshal a few bytes beyond the end of the
      * message reducing the places where we need to check for bufEOD when unmarshaling the body.
      */
     bufSize = sizeof(msgHeader) + ((((msgHeader.headerLen + 7) & ~7) + msgHeader.bodyLen + 7) & ~7) + 8;
-    _msgBuf = new uint8_t[bufSize + 7];
-    msgBuf = (uint64_t*)((uintptr_t)(_msgBuf + 7) & ~7); /* Align to 8 byte boundary */
+    _msgBuf = MsgBufferPool::Allocate(bufSize);
+    msgBuf = (uint64_t*)_msgBuf; /* Pool buffers are aligned to an 8 byte boundary */
     bufPos = (uint8_t*)msgBuf;
     memcpy(bufPos, &msgHeader, sizeof(msgHeader));
     bufPos += sizeof(msgHeader);
@@ -448,10 +462,56 @@ QStatus _Message::ReMarshal(const char* senderName)
      */
     assert((size_t)(bufEOD - (uint8_t*)msgBuf) < bufSize);
     memset(bufEOD, 0, (uint8_t*)msgBuf + bufSize - bufEOD);
-    delete [] _savBuf;
+    MsgBufferPool::Free(_savBuf);
     return ER_OK;
 }
 
+void _Message::RewriteHeaderFields()
+{
+    size_t fieldsLen = (msgHeader.headerLen + 7) & ~7;
+    uint8_t* fieldsPos = (uint8_t*)msgBuf + sizeof(msgHeader);
+    /*
+     * The fields are marshaled into a scratch buffer first because the strings being marshaled
+     * point into the header we are about to overwrite. The scratch buffer is 8 byte aligned just
+     * like the header fields in the message buffer so the padding comes out the same.
+     */
+    uint8_t* scratch = MsgBufferPool::Allocate(fieldsLen);
+    bufPos = scratch;
+    MarshalHeaderFields();
+    assert(bufPos == (scratch + fieldsLen));
+    memcpy(fieldsPos, scratch, fieldsLen);
+    /*
+     * Point the string fields at their marshaled values in the message buffer
+     */
+    for (size_t i = 0; i < ArraySize(hdrFields.field); ++i) {
+        MsgArg& field = hdrFields.field[i];
+        const char** str = NULL;
+        switch (field.typeId) {
+        case ALLJOYN_STRING:
+        case ALLJOYN_OBJECT_PATH:
+            str = &field.v_string.str;
+            break;
+
+        case ALLJOYN_SIGNATURE:
+            str = &field.v_signature.sig;
+            break;
+
+        default:
+            break;
+        }
+        if (str && (*str >= (const char*)scratch) && (*str < (const char*)(scratch + fieldsLen))) {
+            *str = (const char*)fieldsPos + (*str - (const char*)scratch);
+        }
+    }
+    MsgBufferPool::Free(scratch);
+    /*
+     * Update the header length in the message buffer which is in the byte order of the message
+     */
+    MessageHeader* hdr = (MessageHeader*)msgBuf;
+    hdr->headerLen = endianSwap ? EndianSwap32(msgHeader.headerLen) : msgHeader.headerLen;
+    bufPos = bufEOD;
+}
+
 bool _Message::IsExpired(uint32_t* tillExpireMS) const
 {
     uint32_t expires;
@@ -42,7 +42,9 @@
 #include "AllJoynCrypto.h"
 #include "AllJoynPeerObj.h"
 #include "SignatureUtils.h"
+#include "MarshalPlan.h"
 #include "BusInternal.h"
+#include "MsgBufferPool.h"
 
 #define QCC_MODULE "ALLJOYN"
 
@@ -737,6 +739,8 @@ QStatus _Message::EncryptMessage()
     KeyBlob key;
     PeerState peerState = bus->GetInternal().GetPeerStateTable()->GetPeerState(GetDestination());
     QStatus status = peerState->GetKey(key, PEER_SESSION_KEY);
+    /* Copying the peer's cipher only adds a reference, unlike default constructing one */
+    CCMCipher cipher = peerState->GetCipher(PEER_SESSION_KEY);
 
     if (status == ER_OK) {
         /*
@@ -750,7 +754,7 @@ QStatus _Message::EncryptMessage()
     if (status == ER_OK) {
         size_t argsLen = msgHeader.bodyLen - ajn::Crypto::MACLength;
         size_t hdrLen = ROUNDUP8(sizeof(msgHeader) + msgHeader.headerLen);
-        status = ajn::Crypto::Encrypt(*this, key, (uint8_t*)msgBuf, hdrLen, argsLen);
+        status = ajn::Crypto::Encrypt(*this, key, (uint8_t*)msgBuf, hdrLen, argsLen, &cipher);
         if (status == ER_OK) {
             QCC_DbgHLPrintf(("EncryptMessage: %s", Description().c_str()));
             /*
@@ -787,7 +791,15 @@ QStatus _Message::MarshalMessage(const qcc::String& expectedSignature,
 {
     char signature[256];
     QStatus status = ER_OK;
-    size_t argsLen = (numArgs == 0) ? 0 : SignatureUtils::GetSize(args, numArgs);
+    /*
+     * If the args match a cached plan for the expected signature we don't need to walk the args
+     * to compute their size or to build the signature.
+     */
+    const MarshalPlan* plan = (numArgs == 0) ? NULL : MarshalPlan::Get(expectedSignature);
+    if (plan && !plan->Matches(args, numArgs)) {
+        plan = NULL;
+    }
+    size_t argsLen = (numArgs == 0) ? 0 : (plan ? plan->GetSize(args) : SignatureUtils::GetSize(args, numArgs));
     size_t hdrLen = 0;
 
     if (!bus->IsStarted()) {
@@ -858,7 +870,12 @@ QStatus _Message::MarshalMessage(const qcc::String& expectedSignature,
      * If there are arguments build the signature
      */
     hdrFields.field[ALLJOYN_HDR_FIELD_SIGNATURE].Clear();
-    if (numArgs > 0) {
+    if (plan) {
+        /* The args match the plan so they have the expected signature */
+        hdrFields.field[ALLJOYN_HDR_FIELD_SIGNATURE].typeId = ALLJOYN_SIGNATURE;
+        hdrFields.field[ALLJOYN_HDR_FIELD_SIGNATURE].v_signature.sig = plan->GetSignature().c_str();
+        hdrFields.field[ALLJOYN_HDR_FIELD_SIGNATURE].v_signature.len = (uint8_t)plan->GetSignature().size();
+    } else if (numArgs > 0) {
         size_t sigLen = 0;
         status = SignatureUtils::MakeSignature(args, numArgs, signature, sigLen);
         if (status != ER_OK) {
@@ -875,7 +892,7 @@ QStatus _Message::MarshalMessage(const qcc::String& expectedSignature,
     /*
      * Check the signature computed from the args matches the expected signature.
      */
-    if (expectedSignature != signature) {
+    if (!plan && (expectedSignature != signature)) {
         status = ER_BUS_UNEXPECTED_SIGNATURE;
         QCC_LogError(status, ("MarshalMessage expected signature \"%s\" got \"%s\"", expectedSignature.c_str(), signature));
         goto ExitMarshalMessage;
@@ -911,8 +928,8 @@ QStatus _Message::MarshalMessage(const qcc::String& expectedSignature,
      * Allocate buffer for entire message.
      */
     bufSize = (hdrLen + msgHeader.bodyLen + 7);
-    _msgBuf = new uint8_t[bufSize + 7];
-    msgBuf = (uint64_t*)((uintptr_t)(_msgBuf + 7) & ~7); /* Align to 8 byte boundary */
+    _msgBuf = MsgBufferPool::Allocate(bufSize);
+    msgBuf = (uint64_t*)_msgBuf; /* Pool buffers are aligned to an 8 byte boundary */
     /*
      * Initialize the buffer and copy in the message header
      */
@@ -982,14 +999,14 @@ ExitMarshalMessage:
     /*
      * Don't need the old message buffer any more
      */
-    delete [] _oldMsgBuf;
+    MsgBufferPool::Free(_oldMsgBuf);
 
     if (status == ER_OK) {
         QCC_DbgHLPrintf(("MarshalMessage: %d+%d %s %s", hdrLen, msgHeader.bodyLen, Description().c_str(), encrypt ? " (encrypted)" : ""));
     } else {
         QCC_LogError(status, ("MarshalMessage: %s", Description().c_str()));
         msgBuf = NULL;
-        delete [] _msgBuf;
+        MsgBufferPool::Free(_msgBuf);
         _msgBuf = NULL;
         bodyPtr = NULL;
         bufPos = NULL;
@@ -42,6 +42,8 @@
 #include "AllJoynPeerObj.h"
 #include "SignatureUtils.h"
 #include "BusInternal.h"
+#include "ByteSwap.h"
+#include "MsgBufferPool.h"
 
 #define QCC_MODULE "ALLJOYN"
 
@@ -103,6 +105,9 @@ QStatus _Message::ParseArray(MsgArg* arg,
     /*
      * Note: at this point alignment is on a 4 bytes boundary so we only need to align values that
      * need 8 byte alignment.
+     *
+     * Scalar arrays in native endianess point directly into the message buffer, arrays that need
+     * to be endian swapped are copied.
      */
     switch (char elemTypeId = *sigStart) {
     case ALLJOYN_BYTE:
@@ -118,12 +123,9 @@ QStatus _Message::ParseArray(MsgArg* arg,
             arg->typeId = (AllJoynTypeId)((elemTypeId << 8) | ALLJOYN_ARRAY);
             arg->v_scalarArray.numElements = (size_t)(len / 2);
             if (endianSwap) {
-                arg->v_scalarArray.v_uint16 = new uint16_t[arg->v_scalarArray.numElements];
-                uint16_t* p = (uint16_t*)arg->v_scalarArray.v_uint16;
-                uint16_t* n = (uint16_t*)bufPos;
-                for (size_t i = 0; i < arg->v_scalarArray.numElements; i++) {
-                    *p++ = EndianSwap16(*n++);
-                }
+                uint16_t* p = new uint16_t[arg->v_scalarArray.numElements];
+                ByteSwap::Swap16(p, (uint16_t*)bufPos, arg->v_scalarArray.numElements);
+                arg->v_scalarArray.v_uint16 = p;
                 arg->flags = MsgArg::OwnsData;
             } else {
                 arg->v_scalarArray.v_uint16 = (uint16_t*)bufPos;
@@ -175,12 +177,9 @@ QStatus _Message::ParseArray(MsgArg* arg,
             arg->typeId = (AllJoynTypeId)((elemTypeId << 8) | ALLJOYN_ARRAY);
             arg->v_scalarArray.numElements = (size_t)(len / 4);
             if (endianSwap) {
-                arg->v_scalarArray.v_uint32 = new uint32_t[arg->v_scalarArray.numElements];
-                uint32_t* p = (uint32_t*)arg->v_scalarArray.v_uint32;
-                uint32_t* n = (uint32_t*)bufPos;
-                for (size_t i = 0; i < arg->v_scalarArray.numElements; i++) {
-                    *p++ = EndianSwap32(*n++);
-                }
+                uint32_t* p = new uint32_t[arg->v_scalarArray.numElements];
+                ByteSwap::Swap32(p, (uint32_t*)bufPos, arg->v_scalarArray.numElements);
+                arg->v_scalarArray.v_uint32 = p;
                 arg->flags = MsgArg::OwnsData;
             } else {
                 arg->v_scalarArray.v_uint32 = (uint32_t*)bufPos;
@@ -198,14 +197,10 @@ QStatus _Message::ParseArray(MsgArg* arg,
             arg->typeId = (AllJoynTypeId)((elemTypeId << 8) | ALLJOYN_ARRAY);
             arg->v_scalarArray.numElements = (size_t)(len / 8);
             bufPos = AlignPtr(bufPos, 8);
-            arg->v_scalarArray.v_uint64 = (uint64_t*)bufPos;
             if (endianSwap) {
-                arg->v_scalarArray.v_uint64 = new uint64_t[arg->v_scalarArray.numElements];
-                uint64_t* p = (uint64_t*)arg->v_scalarArray.v_uint64;
-                uint64_t* n = (uint64_t*)bufPos;
-                for (size_t i = 0; i < arg->v_scalarArray.numElements; i++) {
-                    *p++ = EndianSwap64(*n++);
-                }
+                uint64_t* p = new uint64_t[arg->v_scalarArray.numElements];
+                ByteSwap::Swap64(p, (uint64_t*)bufPos, arg->v_scalarArray.numElements);
+                arg->v_scalarArray.v_uint64 = p;
                 arg->flags = MsgArg::OwnsData;
             } else {
                 arg->v_scalarArray.v_uint64 = (uint64_t*)bufPos;
@@ -590,7 +585,10 @@ QStatus _Message::UnmarshalArgs(const qcc::String& expectedSignature, const char
         size_t hdrLen = bodyPtr - (uint8_t*)msgBuf;
         PeerState peerState = bus->GetInternal().GetPeerStateTable()->GetPeerState(GetSender());
         KeyBlob key;
-        status = peerState->GetKey(key, broadcast ? PEER_GROUP_KEY : PEER_SESSION_KEY);
+        PeerKeyType keyType = broadcast ? PEER_GROUP_KEY : PEER_SESSION_KEY;
+        status = peerState->GetKey(key, keyType);
+        /* Copying the peer's cipher only adds a reference, unlike default constructing one */
+        CCMCipher cipher = peerState->GetCipher(keyType);
         if (status != ER_OK) {
             QCC_LogError(status, ("Unable to decrypt message"));
             /*
@@ -612,7 +610,7 @@ QStatus _Message::UnmarshalArgs(const qcc::String& expectedSignature, const char
          * algorithm adds appends a MAC block to the end of the encrypted data.
          */
         size_t bodyLen = msgHeader.bodyLen;
-        status = ajn::Crypto::Decrypt(*this, key, (uint8_t*)msgBuf, hdrLen, bodyLen);
+        status = ajn::Crypto::Decrypt(*this, key, (uint8_t*)msgBuf, hdrLen, bodyLen, &cipher);
         if (status != ER_OK) {
             goto ExitUnmarshalArgs;
         }
@@ -890,8 +888,8 @@ QStatus _Message::InterpretHeader()
      * message reducing the places where we need to check for bufEOD when unmarshaling the body.
      */
     bufSize = sizeof(msgHeader) + ((pktSize + 7) & ~7) + sizeof(uint64_t);
-    _msgBuf = new uint8_t[bufSize + 7];
-    msgBuf = (uint64_t*)((uintptr_t)(_msgBuf + 7) & ~7); /* Align to 8 byte boundary */
+    _msgBuf = MsgBufferPool::Allocate(bufSize);
+    msgBuf = (uint64_t*)_msgBuf; /* Pool buffers are aligned to an 8 byte boundary */
     /*
      * Copy header into the buffer
      */
@@ -917,7 +915,7 @@ QStatus _Message::InterpretHeader()
 
 }
 
-QStatus _Message::PullBytes(RemoteEndpoint& endpoint, bool checkSender, bool pedantic, uint32_t timeout)
+QStatus _Message::PullBytes(RemoteEndpoint& endpoint, bool checkSender, bool pedantic, uint32_t timeout, bool buffered)
 {
     QStatus status;
     qcc::SocketFd fdList[qcc::SOCKET_MAX_FILE_DESCRIPTORS];
@@ -951,6 +949,8 @@ QStatus _Message::PullBytes(RemoteEndpoint& endpoint, bool checkSender, bool ped
                 handles = new qcc::SocketFd[numHandles];
                 memcpy(handles, fdList, numHandles * sizeof(qcc::SocketFd));
             }
+        } else if (buffered && (maxFds == 0)) {
+            status = endpoint->PullBufferedBytes(bufPos, toRead, read);
         } else {
             status = source.PullBytes(bufPos, toRead, read, timeout);
         }
@@ -968,7 +968,11 @@ QStatus _Message::PullBytes(RemoteEndpoint& endpoint, bool checkSender, bool ped
     case MESSAGE_HEADER_BODY:
         /* Read the rest of the message header and body */
         toRead = (std::min)(countRead, MAX_PULL);
-        status = source.PullBytes(bufPos, toRead, read, timeout);
+        if (buffered && (maxFds == 0)) {
+            status = endpoint->PullBufferedBytes(bufPos, toRead, read);
+        } else {
+            status = source.PullBytes(bufPos, toRead, read, timeout);
+        }
         if (status == ER_ALERTED_THREAD) {
             QCC_LogError(status, ("PullBytes ALERTED continuing"));
             status = ER_OK;
@@ -996,8 +1000,12 @@ QStatus _Message::ReadNonBlocking(RemoteEndpoint& endpoint, bool checkSender, bo
 
 
     QStatus status = ER_OK;
+    /*
+     * Pull through the endpoint's receive buffer so a burst of messages can be read from the
+     * stream in one go.
+     */
     while ((status == ER_OK) && (readState != MESSAGE_COMPLETE)) {
-        status = PullBytes(endpoint, checkSender, pedantic, 0); /* timeout zero */
+        status = PullBytes(endpoint, checkSender, pedantic, 0, true); /* timeout zero */
     }
     if (status == ER_OK) {
         status = ((readState == MESSAGE_COMPLETE) ? ER_OK : ER_TIMEOUT);
@@ -1016,7 +1024,7 @@ QStatus _Message::Read(RemoteEndpoint& endpoint, bool checkSender, bool pedantic
      * Clear out any stale message state
      */
     msgBuf = NULL;
-    delete [] _msgBuf;
+    MsgBufferPool::Free(_msgBuf);
     _msgBuf = NULL;
     ClearHeader();
     readState = MESSAGE_NEW;
@@ -1270,7 +1278,7 @@ ExitUnmarshal:
          * There was an unrecoverable failure while unmarshaling the message, cleanup before we return.
          */
         msgBuf = NULL;
-        delete [] _msgBuf;
+        MsgBufferPool::Free(_msgBuf);
         _msgBuf = NULL;
         ClearHeader();
         if ((status != ER_SOCK_OTHER_END_CLOSED) && (status != ER_STOPPING_THREAD)) {
@@ -0,0 +1,205 @@
+/**
+ * @file
+ * Size-class pool for message buffers.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#include <qcc/platform.h>
+
+#include <assert.h>
+
+#include <qcc/Mutex.h>
+
+#include "MsgBufferPool.h"
+#include "ThreadShard.h"
+
+#define QCC_MODULE "ALLJOYN"
+
+using namespace qcc;
+
+namespace ajn {
+
+/*
+ * Size classes are powers of two from 64 bytes to 64K bytes. The size of a block includes an
+ * 8 byte header that records the size class so the block can be returned to the right free list.
+ */
+static const size_t MIN_CLASS_SHIFT = 6;
+static const size_t MAX_CLASS_SHIFT = 16;
+static const size_t NUM_CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+
+/*
+ * Size class value recorded in the header of blocks that are too large to be pooled
+ */
+static const uint64_t LARGE_BLOCK = NUM_CLASSES;
+
+/*
+ * The free lists for each size class in a shard are capped at this many bytes but are always
+ * allowed to hold at least a couple of blocks.
+ */
+static const size_t MAX_CACHED_BYTES = 32 * 1024;
+static const size_t MIN_CACHED_BLOCKS = 2;
+
+/*
+ * Number of shards the free lists are split over. Must be a power of two.
+ */
+static const size_t NUM_SHARDS = 8;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+class Shard {
+  public:
+
+    Shard() : allocs(0), poolHits(0), largeAllocs(0)
+    {
+        for (size_t i = 0; i < NUM_CLASSES; ++i) {
+            head[i] = NULL;
+            count[i] = 0;
+        }
+    }
+
+    ~Shard()
+    {
+        for (size_t i = 0; i < NUM_CLASSES; ++i) {
+            while (head[i]) {
+                FreeBlock* block = head[i];
+                head[i] = block->next;
+                delete [] reinterpret_cast<uint64_t*>(block);
+            }
+        }
+    }
+
+    Mutex lock;
+    FreeBlock* head[NUM_CLASSES];
+    size_t count[NUM_CLASSES];
+    uint64_t allocs;        /* Statistics for allocations made by threads using this shard */
+    uint64_t poolHits;
+    uint64_t largeAllocs;
+};
+
+/*
+ * Messages can be freed during static destruction after the shards have gone away and could in
+ * principle be allocated before the shards are constructed. The pool is bypassed when it is not
+ * alive, this is safe because every block carries its size class in the header.
+ */
+static bool poolAlive = false;
+
+class ShardTable {
+  public:
+    ShardTable() { poolAlive = true; }
+    ~ShardTable() { poolAlive = false; }
+    Shard shards[NUM_SHARDS];
+};
+
+static ShardTable shardTable;
+
+static inline Shard& ShardForThisThread()
+{
+    return shardTable.shards[ThreadShard(NUM_SHARDS)];
+}
+
+static inline size_t ClassSize(size_t cls)
+{
+    return static_cast<size_t>(1) << (cls + MIN_CLASS_SHIFT);
+}
+
+uint8_t* MsgBufferPool::Allocate(size_t size)
+{
+    size_t total = size + sizeof(uint64_t);
+    size_t cls = 0;
+    while ((cls < NUM_CLASSES) && (ClassSize(cls) < total)) {
+        ++cls;
+    }
+    uint64_t* block = NULL;
+    if (cls == NUM_CLASSES) {
+        if (poolAlive) {
+            Shard& shard = ShardForThisThread();
+            shard.lock.Lock(MUTEX_CONTEXT);
+            ++shard.allocs;
+            ++shard.largeAllocs;
+            shard.lock.Unlock(MUTEX_CONTEXT);
+        }
+        block = new uint64_t[(total + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+        block[0] = LARGE_BLOCK;
+        return reinterpret_cast<uint8_t*>(block + 1);
+    }
+    if (poolAlive) {
+        Shard& shard = ShardForThisThread();
+        shard.lock.Lock(MUTEX_CONTEXT);
+        ++shard.allocs;
+        FreeBlock* freeBlock = shard.head[cls];
+        if (freeBlock) {
+            shard.head[cls] = freeBlock->next;
+            --shard.count[cls];
+            ++shard.poolHits;
+        }
+        shard.lock.Unlock(MUTEX_CONTEXT);
+        block = reinterpret_cast<uint64_t*>(freeBlock);
+    }
+    if (!block) {
+        block = new uint64_t[ClassSize(cls) / sizeof(uint64_t)];
+    }
+    block[0] = cls;
+    return reinterpret_cast<uint8_t*>(block + 1);
+}
+
+void MsgBufferPool::Free(uint8_t* buf)
+{
+    if (!buf) {
+        return;
+    }
+    uint64_t* block = reinterpret_cast<uint64_t*>(buf) - 1;
+    size_t cls = static_cast<size_t>(block[0]);
+    assert(cls <= LARGE_BLOCK);
+    if ((cls < NUM_CLASSES) && poolAlive) {
+        size_t maxCached = MAX_CACHED_BYTES / ClassSize(cls);
+        if (maxCached < MIN_CACHED_BLOCKS) {
+            maxCached = MIN_CACHED_BLOCKS;
+        }
+        Shard& shard = ShardForThisThread();
+        shard.lock.Lock(MUTEX_CONTEXT);
+        if (shard.count[cls] < maxCached) {
+            FreeBlock* freeBlock = reinterpret_cast<FreeBlock*>(block);
+            freeBlock->next = shard.head[cls];
+            shard.head[cls] = freeBlock;
+            ++shard.count[cls];
+            block = NULL;
+        }
+        shard.lock.Unlock(MUTEX_CONTEXT);
+    }
+    delete [] block;
+}
+
+void MsgBufferPool::GetStats(Stats& stats)
+{
+    stats = Stats();
+    if (!poolAlive) {
+        return;
+    }
+    for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        Shard& shard = shardTable.shards[i];
+        shard.lock.Lock(MUTEX_CONTEXT);
+        stats.allocs += shard.allocs;
+        stats.poolHits += shard.poolHits;
+        stats.largeAllocs += shard.largeAllocs;
+        shard.lock.Unlock(MUTEX_CONTEXT);
+    }
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef _ALLJOYN_MSGBUFFERPOOL_H
+#define _ALLJOYN_MSGBUFFERPOOL_H
+/**
+ * @file
+ * This file defines a size-class pool for allocating message buffers.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#ifndef __cplusplus
+#error Only include MsgBufferPool.h in C++ code.
+#endif
+
+#include <qcc/platform.h>
+
+namespace ajn {
+
+/**
+ * Pool for message buffers. Buffers are rounded up to a power-of-two size class and freed
+ * buffers are kept on per-class free lists so that routing a stream of small messages does not
+ * go to the heap for every message. The free lists are split over a number of shards, each with
+ * its own lock, so that threads allocating and freeing concurrently rarely contend.
+ */
+class MsgBufferPool {
+  public:
+
+    /**
+     * Allocation statistics for the whole pool.
+     */
+    struct Stats {
+        uint64_t allocs;      /**< Number of buffers allocated */
+        uint64_t poolHits;    /**< Number of allocations satisfied from the pool */
+        uint64_t largeAllocs; /**< Number of allocations too large to be pooled */
+
+        Stats() : allocs(0), poolHits(0), largeAllocs(0) { }
+    };
+
+    /**
+     * Allocate a message buffer.
+     *
+     * @param size   The number of bytes required.
+     *
+     * @return  A buffer aligned to an 8 byte boundary.
+     */
+    static uint8_t* Allocate(size_t size);
+
+    /**
+     * Free a message buffer allocated by Allocate().
+     *
+     * @param buf  The buffer to free. May be NULL.
+     */
+    static void Free(uint8_t* buf);
+
+    /**
+     * Get the allocation statistics. The counts are kept per shard under the shard locks and
+     * are summed here so they may be slightly out of date.
+     *
+     * @param[out] stats  Returns the statistics.
+     */
+    static void GetStats(Stats& stats);
+};
+
+}
+
+#endif
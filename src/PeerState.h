@@ -43,6 +43,8 @@
 
 #include <alljoyn/Status.h>
 
+#include "AllJoynCrypto.h"
+
 namespace ajn {
 
 /* Forward declaration */
@@ -142,6 +144,7 @@ class _PeerState {
      */
     void SetKey(const qcc::KeyBlob& key, PeerKeyType keyType) {
         keys[keyType] = key;
+        ciphers[keyType] = key.IsValid() ? CCMCipher(key) : CCMCipher();
         isSecure = key.IsValid();
     }
 
@@ -168,12 +171,24 @@ class _PeerState {
         }
     }
 
+    /**
+     * Gets the cipher for the session key of this peer. Get the cipher right after getting the
+     * key so they match. The cipher is empty if there is no session key.
+     *
+     * @param keyType    Indicate if this is the unicast or broadcast key.
+     *
+     * @return  A reference to the cipher for the session key.
+     */
+    CCMCipher GetCipher(PeerKeyType keyType) const { return ciphers[keyType]; }
+
     /**
      * Clear the keys for this peer.
      */
     void ClearKeys() {
         keys[PEER_SESSION_KEY].Erase();
         keys[PEER_GROUP_KEY].Erase();
+        ciphers[PEER_SESSION_KEY] = CCMCipher();
+        ciphers[PEER_GROUP_KEY] = CCMCipher();
         isSecure = false;
     }
 
@@ -315,6 +330,12 @@ class _PeerState {
      */
     qcc::KeyBlob keys[2];
 
+    /**
+     * Ciphers for the session keys. These are created when the keys are set so the AES key
+     * schedule is not recomputed for every message.
+     */
+    CCMCipher ciphers[2];
+
     /**
      * Serial number window. Used by IsValidSerial() to detect replay attacks. The size of the
      * window defines that largest tolerable gap between consecutive serial numbers.
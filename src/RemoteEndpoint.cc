@@ -20,6 +20,8 @@
 #include <qcc/platform.h>
 
 #include <assert.h>
+#include <algorithm>
+#include <new>
 
 #include <qcc/Debug.h>
 #include <qcc/String.h>
@@ -52,6 +54,220 @@ namespace ajn {
 
 #define ENDPOINT_IS_DEAD_ALERTCODE  1
 
+/*
+ * Limits for coalescing queued messages into a single write
+ */
+static const size_t MAX_TX_BATCH_MSGS = 32;
+static const size_t TX_BATCH_BYTES = 16 * 1024;
+
+/*
+ * Size of the buffer incoming messages are read into
+ */
+static const size_t RX_BUFFER_SIZE = 64 * 1024;
+
+const size_t _RemoteEndpoint::DEFAULT_MAX_TX_QUEUE_SIZE;
+
+/*
+ * Bounded multi-producer/single-consumer ring of messages waiting to be transmitted.
+ *
+ * Producers (any thread calling PushMessage) first reserve room with Reserve(). A successful
+ * reservation guarantees that the cell for the next ticket is free so producers never wait on
+ * each other or on the consumer. The single consumer is the IODispatch write callback for the
+ * endpoint which owns the head of the ring. Cells are handed over with the per-cell ready flag.
+ */
+class TxRing {
+  public:
+
+    TxRing(size_t maxSize) : cells(NULL), mask(0), maxSize(0), count(0), tail(0), head(0)
+    {
+        Resize(maxSize);
+    }
+
+    ~TxRing()
+    {
+        while (Pop(NULL)) {
+            Release();
+        }
+        delete [] cells;
+    }
+
+    /*
+     * Change the capacity of the ring. Must only be called when there are no producers or
+     * consumer, i.e. before the endpoint has been started.
+     */
+    void Resize(size_t newMaxSize)
+    {
+        assert(count == 0);
+        size_t ringSize = 1;
+        while (ringSize < newMaxSize) {
+            ringSize <<= 1;
+        }
+        delete [] cells;
+        cells = new Cell[ringSize];
+        mask = static_cast<uint32_t>(ringSize - 1);
+        maxSize = static_cast<int32_t>(newMaxSize);
+        tail = 0;
+        head = 0;
+    }
+
+    /*
+     * Reserve room for a message. Returns false if the ring is full. On success queued is set to
+     * the number of messages that were queued (or being sent) ahead of this one.
+     */
+    bool Reserve(int32_t& queued)
+    {
+        int32_t n = IncrementAndFetch(&count);
+        if (n > maxSize) {
+            DecrementAndFetch(&count);
+            return false;
+        }
+        queued = n - 1;
+        return true;
+    }
+
+    /*
+     * Add a message to the ring. The caller must have a reservation.
+     */
+    void Push(Message& msg)
+    {
+        uint32_t ticket = static_cast<uint32_t>(IncrementAndFetch(&tail) - 1);
+        Cell& cell = cells[ticket & mask];
+        assert(cell.ready == 0);
+        new (cell.Msg())Message(msg);
+        /* The atomic increment is a full barrier so the message is visible before the flag */
+        IncrementAndFetch(&cell.ready);
+    }
+
+    /*
+     * Consumer only. Take the message at the head of the ring. Returns false if there is no
+     * message ready. The reservation for the message is held until Release() is called.
+     */
+    bool Pop(Message* msg)
+    {
+        Cell& cell = cells[head & mask];
+        if (cell.ready == 0) {
+            return false;
+        }
+        DecrementAndFetch(&cell.ready);
+        if (msg) {
+            /*
+             * Make a deep copy of the message since there is state information inside the message.
+             * Each copy of the message could be in different write state.
+             */
+            *msg = Message(*cell.Msg(), true);
+        }
+        cell.Msg()->~Message();
+        ++head;
+        return true;
+    }
+
+    /*
+     * Consumer only. Get the message offset messages from the head of the ring without removing
+     * it. Returns NULL if that message is not ready.
+     */
+    Message* Peek(uint32_t offset = 0)
+    {
+        if (offset > mask) {
+            return NULL;
+        }
+        Cell& cell = cells[(head + offset) & mask];
+        if (cell.ready == 0) {
+            return NULL;
+        }
+        /* The atomic operations are full barriers so the message is visible once we see the flag */
+        IncrementAndFetch(&cell.ready);
+        DecrementAndFetch(&cell.ready);
+        return cell.Msg();
+    }
+
+    /*
+     * Consumer only. Remove the message at the head of the ring after it has been peeked at.
+     * The reservation for the message is held until Release() is called.
+     */
+    void Drop()
+    {
+        Cell& cell = cells[head & mask];
+        assert(cell.ready != 0);
+        cell.Msg()->~Message();
+        DecrementAndFetch(&cell.ready);
+        ++head;
+    }
+
+    /*
+     * Consumer only. Give up the reservation for a message that has been popped.
+     * Returns the number of messages still queued.
+     */
+    int32_t Release()
+    {
+        return DecrementAndFetch(&count);
+    }
+
+    /*
+     * Consumer only. Remove the expired messages that have been pushed but not popped yet.
+     * Returns the number of messages removed.
+     */
+    size_t PurgeExpired()
+    {
+        /* Only the ready cells at the head of the ring belong to the consumer */
+        uint32_t end = head;
+        while ((end - head) <= mask && cells[end & mask].ready) {
+            ++end;
+        }
+        /* Compact the unexpired messages toward the end so that the freed cells are at the head */
+        uint32_t dst = end;
+        for (uint32_t src = end; src != head;) {
+            --src;
+            Message* m = cells[src & mask].Msg();
+            if (!(*m)->IsExpired()) {
+                --dst;
+                if (dst != src) {
+                    new (cells[dst & mask].Msg())Message(*m);
+                    m->~Message();
+                }
+            } else {
+                QCC_DbgHLPrintf(("TTL expired discarding %s from tx queue", (*m)->Description().c_str()));
+                m->~Message();
+            }
+        }
+        size_t purged = dst - head;
+        while (head != dst) {
+            DecrementAndFetch(&cells[head & mask].ready);
+            ++head;
+            DecrementAndFetch(&count);
+        }
+        return purged;
+    }
+
+    /*
+     * Number of messages queued including a message that has been popped but not released.
+     */
+    size_t Size() const { return static_cast<size_t>(count); }
+
+    bool Empty() const { return count == 0; }
+
+    size_t MaxSize() const { return static_cast<size_t>(maxSize); }
+
+  private:
+
+    struct Cell {
+        Cell() : ready(0) { }
+        Message* Msg() { return reinterpret_cast<Message*>(storage); }
+        uint64_t storage[(sizeof(Message) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];  /* Raw storage for a Message */
+        volatile int32_t ready;                                                         /* 1 when the message is ready to be popped */
+    };
+
+    /* Copy constructor and assignment operator are private */
+    TxRing(const TxRing& other);
+    TxRing& operator=(const TxRing& other);
+
+    Cell* cells;               /* The ring, size is a power of 2 */
+    uint32_t mask;             /* Ring size - 1 */
+    int32_t maxSize;           /* Max number of queued messages */
+    volatile int32_t count;    /* Number of reserved cells */
+    volatile int32_t tail;     /* Ticket for the next push */
+    uint32_t head;             /* Next cell to pop (consumer only) */
+};
+
 class _RemoteEndpoint::Internal {
     friend class _RemoteEndpoint;
   public:
@@ -59,8 +275,12 @@ class _RemoteEndpoint::Internal {
     Internal(BusAttachment& bus, bool incoming, const qcc::String& connectSpec, Stream* stream, const char* threadName, bool isSocket) :
         bus(bus),
         stream(stream),
-        txQueue(),
+        txQueue(DEFAULT_MAX_TX_QUEUE_SIZE),
         txWaitQueue(),
+        txWaiters(0),
+        txOverflowPolicy(TX_OVERFLOW_DROP_EXPIRED),
+        txMaxWaitMs(0),
+        txPurgeRequested(0),
         lock(),
         exitCount(0),
         listener(NULL),
@@ -83,19 +303,52 @@ class _RemoteEndpoint::Internal {
         getNextMsg(true),
         currentWriteMsg(bus),
         stopping(false),
-        sessionId(0)
+        sessionId(0),
+        txBatchBuf(NULL),
+        txBatchPtr(NULL),
+        txBatchLen(0),
+        txBatchMsgs(0),
+        rxBuf(NULL),
+        rxPtr(NULL),
+        rxLen(0),
+        txQueueHighWater(0)
     {
     }
 
     ~Internal() {
+        delete [] txBatchBuf;
+        delete [] rxBuf;
+    }
+
+    /*
+     * Alert the next thread waiting for room in the txQueue. The lock is only taken if
+     * there are waiters.
+     */
+    void WakeTxWaiter() {
+        if (txWaiters > 0) {
+            lock.Lock(MUTEX_CONTEXT);
+            if (!txWaitQueue.empty()) {
+                Thread* wakeMe = txWaitQueue.back();
+                txWaitQueue.pop_back();
+                QStatus status = wakeMe->Alert();
+                if (ER_OK != status) {
+                    QCC_LogError(status, ("Failed to alert thread blocked on full tx queue"));
+                }
+            }
+            lock.Unlock(MUTEX_CONTEXT);
+        }
     }
 
     BusAttachment& bus;                      /**< Message bus associated with this endpoint */
     qcc::Stream* stream;                     /**< Stream for this endpoint or NULL if uninitialized */
 
-    std::deque<Message> txQueue;             /**< Transmit message queue */
+    TxRing txQueue;                          /**< Transmit message queue */
     std::deque<qcc::Thread*> txWaitQueue;    /**< Threads waiting for txQueue to become not-full */
-    qcc::Mutex lock;                         /**< Mutex that protects the txQueue and timeout values */
+    volatile int32_t txWaiters;              /**< Number of threads in WaitForTxQueue, each waiter counts itself in and out (atomically updated) */
+    TxOverflowPolicy txOverflowPolicy;       /**< What to do when txQueue is full */
+    uint32_t txMaxWaitMs;                    /**< Max time to wait for room in txQueue or 0 for no limit */
+    volatile int32_t txPurgeRequested;       /**< Non-zero if a blocked sender wants expired messages purged */
+    qcc::Mutex lock;                         /**< Mutex that protects the txWaitQueue and timeout values */
     int32_t exitCount;                       /**< Number of sub-threads (rx and tx) that have exited (atomically incremented) */
 
     EndpointListener* listener;              /**< Listener for thread exit and untrusted client start and exit notifications. */
@@ -128,6 +381,18 @@ class _RemoteEndpoint::Internal {
     Message currentWriteMsg;                 /**< The message currently being read for this endpoint */
     bool stopping;                           /**< Is this EP stopping? */
     uint32_t sessionId;                      /**< SessionId for BusToBus endpoint. (not used for non-B2B endpoints) */
+
+    uint8_t* txBatchBuf;                     /**< Buffer for coalescing queued messages into a single write */
+    uint8_t* txBatchPtr;                     /**< The current write position in txBatchBuf */
+    size_t txBatchLen;                       /**< Number of bytes remaining to write from txBatchBuf */
+    size_t txBatchMsgs;                      /**< Number of messages in txBatchBuf */
+
+    uint8_t* rxBuf;                          /**< Buffer for reading a burst of incoming messages */
+    uint8_t* rxPtr;                          /**< The current read position in rxBuf */
+    size_t rxLen;                            /**< Number of unread bytes in rxBuf */
+
+    TrafficStats stats;                      /**< Traffic statistics, rx counters belong to the reader and tx counters to the writer */
+    volatile int32_t txQueueHighWater;       /**< Most messages ever queued, updated by senders */
 };
 
 
@@ -342,6 +607,52 @@ QStatus _RemoteEndpoint::Start()
     return status;
 }
 
+QStatus _RemoteEndpoint::SetTxQueuePolicy(size_t maxQueueSize, TxOverflowPolicy policy, uint32_t maxWaitMs)
+{
+    if (!internal) {
+        return ER_BUS_NO_ENDPOINT;
+    }
+    if (maxQueueSize == 0) {
+        return ER_BAD_ARG_1;
+    }
+    if (maxQueueSize != internal->txQueue.MaxSize()) {
+        if (internal->started) {
+            QCC_LogError(ER_FAIL, ("Cannot change tx queue size of started endpoint %s", GetUniqueName().c_str()));
+            return ER_FAIL;
+        }
+        internal->txQueue.Resize(maxQueueSize);
+    }
+    internal->txOverflowPolicy = policy;
+    internal->txMaxWaitMs = maxWaitMs;
+    return ER_OK;
+}
+
+void _RemoteEndpoint::GetTrafficStats(TrafficStats& stats) const
+{
+    if (internal) {
+        stats = internal->stats;
+        stats.txQueueHighWater = static_cast<uint32_t>(internal->txQueueHighWater);
+    } else {
+        stats = TrafficStats();
+    }
+}
+
+void _RemoteEndpoint::RecordTxLatency(const _Message& msg)
+{
+    /* Locally generated messages without a TTL are not timestamped */
+    if (msg.timestamp == 0) {
+        return;
+    }
+    /* The timestamp can be later than now due to clock drift adjustment */
+    uint32_t now = GetTimestamp();
+    uint32_t latency = (now > msg.timestamp) ? now - msg.timestamp : 0;
+    size_t bucket = 0;
+    while ((bucket < (TrafficStats::LATENCY_BUCKETS - 1)) && (latency >= (1u << bucket))) {
+        ++bucket;
+    }
+    ++internal->stats.txLatency[bucket];
+}
+
 void _RemoteEndpoint::SetListener(EndpointListener* listener)
 {
     if (internal) {
@@ -388,7 +699,7 @@ QStatus _RemoteEndpoint::StopAfterTxEmpty(uint32_t maxWaitMs)
     /* Wait for txqueue to empty before triggering stop */
     internal->lock.Lock(MUTEX_CONTEXT);
     while (true) {
-        if (internal->txQueue.empty() || (maxWaitMs && (qcc::GetTimestamp() > (startTime + maxWaitMs)))) {
+        if (internal->txQueue.Empty() || (maxWaitMs && (qcc::GetTimestamp() > (startTime + maxWaitMs)))) {
             status = Stop();
             break;
         } else {
@@ -495,6 +806,38 @@ void _RemoteEndpoint::ExitCallback() {
     internal->exitCount = 1;
 }
 
+QStatus _RemoteEndpoint::PullBufferedBytes(void* buf, size_t reqBytes, size_t& actualBytes)
+{
+    if (!internal) {
+        return ER_BUS_NO_ENDPOINT;
+    }
+    if (internal->rxLen == 0) {
+        /*
+         * Large messages are read directly into the message buffer. If the stream is about to be
+         * handed over for a raw session don't read ahead past the message we are expecting.
+         */
+        if ((reqBytes >= RX_BUFFER_SIZE) || internal->armRxPause) {
+            return GetSource().PullBytes(buf, reqBytes, actualBytes, 0);
+        }
+        if (!internal->rxBuf) {
+            internal->rxBuf = new uint8_t[RX_BUFFER_SIZE];
+        }
+        size_t read = 0;
+        QStatus status = GetSource().PullBytes(internal->rxBuf, RX_BUFFER_SIZE, read, 0);
+        if (status != ER_OK) {
+            actualBytes = 0;
+            return status;
+        }
+        internal->rxPtr = internal->rxBuf;
+        internal->rxLen = read;
+    }
+    actualBytes = (std::min)(reqBytes, internal->rxLen);
+    ::memcpy(buf, internal->rxPtr, actualBytes);
+    internal->rxPtr += actualBytes;
+    internal->rxLen -= actualBytes;
+    return ER_OK;
+}
+
 QStatus _RemoteEndpoint::ReadCallback(qcc::Source& source, bool isTimedOut)
 {
     /* Remote endpoints can be invalid if they were created with the default
@@ -519,6 +862,8 @@ QStatus _RemoteEndpoint::ReadCallback(qcc::Source& source, bool isTimedOut)
                 /* Message read complete.Proceed to unmarshal it. */
                 Message msg = internal->currentReadMsg;
                 status = msg->Unmarshal(rep, (internal->validateSender && !bus2bus));
+                ++internal->stats.rxMsgs;
+                internal->stats.rxBytes += msg->bufEOD - reinterpret_cast<uint8_t*>(msg->msgBuf);
 
                 switch (status) {
                 case ER_OK:
@@ -585,6 +930,7 @@ QStatus _RemoteEndpoint::ReadCallback(qcc::Source& source, bool isTimedOut)
 
                 case ER_BUS_TIME_TO_LIVE_EXPIRED:
                     QCC_DbgHLPrintf(("TTL expired discarding %s", msg->Description().c_str()));
+                    ++internal->stats.rxTtlDrops;
                     status = ER_OK;
                     break;
 
@@ -688,29 +1034,37 @@ QStatus _RemoteEndpoint::WriteCallback(qcc::Sink& sink, bool isTimedOut) {
 
     QStatus status = ER_OK;
     while (status == ER_OK) {
+        if (internal->txPurgeRequested) {
+            /* A blocked sender is waiting for expired messages to be dropped */
+            internal->txPurgeRequested = 0;
+            size_t purged = internal->txQueue.PurgeExpired();
+            if (purged > 0) {
+                internal->stats.txTtlDrops += purged;
+                internal->WakeTxWaiter();
+            }
+        }
+        if (internal->txBatchLen > 0) {
+            /* Continue writing a partially written batch */
+            status = WriteTxBatch(sink);
+            continue;
+        }
         if (internal->getNextMsg) {
-            internal->lock.Lock(MUTEX_CONTEXT);
-            if (!internal->txQueue.empty()) {
-                /* Make a deep copy of the message since there is state information inside the message.
-                 * Each copy of the message could be in different write state.
-                 */
-                internal->currentWriteMsg = Message(internal->txQueue.back(), true);
-
-                /* Alert next thread on wait queue */
-                if (0 < internal->txWaitQueue.size()) {
-                    Thread* wakeMe = internal->txWaitQueue.back();
-                    internal->txWaitQueue.pop_back();
-                    status = wakeMe->Alert();
-                    if (ER_OK != status) {
-                        QCC_LogError(status, ("Failed to alert thread blocked on full tx queue"));
-                    }
-                }
+            if (BuildTxBatch()) {
+                status = WriteTxBatch(sink);
+                continue;
+            }
+            if (internal->txQueue.Pop(&internal->currentWriteMsg)) {
                 internal->getNextMsg = false;
-                internal->lock.Unlock(MUTEX_CONTEXT);
             } else {
-
                 internal->bus.GetInternal().GetIODispatch().DisableWriteCallback(internal->stream);
-                internal->lock.Unlock(MUTEX_CONTEXT);
+                /*
+                 * A sender that reserved room before the callback was disabled may not have
+                 * finished pushing its message. Since it saw a non-empty queue it will not
+                 * enable the callback itself so check again now that the callback is disabled.
+                 */
+                if (!internal->txQueue.Empty()) {
+                    internal->bus.GetInternal().GetIODispatch().EnableWriteCallbackNow(internal->stream);
+                }
                 return ER_OK;
             }
         }
@@ -729,10 +1083,13 @@ QStatus _RemoteEndpoint::WriteCallback(qcc::Sink& sink, bool isTimedOut) {
         if (status == ER_OK) {
             /* Message has been successfully delivered. i.e. PushBytes is complete
              */
-            internal->lock.Lock(MUTEX_CONTEXT);
-            internal->txQueue.pop_back();
+            _Message& m = *internal->currentWriteMsg;
+            ++internal->stats.txMsgs;
+            internal->stats.txBytes += m.bufEOD - reinterpret_cast<uint8_t*>(m.msgBuf);
+            RecordTxLatency(m);
+            internal->txQueue.Release();
             internal->getNextMsg = true;
-            internal->lock.Unlock(MUTEX_CONTEXT);
+            internal->WakeTxWaiter();
         }
     }
 
@@ -757,10 +1114,98 @@ QStatus _RemoteEndpoint::WriteCallback(qcc::Sink& sink, bool isTimedOut) {
     return status;
 }
 
+bool _RemoteEndpoint::IsBatchable(const _Message& msg, size_t len)
+{
+    return (len > 0) && (len <= (TX_BATCH_BYTES / 2)) && !msg.handles && !msg.encrypt;
+}
+
+bool _RemoteEndpoint::BuildTxBatch()
+{
+    /*
+     * The messages are pushed to the sink without a TTL so only batch for socket streams. There
+     * is no point in copying a message into the batch buffer unless at least two messages can
+     * be sent together.
+     */
+    if (!internal->isSocket) {
+        return false;
+    }
+    Message* first = internal->txQueue.Peek(0);
+    Message* second = internal->txQueue.Peek(1);
+    if (!first || !second) {
+        return false;
+    }
+    _Message& m1 = **first;
+    _Message& m2 = **second;
+    size_t len1 = m1.bufEOD - reinterpret_cast<uint8_t*>(m1.msgBuf);
+    size_t len2 = m2.bufEOD - reinterpret_cast<uint8_t*>(m2.msgBuf);
+    if (!IsBatchable(m1, len1) || !IsBatchable(m2, len2)) {
+        return false;
+    }
+    if (!internal->txBatchBuf) {
+        internal->txBatchBuf = new uint8_t[TX_BATCH_BYTES];
+    }
+    size_t len = 0;
+    size_t expired = 0;
+    internal->txBatchMsgs = 0;
+    while (internal->txBatchMsgs < MAX_TX_BATCH_MSGS) {
+        Message* next = internal->txQueue.Peek();
+        if (!next) {
+            break;
+        }
+        _Message& msg = **next;
+        size_t msgLen = msg.bufEOD - reinterpret_cast<uint8_t*>(msg.msgBuf);
+        if (!IsBatchable(msg, msgLen) || ((len + msgLen) > TX_BATCH_BYTES)) {
+            break;
+        }
+        if (msg.ttl && msg.IsExpired()) {
+            QCC_DbgHLPrintf(("TTL has expired - discarding message %s", msg.Description().c_str()));
+            ++expired;
+        } else {
+            ::memcpy(internal->txBatchBuf + len, msg.msgBuf, msgLen);
+            len += msgLen;
+            ++internal->txBatchMsgs;
+            RecordTxLatency(msg);
+        }
+        internal->txQueue.Drop();
+    }
+    /* Expired messages don't need to be written so their room can be given back now */
+    internal->stats.txTtlDrops += expired;
+    while (expired--) {
+        internal->txQueue.Release();
+        internal->WakeTxWaiter();
+    }
+    internal->txBatchPtr = internal->txBatchBuf;
+    internal->txBatchLen = len;
+    return true;
+}
+
+QStatus _RemoteEndpoint::WriteTxBatch(qcc::Sink& sink)
+{
+    QStatus status = ER_OK;
+    while ((status == ER_OK) && (internal->txBatchLen > 0)) {
+        size_t pushed;
+        status = sink.PushBytes(internal->txBatchPtr, internal->txBatchLen, pushed);
+        if (status == ER_OK) {
+            internal->txBatchLen -= pushed;
+            internal->txBatchPtr += pushed;
+            internal->stats.txBytes += pushed;
+        }
+    }
+    if (internal->txBatchLen == 0) {
+        /* All the messages in the batch have been delivered */
+        internal->stats.txMsgs += internal->txBatchMsgs;
+        while (internal->txBatchMsgs) {
+            internal->txQueue.Release();
+            --internal->txBatchMsgs;
+        }
+        internal->WakeTxWaiter();
+    }
+    return status;
+}
+
 QStatus _RemoteEndpoint::PushMessage(Message& msg)
 {
     QCC_DbgTrace(("RemoteEndpoint::PushMessage %s (serial=%d)", GetUniqueName().c_str(), msg->GetCallSerial()));
-    static const size_t MAX_TX_QUEUE_SIZE = 30;
 
     QStatus status = ER_OK;
 
@@ -779,72 +1224,24 @@ QStatus _RemoteEndpoint::PushMessage(Message& msg)
     if (internal->stopping) {
         return ER_BUS_ENDPOINT_CLOSING;
     }
-    internal->lock.Lock(MUTEX_CONTEXT);
-    size_t count = internal->txQueue.size();
-    bool wasEmpty = (count == 0);
-    if (MAX_TX_QUEUE_SIZE > count) {
-        internal->txQueue.push_front(msg);
-    } else {
-        while (true) {
-            /* Remove a queue entry whose TTLs is expired if possible */
-            deque<Message>::iterator it = internal->txQueue.begin();
-            uint32_t maxWait = 20 * 1000;
-            while (it != internal->txQueue.end()) {
-                uint32_t expMs;
-                if ((*it)->IsExpired(&expMs)) {
-                    internal->txQueue.erase(it);
-                    break;
-                } else {
-                    ++it;
-                }
-                maxWait = (std::min)(maxWait, expMs);
-            }
-            if (internal->txQueue.size() < MAX_TX_QUEUE_SIZE) {
-                /* Check queue wasn't drained while we were waiting */
-                if (internal->txQueue.size() == 0) {
-                    wasEmpty = true;
-                }
-                internal->txQueue.push_front(msg);
-                status = ER_OK;
-                break;
-            } else {
-                /* This thread will have to wait for room in the queue */
-                Thread* thread = Thread::GetThread();
-                assert(thread);
-
-                thread->AddAuxListener(this);
-                internal->txWaitQueue.push_front(thread);
-                internal->lock.Unlock(MUTEX_CONTEXT);
-                status = Event::Wait(Event::neverSet, maxWait);
-                internal->lock.Lock(MUTEX_CONTEXT);
-
-                /* Reset alert status */
-                if (ER_ALERTED_THREAD == status) {
-                    if (thread->GetAlertCode() == ENDPOINT_IS_DEAD_ALERTCODE) {
-                        status = ER_BUS_ENDPOINT_CLOSING;
-                    }
-                    thread->GetStopEvent().ResetEvent();
-                }
-                /* Remove thread from wait queue. */
-                thread->RemoveAuxListener(this);
-                deque<Thread*>::iterator eit = find(internal->txWaitQueue.begin(), internal->txWaitQueue.end(), thread);
-                if (eit != internal->txWaitQueue.end()) {
-                    internal->txWaitQueue.erase(eit);
-                }
-
-                if ((ER_OK != status) && (ER_ALERTED_THREAD != status) && (ER_TIMEOUT != status)) {
-                    break;
-                }
-
-            }
+    int32_t count = 0;
+    if (!internal->txQueue.Reserve(count)) {
+        status = WaitForTxQueue(count);
+        if (status != ER_OK) {
+            return status;
         }
     }
+    internal->txQueue.Push(msg);
 
+    /* Racing senders may both raise the high-water mark, the larger one usually wins */
+    if ((count + 1) > internal->txQueueHighWater) {
+        internal->txQueueHighWater = count + 1;
+    }
 
-    if (wasEmpty) {
+    /* The write callback disables itself when it finds the queue empty */
+    if (count == 0) {
         internal->bus.GetInternal().GetIODispatch().EnableWriteCallbackNow(internal->stream);
     }
-    internal->lock.Unlock(MUTEX_CONTEXT);
 #ifndef NDEBUG
 #undef QCC_MODULE
 #define QCC_MODULE "TXSTATS"
@@ -860,6 +1257,88 @@ QStatus _RemoteEndpoint::PushMessage(Message& msg)
     return status;
 }
 
+QStatus _RemoteEndpoint::WaitForTxQueue(int32_t& count)
+{
+    if (internal->txOverflowPolicy == TX_OVERFLOW_FAIL) {
+        return ER_BUS_WRITE_QUEUE_FULL;
+    }
+    Thread* thread = Thread::GetThread();
+    assert(thread);
+
+    uint32_t startTime = GetTimestamp();
+    QStatus status = ER_OK;
+    while (true) {
+        if (internal->stopping) {
+            status = ER_BUS_ENDPOINT_CLOSING;
+            break;
+        }
+        uint32_t maxWait = 20 * 1000;
+        if (internal->txMaxWaitMs) {
+            uint32_t elapsed = GetTimestamp() - startTime;
+            if (elapsed >= internal->txMaxWaitMs) {
+                status = ER_BUS_WRITE_QUEUE_FULL;
+                break;
+            }
+            maxWait = (std::min)(maxWait, internal->txMaxWaitMs - elapsed);
+        }
+        if (internal->txOverflowPolicy == TX_OVERFLOW_DROP_EXPIRED) {
+            /* Only the write callback can remove messages from the queue so ask it to purge */
+            internal->txPurgeRequested = 1;
+            internal->bus.GetInternal().GetIODispatch().EnableWriteCallbackNow(internal->stream);
+        }
+
+        /* Get on the wait queue before checking for room so that a wakeup cannot be missed */
+        internal->lock.Lock(MUTEX_CONTEXT);
+        thread->AddAuxListener(this);
+        internal->txWaitQueue.push_front(thread);
+        IncrementAndFetch(&internal->txWaiters);
+        internal->lock.Unlock(MUTEX_CONTEXT);
+
+        bool reserved = internal->txQueue.Reserve(count);
+        if (!reserved) {
+            status = Event::Wait(Event::neverSet, maxWait);
+        }
+
+        /* Remove thread from wait queue. */
+        internal->lock.Lock(MUTEX_CONTEXT);
+        thread->RemoveAuxListener(this);
+        bool dequeued = true;
+        deque<Thread*>::iterator eit = find(internal->txWaitQueue.begin(), internal->txWaitQueue.end(), thread);
+        if (eit != internal->txWaitQueue.end()) {
+            internal->txWaitQueue.erase(eit);
+            dequeued = false;
+        }
+        /* The waiter is the only one that takes itself out of the count, even if ThreadExit dequeued it */
+        DecrementAndFetch(&internal->txWaiters);
+        internal->lock.Unlock(MUTEX_CONTEXT);
+
+        if (reserved) {
+            if (dequeued) {
+                /* The write callback alerted this thread anyway so consume the alert and pass it on */
+                thread->GetStopEvent().ResetEvent();
+                internal->WakeTxWaiter();
+            }
+            status = ER_OK;
+            break;
+        }
+        /* Reset alert status */
+        if (ER_ALERTED_THREAD == status) {
+            if (thread->GetAlertCode() == ENDPOINT_IS_DEAD_ALERTCODE) {
+                status = ER_BUS_ENDPOINT_CLOSING;
+            }
+            thread->GetStopEvent().ResetEvent();
+        }
+        if ((ER_OK != status) && (ER_ALERTED_THREAD != status) && (ER_TIMEOUT != status)) {
+            break;
+        }
+        if (internal->txQueue.Reserve(count)) {
+            status = ER_OK;
+            break;
+        }
+    }
+    return status;
+}
+
 void _RemoteEndpoint::IncrementRef()
 {
     int refs = IncrementAndFetch(&internal->refCount);
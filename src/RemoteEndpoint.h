@@ -84,6 +84,51 @@ class _RemoteEndpoint : public _BusEndpoint, public qcc::ThreadListener, public
         bool trusted;              /**< Indicated if the remote client was trusted */
     };
 
+    /**
+     * Policy applied by PushMessage when the transmit queue is full.
+     */
+    typedef enum {
+        TX_OVERFLOW_BLOCK,          /**< Block the sender until there is room in the queue or the max wait time elapses */
+        TX_OVERFLOW_DROP_EXPIRED,   /**< Drop expired messages to make room then block the sender like TX_OVERFLOW_BLOCK */
+        TX_OVERFLOW_FAIL            /**< Fail immediately with ER_BUS_WRITE_QUEUE_FULL */
+    } TxOverflowPolicy;
+
+    /**
+     * Traffic statistics for an endpoint. The receive counters are only updated by the thread
+     * reading from the endpoint and the transmit counters by the thread writing to it so keeping
+     * them costs no more than a few adds per message. A copy taken while traffic is flowing may
+     * be slightly out of date.
+     */
+    struct TrafficStats {
+        static const size_t LATENCY_BUCKETS = 12;  /**< Number of buckets in the latency histogram */
+
+        uint64_t rxMsgs;                    /**< Messages received */
+        uint64_t rxBytes;                   /**< Bytes received */
+        uint64_t txMsgs;                    /**< Messages written */
+        uint64_t txBytes;                   /**< Bytes written */
+        uint32_t txQueueHighWater;          /**< Most messages ever waiting in the transmit queue */
+        uint32_t rxTtlDrops;                /**< Received messages discarded because their TTL had expired */
+        uint32_t txTtlDrops;                /**< Queued messages discarded because their TTL expired before they were written */
+        /**
+         * Histogram of the time in ms from when a message was received or generated (see
+         * Message::GetTimeStamp()) until it was written. Bucket 0 counts times under 1ms and
+         * bucket n times under 2^n ms, the last bucket counts everything longer.
+         */
+        uint32_t txLatency[LATENCY_BUCKETS];
+
+        TrafficStats() : rxMsgs(0), rxBytes(0), txMsgs(0), txBytes(0), txQueueHighWater(0), rxTtlDrops(0), txTtlDrops(0)
+        {
+            for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+                txLatency[i] = 0;
+            }
+        }
+    };
+
+    /**
+     * Default maximum number of messages in the transmit queue.
+     */
+    static const size_t DEFAULT_MAX_TX_QUEUE_SIZE = 30;
+
     /**
      * Listener called when endpoint changes state.
      */
@@ -199,6 +244,29 @@ class _RemoteEndpoint : public _BusEndpoint, public qcc::ThreadListener, public
      */
     QStatus PauseAfterRxReply();
 
+    /**
+     * Configure the transmit queue for this endpoint.
+     *
+     * @param maxQueueSize  Maximum number of messages waiting to be sent. This can only be changed
+     *                      before the endpoint is started.
+     * @param policy        What PushMessage does when the queue is full.
+     * @param maxWaitMs     Max number of ms a blocked sender waits for room in the queue or 0 to
+     *                      wait indefinitely. Ignored for TX_OVERFLOW_FAIL.
+     *
+     * @return
+     *      - ER_OK if successful.
+     *      - ER_BAD_ARG_1 if maxQueueSize is 0.
+     *      - ER_FAIL if the queue size was changed after the endpoint was started.
+     */
+    QStatus SetTxQueuePolicy(size_t maxQueueSize, TxOverflowPolicy policy, uint32_t maxWaitMs = 0);
+
+    /**
+     * Get a copy of the traffic statistics for this endpoint.
+     *
+     * @param stats  Returns the statistics.
+     */
+    void GetTrafficStats(TrafficStats& stats) const;
+
     /**
      * Set the underlying stream for this RemoteEndpoint.
      * This call can be used to override the Stream set in RemoteEndpoint's constructor
@@ -306,6 +374,21 @@ class _RemoteEndpoint : public _BusEndpoint, public qcc::ThreadListener, public
      */
     qcc::Source& GetSource() { return GetStream(); }
 
+    /**
+     * Pull bytes of an incoming message through the endpoint's receive buffer without blocking.
+     * When the receive buffer is empty it is refilled with a single read from the data source
+     * so that a burst of small messages only costs one read. Requests that are at least as large
+     * as the receive buffer are read directly into the caller's buffer.
+     *
+     * @param buf          Buffer to copy the bytes into.
+     * @param reqBytes     Maximum number of bytes to copy.
+     * @param actualBytes  Returns the number of bytes copied.
+     * @return
+     *      - ER_OK if some bytes were copied.
+     *      - An error status from the data source otherwise.
+     */
+    QStatus PullBufferedBytes(void* buf, size_t reqBytes, size_t& actualBytes);
+
     /**
      * Get the data sink for this endpoint
      *
@@ -420,6 +503,57 @@ class _RemoteEndpoint : public _BusEndpoint, public qcc::ThreadListener, public
      */
     bool IsProbeMsg(const Message& msg, bool& isAck);
 
+    /**
+     * Check if a queued message can be coalesced with other messages into a single write.
+     * Messages that pass handles or still need to be encrypted are written on their own.
+     *
+     * @param msg   The message.
+     * @param len   Marshaled length of the message.
+     * @return  true if the message can be part of a batch.
+     */
+    static bool IsBatchable(const _Message& msg, size_t len);
+
+    /**
+     * Copy the messages at the head of the transmit queue into the batch buffer so that they
+     * can be written with a single call to the sink. Nothing is done unless at least two
+     * messages can be batched.
+     *
+     * @return  true if a batch was built.
+     */
+    bool BuildTxBatch();
+
+    /**
+     * Write the remainder of the current batch to the sink. The transmit queue room held by the
+     * messages in the batch is released once the whole batch has been written.
+     *
+     * @param sink   Sink to write to.
+     * @return
+     *      - ER_OK if the batch was completely written.
+     *      - ER_TIMEOUT if the batch was partially written.
+     *      - An error status otherwise
+     */
+    QStatus WriteTxBatch(qcc::Sink& sink);
+
+    /**
+     * Wait for room in the transmit queue according to the endpoint's overflow policy.
+     *
+     * @param count   [OUT] Number of messages queued ahead of the caller's message.
+     * @return
+     *      - ER_OK if room was reserved in the transmit queue.
+     *      - ER_BUS_WRITE_QUEUE_FULL if the queue is still full after the max wait time.
+     *      - ER_BUS_ENDPOINT_CLOSING if the endpoint is closing.
+     *      - An error status otherwise
+     */
+    QStatus WaitForTxQueue(int32_t& count);
+
+    /**
+     * Add the time a message spent between being received or generated and being written to
+     * the transmit latency histogram. Only called by the thread writing to the endpoint.
+     *
+     * @param msg   The message that was written.
+     */
+    void RecordTxLatency(const _Message& msg);
+
     /**
      * Internal callback used to indicate that one of the internal threads (rx or tx) has exited.
      * RemoteEndpoint users should not call this method.
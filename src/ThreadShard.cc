@@ -0,0 +1,75 @@
+/**
+ * @file
+ * Implementation of the per-thread index used to spread threads over shards.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#include <qcc/platform.h>
+#include <qcc/atomic.h>
+
+#if !defined(_MSC_VER)
+#include <pthread.h>
+#endif
+
+#include "ThreadShard.h"
+
+#define QCC_MODULE "ALLJOYN"
+
+namespace ajn {
+
+/* Source of the round-robin thread indices */
+static volatile int32_t threadCount = 0;
+
+#if defined(_MSC_VER)
+
+/* Index of this thread plus one, zero until the thread has been given an index */
+static __declspec(thread) uint32_t threadIndex = 0;
+
+uint32_t ThreadIndex()
+{
+    if (threadIndex == 0) {
+        threadIndex = static_cast<uint32_t>(qcc::IncrementAndFetch(&threadCount));
+    }
+    return threadIndex - 1;
+}
+
+#else
+
+/* The thread-specific value is the index of the thread plus one so NULL means no index yet */
+static pthread_key_t threadIndexKey;
+static pthread_once_t threadIndexOnce = PTHREAD_ONCE_INIT;
+
+static void CreateThreadIndexKey()
+{
+    pthread_key_create(&threadIndexKey, NULL);
+}
+
+uint32_t ThreadIndex()
+{
+    pthread_once(&threadIndexOnce, CreateThreadIndexKey);
+    uintptr_t index = reinterpret_cast<uintptr_t>(pthread_getspecific(threadIndexKey));
+    if (index == 0) {
+        index = static_cast<uintptr_t>(static_cast<uint32_t>(qcc::IncrementAndFetch(&threadCount)));
+        pthread_setspecific(threadIndexKey, reinterpret_cast<void*>(index));
+    }
+    return static_cast<uint32_t>(index - 1);
+}
+
+#endif
+
+}
@@ -0,0 +1,65 @@
+#ifndef _ALLJOYN_THREADSHARD_H
+#define _ALLJOYN_THREADSHARD_H
+/**
+ * @file
+ * This file defines a helper for spreading threads over the shards of sharded data.
+ */
+
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+
+#ifndef __cplusplus
+#error Only include ThreadShard.h in C++ code.
+#endif
+
+#include <qcc/platform.h>
+
+namespace ajn {
+
+/**
+ * Size of a cache line. Shards that are written by different threads are padded and aligned to
+ * this so that they do not share cache lines.
+ */
+static const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * Get a small integer index for the calling thread. Indices are handed out round-robin the first
+ * time each thread asks for one and are then cached for the life of the thread.
+ *
+ * @return  The index of the calling thread.
+ */
+uint32_t ThreadIndex();
+
+/**
+ * Pick a shard for the calling thread.
+ *
+ * Threads are dealt out over the shards in the order they first ask for a shard so the first
+ * numShards threads never share. This is not a per-thread mapping: once there are more threads
+ * than shards they wrap around, so the shards must still be safe to share. Picking a busy shard
+ * only costs some contention.
+ *
+ * @param numShards  Number of shards, must be a power of two.
+ *
+ * @return  The index of the shard for the calling thread.
+ */
+inline size_t ThreadShard(size_t numShards)
+{
+    return ThreadIndex() & (numShards - 1);
+}
+
+}
+
+#endif
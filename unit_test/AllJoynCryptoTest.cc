@@ -0,0 +1,137 @@
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#include <qcc/platform.h>
+
+#include <string.h>
+
+#include <qcc/Crypto.h>
+#include <qcc/KeyBlob.h>
+#include <qcc/String.h>
+#include <qcc/Thread.h>
+#include <qcc/Util.h>
+
+#include <alljoyn/BusAttachment.h>
+#include <alljoyn/Message.h>
+
+#include <alljoyn/Status.h>
+
+/* Private files included for unit testing */
+#include <AllJoynCrypto.h>
+
+/* Header files included for Google Test Framework */
+#include <gtest/gtest.h>
+
+using namespace ajn;
+using namespace qcc;
+
+class CryptoTestMessage : public _Message {
+  public:
+
+    CryptoTestMessage(BusAttachment& bus) : _Message(bus) { }
+
+    QStatus MethodCall()
+    {
+        MsgArg arg("u", 42);
+        return CallMsg("u", "a.b.c", 0, "/crypto/test", "crypto.test", "test", &arg, 1, 0);
+    }
+};
+
+/*
+ * Encrypts and decrypts buffers in a loop. Several of these threads share one cipher, half of them
+ * start by encrypting and half by decrypting so both operations run on the cipher at the same time.
+ */
+class CipherThread : public Thread {
+  public:
+    CipherThread(const _Message& msg, const KeyBlob& key, const KeyBlob& peerKey, const CCMCipher& cipher, uint32_t seed) :
+        Thread("CipherThread"), msg(msg), key(key), peerKey(peerKey), cipher(cipher), seed(seed), status(ER_OK) { }
+
+    QStatus GetStatus() const { return status; }
+
+  protected:
+    ThreadReturn STDCALL Run(void* arg)
+    {
+        static const size_t HDR_LEN = 16;
+        static const size_t BODY_LEN = 200;
+        uint8_t plain[HDR_LEN + BODY_LEN];
+        uint8_t buf[HDR_LEN + BODY_LEN + Crypto::MACLength];
+        for (size_t i = 0; i < sizeof(plain); ++i) {
+            plain[i] = static_cast<uint8_t>(seed + i);
+        }
+        for (uint32_t iter = 0; (status == ER_OK) && (iter < 500); ++iter) {
+            size_t bodyLen = BODY_LEN;
+            memcpy(buf, plain, sizeof(plain));
+            /* Odd threads encrypt as the peer so the peer's decryption runs alongside our encryption */
+            const KeyBlob& encKey = (seed & 1) ? peerKey : key;
+            const KeyBlob& decKey = (seed & 1) ? key : peerKey;
+            status = Crypto::Encrypt(msg, encKey, buf, HDR_LEN, bodyLen, &cipher);
+            if (status == ER_OK) {
+                status = Crypto::Decrypt(msg, decKey, buf, HDR_LEN, bodyLen, &cipher);
+            }
+            if ((status == ER_OK) && ((bodyLen != BODY_LEN) || (memcmp(buf, plain, sizeof(plain)) != 0))) {
+                status = ER_FAIL;
+            }
+        }
+        return (ThreadReturn) 0;
+    }
+
+  private:
+    const _Message& msg;
+    const KeyBlob& key;
+    const KeyBlob& peerKey;
+    const CCMCipher& cipher;
+    uint32_t seed;
+    QStatus status;
+};
+
+TEST(AllJoynCryptoTest, SharedCipherAcrossThreads) {
+    BusAttachment bus("SharedCipherAcrossThreads", false);
+    bus.Start();
+
+    CryptoTestMessage msg(bus);
+    QStatus status = msg.MethodCall();
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    KeyBlob key;
+    key.Rand(Crypto_AES::AES128_SIZE, KeyBlob::AES);
+    key.SetTag("test", KeyBlob::INITIATOR);
+    KeyBlob peerKey(key);
+    peerKey.SetTag("test", KeyBlob::RESPONDER);
+    CCMCipher cipher(key);
+    ASSERT_TRUE(cipher->IsValid());
+
+    CipherThread* threads[8];
+    for (size_t i = 0; i < ArraySize(threads); ++i) {
+        threads[i] = new CipherThread(msg, key, peerKey, cipher, static_cast<uint32_t>(i));
+        ASSERT_EQ(ER_OK, threads[i]->Start());
+    }
+    for (size_t i = 0; i < ArraySize(threads); ++i) {
+        threads[i]->Join();
+        EXPECT_EQ(ER_OK, threads[i]->GetStatus()) << "  Thread " << i << " status: " << QCC_StatusText(threads[i]->GetStatus());
+        delete threads[i];
+    }
+
+    /* The shared cipher must agree with a cipher made for a single message */
+    uint8_t a[16 + 32 + Crypto::MACLength];
+    uint8_t b[sizeof(a)];
+    memset(a, 0x5A, sizeof(a));
+    memcpy(b, a, sizeof(a));
+    size_t lenA = 32;
+    size_t lenB = 32;
+    EXPECT_EQ(ER_OK, Crypto::Encrypt(msg, key, a, 16, lenA, &cipher));
+    EXPECT_EQ(ER_OK, Crypto::Encrypt(msg, key, b, 16, lenB));
+    EXPECT_EQ(lenA, lenB);
+    EXPECT_EQ(0, memcmp(a, b, sizeof(a)));
+}
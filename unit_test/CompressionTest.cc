@@ -196,3 +196,33 @@ TEST(CompressionTest, Compression) {
         ASSERT_EQ(sig, msg2.GetMemberName()) << "FAILD 6." << 1;
     }
 }
+
+TEST(CompressionTest, ManyRules) {
+    QStatus status;
+    BusAttachment bus("compressionmany");
+    MyMessage msg(bus);
+    vector<uint32_t> tokens;
+
+    bus.Start();
+
+    /* Enough distinct headers to make the rule table grow several times */
+    for (int i = 0; i < 500; ++i) {
+        qcc::String member = "test" + qcc::U32ToString(i);
+        status = msg.MethodCall(":1.99", "/foo/bar", "foo.bar", member.c_str());
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+        uint32_t tok = msg.GetCompressionToken();
+        ASSERT_NE(0U, tok) << "FAILED 1." << i;
+        tokens.push_back(tok);
+    }
+
+    /* Every header must still map to the token it was first given */
+    for (int i = 0; i < 500; ++i) {
+        qcc::String member = "test" + qcc::U32ToString(i);
+        status = msg.MethodCall(":1.99", "/foo/bar", "foo.bar", member.c_str());
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+        ASSERT_EQ(tokens[i], msg.GetCompressionToken()) << "FAILED 2." << i;
+        for (int j = 0; j < i; ++j) {
+            ASSERT_NE(tokens[j], tokens[i]) << "FAILED 3." << i;
+        }
+    }
+}
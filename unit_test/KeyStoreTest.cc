@@ -25,8 +25,11 @@
 
 #include <qcc/platform.h>
 
+#include <string.h>
+
 #include <qcc/Crypto.h>
 #include <qcc/Debug.h>
+#include <qcc/Environ.h>
 #include <qcc/FileStream.h>
 #include <qcc/KeyBlob.h>
 #include <qcc/Pipe.h>
@@ -229,3 +232,144 @@ TEST(KeyStoreTest, keystore_store_load_merge) {
     DeleteFile("keystore_test");
 }
 
+
+TEST(KeyStoreTest, keystore_journal) {
+    qcc::GUID128 guid1;
+    qcc::GUID128 guid2;
+    qcc::GUID128 guid3;
+    QStatus status = ER_OK;
+    KeyBlob key;
+
+    /*
+     * The first store after a clear writes the whole key store
+     */
+    {
+        KeyStore keyStore("keystore_journal_test");
+        keyStore.Init(NULL, false);
+        keyStore.Clear();
+
+        key.Rand(Crypto_AES::AES128_SIZE, KeyBlob::AES);
+        keyStore.AddKey(guid1, key);
+        key.Rand(Crypto_AES::AES128_SIZE, KeyBlob::AES);
+        keyStore.AddKey(guid2, key);
+
+        ASSERT_TRUE(keyStore.IsJournalFull());
+        status = keyStore.Store();
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to store keystore";
+    }
+
+    /*
+     * Later changes are journaled
+     */
+    {
+        KeyStore keyStore("keystore_journal_test");
+        keyStore.Init(NULL, false);
+
+        key.Rand(Crypto_AES::AES128_SIZE, KeyBlob::AES);
+        keyStore.AddKey(guid3, key);
+        ASSERT_FALSE(keyStore.IsJournalFull());
+        status = keyStore.Store();
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to store keystore journal";
+
+        status = keyStore.DelKey(guid1);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to delete guid1";
+    }
+
+    /*
+     * Loading applies the journal
+     */
+    {
+        KeyStore keyStore("keystore_journal_test");
+        keyStore.Init(NULL, false);
+
+        status = keyStore.GetKey(guid1, key);
+        ASSERT_EQ(ER_BUS_KEY_UNAVAILABLE, status) << "  Actual Status: " << QCC_StatusText(status) << " guid1 was not deleted";
+
+        status = keyStore.GetKey(guid2, key);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to load guid2";
+
+        status = keyStore.GetKey(guid3, key);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to load guid3 from journal";
+
+        keyStore.Clear();
+    }
+    qcc::String fileName = GetHomeDir() + "/.alljoyn_keystore/keystore_journal_test";
+    DeleteFile(fileName);
+    DeleteFile(fileName + ".journal");
+}
+
+TEST(KeyStoreTest, keystore_journal_truncated) {
+    qcc::GUID128 guid1;
+    qcc::GUID128 guid2;
+    QStatus status = ER_OK;
+    KeyBlob key;
+    qcc::String fileName = GetHomeDir() + "/.alljoyn_keystore/keystore_journal_truncated_test";
+
+    {
+        KeyStore keyStore("keystore_journal_truncated_test");
+        keyStore.Init(NULL, false);
+        keyStore.Clear();
+
+        key.Rand(Crypto_AES::AES128_SIZE, KeyBlob::AES);
+        keyStore.AddKey(guid1, key);
+        status = keyStore.Store();
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to store keystore";
+
+        key.Rand(Crypto_AES::AES128_SIZE, KeyBlob::AES);
+        keyStore.AddKey(guid2, key);
+        status = keyStore.Store();
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to store keystore journal";
+
+        status = keyStore.DelKey(guid1);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to delete guid1";
+        status = keyStore.Store();
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to store keystore journal";
+    }
+
+    /*
+     * Cut the journal off after the first record as if the last push was interrupted. The header
+     * is the version, revision, salt and record count and each record is a sequence number, a
+     * length and the encrypted data.
+     */
+    {
+        qcc::String journal;
+        {
+            FileSource source(fileName + ".journal");
+            uint8_t buf[256];
+            size_t pulled;
+            while (source.PullBytes(buf, sizeof(buf), pulled) == ER_OK) {
+                journal.append((const char*)buf, pulled);
+            }
+        }
+        const size_t hdrLen = sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+        ASSERT_GT(journal.size(), hdrLen + 2 * sizeof(uint32_t));
+        uint32_t recLen;
+        memcpy(&recLen, journal.data() + hdrLen + sizeof(uint32_t), sizeof(recLen));
+        size_t truncLen = hdrLen + 2 * sizeof(uint32_t) + recLen;
+        ASSERT_LT(truncLen, journal.size());
+
+        FileSink sink(fileName + ".journal", FileSink::PRIVATE);
+        size_t pushed;
+        status = sink.PushBytes(journal.data(), truncLen, pushed);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to truncate journal";
+    }
+
+    /*
+     * The first record is applied and the missing record is detected so the next store compacts
+     */
+    {
+        KeyStore keyStore("keystore_journal_truncated_test");
+        keyStore.Init(NULL, false);
+
+        status = keyStore.GetKey(guid1, key);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Deletion of guid1 should be lost";
+
+        status = keyStore.GetKey(guid2, key);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status) << " Failed to load guid2 from journal";
+
+        ASSERT_TRUE(keyStore.IsJournalFull());
+        keyStore.Clear();
+    }
+    DeleteFile(fileName);
+    DeleteFile(fileName + ".journal");
+}
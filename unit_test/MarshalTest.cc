@@ -32,6 +32,8 @@
 /* Private files included for unit testing */
 #include <PeerState.h>
 #include <SignatureUtils.h>
+#include <MarshalPlan.h>
+#include <ByteSwap.h>
 #include <RemoteEndpoint.h>
 
 /* Header files included for Google Test Framework */
@@ -250,6 +252,89 @@ TEST(MarshalTest, NestedArraysAndStructs) {
 
 }
 
+TEST(MarshalTest, MarshalPlans) {
+
+    const char* unplanned[] = {
+        "(ii)",
+        "v",
+        "as",
+        "a{sv}",
+        "ih",
+        "aai",
+    };
+    for (size_t i = 0; i < ArraySize(unplanned); i++) {
+        ASSERT_TRUE(MarshalPlan::Get(unplanned[i]) == NULL) << "\nSignature \"" << unplanned[i] << "\" should not have a marshal plan.";
+    }
+
+    /* Plan sizes must agree with the generic size computation */
+    uint32_t au[] = { 1, 2, 3 };
+    uint64_t at[] = { 4, 5 };
+    uint8_t ay[] = { 6, 7, 8, 9, 10 };
+    MsgArg args[7];
+    size_t numArgs = ArraySize(args);
+    QStatus status = MsgArg::Set(args, numArgs, "ysqaytsau", 1, "hello", 2, ArraySize(ay), ay, static_cast<uint64_t>(3), "world!", ArraySize(au), au);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+    const MarshalPlan* plan = MarshalPlan::Get("ysqaytsau");
+    ASSERT_TRUE(plan != NULL);
+    ASSERT_TRUE(plan->Matches(args, numArgs));
+    ASSERT_EQ(SignatureUtils::GetSize(args, numArgs), plan->GetSize(args));
+    ASSERT_FALSE(plan->Matches(args, numArgs - 1));
+
+    MsgArg fixedArgs[5];
+    numArgs = ArraySize(fixedArgs);
+    status = MsgArg::Set(fixedArgs, numArgs, "ybtnd", 1, true, static_cast<uint64_t>(2), 3, 4.0);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+    plan = MarshalPlan::Get("ybtnd");
+    ASSERT_TRUE(plan != NULL);
+    ASSERT_TRUE(plan->Matches(fixedArgs, numArgs));
+    ASSERT_EQ(SignatureUtils::GetSize(fixedArgs, numArgs), plan->GetSize(fixedArgs));
+
+    MsgArg arrayArg("at", ArraySize(at), at);
+    plan = MarshalPlan::Get("at");
+    ASSERT_TRUE(plan != NULL);
+    ASSERT_TRUE(plan->Matches(&arrayArg, 1));
+    ASSERT_EQ(SignatureUtils::GetSize(&arrayArg, 1), plan->GetSize(&arrayArg));
+    ASSERT_FALSE(plan->Matches(fixedArgs, 1));
+
+    /* Plans are cached without a size limit and unplannable signatures do not take up room */
+    for (size_t i = 0; i < 1024; i++) {
+        ASSERT_TRUE(MarshalPlan::Get(unplanned[i % ArraySize(unplanned)]) == NULL);
+        qcc::String sig;
+        size_t n = i;
+        do {
+            sig += "ybnqiuxt"[n % 8];
+            n /= 8;
+        } while (n);
+        plan = MarshalPlan::Get(sig);
+        ASSERT_TRUE(plan != NULL) << "\nSignature \"" << sig.c_str() << "\" should have a marshal plan.";
+        ASSERT_TRUE(plan == MarshalPlan::Get(sig));
+        ASSERT_STREQ(sig.c_str(), plan->GetSignature().c_str());
+    }
+}
+
+TEST(MarshalTest, ByteSwapArrays) {
+    uint16_t in16[37], out16[37];
+    uint32_t in32[37], out32[37];
+    uint64_t in64[37], out64[37];
+
+    for (size_t i = 0; i < ArraySize(in16); ++i) {
+        in16[i] = static_cast<uint16_t>(0x0102 * (i + 1));
+        in32[i] = static_cast<uint32_t>(0x01020304 * (i + 1));
+        in64[i] = static_cast<uint64_t>(0x0102030405060708ULL * (i + 1));
+    }
+    /* Check every length so both the vector and scalar tails get exercised */
+    for (size_t num = 0; num < ArraySize(in16); ++num) {
+        ByteSwap::Swap16(out16, in16, num);
+        ByteSwap::Swap32(out32, in32, num);
+        ByteSwap::Swap64(out64, in64, num);
+        for (size_t i = 0; i < num; ++i) {
+            ASSERT_EQ(EndianSwap16(in16[i]), out16[i]) << "16 bit swap of " << num << " elements failed at " << i;
+            ASSERT_EQ(EndianSwap32(in32[i]), out32[i]) << "32 bit swap of " << num << " elements failed at " << i;
+            ASSERT_EQ(EndianSwap64(in64[i]), out64[i]) << "64 bit swap of " << num << " elements failed at " << i;
+        }
+    }
+}
+
 TEST(MarshalTest, TestMsgUnpack) {
     QStatus status = ER_OK;
 
@@ -297,6 +382,62 @@ TEST(MarshalTest, TestMsgUnpack) {
     delete bus;
 }
 
+/*
+ * The receiving endpoint has no unique name so the sender is replaced on every message. Varying
+ * the object path length makes some of the rewritten headers keep their padded length, where the
+ * fields are rewritten in place, and some change length, where the message is remarshaled.
+ */
+TEST(MarshalTest, ReplaceSender) {
+    QStatus status = ER_OK;
+
+    BusAttachment*bus = new BusAttachment("TestReplaceSender", false);
+    bus->Start();
+
+    TestPipe stream;
+    TestPipe* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(*bus, falsiness, String::Empty, pStream);
+
+    qcc::String path = "/";
+    for (size_t len = 1; len <= 16; ++len) {
+        MyMessage msg(*bus);
+        MsgArg args[2];
+        size_t numArgs = ArraySize(args);
+        path += "p";
+
+        MsgArg::Set(args, numArgs, "us", 42, "body survives");
+        status = msg.Signal("a.b.c", path.c_str(), "foo.bar", "test", args, numArgs);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+        ASSERT_STRNE("", msg.GetSender());
+
+        status = msg.Deliver(ep);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+        status = msg.Read(ep, "");
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+        status = msg.Unmarshal(ep, "");
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+        EXPECT_STREQ("", msg.GetSender());
+        EXPECT_STREQ(path.c_str(), msg.GetObjectPath());
+        EXPECT_STREQ("foo.bar", msg.GetInterface());
+        EXPECT_STREQ("test", msg.GetMemberName());
+        EXPECT_STREQ("us", msg.GetSignature());
+
+        status = msg.UnmarshalBody();
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+        uint32_t i;
+        const char* s;
+        status = msg.GetArgs("us", &i, &s);
+        ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+        EXPECT_EQ(42U, i);
+        EXPECT_STREQ("body survives", s);
+    }
+    delete bus;
+}
+
 /*--------------------------FUZZING TEST CODE---------------------------------*/
 static bool fuzzing = false;
 static bool nobig = false;
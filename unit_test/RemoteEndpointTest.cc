@@ -0,0 +1,239 @@
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#include <qcc/platform.h>
+
+#include <qcc/Pipe.h>
+#include <qcc/String.h>
+#include <qcc/Thread.h>
+#include <qcc/Util.h>
+
+#include <alljoyn/BusAttachment.h>
+#include <alljoyn/Message.h>
+
+#include <alljoyn/Status.h>
+
+/* Private files included for unit testing */
+#include <RemoteEndpoint.h>
+
+/* Header files included for Google Test Framework */
+#include <gtest/gtest.h>
+
+using namespace ajn;
+using namespace qcc;
+
+class TxQueueMessage : public _Message {
+  public:
+
+    TxQueueMessage(BusAttachment& bus) : _Message(bus) { }
+
+    QStatus Signal(uint16_t ttl)
+    {
+        MsgArg arg("s", "tx queue test");
+        return SignalMsg("s", "a.b.c", 0, "/tx/queue", "tx.queue", "test", &arg, 1, 0, ttl);
+    }
+};
+
+static QStatus PushSignal(BusAttachment& bus, RemoteEndpoint& ep, uint16_t ttl = 0)
+{
+    TxQueueMessage signal(bus);
+    QStatus status = signal.Signal(ttl);
+    if (status == ER_OK) {
+        Message msg(signal);
+        status = ep->PushMessage(msg);
+    }
+    return status;
+}
+
+/*
+ * The endpoints in these tests are never started so this thread stands in for IODispatch and
+ * runs the write callback once after a delay.
+ */
+class WriteCallbackThread : public Thread {
+  public:
+    WriteCallbackThread(RemoteEndpoint& ep, Sink& sink) : Thread("WriteCallback"), ep(ep), sink(sink) { }
+
+  protected:
+    ThreadReturn STDCALL Run(void* arg)
+    {
+        qcc::Sleep(100);
+        IOWriteListener* listener = &(*ep);
+        listener->WriteCallback(sink, false);
+        return (ThreadReturn) 0;
+    }
+
+  private:
+    RemoteEndpoint& ep;
+    Sink& sink;
+};
+
+TEST(RemoteEndpointTest, TxOverflowFail) {
+    BusAttachment bus("TxOverflowFail", false);
+    bus.Start();
+
+    Pipe stream;
+    Stream* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(bus, falsiness, String::Empty, pStream);
+
+    QStatus status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_FAIL, 5000);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+
+    /* The max wait time is ignored, a full queue fails straight away */
+    uint32_t start = GetTimestamp();
+    status = PushSignal(bus, ep);
+    EXPECT_EQ(ER_BUS_WRITE_QUEUE_FULL, status) << "  Actual Status: " << QCC_StatusText(status);
+    EXPECT_LT(GetTimestamp() - start, 1000U);
+}
+
+TEST(RemoteEndpointTest, TxOverflowBlock) {
+    BusAttachment bus("TxOverflowBlock", false);
+    bus.Start();
+
+    Pipe stream;
+    Stream* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(bus, falsiness, String::Empty, pStream);
+
+    QStatus status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_BLOCK, 200);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+
+    /* Nothing drains the queue so the sender gives up at the deadline */
+    uint32_t start = GetTimestamp();
+    status = PushSignal(bus, ep);
+    EXPECT_EQ(ER_BUS_WRITE_QUEUE_FULL, status) << "  Actual Status: " << QCC_StatusText(status);
+    EXPECT_GE(GetTimestamp() - start, 200U);
+
+    /* The sender is unblocked when the write callback sends the queued messages */
+    status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_BLOCK, 5000);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+    WriteCallbackThread writer(ep, stream);
+    writer.Start();
+    status = PushSignal(bus, ep);
+    EXPECT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+    writer.Join();
+}
+
+TEST(RemoteEndpointTest, TxOverflowDropExpired) {
+    BusAttachment bus("TxOverflowDropExpired", false);
+    bus.Start();
+
+    Pipe stream;
+    Stream* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(bus, falsiness, String::Empty, pStream);
+
+    QStatus status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_DROP_EXPIRED, 5000);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    /* Fill the queue with messages that expire before the write callback gets to them */
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep, 1));
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep, 1));
+    qcc::Sleep(20);
+
+    /* The sender gets room as soon as the write callback drops the expired messages */
+    WriteCallbackThread writer(ep, stream);
+    writer.Start();
+    uint32_t start = GetTimestamp();
+    status = PushSignal(bus, ep);
+    EXPECT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+    EXPECT_LT(GetTimestamp() - start, 5000U);
+    writer.Join();
+}
+
+TEST(RemoteEndpointTest, TxOverflowDropExpiredKeepsLive) {
+    BusAttachment bus("TxOverflowDropExpiredKeepsLive", false);
+    bus.Start();
+
+    Pipe stream;
+    Stream* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(bus, falsiness, String::Empty, pStream);
+
+    QStatus status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_DROP_EXPIRED, 200);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    /* Messages that have not expired are never dropped to make room */
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep, 60000));
+    uint32_t start = GetTimestamp();
+    status = PushSignal(bus, ep);
+    EXPECT_EQ(ER_BUS_WRITE_QUEUE_FULL, status) << "  Actual Status: " << QCC_StatusText(status);
+    EXPECT_GE(GetTimestamp() - start, 200U);
+}
+
+TEST(RemoteEndpointTest, TxQueueWrap) {
+    BusAttachment bus("TxQueueWrap", false);
+    bus.Start();
+
+    Pipe stream;
+    Stream* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(bus, falsiness, String::Empty, pStream);
+
+    QStatus status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_FAIL);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    /* Fill and drain the queue several times so the ring wraps around */
+    IOWriteListener* listener = &(*ep);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+        EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+        status = PushSignal(bus, ep);
+        EXPECT_EQ(ER_BUS_WRITE_QUEUE_FULL, status) << "  Actual Status: " << QCC_StatusText(status);
+        listener->WriteCallback(stream, false);
+    }
+}
+
+TEST(RemoteEndpointTest, TxTrafficStats) {
+    BusAttachment bus("TxTrafficStats", false);
+    bus.Start();
+
+    Pipe stream;
+    Stream* pStream = &stream;
+    static const bool falsiness = false;
+    RemoteEndpoint ep(bus, falsiness, String::Empty, pStream);
+
+    QStatus status = ep->SetTxQueuePolicy(2, _RemoteEndpoint::TX_OVERFLOW_DROP_EXPIRED, 5000);
+    ASSERT_EQ(ER_OK, status) << "  Actual Status: " << QCC_StatusText(status);
+
+    _RemoteEndpoint::TrafficStats stats;
+    ep->GetTrafficStats(stats);
+    EXPECT_EQ(0U, stats.txMsgs);
+    EXPECT_EQ(0U, stats.txTtlDrops);
+
+    /* Two messages expire in the queue and the write callback sends the third */
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep, 1));
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep, 1));
+    qcc::Sleep(20);
+    WriteCallbackThread writer(ep, stream);
+    writer.Start();
+    EXPECT_EQ(ER_OK, PushSignal(bus, ep));
+    writer.Join();
+    IOWriteListener* listener = &(*ep);
+    listener->WriteCallback(stream, false);
+
+    ep->GetTrafficStats(stats);
+    EXPECT_EQ(2U, stats.txTtlDrops);
+    EXPECT_EQ(1U, stats.txMsgs);
+    EXPECT_LT(0U, stats.txBytes);
+    EXPECT_LE(1U, stats.txQueueHighWater);
+}
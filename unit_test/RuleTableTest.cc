@@ -0,0 +1,190 @@
+/******************************************************************************
+ * Copyright 2013, Qualcomm Innovation Center, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ ******************************************************************************/
+#include <qcc/platform.h>
+
+#include <qcc/String.h>
+#include <qcc/Util.h>
+
+#include <alljoyn/BusAttachment.h>
+#include <alljoyn/Message.h>
+#include <alljoyn/MsgArg.h>
+
+#include <alljoyn/Status.h>
+
+/* Private files included for unit testing */
+#include <RuleTable.h>
+
+/* Header files included for Google Test Framework */
+#include <gtest/gtest.h>
+
+using namespace ajn;
+using namespace qcc;
+
+class RuleTestMessage : public _Message {
+  public:
+
+    RuleTestMessage(BusAttachment& bus) : _Message(bus) { }
+
+    QStatus Signal(const char* path, const char* arg0, const char* arg1, const char* arg2)
+    {
+        MsgArg args[3];
+        args[0].Set("s", arg0);
+        args[1].Set("s", arg1);
+        args[2].Set("o", arg2);
+        return SignalMsg("sso", NULL, 0, path, "rule.table", "test", args, 3, 0, 0);
+    }
+};
+
+static Message MakeSignal(BusAttachment& bus, const char* path, const char* arg0, const char* arg1 = "", const char* arg2 = "/")
+{
+    RuleTestMessage signal(bus);
+    EXPECT_EQ(ER_OK, signal.Signal(path, arg0, arg1, arg2));
+    return Message(signal);
+}
+
+static bool IsMatch(const char* ruleSpec, Message& msg)
+{
+    QStatus status;
+    Rule rule(ruleSpec, &status);
+    EXPECT_EQ(ER_OK, status) << "  Rule: " << ruleSpec;
+    return rule.IsMatch(msg);
+}
+
+TEST(RuleTableTest, ParseErrors) {
+    static const char* badRules[] = {
+        "type",
+        "type='signal",
+        "type='bogus'",
+        "bogus='x'",
+        "arg='x'",
+        "argx='x'",
+        "arg64='x'",
+        "arg100='x'",
+        "arg1foo='x'",
+        "arg1pat='x'",
+        "path='/a',path_namespace='/a'"
+    };
+    for (size_t i = 0; i < ArraySize(badRules); ++i) {
+        QStatus status = ER_OK;
+        Rule rule(badRules[i], &status);
+        EXPECT_EQ(ER_FAIL, status) << "  Rule: " << badRules[i];
+    }
+}
+
+TEST(RuleTableTest, Parse) {
+    QStatus status = ER_FAIL;
+    Rule rule("type='signal',arg0='a,b',arg63='x',arg2path='/a/',arg0namespace='org.x',path_namespace='/a'", &status);
+    EXPECT_EQ(ER_OK, status);
+    EXPECT_EQ(MESSAGE_SIGNAL, rule.type);
+    EXPECT_STREQ("a,b", rule.args[0].c_str());
+    EXPECT_STREQ("x", rule.args[63].c_str());
+    EXPECT_STREQ("/a/", rule.pathArgs[2].c_str());
+    EXPECT_STREQ("org.x", rule.arg0Namespace.c_str());
+    EXPECT_STREQ("/a", rule.pathNamespace.c_str());
+    EXPECT_TRUE(rule.HasArgMatches());
+
+    Rule noArgs("type='signal',interface='rule.table'", &status);
+    EXPECT_EQ(ER_OK, status);
+    EXPECT_FALSE(noArgs.HasArgMatches());
+}
+
+TEST(RuleTableTest, ArgMatch) {
+    BusAttachment bus("RuleTableTest", false);
+    bus.Start();
+    Message msg = MakeSignal(bus, "/a/b", "foo", "bar");
+
+    EXPECT_TRUE(IsMatch("arg0='foo'", msg));
+    EXPECT_TRUE(IsMatch("arg0='foo',arg1='bar'", msg));
+    EXPECT_TRUE(IsMatch("interface='rule.table',arg1='bar'", msg));
+    EXPECT_FALSE(IsMatch("arg0='bar'", msg));
+    EXPECT_FALSE(IsMatch("arg0='fo'", msg));
+    EXPECT_FALSE(IsMatch("arg0='foo',arg1='foo'", msg));
+    /* Only string args match argN */
+    EXPECT_FALSE(IsMatch("arg2='/'", msg));
+    /* Past the last arg */
+    EXPECT_FALSE(IsMatch("arg3='foo'", msg));
+    /* Header mismatch */
+    EXPECT_FALSE(IsMatch("interface='other',arg0='foo'", msg));
+
+    MatchArgs msgArgs(msg);
+    QStatus status;
+    Rule rule("arg1='bar'", &status);
+    EXPECT_TRUE(rule.IsMatch(msg, msgArgs));
+    Rule other("arg1='baz'", &status);
+    EXPECT_FALSE(other.IsMatch(msg, msgArgs));
+}
+
+TEST(RuleTableTest, ArgPathMatch) {
+    BusAttachment bus("RuleTableTest", false);
+    bus.Start();
+    Message msg = MakeSignal(bus, "/a/b", "/aa/bb/", "/aa/bb", "/x/y");
+
+    /* String args */
+    EXPECT_TRUE(IsMatch("arg0path='/aa/bb/'", msg));
+    EXPECT_TRUE(IsMatch("arg0path='/aa/'", msg));
+    EXPECT_TRUE(IsMatch("arg0path='/aa/bb/cc'", msg));
+    EXPECT_TRUE(IsMatch("arg1path='/aa/bb'", msg));
+    EXPECT_TRUE(IsMatch("arg1path='/'", msg));
+    EXPECT_FALSE(IsMatch("arg1path='/aa/bb/'", msg));
+    EXPECT_FALSE(IsMatch("arg1path='/aa/b'", msg));
+    EXPECT_FALSE(IsMatch("arg1path='/aa/bb/cc'", msg));
+    EXPECT_FALSE(IsMatch("arg0path='/aa/b'", msg));
+
+    /* Object path args */
+    EXPECT_TRUE(IsMatch("arg2path='/x/y'", msg));
+    EXPECT_TRUE(IsMatch("arg2path='/x/'", msg));
+    EXPECT_FALSE(IsMatch("arg2path='/x'", msg));
+    EXPECT_FALSE(IsMatch("arg2path='/x/y/'", msg));
+
+    /* Past the last arg */
+    EXPECT_FALSE(IsMatch("arg3path='/'", msg));
+}
+
+TEST(RuleTableTest, Arg0NamespaceMatch) {
+    BusAttachment bus("RuleTableTest", false);
+    bus.Start();
+    Message msg = MakeSignal(bus, "/a/b", "org.alljoyn.Bus");
+
+    EXPECT_TRUE(IsMatch("arg0namespace='org.alljoyn.Bus'", msg));
+    EXPECT_TRUE(IsMatch("arg0namespace='org.alljoyn'", msg));
+    EXPECT_TRUE(IsMatch("arg0namespace='org'", msg));
+    EXPECT_FALSE(IsMatch("arg0namespace='org.all'", msg));
+    EXPECT_FALSE(IsMatch("arg0namespace='org.alljoyn.Bus.Peer'", msg));
+    EXPECT_FALSE(IsMatch("arg0namespace='com'", msg));
+
+    /* An empty arg 0 is not in any namespace */
+    Message emptyMsg = MakeSignal(bus, "/a/b", "");
+    EXPECT_FALSE(IsMatch("arg0namespace='org'", emptyMsg));
+}
+
+TEST(RuleTableTest, PathNamespaceMatch) {
+    BusAttachment bus("RuleTableTest", false);
+    bus.Start();
+    Message msg = MakeSignal(bus, "/aa/bb/cc", "foo");
+
+    EXPECT_TRUE(IsMatch("path_namespace='/aa/bb/cc'", msg));
+    EXPECT_TRUE(IsMatch("path_namespace='/aa/bb'", msg));
+    EXPECT_TRUE(IsMatch("path_namespace='/aa'", msg));
+    EXPECT_TRUE(IsMatch("path_namespace='/'", msg));
+    EXPECT_FALSE(IsMatch("path_namespace='/aa/b'", msg));
+    EXPECT_FALSE(IsMatch("path_namespace='/aa/bb/cc/dd'", msg));
+    EXPECT_FALSE(IsMatch("path_namespace='/x'", msg));
+
+    /* path_namespace and arg keys are anded together */
+    EXPECT_TRUE(IsMatch("path_namespace='/aa',arg0='foo'", msg));
+    EXPECT_FALSE(IsMatch("path_namespace='/aa',arg0='bar'", msg));
+    EXPECT_FALSE(IsMatch("path_namespace='/x',arg0='foo'", msg));
+}